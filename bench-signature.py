@@ -0,0 +1,280 @@
+#!/usr/bin/python3
+# -*- coding: utf-8 -*-
+
+# An end-to-end benchmark of file_signature on synthetic files
+# It sweeps readers x hashes x chunk sizes x threads with a cold or warm page cache
+# and writes GB/s, CPU utilisation and peak RSS of every run to CSV and/or JSON.
+# It needs no privileges: a cold run drops the pages of the file by posix_fadvise(DONTNEED)
+#
+# e.g.: bench-signature.py --binary=./file_signature --size=1G --reader=stream,map --csv=bench.csv
+
+import sys, os
+import argparse, csv, hashlib, itertools, json, random, subprocess, tempfile, threading, time
+
+UNITS = {"K": 1024, "M": 1024 * 1024, "G": 1024 * 1024 * 1024}
+BLOCK = 1024 * 1024
+PAGE = 4096
+
+FIELDS = ["size_mb", "entropy", "reader", "hash", "chunk_size", "threads", "cache", "repeat",
+          "seconds", "gbps", "cpu_util", "peak_rss_mb", "signature", "status"]
+
+def parseSize(s):
+    s = s.strip()
+
+    if s and s[-1].upper() in UNITS:
+        return int(s[:-1]) * UNITS[s[-1].upper()]
+
+    return int(s)
+
+def parseList(s, convert = str):
+    return [convert(v) for v in s.split(",") if v.strip()]
+
+def makeFile(dir, size, entropy, seed):
+    # the same parameters make the same file, so it is generated once
+    # 'entropy' of every page is random, the rest of it is zeros
+    path = os.path.join(dir, "bench-{0}-{1:.2f}-{2}.bin".format(size, entropy, seed))
+
+    if os.path.exists(path) and os.path.getsize(path) == size:
+        return path
+
+    print("Generating", path)
+    rnd = random.Random(seed)
+    randomSize = int(PAGE * entropy)
+
+    with open(path + ".tmp", "wb") as file:
+        left = size
+
+        while left > 0:
+            blockSize = min(left, BLOCK)
+            block = bytearray(blockSize)
+
+            for offset in range(0, blockSize, PAGE):
+                n = min(randomSize, blockSize - offset)
+
+                if n > 0:
+                    block[offset:offset + n] = rnd.getrandbits(n * 8).to_bytes(n, "little")
+
+            file.write(block)
+            left -= blockSize
+
+        file.flush()
+        os.fsync(file.fileno())
+
+    os.replace(path + ".tmp", path)
+    return path
+
+def dropCache(path):
+    # only clean pages are dropped, the file has been synced when it was made
+    fd = os.open(path, os.O_RDONLY)
+
+    try:
+        os.fsync(fd)
+        os.posix_fadvise(fd, 0, 0, os.POSIX_FADV_DONTNEED)
+    finally:
+        os.close(fd)
+
+def warmCache(path):
+    with open(path, "rb") as file:
+        while file.read(BLOCK):
+            pass
+
+def readPeakRss(pid):
+    try:
+        with open("/proc/{0}/status".format(pid), "r") as status:
+            for line in status:
+                if line.startswith("VmHWM:"):
+                    return int(line.split()[1])
+    except (OSError, ValueError):
+        pass
+
+    return None
+
+class PeakRssSampler:
+    # ru_maxrss of a child is never below the RSS of the forked python parent, exec does not reset it.
+    # VmHWM is the peak of the binary only, but it is gone when the child exits,
+    # so it is read until the exit, the growth of the last interval may be missed
+    INTERVAL = 0.01
+
+    def __init__(self, pid):
+        self.pid = pid
+        self.peakKb = None
+        self.stopped = threading.Event()
+        self.thread = threading.Thread(target = self.run, daemon = True)
+        self.thread.start()
+
+    def run(self):
+        while True:
+            value = readPeakRss(self.pid)
+
+            if value is not None:
+                self.peakKb = max(self.peakKb or 0, value)
+
+            if self.stopped.wait(self.INTERVAL):
+                return
+
+    def stop(self):
+        self.stopped.set()
+        self.thread.join()
+        return self.peakKb
+
+def runOnce(binary, path, out, reader, hash, chunkSize, threads):
+    cmd = [binary,
+           "--file=" + path,
+           "--out=" + out,
+           "--reader=" + reader,
+           "--hash=" + hash,
+           "--chunk-size=" + str(chunkSize),
+           "--checkpoint-interval=0"]
+
+    if threads:
+        cmd.append("--threads=" + str(threads))
+
+    # the tool is canceled by a key press, stdin is a pipe that is never written,
+    # the output goes to a file, so the tool never waits for a full pipe
+    with tempfile.TemporaryFile() as log:
+        start = time.perf_counter()
+        proc = subprocess.Popen(cmd, stdin = subprocess.PIPE, stdout = log, stderr = subprocess.STDOUT)
+
+        sampler = PeakRssSampler(proc.pid)
+
+        # the exited child is not reaped yet, so the sampler never reads a reused pid
+        os.waitid(os.P_PID, proc.pid, os.WEXITED | os.WNOWAIT)
+        seconds = time.perf_counter() - start
+        peakKb = sampler.stop()
+        _, status, usage = os.wait4(proc.pid, 0)
+        proc.stdin.close()
+
+        log.seek(0)
+        output = log.read().decode(errors = "replace")
+
+    code = os.WEXITSTATUS(status) if os.WIFEXITED(status) else -1
+
+    # no /proc, ru_maxrss is in kilobytes on Linux
+    if peakKb is None:
+        peakKb = usage.ru_maxrss
+
+    return (code, output, seconds, usage.ru_utime + usage.ru_stime, peakKb / 1024.0)
+
+def getSignatureHash(path):
+    # the header keeps the file name, only the records are compared
+    digest = hashlib.sha256()
+
+    with open(path, "rb") as file:
+        for line in file:
+            if line[:2] == b"0x":
+                digest.update(line)
+
+    return digest.hexdigest()[:16]
+
+def main():
+    parser = argparse.ArgumentParser(description = "End-to-end benchmark of file_signature")
+    parser.add_argument("--binary", default = "./file_signature", help = "path to file_signature")
+    parser.add_argument("--dir", default = ".", help = "directory of the synthetic files and signatures")
+    parser.add_argument("--size", default = "256M", help = "file sizes, e.g. 256M,4G")
+    parser.add_argument("--entropy", default = "1.0", help = "random share of every page, e.g. 0,0.5,1")
+    parser.add_argument("--seed", type = int, default = 1, help = "seed of the synthetic data")
+    parser.add_argument("--reader", default = "stream,map,mapall")
+    parser.add_argument("--hash", default = "crc32,sha2")
+    parser.add_argument("--chunk-size", default = "64K,1M,16M")
+    parser.add_argument("--threads", default = "0", help = "hasher threads, 0 is the default of the reader")
+    parser.add_argument("--cache", default = "cold,warm", help = "page cache state before a run")
+    parser.add_argument("--repeat", type = int, default = 1)
+    parser.add_argument("--csv", help = "CSV output file, '-' is stdout")
+    parser.add_argument("--json", help = "JSON output file, '-' is stdout")
+    parser.add_argument("--keep", action = "store_true", help = "keep the synthetic files")
+    args = parser.parse_args()
+
+    cpus = len(os.sched_getaffinity(0)) if hasattr(os, "sched_getaffinity") else os.cpu_count()
+    os.makedirs(args.dir, exist_ok = True)
+
+    results = []
+    files = []
+
+    for size in parseList(args.size, parseSize):
+        for entropy in parseList(args.entropy, float):
+            path = makeFile(args.dir, size, entropy, args.seed)
+            files.append(path)
+
+            # every configuration of the same hash and chunk size must make the same signature
+            expected = {}
+
+            configs = itertools.product(parseList(args.reader),
+                                        parseList(args.hash),
+                                        parseList(args.chunk_size, parseSize),
+                                        parseList(args.threads, int),
+                                        parseList(args.cache),
+                                        range(args.repeat))
+
+            for reader, hash, chunkSize, threads, cache, repeat in configs:
+                if cache == "cold":
+                    dropCache(path)
+                elif cache == "warm":
+                    warmCache(path)
+                else:
+                    raise Exception("unknown cache state: " + cache)
+
+                out = path + ".signature"
+                code, output, seconds, cpu, rss = runOnce(args.binary, path, out, reader, hash, chunkSize, threads)
+
+                signature = ""
+                status = "ok"
+
+                if code != 0:
+                    status = "error {0}: {1}".format(code, output.strip().splitlines()[-1] if output.strip() else "")
+                else:
+                    signature = getSignatureHash(out)
+
+                    if expected.setdefault((hash, chunkSize), signature) != signature:
+                        status = "signature mismatch"
+
+                if os.path.exists(out):
+                    os.remove(out)
+
+                result = {
+                    "size_mb": size // (1024 * 1024),
+                    "entropy": entropy,
+                    "reader": reader,
+                    "hash": hash,
+                    "chunk_size": chunkSize,
+                    "threads": threads if threads else "default",
+                    "cache": cache,
+                    "repeat": repeat,
+                    "seconds": round(seconds, 3),
+                    "gbps": round(size / seconds / 1e9, 3),
+                    "cpu_util": round(cpu / seconds / cpus, 3),
+                    "peak_rss_mb": round(rss, 1),
+                    "signature": signature,
+                    "status": status
+                }
+                results.append(result)
+
+                print("{reader:>6} {hash:>5} chunk={chunk_size:<9} threads={threads:<7} {cache:<4}"
+                      " {gbps:7.3f} GB/s cpu={cpu_util:5.2f} rss={peak_rss_mb:8.1f}MB {status}".format(**result))
+
+    if args.csv:
+        file = sys.stdout if args.csv == "-" else open(args.csv, "w", newline = "")
+        writer = csv.DictWriter(file, fieldnames = FIELDS)
+        writer.writeheader()
+        writer.writerows(results)
+
+        if file is not sys.stdout:
+            file.close()
+
+    if args.json:
+        text = json.dumps({"cpus": cpus, "results": results}, indent = 2)
+
+        if args.json == "-":
+            print(text)
+        else:
+            with open(args.json, "w") as file:
+                file.write(text + "\n")
+
+    if not args.keep:
+        for path in files:
+            os.remove(path)
+
+    # a failed or inconsistent run is a regression
+    return 0 if all(r["status"] == "ok" for r in results) else 1
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,270 @@
+#!/usr/bin/python3
+# -*- coding: utf-8 -*-
+
+# An end-to-end check of the modes of file_signature that change or reuse a signature:
+#   * a canceled run is resumed and the signature is the same as a fresh one
+#   * --update of an appended file is the same as a fresh signature
+#   * text and binary (--format=bin) signatures are converted to each other without changes
+#   * --verify passes the file and finds a changed chunk
+#   * the delta of an edited file applied to the old file makes the new one
+#
+# e.g.: check-modes.py --binary=./file_signature
+
+import sys, os
+import argparse, random, subprocess, tempfile, threading, zlib
+
+CHUNK_SIZE = 4096
+
+def makeFile(path, size, seed):
+    rnd = random.Random(seed)
+    block = 1024 * 1024
+
+    with open(path, "wb") as file:
+        for offset in range(0, size, block):
+            part = min(block, size - offset)
+            file.write(rnd.getrandbits(part * 8).to_bytes(part, "little"))
+
+def readFile(path):
+    with open(path, "rb") as file:
+        return file.read()
+
+def run(binary, args, cancelAfter = None):
+    # the tool is canceled by any key, so its stdin stays open and empty
+    # unless the run has to be canceled
+    proc = subprocess.Popen([binary] + args,
+                            stdin = subprocess.PIPE, stdout = subprocess.PIPE, stderr = subprocess.STDOUT)
+    timer = None
+
+    def cancel():
+        try:
+            proc.stdin.write(b"x\n")
+            proc.stdin.flush()
+        except OSError:
+            pass
+
+    if cancelAfter is not None:
+        timer = threading.Timer(cancelAfter, cancel)
+        timer.start()
+
+    output = proc.stdout.read().decode(errors = "replace")
+    proc.wait()
+
+    if timer:
+        timer.cancel()
+
+    proc.stdin.close()
+    return proc.returncode, output
+
+def sign(binary, path, out, extra = []):
+    code, output = run(binary, ["--file=" + path, "--out=" + out, "--chunk-size=" + str(CHUNK_SIZE)] + extra)
+
+    if code != 0:
+        raise Exception("signing {0} has failed: {1}".format(path, output))
+
+def checkSignature(sigPath, path):
+    data = readFile(path)
+    records = 0
+
+    with open(sigPath, "r") as sig:
+        for line in sig:
+            if not line.startswith("0x"):
+                continue
+
+            offset, size, hashVal = line.strip().split(":")
+            offset = int(offset, 16)
+            size = int(size, 16)
+
+            if offset != records * CHUNK_SIZE:
+                raise Exception("the record of offset {0} is out of order".format(offset))
+
+            if "{0:08x}".format(zlib.crc32(data[offset:offset + size]) & 0xffffffff) != hashVal:
+                raise Exception("invalid hash offset={0} size={1}".format(offset, size))
+
+            records += 1
+
+    if records != (len(data) + CHUNK_SIZE - 1) // CHUNK_SIZE:
+        raise Exception("{0} records of {1} bytes".format(records, len(data)))
+
+def checkSame(path, expectedPath, what):
+    if readFile(path) != readFile(expectedPath):
+        raise Exception("{0}: {1} differs from {2}".format(what, path, expectedPath))
+
+def checkResume(binary, dir, size):
+    path = os.path.join(dir, "resume.bin")
+    out = os.path.join(dir, "resume.sig")
+    fresh = os.path.join(dir, "resume-fresh.sig")
+    makeFile(path, size, 1)
+
+    # small chunks make the run long enough to be canceled, the progress is polled every second
+    extra = ["--chunk-size=256"]
+    run(binary, ["--file=" + path, "--out=" + out] + extra, cancelAfter = 1.2)
+
+    if not os.path.exists(out + ".checkpoint"):
+        raise Exception("resume: the run has finished before it has been canceled, use a bigger --size")
+
+    code, output = run(binary, ["--file=" + path, "--out=" + out, "--resume"] + extra)
+
+    if code != 0 or "Resuming from offset" not in output:
+        raise Exception("resume: the signature has not been resumed: " + output)
+
+    if os.path.exists(out + ".checkpoint"):
+        raise Exception("resume: the checkpoint is left after the signature is complete")
+
+    code, output = run(binary, ["--file=" + path, "--out=" + fresh] + extra)
+
+    if code != 0:
+        raise Exception("resume: signing has failed: " + output)
+
+    checkSame(out, fresh, "resume")
+    print("Resume after cancel: ok")
+
+def checkUpdate(binary, dir):
+    path = os.path.join(dir, "update.bin")
+    out = os.path.join(dir, "update.sig")
+    fresh = os.path.join(dir, "update-fresh.sig")
+
+    # the last chunk of the old file is not complete, it is hashed again
+    makeFile(path, 10 * 1024 * 1024 + 123, 2)
+    sign(binary, path, out)
+
+    with open(path, "ab") as file:
+        file.write(random.Random(3).getrandbits(5 * 1024 * 1024 * 8).to_bytes(5 * 1024 * 1024, "little"))
+
+    sign(binary, path, out, ["--update"])
+    sign(binary, path, fresh)
+
+    checkSignature(fresh, path)
+    checkSame(out, fresh, "update")
+    print("Update of an appended file: ok")
+
+def checkConvert(binary, dir):
+    path = os.path.join(dir, "convert.bin")
+    textSig = os.path.join(dir, "convert.sig")
+    binSig = os.path.join(dir, "convert.sigbin")
+    makeFile(path, 3 * 1024 * 1024 + 17, 4)
+
+    sign(binary, path, textSig)
+    sign(binary, path, binSig, ["--format=bin"])
+
+    toText = binSig + ".text"
+    toBin = textSig + ".bin"
+
+    for args in [["--convert=" + binSig, "--format=text", "--out=" + toText],
+                 ["--convert=" + textSig, "--format=bin", "--out=" + toBin]]:
+        code, output = run(binary, args)
+
+        if code != 0:
+            raise Exception("convert has failed: " + output)
+
+    checkSignature(textSig, path)
+    checkSame(toText, textSig, "bin to text")
+    checkSame(toBin, binSig, "text to bin")
+    print("Text and binary round trip: ok")
+
+def checkVerify(binary, dir):
+    path = os.path.join(dir, "verify.bin")
+    out = os.path.join(dir, "verify.sig")
+    makeFile(path, 2 * 1024 * 1024, 5)
+    sign(binary, path, out)
+
+    code, output = run(binary, ["--verify=" + out])
+
+    if code != 0:
+        raise Exception("verify: the file does not match its signature: " + output)
+
+    changed = 5 * CHUNK_SIZE + 7
+
+    with open(path, "r+b") as file:
+        file.seek(changed)
+        byte = file.read(1)
+        file.seek(changed)
+        file.write(bytes([byte[0] ^ 0xff]))
+
+    code, output = run(binary, ["--verify=" + out])
+    badRange = "Bad range: 0x{0:x}:0x{1:x}".format(5 * CHUNK_SIZE, CHUNK_SIZE)
+
+    if code != 2 or badRange not in output:
+        raise Exception("verify: the changed chunk is not found, exit code {0}: {1}".format(code, output))
+
+    print("Verify: ok")
+
+def applyDelta(deltaPath, oldData, newData):
+    result = bytearray()
+
+    with open(deltaPath, "r") as delta:
+        for line in delta:
+            line = line.strip()
+
+            if line.startswith("copy "):
+                offset, size, oldOffset = [int(value, 16) for value in line[5:].split(":")]
+                data = oldData[oldOffset:oldOffset + size]
+            elif line.startswith("literal "):
+                offset, size = [int(value, 16) for value in line[8:].split(":")]
+                # the literal data are transferred with the delta, they are taken from the new file
+                data = newData[offset:offset + size]
+            else:
+                continue
+
+            if offset != len(result) or len(data) != size:
+                raise Exception("delta: the instruction '{0}' is out of order or out of the file".format(line))
+
+            result += data
+
+    return bytes(result)
+
+def checkDelta(binary, dir):
+    old = os.path.join(dir, "delta-old.bin")
+    new = os.path.join(dir, "delta-new.bin")
+    sig = os.path.join(dir, "delta-old.sig")
+    out = os.path.join(dir, "delta.delta")
+    makeFile(old, 8 * 1024 * 1024, 6)
+
+    # an insertion shifts the rest of the file, a chunk is overwritten
+    oldData = readFile(old)
+    newData = bytearray(oldData[:3000000] + b"INSERTED" + oldData[3000000:])
+    newData[5000000:5000000 + CHUNK_SIZE] = bytes(CHUNK_SIZE)
+    newData = bytes(newData)
+
+    with open(new, "wb") as file:
+        file.write(newData)
+
+    sign(binary, old, sig)
+    code, output = run(binary, ["--file=" + new, "--delta=" + sig, "--out=" + out])
+
+    if code != 0:
+        raise Exception("delta has failed: " + output)
+
+    if applyDelta(out, oldData, newData) != newData:
+        raise Exception("delta: the applied delta does not make the new file")
+
+    literal = sum(int(line.strip()[8:].split(":")[1], 16)
+                  for line in open(out, "r") if line.startswith("literal "))
+
+    # the insertion and the overwritten chunk take a few chunks at most
+    if literal > 4 * CHUNK_SIZE:
+        raise Exception("delta: {0} literal bytes for a small edit".format(literal))
+
+    print("Delta applied to the old file: {0} literal bytes, ok".format(literal))
+
+def main():
+    parser = argparse.ArgumentParser(description = "End-to-end check of resume, update, convert, verify and delta")
+    parser.add_argument("--binary", default = "./file_signature", help = "path to file_signature")
+    parser.add_argument("--size", type = int, default = 160 * 1024 * 1024,
+                        help = "size of the file of the canceled run, it must take more than a second")
+    args = parser.parse_args()
+
+    with tempfile.TemporaryDirectory() as dir:
+        try:
+            checkResume(args.binary, dir, args.size)
+            checkUpdate(args.binary, dir)
+            checkConvert(args.binary, dir)
+            checkVerify(args.binary, dir)
+            checkDelta(args.binary, dir)
+        except Exception as ex:
+            print("Error:", ex)
+            return 1
+
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main())
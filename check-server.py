@@ -0,0 +1,128 @@
+#!/usr/bin/python3
+# -*- coding: utf-8 -*-
+
+# An end-to-end check of the file_signature daemon (--serve)
+# A client sends a sign job of a big file and never reads the answer,
+# then a small file is signed by another client. The small job must finish
+# in time and its signature must match the file, so a client that stops
+# reading does not block the jobs of other clients
+#
+# e.g.: check-server.py --binary=./file_signature --threads=2
+
+import sys, os
+import argparse, random, signal, socket, subprocess, tempfile, time, zlib
+
+def makeFile(path, size, seed):
+    rnd = random.Random(seed)
+
+    with open(path, "wb") as file:
+        file.write(rnd.getrandbits(size * 8).to_bytes(size, "little"))
+
+def waitForSocket(path, daemon, timeout):
+    deadline = time.monotonic() + timeout
+
+    while time.monotonic() < deadline:
+        if daemon.poll() is not None:
+            raise Exception("the daemon has exited with {0}".format(daemon.returncode))
+
+        if os.path.exists(path):
+            return
+
+        time.sleep(0.05)
+
+    raise Exception("the daemon does not listen " + path)
+
+def checkSignature(sigPath, path, chunkSize):
+    with open(path, "rb") as file:
+        data = file.read()
+
+    records = 0
+
+    with open(sigPath, "r") as sig:
+        for line in sig:
+            if not line.startswith("0x"):
+                continue
+
+            offset, size, hashVal = line.strip().split(":")
+            offset = int(offset, 16)
+            size = int(size, 16)
+
+            if offset != records * chunkSize:
+                raise Exception("the record of offset {0} is out of order".format(offset))
+
+            if "{0:08x}".format(zlib.crc32(data[offset:offset + size]) & 0xffffffff) != hashVal:
+                raise Exception("invalid hash offset={0} size={1}".format(offset, size))
+
+            records += 1
+
+    if records != (len(data) + chunkSize - 1) // chunkSize:
+        raise Exception("{0} records of {1} bytes".format(records, len(data)))
+
+def main():
+    parser = argparse.ArgumentParser(description = "End-to-end check of the file_signature daemon")
+    parser.add_argument("--binary", default = "./file_signature", help = "path to file_signature")
+    parser.add_argument("--threads", type = int, default = 2, help = "workers of the daemon")
+    parser.add_argument("--size", type = int, default = 64 * 1024 * 1024, help = "size of the file of the stuck job")
+    parser.add_argument("--timeout", type = float, default = 20, help = "seconds to sign the small file")
+    args = parser.parse_args()
+
+    with tempfile.TemporaryDirectory() as dir:
+        big = os.path.join(dir, "big.bin")
+        small = os.path.join(dir, "small.bin")
+        sockPath = os.path.join(dir, "sig.sock")
+
+        # small chunks make an answer much bigger than the socket buffers
+        makeFile(big, args.size, 1)
+        makeFile(small, 1024 * 1024, 2)
+
+        daemon = subprocess.Popen([args.binary, "--serve=" + sockPath, "--threads=" + str(args.threads)],
+                                  stdin = subprocess.DEVNULL, stdout = subprocess.DEVNULL)
+        stuck = None
+
+        try:
+            waitForSocket(sockPath, daemon, 10)
+
+            stuck = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+            stuck.connect(sockPath)
+            stuck.sendall("Job: sign\r\nFilename: {0}\r\nHash: crc32\r\nChunksize: 1024\r\n\r\n".format(big).encode())
+
+            # let the stuck job fill the socket and its reorder window
+            time.sleep(1)
+
+            out = os.path.join(dir, "small.sig")
+            start = time.monotonic()
+            client = subprocess.run([args.binary, "--connect=" + sockPath, "--file=" + small, "--out=" + out,
+                                     "--chunk-size=4096"],
+                                    stdin = subprocess.DEVNULL, stdout = subprocess.PIPE, stderr = subprocess.STDOUT,
+                                    timeout = args.timeout)
+            seconds = time.monotonic() - start
+
+            if client.returncode != 0:
+                raise Exception("the client has failed: " + client.stdout.decode(errors = "replace"))
+
+            checkSignature(out, small, 4096)
+            print("A job next to a client that does not read: {0:.2f}s, ok".format(seconds))
+        except subprocess.TimeoutExpired:
+            print("The job has not finished in {0}s next to a client that does not read".format(args.timeout))
+            return 1
+        except Exception as ex:
+            print("Error:", ex)
+            return 1
+        finally:
+            if stuck:
+                stuck.close()
+
+            daemon.send_signal(signal.SIGINT)
+
+            try:
+                daemon.wait(30)
+            except subprocess.TimeoutExpired:
+                daemon.kill()
+                daemon.wait()
+                print("The daemon has not stopped")
+                return 1
+
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -1,6 +1,9 @@
 #!/usr/bin/python3
 # -*- coding: <encoding name> -*-
 
+# A reference checker that verifies chunks one by one,
+# big files are verified in parallel by: file_signature --verify=<signature file>
+
 import sys, os
 import zlib, hashlib
 
@@ -0,0 +1,735 @@
+//
+//  main.cpp
+//  file_sig_bench
+//
+//  Created by artem k on 19.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#include "Hash.hpp"
+#include "Utils.hpp"
+#include "Histogram.hpp"
+#include "TaskPool.hpp"
+#include "Topology.hpp"
+#include "SigPipeline.hpp"
+#include "SigRecords.hpp"
+#include "SigLatency.hpp"
+#include "FileStreamChunkReader.hpp"
+#include "SyntheticChunkReader.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+//
+// Microbenchmarks of the hand-offs between hasher threads:
+//   * records - SigRecords::pushRecord by the hashers and tryPopRecord by one consumer
+//   * reader  - ChunkReader::getNextChunk and Chunk::free of FileStreamChunkReader
+//   * pipeline - SigPipeline over a SyntheticChunkReader, so there is no I/O,
+//                the device is emulated by the delay, jitter and stragglers of the reader
+// Hashing is a no-op that spins for a random time, so chunks are completed
+// in random order as by real hashers, but nothing else is measured.
+// Every benchmark runs from 1 to N threads and reports operations per second
+// and p50/p99/max latency of each hand-off
+//
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+    using Records = file_sig::SigPipeline::Records;
+    using Record = file_sig::SigPipeline::Record;
+
+    struct Arguments
+    {
+        std::string bench = "all";
+        std::string report = "text";
+        std::string filePath;
+        std::string hasher = "none";
+        std::string pattern = "random";
+        uint32_t threads = 0;
+        uint32_t reorderWindow = 0;
+        uint32_t cachedChunks = 0;
+        uint32_t chunkSize = 4 * 1024;
+        uint32_t jitterNs = 1000;
+        uint64_t ops = 1000 * 1000;
+        uint64_t fileSize = 256 * 1024 * 1024;
+        uint64_t streamSize = 1024 * 1024 * 1024;
+        uint32_t readDelayUs = 0;
+        uint32_t readJitterUs = 0;
+        uint32_t slowEvery = 0;
+        uint32_t slowDelayUs = 10 * 1000;
+        uint32_t seed = 1;
+        
+        void help()
+        {
+            std::cout << "Usage: \n";
+            std::cout << "  --bench=<records|reader|pipeline|all>\n";
+            std::cout << "                                - optional, default: all\n";
+            std::cout << "  --threads=<count>             - optional, default: available CPUs\n";
+            std::cout << "                                  every benchmark runs with 1, 2, 4 ... <count> threads\n";
+            std::cout << "  --ops=<count>                 - optional, default: 1000000\n";
+            std::cout << "                                  records pushed by a run of the records benchmark\n";
+            std::cout << "  --reorder-window=<chunks>     - optional, default: 4 chunks per a thread\n";
+            std::cout << "  --jitter=<ns>                 - optional, default: 1000\n";
+            std::cout << "                                  max time of the no-op hashing of a chunk,\n";
+            std::cout << "                                  the time is random, so is the completion order\n";
+            std::cout << "  --file=<file path>            - optional, a file for the reader benchmark,\n";
+            std::cout << "                                  default: a temporary file of --file-size\n";
+            std::cout << "  --file-size=<bytes>           - optional, default: 256MB\n";
+            std::cout << "  --chunk-size=<bytes>          - optional, default: 4KB\n";
+            std::cout << "  --cached-chunks=<count>       - optional, default: 2 chunks per a thread\n";
+            std::cout << "  --stream-size=<bytes>         - optional, default: 1GB\n";
+            std::cout << "                                  size of the synthetic stream of the pipeline benchmark\n";
+            std::cout << "  --pattern=<random|zeros>      - optional, default: random\n";
+            std::cout << "  --hash=<none|crc32|sha2>      - optional, default: none - the no-op hashing\n";
+            std::cout << "  --read-delay=<us>             - optional, default: 0, time to read a chunk\n";
+            std::cout << "  --read-jitter=<us>            - optional, default: 0, max random time added to it\n";
+            std::cout << "  --slow-every=<chunks>         - optional, default: 0 - no stragglers\n";
+            std::cout << "                                  on average one chunk of <chunks> is read slowly,\n";
+            std::cout << "                                  the same ones for the same --seed\n";
+            std::cout << "  --slow-delay=<us>             - optional, default: 10000, the time added to a straggler\n";
+            std::cout << "  --seed=<number>               - optional, default: 1\n";
+            std::cout << "  --report=<text|json>          - optional, default: text\n";
+        }
+        
+        bool parseArg(const std::string& argv, const std::string& prefix, std::string& value) const
+        {
+            if (prefix == argv.substr(0, prefix.size()))
+            {
+                value = argv.substr(prefix.size());
+                return true;
+            }
+            
+            return false;
+        }
+        
+        bool parse(int argc, const char * argv[])
+        {
+            std::string cmd;
+            std::string val;
+            
+            for (int i = 1; i < argc; ++i)
+            {
+                cmd.assign(argv[i]);
+                
+                if (parseArg(cmd, "--bench=", bench)
+                    || parseArg(cmd, "--report=", report)
+                    || parseArg(cmd, "--file=", filePath)
+                    || parseArg(cmd, "--hash=", hasher)
+                    || parseArg(cmd, "--pattern=", pattern))
+                {
+                    continue;
+                }
+                
+                if (parseArg(cmd, "--threads=", val))
+                {
+                    threads = utils::toUnsigned<uint32_t>(val);
+                }
+                else if (parseArg(cmd, "--ops=", val))
+                {
+                    ops = utils::toUnsigned<uint64_t>(val);
+                }
+                else if (parseArg(cmd, "--reorder-window=", val))
+                {
+                    reorderWindow = utils::toUnsigned<uint32_t>(val);
+                }
+                else if (parseArg(cmd, "--jitter=", val))
+                {
+                    jitterNs = utils::toUnsigned<uint32_t>(val);
+                }
+                else if (parseArg(cmd, "--file-size=", val))
+                {
+                    fileSize = utils::toUnsigned<uint64_t>(val);
+                }
+                else if (parseArg(cmd, "--chunk-size=", val))
+                {
+                    chunkSize = utils::toUnsigned<uint32_t>(val);
+                }
+                else if (parseArg(cmd, "--cached-chunks=", val))
+                {
+                    cachedChunks = utils::toUnsigned<uint32_t>(val);
+                }
+                else if (parseArg(cmd, "--stream-size=", val))
+                {
+                    streamSize = utils::toUnsigned<uint64_t>(val);
+                }
+                else if (parseArg(cmd, "--read-delay=", val))
+                {
+                    readDelayUs = utils::toUnsigned<uint32_t>(val);
+                }
+                else if (parseArg(cmd, "--read-jitter=", val))
+                {
+                    readJitterUs = utils::toUnsigned<uint32_t>(val);
+                }
+                else if (parseArg(cmd, "--slow-every=", val))
+                {
+                    slowEvery = utils::toUnsigned<uint32_t>(val);
+                }
+                else if (parseArg(cmd, "--slow-delay=", val))
+                {
+                    slowDelayUs = utils::toUnsigned<uint32_t>(val);
+                }
+                else if (parseArg(cmd, "--seed=", val))
+                {
+                    seed = utils::toUnsigned<uint32_t>(val);
+                }
+                else
+                {
+                    help();
+                    return false;
+                }
+            }
+            
+            THROW_IF(bench != "records" && bench != "reader" && bench != "pipeline" && bench != "all",
+                     "Unknown benchmark '" << bench << "'");
+            THROW_IF(hasher != "none" && hasher != "crc32" && hasher != "sha2", "Unknown hasher type: " << hasher);
+            THROW_IF(pattern != "random" && pattern != "zeros", "Unknown pattern '" << pattern << "'");
+            THROW_IF(report != "text" && report != "json", "Unknown report '" << report << "'");
+            THROW_IF(0 == ops, "--ops must not be 0");
+            THROW_IF(0 == chunkSize, "--chunk-size must not be 0");
+            
+            if (0 == threads)
+            {
+                threads = utils::Topology::getAvailableCpus();
+            }
+            
+            return true;
+        }
+    };
+
+    //
+    // the no-op hashing: a thread spins for a random time,
+    // so the chunks are completed in random order
+    //
+    class Jitter
+    {
+    public:
+        Jitter(uint32_t maxNs, uint32_t seed)
+            : m_random(seed)
+            , m_ns(0, maxNs)
+        {
+        }
+        
+        void spin()
+        {
+            const auto until = Clock::now() + std::chrono::nanoseconds(m_ns(m_random));
+            
+            while (Clock::now() < until)
+            {
+            }
+        }
+
+    private:
+        std::mt19937 m_random;
+        std::uniform_int_distribution<uint32_t> m_ns;
+    };
+
+    //
+    // latency histograms of the hand-offs of one run, in nanoseconds
+    //
+    struct Result
+    {
+        std::string bench;
+        uint32_t threads = 0;
+        uint64_t ops = 0;
+        double seconds = 0;
+        uint64_t bytes = 0;          // 0 if the benchmark does not pass data
+        uint32_t maxReorderDepth = 0;
+        uint32_t reorderWindow = 0;
+        std::vector<std::string> stageNames;
+        std::vector<utils::Histogram> stages;
+    };
+
+    uint64_t toNs(Clock::duration time)
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(time).count());
+    }
+
+    //
+    // hashers wait for the window, take the next index, spin and push the record,
+    // the main thread pops the records and checks they come in order
+    //
+    Result runRecords(const Arguments& args, uint32_t threads)
+    {
+        enum { kWindow, kPush, kStagesCount };
+        
+        Records records(args.chunkSize, file_sig::SigPipeline::getReorderWindowSize(threads, args.reorderWindow));
+        
+        //
+        // the reorder stage is recorded by SigRecords itself: from a push until the pop
+        //
+        file_sig::SigLatency latency;
+        file_sig::SigProbes probes;
+        probes.latency = &latency;
+        records.setProbes(probes);
+        
+        utils::LatencyRecorder recorder(kStagesCount);
+        std::atomic<uint64_t> next{0};
+        std::atomic<uint32_t> active{threads};
+        std::vector<std::thread> hashers;
+        
+        const auto start = Clock::now();
+        
+        for (uint32_t i = 0; i < threads; ++i)
+        {
+            hashers.emplace_back([&, i]()
+            {
+                try
+                {
+                    Jitter jitter(args.jitterNs, args.seed + i);
+                    
+                    while (true)
+                    {
+                        auto time = Clock::now();
+                        
+                        if (!records.waitForWindow())
+                        {
+                            break;
+                        }
+                        
+                        const uint64_t index = next++;
+                        
+                        if (index >= args.ops)
+                        {
+                            break;
+                        }
+                        
+                        recorder.record(kWindow, toNs(Clock::now() - time));
+                        jitter.spin();
+                        
+                        Record record;
+                        record.size = args.chunkSize;
+                        record.offset = index * args.chunkSize;
+                        
+                        time = Clock::now();
+                        const bool pushed = records.pushRecord(std::move(record));
+                        recorder.record(kPush, toNs(Clock::now() - time));
+                        
+                        if (!pushed)
+                        {
+                            break;
+                        }
+                    }
+                }
+                catch (const std::exception&)
+                {
+                    records.setException(std::current_exception());
+                }
+                
+                if (1 == active--)
+                {
+                    records.setFreez();
+                }
+            });
+        }
+        
+        Record record;
+        uint64_t popped = 0;
+        
+        try
+        {
+            while (true)
+            {
+                const auto res = records.tryPopRecord(100, record);
+                
+                if (Records::RecordResult::finished == res || Records::RecordResult::canceled == res)
+                {
+                    break;
+                }
+                
+                if (Records::RecordResult::ready == res)
+                {
+                    THROW_IF(record.offset != popped * args.chunkSize, "The record " << record.offset << " is out of order");
+                    ++popped;
+                }
+            }
+        }
+        catch (const std::exception&)
+        {
+            records.setCleanup();
+            
+            for (auto& hasher : hashers)
+            {
+                hasher.join();
+            }
+            
+            throw;
+        }
+        
+        Result result;
+        result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        
+        for (auto& hasher : hashers)
+        {
+            hasher.join();
+        }
+        
+        records.checkException();
+        THROW_IF(popped != args.ops, "Popped " << popped << " records of " << args.ops);
+        
+        auto stages = recorder.merge();
+        result.bench = "records";
+        result.threads = threads;
+        result.ops = popped;
+        result.stageNames = {"window", "push", "reorder"};
+        result.stages = {stages[kWindow], stages[kPush], latency.merge()[static_cast<size_t>(file_sig::SigStage::reorder)]};
+        return result;
+    }
+
+    //
+    // hashers take chunks, spin and free them,
+    // the file is read by the tasks of a pool of one worker and by the hashers themselves
+    //
+    Result runReader(const Arguments& args, const std::string& path, uint32_t threads)
+    {
+        enum { kGet, kFree, kStagesCount };
+        
+        utils::TaskPool pool(1);
+        const uint32_t cachedChunks = args.cachedChunks ? args.cachedChunks : threads * 2;
+        file_sig::FileStreamChunkReader reader(path, pool, cachedChunks, args.chunkSize);
+        
+        utils::LatencyRecorder recorder(kStagesCount);
+        std::atomic<uint64_t> ops{0};
+        std::vector<std::thread> hashers;
+        std::exception_ptr exception;
+        std::mutex exceptionMutex;
+        
+        const auto start = Clock::now();
+        
+        for (uint32_t i = 0; i < threads; ++i)
+        {
+            hashers.emplace_back([&, i]()
+            {
+                try
+                {
+                    Jitter jitter(args.jitterNs, args.seed + i);
+                    file_sig::ChunkReader::Chunk chunk;
+                    
+                    while (true)
+                    {
+                        auto time = Clock::now();
+                        
+                        if (!reader.getNextChunk(chunk))
+                        {
+                            break;
+                        }
+                        
+                        recorder.record(kGet, toNs(Clock::now() - time));
+                        jitter.spin();
+                        
+                        time = Clock::now();
+                        chunk.free();
+                        recorder.record(kFree, toNs(Clock::now() - time));
+                        ++ops;
+                    }
+                }
+                catch (const std::exception&)
+                {
+                    std::lock_guard<std::mutex> lock(exceptionMutex);
+                    exception = std::current_exception();
+                }
+            });
+        }
+        
+        for (auto& hasher : hashers)
+        {
+            hasher.join();
+        }
+        
+        Result result;
+        result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        
+        if (exception)
+        {
+            std::rethrow_exception(exception);
+        }
+        
+        auto stages = recorder.merge();
+        result.bench = "reader";
+        result.threads = threads;
+        result.ops = ops;
+        result.stageNames = {"get", "free"};
+        result.stages = {stages[kGet], stages[kFree]};
+        return result;
+    }
+
+    //
+    // the pipeline hashes a synthetic stream, the records are counted by the batch callback,
+    // so scheduling, reorder and output are measured without I/O
+    //
+    Result runPipeline(const Arguments& args, uint32_t threads)
+    {
+        file_sig::SyntheticReaderSettings settings;
+        settings.size = args.streamSize;
+        settings.chunkSize = args.chunkSize;
+        settings.pattern = args.pattern == "zeros" ? file_sig::SyntheticPattern::zeros : file_sig::SyntheticPattern::random;
+        settings.seed = args.seed;
+        settings.delayUs = args.readDelayUs;
+        settings.jitterUs = args.readJitterUs;
+        settings.slowEvery = args.slowEvery;
+        settings.slowDelayUs = args.slowDelayUs;
+        file_sig::SyntheticChunkReader reader(settings);
+        
+        file_sig::SigPipeline::Hasher hasher = utils::crc32;
+        
+        if (args.hasher == "sha2")
+        {
+            hasher = utils::sha2;
+        }
+        else if (args.hasher == "none")
+        {
+            const uint32_t jitterNs = args.jitterNs;
+            
+            hasher = [jitterNs](const void* /*data*/, size_t /*size*/)
+            {
+                thread_local Jitter jitter(jitterNs, static_cast<uint32_t>(std::hash<std::thread::id>()(std::this_thread::get_id())));
+                jitter.spin();
+                return std::string();
+            };
+        }
+        
+        utils::TaskPool pool(threads);
+        file_sig::SigLatency latency;
+        file_sig::SigProbes probes;
+        probes.latency = &latency;
+        
+        std::atomic<uint64_t> ops{0};
+        std::atomic<uint64_t> offset{0};
+        std::atomic<bool> ordered{true};
+        
+        const auto start = Clock::now();
+        file_sig::SigPipeline pipeline(reader, hasher, pool, threads, args.reorderWindow, probes);
+        
+        pipeline.setRecordBatchCallback([&](file_sig::SigPipeline::RecordBatch records)
+        {
+            for (const auto& record : records)
+            {
+                if (record.offset != offset)
+                {
+                    ordered = false;
+                }
+                
+                offset = record.offset + record.size;
+            }
+            
+            ops += records.size();
+        });
+        
+        auto res = file_sig::SigPipeline::WaitRes::timeout;
+        
+        while (file_sig::SigPipeline::WaitRes::timeout == (res = pipeline.wait(1000)))
+        {
+        }
+        
+        Result result;
+        result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        
+        THROW_IF(file_sig::SigPipeline::WaitRes::finished != res, "The pipeline has been canceled");
+        THROW_IF(!ordered || offset != args.streamSize, "The records are out of order or lost");
+        
+        const auto stats = pipeline.stats();
+        const auto stages = latency.merge();
+        result.bench = "pipeline";
+        result.threads = threads;
+        result.ops = ops;
+        result.bytes = stats.bytesHashed;
+        result.maxReorderDepth = stats.maxReorderDepth;
+        result.reorderWindow = stats.reorderWindow;
+        
+        for (const auto stage : {file_sig::SigStage::read, file_sig::SigStage::hash, file_sig::SigStage::reorder})
+        {
+            result.stageNames.push_back(file_sig::getStageName(stage));
+            result.stages.push_back(stages[static_cast<size_t>(stage)]);
+        }
+        
+        return result;
+    }
+
+    //
+    // the file is written once and is in the page cache for all the runs
+    //
+    void createFile(const std::string& path, uint64_t size, uint32_t seed)
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        THROW_IF(!file.is_open(), "Cannot create " << path);
+        
+        std::mt19937 random(seed);
+        std::vector<uint32_t> block(256 * 1024);
+        
+        for (uint64_t left = size; left > 0; )
+        {
+            std::generate(block.begin(), block.end(), std::ref(random));
+            const uint64_t blockSize = std::min<uint64_t>(left, block.size() * sizeof(uint32_t));
+            file.write(reinterpret_cast<const char*>(block.data()), static_cast<std::streamsize>(blockSize));
+            left -= blockSize;
+        }
+        
+        THROW_IF(!file.flush(), "Cannot write " << path);
+    }
+
+    //
+    // 1, 2, 4 ... up to the max, the max is always included
+    //
+    std::vector<uint32_t> getThreadCounts(uint32_t maxThreads)
+    {
+        std::vector<uint32_t> counts;
+        
+        for (uint32_t threads = 1; threads < maxThreads; threads *= 2)
+        {
+            counts.push_back(threads);
+        }
+        
+        counts.push_back(maxThreads);
+        return counts;
+    }
+
+    //
+    // operations per second and latency of the hand-offs in microseconds
+    //
+    void printResult(std::ostream& out, const Result& result, bool json)
+    {
+        const double opsPerSecond = result.seconds > 0 ? result.ops / result.seconds : 0;
+        const double throughput = result.seconds > 0 ? result.bytes / result.seconds / (1024 * 1024) : 0;
+        
+        out << std::fixed << std::setprecision(2);
+        
+        if (json)
+        {
+            out << "{\"bench\":\"" << result.bench << "\"";
+            out << ",\"threads\":" << result.threads;
+            out << ",\"ops\":" << result.ops;
+            out << ",\"seconds\":" << result.seconds;
+            out << ",\"ops_s\":" << opsPerSecond;
+            
+            if (result.bytes)
+            {
+                out << ",\"throughput_mb_s\":" << throughput;
+                out << ",\"max_reorder_depth\":" << result.maxReorderDepth;
+                out << ",\"reorder_window\":" << result.reorderWindow;
+            }
+            
+            out << ",\"stages\":{";
+            
+            for (size_t i = 0; i < result.stages.size(); ++i)
+            {
+                const auto& stage = result.stages[i];
+                out << (i ? "," : "") << "\"" << result.stageNames[i] << "\":{";
+                out << "\"count\":" << stage.getCount();
+                out << ",\"p50_us\":" << stage.getPercentile(50) / 1000.0;
+                out << ",\"p99_us\":" << stage.getPercentile(99) / 1000.0;
+                out << ",\"max_us\":" << stage.getMax() / 1000.0 << "}";
+            }
+            
+            out << "}}\n";
+            return;
+        }
+        
+        out << result.bench << ", threads " << result.threads << ": ";
+        out << result.ops << " ops in " << result.seconds << " s, " << opsPerSecond << " ops/s";
+        
+        if (result.bytes)
+        {
+            out << ", " << throughput << " MB/s";
+            out << ", max reorder depth " << result.maxReorderDepth << " of " << result.reorderWindow;
+        }
+        
+        out << "\n";
+        out << std::setw(10) << "stage" << std::setw(12) << "count";
+        out << std::setw(14) << "p50, us" << std::setw(14) << "p99, us" << std::setw(14) << "max, us" << "\n";
+        
+        for (size_t i = 0; i < result.stages.size(); ++i)
+        {
+            const auto& stage = result.stages[i];
+            out << std::setw(10) << result.stageNames[i];
+            out << std::setw(12) << stage.getCount();
+            out << std::setw(14) << stage.getPercentile(50) / 1000.0;
+            out << std::setw(14) << stage.getPercentile(99) / 1000.0;
+            out << std::setw(14) << stage.getMax() / 1000.0 << "\n";
+        }
+    }
+}
+
+int main(int argc, const char * argv[])
+{
+    try
+    {
+        Arguments args;
+        
+        if (!args.parse(argc, argv))
+        {
+            return 1;
+        }
+        
+        const bool json = args.report == "json";
+        const auto threadCounts = getThreadCounts(args.threads);
+        
+        if (args.bench == "records" || args.bench == "all")
+        {
+            for (const uint32_t threads : threadCounts)
+            {
+                printResult(std::cout, runRecords(args, threads), json);
+            }
+        }
+        
+        if (args.bench == "reader" || args.bench == "all")
+        {
+            std::string path = args.filePath;
+            
+            if (path.empty())
+            {
+                path = "file_sig_bench.tmp";
+                createFile(path, args.fileSize, args.seed);
+            }
+            
+            try
+            {
+                for (const uint32_t threads : threadCounts)
+                {
+                    printResult(std::cout, runReader(args, path, threads), json);
+                }
+            }
+            catch (const std::exception&)
+            {
+                if (args.filePath.empty())
+                {
+                    std::remove(path.c_str());
+                }
+                
+                throw;
+            }
+            
+            if (args.filePath.empty())
+            {
+                std::remove(path.c_str());
+            }
+        }
+        
+        if (args.bench == "pipeline" || args.bench == "all")
+        {
+            for (const uint32_t threads : threadCounts)
+            {
+                printResult(std::cout, runPipeline(args, threads), json);
+            }
+        }
+        
+        return 0;
+    }
+    catch (const std::ios::failure& ex)
+    {
+        std::cerr << "\nIO error: " << ex.code() << " " << ex.what() << std::endl;
+    }
+    catch (const std::exception& ex)
+    {
+        std::cerr << "\nError: " << ex.what() << std::endl;
+    }
+
+    return -1;
+}
@@ -0,0 +1,112 @@
+//
+//  ChunkBufferPool.cpp
+//  file_signature
+//
+//  Created by artem k on 14.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#include "ChunkBufferPool.hpp"
+
+namespace file_sig
+{
+    namespace
+    {
+        size_t alignToPage(size_t size)
+        {
+            const size_t pageSize = utils::PageMemory::getPageSize();
+            return (size + pageSize - 1) / pageSize * pageSize;
+        }
+    }
+
+    ChunkBufferPool::ChunkBufferPool(size_t buffersCount, uint32_t bufferSize)
+        : m_bufferSize(bufferSize)
+        , m_slotSize(alignToPage(bufferSize))
+        , m_memory(buffersCount * m_slotSize)
+    {
+        m_free.reserve(buffersCount);
+        
+        //
+        // the first slots are taken first
+        //
+        for (size_t i = buffersCount; i > 0; --i)
+        {
+            m_free.push_back(reinterpret_cast<char*>(m_memory.data()) + (i - 1) * m_slotSize);
+        }
+    }
+
+    ChunkBufferPool::Buffer ChunkBufferPool::take(uint32_t size)
+    {
+        Buffer buffer;
+        
+        if (size <= m_bufferSize)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            
+            if (!m_free.empty())
+            {
+                buffer.data = m_free.back();
+                buffer.capacity = m_bufferSize;
+                m_free.pop_back();
+                return buffer;
+            }
+        }
+
+        //
+        // it is not initialized as well as a slot
+        //
+        buffer.data = new char[size];
+        buffer.capacity = size;
+        return buffer;
+    }
+
+    void ChunkBufferPool::give(Buffer& buffer, bool discard)
+    {
+        if (!buffer.data)
+        {
+            return;
+        }
+        
+        if (isSlot(buffer.data))
+        {
+            if (discard)
+            {
+                //
+                // the slot is still owned by the caller, so nobody reads into it
+                //
+                utils::PageMemory::discard(buffer.data, m_slotSize);
+            }
+            
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_free.push_back(buffer.data);
+        }
+        else
+        {
+            delete[] buffer.data;
+        }
+        
+        buffer = Buffer();
+    }
+
+    size_t ChunkBufferPool::getFreeBuffers() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_free.size();
+    }
+
+    uint32_t ChunkBufferPool::getBufferSize() const
+    {
+        return m_bufferSize;
+    }
+
+    bool ChunkBufferPool::isHugePages() const
+    {
+        return m_memory.isHugePages();
+    }
+
+    bool ChunkBufferPool::isSlot(const char* data) const
+    {
+        const char* begin = reinterpret_cast<const char*>(m_memory.data());
+        return begin && data >= begin && data < begin + m_memory.size();
+    }
+}
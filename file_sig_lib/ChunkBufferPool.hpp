@@ -0,0 +1,77 @@
+//
+//  ChunkBufferPool.hpp
+//  file_signature
+//
+//  Created by artem k on 14.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#pragma once
+
+#include "PageMemory.hpp"
+
+#include <mutex>
+#include <vector>
+
+namespace file_sig
+{
+    //
+    // An arena of chunk buffers: fixed slots of one aligned region
+    // (huge pages where they are supported), they are never zeroed,
+    // a page is faulted once by the first reading to it.
+    // A slot is reused by the next reader, so a long-running process
+    // allocates and faults the pages of a buffer only once and not for every file.
+    // If all the slots are taken or a bigger buffer is requested,
+    // an extra buffer is allocated and it is freed when it is given back
+    //
+    class ChunkBufferPool
+    {
+    public:
+        //
+        // only 'size' bytes after 'data' are valid,
+        // 'capacity' bytes may be written
+        //
+        struct Buffer
+        {
+            char* data = nullptr;
+            uint32_t size = 0;
+            uint32_t capacity = 0;
+        };
+
+    public:
+        //
+        // the region of 'buffersCount' slots of 'bufferSize' is allocated at once
+        //
+        ChunkBufferPool(size_t buffersCount, uint32_t bufferSize);
+        
+        ChunkBufferPool(const ChunkBufferPool&) = delete;
+        ChunkBufferPool& operator=(const ChunkBufferPool&) = delete;
+        
+        //
+        // a buffer of at least 'size' capacity, its size is 0
+        //
+        Buffer take(uint32_t size);
+        
+        //
+        // the buffer is reset, an empty buffer is ignored.
+        // If 'discard' is set, the pages of a slot are given back to the system,
+        // e.g. when a cache is shrunk, they are faulted again by the next reading
+        //
+        void give(Buffer& buffer, bool discard = false);
+        
+        size_t getFreeBuffers() const;
+        uint32_t getBufferSize() const;
+        bool isHugePages() const;
+
+    private:
+        bool isSlot(const char* data) const;
+
+    private:
+        const uint32_t m_bufferSize;
+        const size_t m_slotSize; // the buffer size aligned to a page
+        utils::PageMemory m_memory;
+        
+        mutable std::mutex m_mutex;
+        std::vector<char*> m_free;
+    };
+}
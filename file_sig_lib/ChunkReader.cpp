@@ -7,7 +7,9 @@
 //
 
 #include "ChunkReader.hpp"
+#include <algorithm>
 #include <assert.h>
+#include <chrono>
 
 namespace file_sig
 {
@@ -61,7 +63,8 @@ namespace file_sig
     {
         if (m_reader)
         {
-            m_reader->freeChunk(m_data, m_size);
+            m_reader->freeChunk(m_data, m_size, m_offset);
+            m_reader->m_busyChunks.add(static_cast<uint32_t>(-1));
             m_reader = nullptr;
         }
     }
@@ -108,7 +111,13 @@ namespace file_sig
         uint32_t size = 0;
         uint64_t offset = 0;
         
-        if (!getChunk(data, size, offset))
+        const auto start = std::chrono::steady_clock::now();
+        const bool res = getChunk(data, size, offset);
+        const auto time = std::chrono::steady_clock::now() - start;
+        
+        m_stallNs.add(std::chrono::duration_cast<std::chrono::nanoseconds>(time).count());
+        
+        if (!res)
         {
             //
             // EOF, EOS
@@ -116,7 +125,81 @@ namespace file_sig
             return false;
         }
         
+        m_bytesRead.add(size);
+        m_busyChunks.add(1);
+        
         chunk = Chunk(*this, data, size, offset);
         return true;
     }
+
+    ChunkReader::ReadResult ChunkReader::getNextChunk(Chunk& chunk, const Resume& resume)
+    {
+        const void * data = nullptr;
+        uint32_t size = 0;
+        uint64_t offset = 0;
+        
+        //
+        // a parked caller does not stall, so only the time in the call is counted
+        //
+        const auto start = std::chrono::steady_clock::now();
+        const ReadResult res = tryGetChunk(data, size, offset, resume);
+        const auto time = std::chrono::steady_clock::now() - start;
+        
+        m_stallNs.add(std::chrono::duration_cast<std::chrono::nanoseconds>(time).count());
+        
+        if (res != ReadResult::ready)
+        {
+            return res;
+        }
+        
+        m_bytesRead.add(size);
+        m_busyChunks.add(1);
+        
+        chunk = Chunk(*this, data, size, offset);
+        return res;
+    }
+
+    ChunkReader::Stats ChunkReader::getStats() const
+    {
+        Stats stats;
+        stats.bytesRead = m_bytesRead.load();
+        stats.stallUs = m_stallNs.load() / 1000;
+        stats.busyChunks = m_busyChunks.load();
+        getCacheStats(stats.readyChunks, stats.freeChunks);
+        return stats;
+    }
+
+    void ChunkReader::setTrace(SigTrace* trace)
+    {
+        m_trace = trace;
+    }
+
+    uint32_t ChunkReader::setCacheLimit(uint32_t chunks)
+    {
+        return limitCache(std::max(chunks, 1u));
+    }
+
+    SigTrace* ChunkReader::getTrace() const
+    {
+        return m_trace;
+    }
+
+    void ChunkReader::getCacheStats(uint32_t& readyChunks, uint32_t& freeChunks) const
+    {
+        readyChunks = 0;
+        freeChunks = 0;
+    }
+
+    uint32_t ChunkReader::limitCache(uint32_t /*chunks*/)
+    {
+        return 0;
+    }
+
+    ChunkReader::ReadResult ChunkReader::tryGetChunk(const void *& data,
+                                                     uint32_t& size,
+                                                     uint64_t& offset,
+                                                     const Resume& /*resume*/)
+    {
+        return getChunk(data, size, offset) ? ReadResult::ready : ReadResult::finished;
+    }
 }
@@ -8,7 +8,11 @@
 
 #pragma once
 
+#include "PaddedAtomic.hpp"
+#include "SigTrace.hpp"
+
 #include <stdint.h>
+#include <functional>
 
 //
 // TODO: the class has to be covered by unit tests
@@ -56,6 +60,27 @@ namespace file_sig
             ChunkReader * m_reader;
         };
         
+        //
+        // snapshot of reader counters, see getStats
+        //
+        struct Stats
+        {
+            uint64_t bytesRead = 0;   // size of all the chunks returned by getNextChunk
+            uint64_t stallUs = 0;     // time that callers of getNextChunk waited for data
+            uint32_t readyChunks = 0; // cached chunks with data that are not taken yet
+            uint32_t busyChunks = 0;  // taken chunks that are not freed yet
+            uint32_t freeChunks = 0;  // cached chunks that may be reused for reading
+        };
+        
+        using Resume = std::function<void()>;
+        
+        enum class ReadResult
+        {
+            ready,    // the chunk has been read
+            finished, // EOF, EOS
+            parked    // the continuation will be called, the task must return
+        };
+        
     public:
         virtual ~ChunkReader() = default;
         
@@ -66,6 +91,46 @@ namespace file_sig
         //
         bool getNextChunk(Chunk& chunk);
         
+        //
+        // the same for a pool task that must not wait for another thread:
+        // if a chunk is not ready yet, 'resume' is kept and the result is parked,
+        // the continuation is called once a chunk may be taken
+        //
+        ReadResult getNextChunk(Chunk& chunk, const Resume& resume);
+        
+        //
+        // returns the size of every chunk except the last one,
+        // so a chunk index can be calculated as offset / chunk size
+        //
+        virtual uint32_t getChunkSize() const = 0;
+        
+        //
+        // offset of the first chunk, it is not zero if a signature is resumed
+        //
+        virtual uint64_t getStartOffset() const = 0;
+        
+        //
+        // may be called at any time from any thread
+        //
+        Stats getStats() const;
+        
+        //
+        // a reader may trace its own slices, e.g. map/unmap,
+        // must be called before reading, nullptr disables tracing
+        //
+        void setTrace(SigTrace* trace);
+        
+        //
+        // limits the chunks that a caching reader keeps (ready, busy and free),
+        // the buffers above the limit are freed as soon as they are not used.
+        // It may be called at any time from any thread,
+        // returns the new limit or 0 if the reader has no cache
+        //
+        uint32_t setCacheLimit(uint32_t chunks);
+        
+    protected:
+        SigTrace* getTrace() const;
+        
     private:
         //
         // retunrs true if the data has been successfully read
@@ -74,11 +139,30 @@ namespace file_sig
         //
         virtual bool getChunk(const void *& data, uint32_t& size, uint64_t& offset) = 0;
         
+        //
+        // a reader that waits for other threads parks the caller instead,
+        // the default is getChunk because it reads the chunk in the calling thread
+        //
+        virtual ReadResult tryGetChunk(const void *& data, uint32_t& size, uint64_t& offset, const Resume& resume);
+        
         //
         // freeChunk method must always be called once for each getChunk
         // the function must not throw any exceptions because it is a
         // function that free resources
         //
-        virtual void freeChunk(const void * data, uint32_t size) = 0;
+        virtual void freeChunk(const void * data, uint32_t size, uint64_t offset) = 0;
+        
+        //
+        // a reader that caches chunks reports the sizes of its lists,
+        // a reader without a cache keeps zeros
+        //
+        virtual void getCacheStats(uint32_t& readyChunks, uint32_t& freeChunks) const;
+        virtual uint32_t limitCache(uint32_t chunks);
+        
+    private:
+        utils::PaddedAtomic<uint64_t> m_bytesRead;
+        utils::PaddedAtomic<uint64_t> m_stallNs;
+        utils::PaddedAtomic<uint32_t> m_busyChunks;
+        SigTrace* m_trace = nullptr;
     };
 }
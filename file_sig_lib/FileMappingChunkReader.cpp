@@ -26,16 +26,20 @@ namespace file_sig
         utils::ScopedHandle<int, decltype(::close), ::close, -1> file;
         uint64_t fileSize = 0;
         uint64_t filePos = 0;
+        uint64_t startOffset = 0;
         uint32_t chunkSize = 0;
         uint8_t * filePtr = nullptr;
     };
 
     FileMappingChunkReader::FileMappingChunkReader(const std::string& fileName,
                                                    uint32_t chunkSize,
-                                                   bool mapAllFile)
+                                                   bool mapAllFile,
+                                                   uint64_t startOffset)
         : m_impl(std::make_unique<FileMappingChunkReader::Impl>())
     {
         m_impl->chunkSize = chunkSize;
+        m_impl->filePos = startOffset;
+        m_impl->startOffset = startOffset;
         m_impl->file.reset(open(fileName.c_str(), O_RDONLY));
         THROW_ERRNO_IF(m_impl->file.get() < 0, "Cannot open " << fileName);
         
@@ -66,6 +70,16 @@ namespace file_sig
         }
     }
 
+    uint32_t FileMappingChunkReader::getChunkSize() const
+    {
+        return m_impl->chunkSize;
+    }
+
+    uint64_t FileMappingChunkReader::getStartOffset() const
+    {
+        return m_impl->startOffset;
+    }
+
     bool FileMappingChunkReader::getChunk(const void *& data, uint32_t& size, uint64_t& offset)
     {
         {
@@ -87,18 +101,34 @@ namespace file_sig
             }
         }
         
+        SigTrace* trace = getTrace();
+        const auto time = trace ? SigTrace::Clock::now() : SigTrace::Clock::time_point();
+        
         data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, m_impl->file, offset);
         THROW_ERRNO_IF(data == MAP_FAILED, "mmap failed");
         
+        if (trace && trace->isSampled(offset))
+        {
+            trace->slice("map", time, offset);
+        }
+        
         return true;
     }
 
-    void FileMappingChunkReader::freeChunk(const void * data, uint32_t size)
+    void FileMappingChunkReader::freeChunk(const void * data, uint32_t size, uint64_t offset)
     {
         if (!m_impl->filePtr)
         {
+            SigTrace* trace = getTrace();
+            const auto time = trace ? SigTrace::Clock::now() : SigTrace::Clock::time_point();
+            
             int res = munmap(const_cast<void*>(data), size);
             THROW_ERRNO_IF(res == -1, "munmap failed (logic error)");
+            
+            if (trace && trace->isSampled(offset))
+            {
+                trace->slice("unmap", time, offset);
+            }
         }
     }
 }
@@ -24,7 +24,8 @@ namespace file_sig
     public:
         FileMappingChunkReader(const std::string& fileName,
                                uint32_t chunkSize,
-                               bool mapAllFile);
+                               bool mapAllFile,
+                               uint64_t startOffset = 0);
         
         FileMappingChunkReader(const FileMappingChunkReader&) = delete;
         FileMappingChunkReader& operator=(const FileMappingChunkReader&) = delete;
@@ -32,9 +33,12 @@ namespace file_sig
         FileMappingChunkReader(FileMappingChunkReader&&) = delete;
         FileMappingChunkReader& operator=(FileMappingChunkReader&&) = delete;
         
+        uint32_t getChunkSize() const override;
+        uint64_t getStartOffset() const override;
+        
     private:
         bool getChunk(const void *& data, uint32_t& size, uint64_t& offset) override;
-        void freeChunk(const void * data, uint32_t size) override;
+        void freeChunk(const void * data, uint32_t size, uint64_t offset) override;
         
     private:
         struct Impl;
@@ -17,15 +17,19 @@ namespace file_sig
 
         LARGE_INTEGER fileSize{ 0 };
         LARGE_INTEGER filePos{ 0 };
+        uint64_t startOffset = 0;
         uint32_t chunkSize = 0;
     };
 
     FileMappingChunkReader::FileMappingChunkReader(const std::string& fileName,
                                                    uint32_t chunkSize,
-                                                   bool mapAllFile)
+                                                   bool mapAllFile,
+                                                   uint64_t startOffset)
         : m_impl(std::make_unique<FileMappingChunkReader::Impl>())
     {
         m_impl->chunkSize = chunkSize;
+        m_impl->filePos.QuadPart = static_cast<LONGLONG>(startOffset);
+        m_impl->startOffset = startOffset;
 
         m_impl->file = CreateFileA(fileName.c_str()
             , GENERIC_READ
@@ -64,6 +68,16 @@ namespace file_sig
         }
     }
 
+    uint32_t FileMappingChunkReader::getChunkSize() const
+    {
+        return m_impl->chunkSize;
+    }
+
+    uint64_t FileMappingChunkReader::getStartOffset() const
+    {
+        return m_impl->startOffset;
+    }
+
     bool FileMappingChunkReader::getChunk(const void *& data, uint32_t& size, uint64_t& offset)
     {
         {
@@ -88,6 +102,9 @@ namespace file_sig
             }
         }
 
+        SigTrace* trace = getTrace();
+        const auto time = trace ? SigTrace::Clock::now() : SigTrace::Clock::time_point();
+        
         LARGE_INTEGER offset2{};
         offset2.QuadPart = offset;
         
@@ -99,15 +116,29 @@ namespace file_sig
             , NULL);
 
         THROW_WIN_IF(!data, "MapViewOfFileEx failed");
+        
+        if (trace && trace->isSampled(offset))
+        {
+            trace->slice("map", time, offset);
+        }
+        
         return true;
     }
 
-    void FileMappingChunkReader::freeChunk(const void * data, uint32_t /*size*/)
+    void FileMappingChunkReader::freeChunk(const void * data, uint32_t /*size*/, uint64_t offset)
     {
         if (!m_impl->view)
         {
+            SigTrace* trace = getTrace();
+            const auto time = trace ? SigTrace::Clock::now() : SigTrace::Clock::time_point();
+            
             BOOL res = UnmapViewOfFile(const_cast<LPVOID>(data));
             THROW_WIN_IF(!res, "UnmapViewOfFile failed (logic error)");
+            
+            if (trace && trace->isSampled(offset))
+            {
+                trace->slice("unmap", time, offset);
+            }
         }
     }
 }
@@ -0,0 +1,328 @@
+//
+//  FileSigApi.cpp
+//  file_signature
+//
+//  Created by artem k on 13.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#include "FileSigApi.h"
+#include "SigPipeline.hpp"
+#include "FileStreamChunkReader.hpp"
+#include "FileMappingChunkReader.hpp"
+#include "MemoryChunkReader.hpp"
+#include "MappedFile.hpp"
+#include "TaskPool.hpp"
+#include "Hash.hpp"
+#include "Exceptions.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct fsig_context
+{
+    explicit fsig_context(size_t threads)
+        : pool(threads)
+    {
+    }
+
+    utils::TaskPool pool;
+};
+
+struct fsig_pipeline
+{
+    fsig_context* context = nullptr;
+    fsig_options options = {};
+
+    //
+    // the members are destroyed in the reverse order:
+    // the pipeline stops before its reader, the reader before the mapping
+    //
+    std::unique_ptr<utils::MappedFile> file;
+    std::unique_ptr<file_sig::ChunkReader> reader;
+    std::unique_ptr<file_sig::SigPipeline> pipeline;
+
+    //
+    // records of a batch are converted to this buffer, the hashes are not copied
+    //
+    std::vector<fsig_record> records;
+
+    //
+    // cancel may be called before the pipeline is started by fsig_pipeline_run
+    //
+    std::mutex cancelMutex;
+    bool canceled = false;
+    bool started = false;
+};
+
+namespace
+{
+    thread_local std::string g_lastError;
+
+    const uint32_t kDefaultChunkSize = 1024 * 1024;
+
+    void setError(const char* error)
+    {
+        g_lastError = error;
+    }
+
+    //
+    // exceptions never leave the C interface
+    //
+    template<typename Func, typename Result>
+    Result call(Func func, Result failed)
+    {
+        try
+        {
+            return func();
+        }
+        catch (const std::exception& ex)
+        {
+            setError(ex.what());
+        }
+        catch (...)
+        {
+            setError("Unknown error");
+        }
+        
+        return failed;
+    }
+
+    file_sig::SigPipeline::Hasher createHasher(fsig_hasher hasher)
+    {
+        switch (hasher)
+        {
+            case FSIG_HASH_CRC32:
+                return utils::crc32;
+            case FSIG_HASH_SHA2:
+                return utils::sha2;
+        }
+        
+        THROW("Unknown hasher type: " << hasher);
+    }
+
+    uint32_t getThreads(const fsig_pipeline& pipeline)
+    {
+        if (pipeline.options.threads)
+        {
+            return pipeline.options.threads;
+        }
+        
+        //
+        // a pipeline does not take the whole pool by default,
+        // so the pipelines of one context are hashed side by side
+        //
+        const uint32_t poolThreads = static_cast<uint32_t>(pipeline.context->pool.getThreadsCount());
+        return std::max(poolThreads / 2, 1u);
+    }
+
+    std::unique_ptr<fsig_pipeline> createPipeline(fsig_context* context, const fsig_options* options)
+    {
+        THROW_IF(!context, "The context is null");
+        
+        std::unique_ptr<fsig_pipeline> pipeline(new fsig_pipeline());
+        pipeline->context = context;
+        
+        if (options)
+        {
+            pipeline->options = *options;
+        }
+        else
+        {
+            fsig_options_init(&pipeline->options);
+        }
+        
+        if (0 == pipeline->options.chunk_size)
+        {
+            pipeline->options.chunk_size = kDefaultChunkSize;
+        }
+
+        //
+        // it throws before any reading if the hasher is unknown
+        //
+        createHasher(pipeline->options.hasher);
+        return pipeline;
+    }
+}
+
+const char* fsig_last_error(void)
+{
+    return g_lastError.c_str();
+}
+
+void fsig_options_init(fsig_options* options)
+{
+    if (options)
+    {
+        options->reader = FSIG_READER_STREAM;
+        options->hasher = FSIG_HASH_CRC32;
+        options->chunk_size = kDefaultChunkSize;
+        options->threads = 0;
+        options->reorder_window = 0;
+    }
+}
+
+fsig_context* fsig_context_create(uint32_t threads)
+{
+    return call([threads]()
+    {
+        const size_t count = threads ? threads : std::max(std::thread::hardware_concurrency(), 1u);
+        return new fsig_context(count);
+    }, static_cast<fsig_context*>(nullptr));
+}
+
+void fsig_context_destroy(fsig_context* context)
+{
+    delete context;
+}
+
+fsig_pipeline* fsig_pipeline_open_path(fsig_context* context, const char* path, const fsig_options* options)
+{
+    return call([&]()
+    {
+        THROW_IF(!path, "The path is null");
+        
+        auto pipeline = createPipeline(context, options);
+        const uint32_t chunkSize = pipeline->options.chunk_size;
+        
+        switch (pipeline->options.reader)
+        {
+            case FSIG_READER_STREAM:
+                //
+                // each hasher task has one cached chunk and one current chunk
+                //
+                pipeline->reader.reset(new file_sig::FileStreamChunkReader(path,
+                                                                           context->pool,
+                                                                           getThreads(*pipeline) * 2,
+                                                                           chunkSize));
+                break;
+            case FSIG_READER_MAP:
+                pipeline->reader.reset(new file_sig::FileMappingChunkReader(path, chunkSize, false));
+                break;
+            case FSIG_READER_MAPALL:
+                pipeline->reader.reset(new file_sig::FileMappingChunkReader(path, chunkSize, true));
+                break;
+        }
+        
+        THROW_IF(!pipeline->reader, "Unknown reader type: " << pipeline->options.reader);
+        return pipeline.release();
+    }, static_cast<fsig_pipeline*>(nullptr));
+}
+
+fsig_pipeline* fsig_pipeline_open_fd(fsig_context* context, int fd, const fsig_options* options)
+{
+    return call([&]()
+    {
+        auto pipeline = createPipeline(context, options);
+        pipeline->file.reset(new utils::MappedFile(fd));
+        pipeline->reader.reset(new file_sig::MemoryChunkReader(pipeline->file->data(),
+                                                               pipeline->file->size(),
+                                                               pipeline->options.chunk_size));
+        return pipeline.release();
+    }, static_cast<fsig_pipeline*>(nullptr));
+}
+
+fsig_pipeline* fsig_pipeline_open_buffer(fsig_context* context,
+                                         const void* data,
+                                         uint64_t size,
+                                         const fsig_options* options)
+{
+    return call([&]()
+    {
+        auto pipeline = createPipeline(context, options);
+        pipeline->reader.reset(new file_sig::MemoryChunkReader(data, size, pipeline->options.chunk_size));
+        return pipeline.release();
+    }, static_cast<fsig_pipeline*>(nullptr));
+}
+
+fsig_status fsig_pipeline_run(fsig_pipeline* pipeline, fsig_records_cb cb, void* user)
+{
+    return call([&]()
+    {
+        THROW_IF(!pipeline || !cb, "The pipeline or the callback is null");
+        
+        {
+            std::lock_guard<std::mutex> lock(pipeline->cancelMutex);
+            THROW_IF(pipeline->started, "The pipeline has already been run");
+            pipeline->started = true;
+            
+            if (pipeline->canceled)
+            {
+                return FSIG_CANCELED;
+            }
+            
+            pipeline->pipeline.reset(new file_sig::SigPipeline(*pipeline->reader,
+                                                               createHasher(pipeline->options.hasher),
+                                                               pipeline->context->pool,
+                                                               getThreads(*pipeline),
+                                                               pipeline->options.reorder_window));
+        }
+        
+        auto& sigPipeline = *pipeline->pipeline;
+        
+        sigPipeline.setRecordBatchCallback([pipeline, cb, user](file_sig::SigPipeline::RecordBatch batch)
+        {
+            auto& records = pipeline->records;
+            records.resize(batch.size());
+            
+            for (size_t i = 0; i < batch.size(); ++i)
+            {
+                records[i].offset = batch[i].offset;
+                records[i].size = batch[i].size;
+                records[i].hash = batch[i].hash.data();
+                records[i].hash_size = batch[i].hash.size();
+            }
+            
+            if (cb(user, records.data(), records.size()) != 0)
+            {
+                fsig_pipeline_cancel(pipeline);
+            }
+        });
+        
+        auto res = file_sig::SigPipeline::WaitRes::timeout;
+        
+        while (file_sig::SigPipeline::WaitRes::timeout == (res = sigPipeline.wait(1000)))
+        {
+        }
+        
+        if (file_sig::SigPipeline::WaitRes::canceled == res)
+        {
+            //
+            // the tasks may still use the reader and the callback
+            //
+            sigPipeline.cancel(true);
+            return FSIG_CANCELED;
+        }
+        
+        return FSIG_OK;
+    }, FSIG_ERROR);
+}
+
+void fsig_pipeline_cancel(fsig_pipeline* pipeline)
+{
+    if (!pipeline)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(pipeline->cancelMutex);
+    pipeline->canceled = true;
+
+    if (pipeline->pipeline)
+    {
+        //
+        // it does not wait for the tasks, so it may be called by the callback
+        //
+        pipeline->pipeline->cancel(false);
+    }
+}
+
+void fsig_pipeline_destroy(fsig_pipeline* pipeline)
+{
+    delete pipeline;
+}
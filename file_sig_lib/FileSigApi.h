@@ -0,0 +1,160 @@
+//
+//  FileSigApi.h
+//  file_signature
+//
+//  Created by artem k on 13.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+//
+// C interface of the signature library for services that hash many files in one process
+//
+// A context owns the thread pool, it is created once and shared by all the pipelines,
+// so neither threads nor the process are started per file.
+// A pipeline hashes one source (a path, a file descriptor or a memory buffer)
+// and passes sorted batches of records to the callback.
+// By default a pipeline runs up to half of the pool threads,
+// so two pipelines of a context hash side by side and never starve each other.
+//
+// e.g.: fsig_context* context = fsig_context_create(0);
+//       fsig_options options;
+//       fsig_options_init(&options);
+//       fsig_pipeline* pipeline = fsig_pipeline_open_path(context, path, &options);
+//       if (!pipeline || fsig_pipeline_run(pipeline, onRecords, user) == FSIG_ERROR)
+//           puts(fsig_last_error());
+//       fsig_pipeline_destroy(pipeline);
+//       ...
+//       fsig_context_destroy(context);
+//
+// Functions do not throw, errors are returned as FSIG_ERROR or NULL
+// and described by fsig_last_error of the calling thread
+//
+
+#if defined(_WIN32)
+#if defined(FILE_SIG_EXPORTS)
+#define FILE_SIG_API __declspec(dllexport)
+#elif defined(FILE_SIG_STATIC)
+#define FILE_SIG_API
+#else
+#define FILE_SIG_API __declspec(dllimport)
+#endif
+#else
+#define FILE_SIG_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct fsig_context fsig_context;
+typedef struct fsig_pipeline fsig_pipeline;
+
+typedef enum fsig_status
+{
+    FSIG_OK = 0,
+    FSIG_CANCELED = 1,
+    FSIG_ERROR = -1
+} fsig_status;
+
+typedef enum fsig_reader
+{
+    FSIG_READER_STREAM = 0,  // buffered reading by the pool tasks
+    FSIG_READER_MAP = 1,     // a mapping per chunk
+    FSIG_READER_MAPALL = 2   // a mapping of the whole file
+} fsig_reader;
+
+typedef enum fsig_hasher
+{
+    FSIG_HASH_CRC32 = 0,
+    FSIG_HASH_SHA2 = 1
+} fsig_hasher;
+
+typedef struct fsig_options
+{
+    fsig_reader reader;
+    fsig_hasher hasher;
+    uint32_t chunk_size;     // default: 1MB
+    uint32_t threads;        // chunks hashed in parallel, 0 - half of the pool threads
+    uint32_t reorder_window; // 0 - a default value that depends on threads
+} fsig_options;
+
+//
+// the hash is hex digits of the pipeline that are valid only during the callback,
+// it is not terminated by zero
+//
+typedef struct fsig_record
+{
+    uint64_t offset;
+    uint32_t size;
+    const char* hash;
+    size_t hash_size;
+} fsig_record;
+
+//
+// records are sorted and contiguous, the callback may return nonzero to cancel the pipeline
+// It is called by the pool threads, but never concurrently for the same pipeline.
+// A callback that blocks holds one pool thread, the other tasks of its pipeline
+// wait without threads, so the pipelines of other callbacks go on
+//
+typedef int (*fsig_records_cb)(void* user, const fsig_record* records, size_t count);
+
+//
+// the error of the last failed call of the calling thread
+//
+FILE_SIG_API const char* fsig_last_error(void);
+
+FILE_SIG_API void fsig_options_init(fsig_options* options);
+
+//
+// threads - pool worker threads, 0 - one per CPU
+//
+FILE_SIG_API fsig_context* fsig_context_create(uint32_t threads);
+
+//
+// all the pipelines of the context must be destroyed before
+//
+FILE_SIG_API void fsig_context_destroy(fsig_context* context);
+
+FILE_SIG_API fsig_pipeline* fsig_pipeline_open_path(fsig_context* context,
+                                                    const char* path,
+                                                    const fsig_options* options);
+
+//
+// a regular file is mapped, the descriptor may be closed after the call,
+// options->reader is ignored
+//
+FILE_SIG_API fsig_pipeline* fsig_pipeline_open_fd(fsig_context* context,
+                                                  int fd,
+                                                  const fsig_options* options);
+
+//
+// chunks are hashed in place, the buffer must outlive the pipeline,
+// options->reader is ignored
+//
+FILE_SIG_API fsig_pipeline* fsig_pipeline_open_buffer(fsig_context* context,
+                                                      const void* data,
+                                                      uint64_t size,
+                                                      const fsig_options* options);
+
+//
+// blocks until all the records have been passed to the callback,
+// the pipeline is canceled or fails. A pipeline runs once
+//
+FILE_SIG_API fsig_status fsig_pipeline_run(fsig_pipeline* pipeline, fsig_records_cb cb, void* user);
+
+//
+// may be called from any thread, including the callback,
+// fsig_pipeline_run returns FSIG_CANCELED
+//
+FILE_SIG_API void fsig_pipeline_cancel(fsig_pipeline* pipeline);
+
+FILE_SIG_API void fsig_pipeline_destroy(fsig_pipeline* pipeline);
+
+#ifdef __cplusplus
+}
+#endif
@@ -16,97 +16,177 @@
 namespace file_sig
 {
     FileStreamChunkReader::FileStreamChunkReader(const std::string& fileName,
+                                                 utils::TaskPool& pool,
                                                  uint32_t cachedChunksCount,
-                                                 uint32_t chunkSize)
+                                                 uint32_t chunkSize,
+                                                 size_t readWorker,
+                                                 uint64_t startOffset,
+                                                 ChunkBufferPool* buffers)
+        : m_maxChunks(cachedChunksCount)
+        , m_chunkSize(chunkSize)
+        , m_readWorker(readWorker)
+        , m_startOffset(startOffset)
+        , m_ownBuffers(buffers ? nullptr : new ChunkBufferPool(cachedChunksCount, chunkSize))
+        , m_buffers(buffers ? buffers : m_ownBuffers.get())
+        , m_pool(pool)
     {
         m_file.open(fileName, std::ios::binary);
         THROW_IF(!m_file.is_open(), "Cannot open " << fileName);
         m_file.exceptions(std::ios::badbit);
         
-        m_fileIo.resize(1024 * 1024);
+        m_fileIo.resize(kFileBufferSize);
         m_file.rdbuf()->pubsetbuf(m_fileIo.data(), m_fileIo.size());
         
+        if (m_startOffset)
+        {
+            m_file.seekg(m_startOffset);
+            THROW_IF(!m_file, "Cannot seek " << fileName << " to " << m_startOffset);
+        }
+        
         //
-        // create 'cachedChunksCount' free chunks
-        // each of that has pre allocated 'chunkSize' buffer
+        // create 'cachedChunksCount' free chunks,
+        // a buffer is taken at the first reading
+        // (the first touch places the memory on the node of the reading thread)
         //
-        m_free.resize(cachedChunksCount, {std::vector<char>(chunkSize, 0), 0 });
+        m_free.resize(cachedChunksCount);
         
         //
-        // create a thread that reads file data
+        // start reading file data by a pool task
         //
-        m_thread = std::async(std::launch::async,
-                              &FileStreamChunkReader::readerThread,
-                              this);
+        std::unique_lock<std::mutex> lock(m_chunkMutex);
+        const bool schedule = prepareReadTask();
+        lock.unlock();
+        
+        if (schedule)
+        {
+            pushReadTask();
+        }
     }
 
     FileStreamChunkReader::~FileStreamChunkReader()
     {
         stop(false);
-        m_thread.wait();
+        m_readTasks.wait();
+        
+        for (auto list : {&m_ready, &m_busy, &m_free})
+        {
+            for (auto& chunk : *list)
+            {
+                m_buffers->give(chunk.buffer);
+            }
+        }
     }
 
     void FileStreamChunkReader::stop(bool sync)
     {
         //
-        // stop the thread and clean up all cached data
+        // stop reading and clean up all cached data
         // the further reading is not necessary
         // caller wants to stop/cancel all operations
         //
         std::unique_lock<std::mutex> lock(m_chunkMutex);
         m_stopped = true;
+        resumeParked();
         lock.unlock();
         
         //
         // notify all threads that wait for a new data
         // that it is finished
         //
-        m_freeCv.notify_all();
+        m_readyCv.notify_all();
 
         if (sync)
         {
             //
-            // wait for thread stops
-            // the mutex is needed for safety calling of this method
-            // from multiple threads
+            // wait for queued and running read tasks
             //
-            std::lock_guard<std::mutex> threadLock(m_threadMutex);
-            m_thread.get();
+            m_readTasks.wait();
         }
     }
 
+    uint32_t FileStreamChunkReader::getChunkSize() const
+    {
+        return m_chunkSize;
+    }
+
+    uint64_t FileStreamChunkReader::getStartOffset() const
+    {
+        return m_startOffset;
+    }
+
     bool FileStreamChunkReader::getChunk(const void *& data, uint32_t& size, uint64_t& offset)
+    {
+        return takeChunk(data, size, offset, nullptr) == ReadResult::ready;
+    }
+
+    ChunkReader::ReadResult FileStreamChunkReader::tryGetChunk(const void *& data,
+                                                               uint32_t& size,
+                                                               uint64_t& offset,
+                                                               const Resume& resume)
+    {
+        return takeChunk(data, size, offset, &resume);
+    }
+
+    ChunkReader::ReadResult FileStreamChunkReader::takeChunk(const void *& data,
+                                                             uint32_t& size,
+                                                             uint64_t& offset,
+                                                             const Resume* resume)
     {
         std::unique_lock<std::mutex> lock(m_chunkMutex);
         
-        m_readyCv.wait(lock, [this]()
-        {
-            return !m_ready.empty() || m_stopped || m_eof;
-        });
-        
-        if (m_exception)
-        {
-            //
-            // an exception happened in a reader thread
-            //
-            std::exception_ptr ex;
-            std::swap(ex, m_exception);
-            std::rethrow_exception(ex);
-        }
-        
-        if (m_eof && m_ready.empty())
+        for (;;)
         {
+            if (m_exception)
+            {
+                //
+                // an exception happened while reading
+                //
+                std::exception_ptr ex;
+                std::swap(ex, m_exception);
+                std::rethrow_exception(ex);
+            }
+            
+            if (m_eof && m_ready.empty())
+            {
+                //
+                // all the data have been read from a file
+                // and all the read data have been processed
+                // so need not further calls
+                //
+                m_stopped = true;
+            }
+            
+            if (m_stopped)
+            {
+                return ReadResult::finished;
+            }
+            
+            if (!m_ready.empty())
+            {
+                break;
+            }
+            
+            if (!m_reading && !m_free.empty())
+            {
+                //
+                // nobody reads the file now (a read task may be still in the queue),
+                // read the next chunk in this thread instead of waiting
+                //
+                readChunks(lock, 1);
+                continue;
+            }
+            
             //
-            // all the data have been read from a file
-            // and all the read data have been processed
-            // so need not further calls
+            // either the file is being read by another thread
+            // or all the chunks are being hashed, both finish without waiting for the pool
             //
-            m_stopped = true;
-        }
-        
-        if (m_stopped)
-        {
-            return false;
+            if (resume)
+            {
+                m_parked.push_back(*resume);
+                return ReadResult::parked;
+            }
+            
+            m_readyCv.wait(lock);
         }
         
         //
@@ -114,20 +194,24 @@ namespace file_sig
         //
         auto& val = m_ready.front();
         
-        if (val.buffer.size() > std::numeric_limits<uint32_t>::max())
-        {
-            THROW("cannot convert " << val.buffer.size() << " to 32bits value");
-        }
-        
-        data = static_cast<void*>(val.buffer.data());
-        size = static_cast<uint32_t>(val.buffer.size());
+        data = static_cast<void*>(val.buffer.data);
+        size = val.buffer.size;
         offset = val.offset;
         
         m_busy.splice(m_busy.end(), m_ready, m_ready.begin());
-        return true;
+        
+        const bool schedule = prepareReadTask();
+        lock.unlock();
+        
+        if (schedule)
+        {
+            pushReadTask();
+        }
+        
+        return ReadResult::ready;
     }
 
-    void FileStreamChunkReader::freeChunk(const void * data, uint32_t /*size*/)
+    void FileStreamChunkReader::freeChunk(const void * data, uint32_t /*size*/, uint64_t /*offset*/)
     {
         //
         // finds the chunk in the busy list
@@ -135,14 +219,40 @@ namespace file_sig
         // the chunk memory is not reallocated
         // and can be reused
         //
-        std::lock_guard<std::mutex> lock(m_chunkMutex);
+        std::unique_lock<std::mutex> lock(m_chunkMutex);
         
         for (auto it = m_busy.begin(); it != m_busy.end(); ++it)
         {
-            if (data == it->buffer.data())
+            if (data == it->buffer.data)
             {
+                if (getChunksCount() > m_maxChunks)
+                {
+                    //
+                    // the cache has been limited while the chunk was hashed,
+                    // the pages of the buffer are not kept resident by the pool
+                    //
+                    m_buffers->give(it->buffer, true);
+                    m_busy.erase(it);
+                    return;
+                }
+                
                 m_free.splice(m_free.end(), m_busy, it);
-                m_freeCv.notify_one();
+                
+                const bool schedule = prepareReadTask();
+                resumeParked();
+                lock.unlock();
+                
+                //
+                // a thread that waits for a ready chunk
+                // may read the free chunk itself
+                //
+                m_readyCv.notify_all();
+                
+                if (schedule)
+                {
+                    pushReadTask();
+                }
+                
                 return;
             }
         }
@@ -154,41 +264,163 @@ namespace file_sig
         THROW("Logic error, the buffer was not found");
     }
 
-    void FileStreamChunkReader::readerThread()
+    void FileStreamChunkReader::getCacheStats(uint32_t& readyChunks, uint32_t& freeChunks) const
+    {
+        std::lock_guard<std::mutex> lock(m_chunkMutex);
+        readyChunks = static_cast<uint32_t>(m_ready.size());
+        freeChunks = static_cast<uint32_t>(m_free.size());
+    }
+
+    uint32_t FileStreamChunkReader::limitCache(uint32_t chunks)
+    {
+        std::unique_lock<std::mutex> lock(m_chunkMutex);
+        m_maxChunks = chunks;
+        
+        //
+        // ready and busy chunks are freed when they are returned by freeChunk,
+        // a new free chunk gets its buffer at the first reading
+        //
+        while (getChunksCount() > m_maxChunks && !m_free.empty())
+        {
+            m_buffers->give(m_free.back().buffer, true);
+            m_free.pop_back();
+        }
+        
+        while (getChunksCount() < m_maxChunks)
+        {
+            m_free.emplace_back();
+        }
+        
+        const bool schedule = prepareReadTask();
+        resumeParked();
+        lock.unlock();
+        
+        m_readyCv.notify_all();
+        
+        if (schedule)
+        {
+            pushReadTask();
+        }
+        
+        return chunks;
+    }
+
+    size_t FileStreamChunkReader::getChunksCount() const
+    {
+        //
+        // the chunk that is being read is in none of the lists,
+        // the mutex is released only while it is read
+        //
+        return m_ready.size() + m_busy.size() + m_free.size() + (m_reading ? 1 : 0);
+    }
+
+    void FileStreamChunkReader::resumeParked()
+    {
+        std::vector<Resume> parked;
+        parked.swap(m_parked);
+        
+        for (auto& resume : parked)
+        {
+            resume();
+        }
+    }
+
+    bool FileStreamChunkReader::prepareReadTask()
+    {
+        //
+        // must be called under m_chunkMutex
+        // only one read task may be queued at once
+        //
+        if (m_reading || m_readScheduled || m_stopped || m_eof || m_free.empty())
+        {
+            return false;
+        }
+        
+        m_readScheduled = true;
+        return true;
+    }
+
+    void FileStreamChunkReader::pushReadTask()
     {
         try
         {
-            std::unique_lock<std::mutex> lock(m_chunkMutex, std::defer_lock);
+            auto task = [this]() noexcept
+            {
+                readTask();
+            };
             
-            while (!m_eof)
+            if (m_readWorker == utils::TaskPool::kAnyWorker)
+            {
+                m_pool.push(task, m_readTasks);
+            }
+            else
+            {
+                m_pool.pushTo(m_readWorker, task, m_readTasks);
+            }
+        }
+        catch (const std::exception&)
+        {
+            //
+            // the pool is stopped, chunks will be read
+            // by the threads that call getChunk
+            //
+            std::lock_guard<std::mutex> lock(m_chunkMutex);
+            m_readScheduled = false;
+        }
+    }
+
+    void FileStreamChunkReader::readTask()
+    {
+        std::unique_lock<std::mutex> lock(m_chunkMutex);
+        m_readScheduled = false;
+        
+        if (!m_reading)
+        {
+            readChunks(lock, std::numeric_limits<size_t>::max());
+        }
+    }
+
+    void FileStreamChunkReader::readChunks(std::unique_lock<std::mutex>& lock, size_t maxChunks)
+    {
+        m_reading = true;
+        
+        try
+        {
+            for (size_t i = 0; i < maxChunks && !m_stopped && !m_eof && !m_free.empty(); ++i)
             {
-                lock.lock();
-                
                 //
-                // wait for free chunks
-                // and move it from the free list
+                // take a free chunk,
+                // the file is read only by one thread at once
                 //
-                m_freeCv.wait(lock, [this]()
-                {
-                    return !m_free.empty() || m_stopped;
-                });
-                
-                if (m_stopped)
-                {
-                    return;
-                }
-                
                 auto var = std::move(m_free.back());
                 m_free.pop_back();
                 
                 lock.unlock();
                 
                 //
-                // read file data to a pre-allocated buffer of a free chunk
+                // read file data to the buffer of a free chunk,
+                // the buffer is reused, so it is taken only once
                 //
-                var.offset = m_file.tellg();
-                m_file.read(var.buffer.data(), var.buffer.size());
-                var.buffer.resize(m_file.gcount());
+                if (!var.buffer.data)
+                {
+                    var.buffer = m_buffers->take(m_chunkSize);
+                }
+                
+                try
+                {
+                    var.offset = m_file.tellg();
+                    m_file.read(var.buffer.data, m_chunkSize);
+                    var.buffer.size = static_cast<uint32_t>(m_file.gcount());
+                }
+                catch (const std::exception&)
+                {
+                    //
+                    // the buffer is kept by the free chunk
+                    //
+                    lock.lock();
+                    m_free.push_back(std::move(var));
+                    throw;
+                }
                 
                 lock.lock();
                 
@@ -196,14 +428,14 @@ namespace file_sig
                 // move the chunk to the ready list
                 // and notify about ready data
                 //
-                if (var.buffer.empty())
+                if (0 == var.buffer.size)
                 {
                     m_eof = true;
+                    m_free.push_back(std::move(var));
                 }
                 else
                 {
                     m_ready.push_back(std::move(var));
-                    m_readyCv.notify_all();
                 }
                 
                 if (m_file.eof())
@@ -211,16 +443,23 @@ namespace file_sig
                     m_eof = true;
                 }
                 
-                lock.unlock();
                 m_readyCv.notify_all();
+                resumeParked();
             }
         }
         catch (const std::exception&)
         {
-            std::lock_guard<std::mutex> lock(m_chunkMutex);
+            if (!lock.owns_lock())
+            {
+                lock.lock();
+            }
+            
             m_exception = std::current_exception();
             m_stopped = true;
-            m_readyCv.notify_all();
         }
+        
+        m_reading = false;
+        m_readyCv.notify_all();
+        resumeParked();
     }
 }
@@ -9,9 +9,11 @@
 #pragma once
 
 #include "ChunkReader.hpp"
+#include "ChunkBufferPool.hpp"
+#include "TaskPool.hpp"
 
 #include <fstream>
-#include <future>
+#include <memory>
 #include <vector>
 #include <list>
 
@@ -19,22 +21,41 @@ namespace file_sig
 {
     //
     // It is an implementation of a file reader
-    // that reads the file in a separate thread
+    // that reads the file by tasks of a shared task pool
     // and uses caches for proactive reading
+    // If there is no ready chunk and nobody reads the file,
+    // the caller reads the next chunk itself instead of waiting for a queued task,
+    // so hasher tasks of the same pool never wait for a task that cannot be started.
+    // A task that calls getNextChunk with a continuation is parked
+    // instead of waiting for another thread, it is resumed when a chunk is read or freed
+    // Read tasks may be bound to one worker (e.g. the one near the storage),
+    // chunk buffers are not initialized and their pages are faulted by the reading thread,
+    // so their memory is placed on the node of this thread.
+    // Buffers are slots of a pool, it may be shared and outlive the reader,
+    // then they are allocated once per process instead of once per file
     //
     class FileStreamChunkReader : public ChunkReader
     {
     private:
         struct Chunk
         {
-            std::vector<char> buffer;
+            ChunkBufferPool::Buffer buffer;
             uint64_t offset = 0;
         };
 
     public:
+        //
+        // the buffer of the file stream, it is allocated besides the chunks
+        //
+        static const size_t kFileBufferSize = 1024 * 1024;
+        
         FileStreamChunkReader(const std::string& fileName,
+                              utils::TaskPool& pool,
                               uint32_t cachedChunksCount,
-                              uint32_t chunkSize);
+                              uint32_t chunkSize,
+                              size_t readWorker = utils::TaskPool::kAnyWorker,
+                              uint64_t startOffset = 0,
+                              ChunkBufferPool* buffers = nullptr);
         
         ~FileStreamChunkReader();
         
@@ -46,24 +67,61 @@ namespace file_sig
         
         void stop(bool sync);
         
+        uint32_t getChunkSize() const override;
+        uint64_t getStartOffset() const override;
+        
     private:        
         bool getChunk(const void *& data, uint32_t& size, uint64_t& offset) override;
-        void freeChunk(const void * data, uint32_t size) override;
-        void readerThread();
+        ReadResult tryGetChunk(const void *& data, uint32_t& size, uint64_t& offset, const Resume& resume) override;
+        void freeChunk(const void * data, uint32_t size, uint64_t offset) override;
+        void getCacheStats(uint32_t& readyChunks, uint32_t& freeChunks) const override;
+        uint32_t limitCache(uint32_t chunks) override;
+        
+        //
+        // ready, busy and free chunks, must be called under m_chunkMutex
+        //
+        size_t getChunksCount() const;
+        
+        //
+        // waits for a ready chunk or parks the caller if 'resume' is given
+        //
+        ReadResult takeChunk(const void *& data, uint32_t& size, uint64_t& offset, const Resume* resume);
+        
+        //
+        // continuations only push tasks to the pool,
+        // so they are called under m_chunkMutex wherever m_readyCv is notified
+        //
+        void resumeParked();
+        
+        //
+        // reads up to maxChunks to free chunks, must be called under m_chunkMutex
+        //
+        void readChunks(std::unique_lock<std::mutex>& lock, size_t maxChunks);
+        bool prepareReadTask();
+        void pushReadTask();
+        void readTask();
         
     private:
-        std::mutex m_chunkMutex;
+        mutable std::mutex m_chunkMutex;
         std::condition_variable m_readyCv;
-        std::condition_variable m_freeCv;
         std::exception_ptr m_exception;
         std::list<Chunk> m_ready; // chunks with ready to use data
         std::list<Chunk> m_busy;  // chunks that are used now (getChunk has been called, but not the freeChunk
-        std::list<Chunk> m_free;  // chunks that have been freed by calling freeChunk, they may be reused by the m_thread
+        std::list<Chunk> m_free;  // chunks that have been freed by calling freeChunk, they may be reused by a read task
+        std::vector<Resume> m_parked; // continuations of tasks that wait for a chunk
         bool m_stopped = false;
         bool m_eof = false;
+        bool m_reading = false;       // a thread reads the file now
+        bool m_readScheduled = false; // a read task is queued but has not been started
+        uint32_t m_maxChunks;         // chunks above it are freed, see limitCache
+        const uint32_t m_chunkSize;
+        const size_t m_readWorker;
+        const uint64_t m_startOffset;
+        std::unique_ptr<ChunkBufferPool> m_ownBuffers; // if no pool is given
+        ChunkBufferPool* const m_buffers;
         
-        std::mutex m_threadMutex;
-        std::future<void> m_thread;
+        utils::TaskPool& m_pool;
+        utils::TaskPool::Handle m_readTasks;
         std::ifstream m_file;
         std::vector<char> m_fileIo;
     };
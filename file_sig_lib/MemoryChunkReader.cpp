@@ -0,0 +1,67 @@
+//
+//  MemoryChunkReader.cpp
+//  file_signature
+//
+//  Created by artem k on 13.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#include "MemoryChunkReader.hpp"
+#include "Exceptions.hpp"
+
+#include <algorithm>
+
+namespace file_sig
+{
+    MemoryChunkReader::MemoryChunkReader(const void* data,
+                                         uint64_t size,
+                                         uint32_t chunkSize,
+                                         uint64_t startOffset)
+        : m_data(static_cast<const uint8_t*>(data))
+        , m_size(size)
+        , m_chunkSize(chunkSize)
+        , m_startOffset(startOffset)
+        , m_nextChunk(0)
+    {
+        THROW_IF(0 == chunkSize, "Chunk size must be positive");
+        THROW_IF(size && !data, "The buffer is null");
+        
+        if (m_size > m_startOffset)
+        {
+            m_chunksCount = (m_size - m_startOffset + m_chunkSize - 1) / m_chunkSize;
+        }
+    }
+
+    uint32_t MemoryChunkReader::getChunkSize() const
+    {
+        return m_chunkSize;
+    }
+
+    uint64_t MemoryChunkReader::getStartOffset() const
+    {
+        return m_startOffset;
+    }
+
+    bool MemoryChunkReader::getChunk(const void *& data, uint32_t& size, uint64_t& offset)
+    {
+        //
+        // the index only grows, so a chunk is never returned twice
+        // and the counter cannot overflow before the end of the buffer
+        //
+        const uint64_t chunk = m_nextChunk.fetch_add(1, std::memory_order_relaxed);
+        
+        if (chunk >= m_chunksCount)
+        {
+            return false;
+        }
+        
+        offset = m_startOffset + chunk * m_chunkSize;
+        size = static_cast<uint32_t>(std::min<uint64_t>(m_chunkSize, m_size - offset));
+        data = m_data + offset;
+        return true;
+    }
+
+    void MemoryChunkReader::freeChunk(const void * /*data*/, uint32_t /*size*/, uint64_t /*offset*/)
+    {
+    }
+}
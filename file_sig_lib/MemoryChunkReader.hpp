@@ -0,0 +1,56 @@
+//
+//  MemoryChunkReader.hpp
+//  file_signature
+//
+//  Created by artem k on 13.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#pragma once
+
+#include "ChunkReader.hpp"
+
+#include <atomic>
+
+namespace file_sig
+{
+    //
+    // It is a reader of a buffer that is already in memory,
+    // e.g. a data block of a service or a mapped file.
+    // Chunks point to the buffer, nothing is copied or allocated,
+    // so the buffer must outlive the reader and its chunks
+    //
+    class MemoryChunkReader : public ChunkReader
+    {
+    public:
+        MemoryChunkReader(const void* data,
+                          uint64_t size,
+                          uint32_t chunkSize,
+                          uint64_t startOffset = 0);
+        
+        MemoryChunkReader(const MemoryChunkReader&) = delete;
+        MemoryChunkReader& operator=(const MemoryChunkReader&) = delete;
+        
+        MemoryChunkReader(MemoryChunkReader&&) = delete;
+        MemoryChunkReader& operator=(MemoryChunkReader&&) = delete;
+        
+        uint32_t getChunkSize() const override;
+        uint64_t getStartOffset() const override;
+
+    private:
+        bool getChunk(const void *& data, uint32_t& size, uint64_t& offset) override;
+        void freeChunk(const void * data, uint32_t size, uint64_t offset) override;
+
+    private:
+        const uint8_t* const m_data;
+        const uint64_t m_size;
+        const uint32_t m_chunkSize;
+        const uint64_t m_startOffset;
+        uint64_t m_chunksCount = 0;
+        
+        //
+        // chunk index of the next chunk, it is taken by hasher threads without locks
+        //
+        std::atomic<uint64_t> m_nextChunk;
+    };
+}
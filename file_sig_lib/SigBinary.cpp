@@ -0,0 +1,261 @@
+//
+//  SigBinary.cpp
+//  file_signature
+//
+//  Created by artem k on 11.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#include "SigBinary.hpp"
+#include "SigFileReader.hpp"
+#include "SigWriter.hpp"
+#include "Hash.hpp"
+#include "Endian.hpp"
+#include "Exceptions.hpp"
+
+#include <algorithm>
+#include <vector>
+#include <string.h>
+
+namespace file_sig
+{
+    namespace
+    {
+        const char kMagic[SigBinHeader::kMagicSize] = {'F', 'S', 'I', 'G', 'B', 'I', 'N', '\0'};
+        const size_t kHasherSize = 16;
+        
+        //
+        // offset, size and reserved bytes before the digest of a record with its own size
+        //
+        const uint32_t kRecordPrefix = 16;
+        
+        //
+        // records are converted by batches, the writer queue keeps a few of them
+        //
+        const size_t kConvertBatch = 4096;
+    }
+
+    uint32_t SigBinHeader::getRecordSize() const
+    {
+        return chunkSize ? digestSize : kRecordPrefix + digestSize;
+    }
+
+    std::string SigBinHeader::serialize() const
+    {
+        THROW_IF(hasher.size() >= kHasherSize, "The hash name is too long: " << hasher);
+        
+        const size_t headerSize = (kFixedSize + fileName.size() + 7) / 8 * 8;
+        std::string data(headerSize, '\0');
+        auto out = reinterpret_cast<uint8_t*>(&data[0]);
+        
+        memcpy(out, kMagic, kMagicSize);
+        utils::store32(out + 8, kVersion);
+        utils::store32(out + 12, static_cast<uint32_t>(headerSize));
+        utils::store64(out + 16, fileSize);
+        utils::store32(out + 24, chunkSize);
+        utils::store32(out + 28, digestSize);
+        memcpy(out + 32, hasher.data(), hasher.size());
+        utils::store32(out + 48, static_cast<uint32_t>(fileName.size()));
+        memcpy(out + kFixedSize, fileName.data(), fileName.size());
+        
+        return data;
+    }
+
+    size_t SigBinHeader::parse(const void* data, size_t size)
+    {
+        THROW_IF(!isBinary(data, size) || size < kFixedSize, "Invalid header of the binary signature");
+        
+        auto in = static_cast<const uint8_t*>(data);
+        const uint32_t version = utils::load32(in + 8);
+        THROW_IF(version != kVersion, "Unsupported version of the binary signature: " << version);
+        
+        const uint32_t headerSize = utils::load32(in + 12);
+        const uint32_t nameSize = utils::load32(in + 48);
+        THROW_IF(headerSize > size || headerSize < kFixedSize + static_cast<uint64_t>(nameSize),
+                 "The header of the binary signature is truncated");
+        
+        fileSize = utils::load64(in + 16);
+        chunkSize = utils::load32(in + 24);
+        digestSize = utils::load32(in + 28);
+        
+        auto name = reinterpret_cast<const char*>(in + 32);
+        hasher.assign(name, std::find(name, name + kHasherSize, '\0'));
+        fileName.assign(reinterpret_cast<const char*>(in + kFixedSize), nameSize);
+        
+        return headerSize;
+    }
+
+    void SigBinHeader::encodeRecord(const SigPipeline::Record& record, uint8_t* out) const
+    {
+        if (chunkSize)
+        {
+            //
+            // the offset and the size are implicit
+            //
+            THROW_IF(record.offset % chunkSize != 0 || record.offset >= fileSize
+                     || record.size != std::min<uint64_t>(chunkSize, fileSize - record.offset),
+                     "The record at " << record.offset << " is out of the chunk grid");
+        }
+        else
+        {
+            utils::store64(out, record.offset);
+            utils::store32(out + 8, record.size);
+            utils::store32(out + 12, 0);
+            out += kRecordPrefix;
+        }
+        
+        THROW_IF(!utils::fromHex(record.hash, out, digestSize), "Invalid hash of the record at " << record.offset);
+    }
+
+    void SigBinHeader::decodeRecord(const uint8_t* data, uint64_t index, SigPipeline::Record& record) const
+    {
+        record.hash = utils::toHex(decodeChunk(data, index, record.offset, record.size), digestSize);
+    }
+
+    const uint8_t* SigBinHeader::decodeChunk(const uint8_t* data, uint64_t index, uint64_t& offset, uint32_t& size) const
+    {
+        if (chunkSize)
+        {
+            offset = index * chunkSize;
+            THROW_IF(offset >= fileSize, "The record " << index << " is beyond the end of the file");
+            size = static_cast<uint32_t>(std::min<uint64_t>(chunkSize, fileSize - offset));
+            return data;
+        }
+        
+        offset = utils::load64(data);
+        size = utils::load32(data + 8);
+        return data + kRecordPrefix;
+    }
+
+    bool SigBinHeader::isBinary(const void* data, size_t size)
+    {
+        return size >= kMagicSize && 0 == memcmp(data, kMagic, kMagicSize);
+    }
+
+    SigBinFile::SigBinFile(const std::string& path)
+        : m_file(path)
+    {
+        THROW_IF(!SigBinHeader::isBinary(m_file.data(), m_file.size()), path << " is not a binary signature");
+        
+        m_headerSize = m_header.parse(m_file.data(), static_cast<size_t>(std::min<uint64_t>(m_file.size(), SIZE_MAX)));
+        
+        const uint32_t recordSize = m_header.getRecordSize();
+        m_recordsCount = recordSize ? (m_file.size() - m_headerSize) / recordSize : 0;
+    }
+
+    const SigBinHeader& SigBinFile::getHeader() const
+    {
+        return m_header;
+    }
+
+    uint64_t SigBinFile::getHeaderSize() const
+    {
+        return m_headerSize;
+    }
+
+    uint64_t SigBinFile::getRecordsCount() const
+    {
+        return m_recordsCount;
+    }
+
+    const uint8_t* SigBinFile::getDigest(uint64_t index) const
+    {
+        return getRecordData(index) + (m_header.chunkSize ? 0 : kRecordPrefix);
+    }
+
+    void SigBinFile::getRecord(uint64_t index, Record& record) const
+    {
+        m_header.decodeRecord(getRecordData(index), index, record);
+    }
+
+    const uint8_t* SigBinFile::getChunk(uint64_t index, uint64_t& offset, uint32_t& size) const
+    {
+        return m_header.decodeChunk(getRecordData(index), index, offset, size);
+    }
+
+    const uint8_t* SigBinFile::getRecordData(uint64_t index) const
+    {
+        THROW_IF(index >= m_recordsCount, "The record " << index << " is out of the signature");
+        return m_file.data() + m_headerSize + index * m_header.getRecordSize();
+    }
+
+    void convertSignature(const std::string& inPath, const std::string& outPath, bool binary)
+    {
+        THROW_IF(inPath == outPath, "The signature cannot be converted to itself");
+        
+        SigBinHeader header;
+        SigPipeline::Record record;
+        
+        {
+            //
+            // the first pass checks if the chunks can be implicit
+            //
+            SigFileReader in(inPath);
+            header.fileName = in.getHeader().fileName;
+            header.fileSize = in.getHeader().fileSize;
+            header.hasher = in.getHeader().hasher;
+            
+            uint64_t index = 0;
+            bool grid = true;
+            
+            while (in.next(record))
+            {
+                if (0 == index)
+                {
+                    header.chunkSize = record.size;
+                    header.digestSize = static_cast<uint32_t>(record.hash.size() / 2);
+                }
+                
+                grid = grid
+                    && record.offset == index * header.chunkSize
+                    && record.offset < header.fileSize
+                    && record.size == std::min<uint64_t>(header.chunkSize, header.fileSize - record.offset);
+                ++index;
+            }
+            
+            if (!grid)
+            {
+                header.chunkSize = 0;
+            }
+        }
+        
+        SigFileReader in(inPath);
+        SigWriter out(outPath, 4 * kConvertBatch);
+        
+        if (binary)
+        {
+            out.setBinary(header);
+            out.write(header.serialize());
+        }
+        else
+        {
+            out.write(SigFileReader::formatHeader(in.getHeader()));
+        }
+        
+        std::vector<SigPipeline::Record> batch;
+        batch.reserve(kConvertBatch);
+        
+        for (;;)
+        {
+            const bool hasRecord = in.next(record);
+            
+            if (hasRecord)
+            {
+                batch.push_back(record);
+            }
+            
+            if (!batch.empty() && (!hasRecord || batch.size() == kConvertBatch))
+            {
+                out.push(SigPipeline::RecordBatch(batch.data(), batch.size()));
+                batch.clear();
+            }
+            
+            if (!hasRecord)
+            {
+                break;
+            }
+        }
+        
+        out.finish();
+    }
+}
@@ -0,0 +1,124 @@
+//
+//  SigBinary.hpp
+//  file_signature
+//
+//  Created by artem k on 11.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#pragma once
+
+#include "SigPipeline.hpp"
+#include "MappedFile.hpp"
+
+#include <string>
+
+namespace file_sig
+{
+    //
+    // Header of a binary signature, the numbers are little-endian:
+    //
+    //   offset  size
+    //   0       8     magic "FSIGBIN\0"
+    //   8       4     version
+    //   12      4     header size, the offset of the first record aligned to 8
+    //   16      8     file size
+    //   24      4     chunk size, 0 if the chunks have different sizes
+    //   28      4     digest size
+    //   32      16    hash name, zero padded
+    //   48      4     file name size
+    //   52            file name
+    //
+    // The records have a fixed width and run from the header to the end of the file:
+    //   * chunk size is set: a raw digest, record i is the chunk at i * chunk size
+    //   * chunk size is 0: 8 bytes offset, 4 bytes size, 4 reserved bytes and a raw digest
+    // The records count is taken from the file length, so the header is not rewritten
+    // when records are appended and an interrupted signature is read up to its last whole record
+    //
+    struct SigBinHeader
+    {
+        static const uint32_t kVersion = 1;
+        
+        std::string fileName;
+        uint64_t fileSize = 0;
+        std::string hasher;
+        uint32_t chunkSize = 0;
+        uint32_t digestSize = 0;
+        
+        uint32_t getRecordSize() const;
+        
+        std::string serialize() const;
+        
+        //
+        // returns the header size, throws if the header is invalid.
+        // 'size' must be at least kFixedSize and then the header size
+        //
+        size_t parse(const void* data, size_t size);
+        
+        //
+        // the record must be at its place in the chunk grid if the chunk size is set
+        //
+        void encodeRecord(const SigPipeline::Record& record, uint8_t* out) const;
+        void decodeRecord(const uint8_t* data, uint64_t index, SigPipeline::Record& record) const;
+        
+        //
+        // decodes the offset and the size of the record, returns its raw digest
+        //
+        const uint8_t* decodeChunk(const uint8_t* data, uint64_t index, uint64_t& offset, uint32_t& size) const;
+        
+        static bool isBinary(const void* data, size_t size);
+        
+        static const size_t kMagicSize = 8;
+        static const size_t kFixedSize = 52;
+    };
+
+    //
+    // Mapped binary signature, record i is reached in O(1)
+    // without parsing the records before it
+    //
+    class SigBinFile
+    {
+    public:
+        using Record = SigPipeline::Record;
+
+    public:
+        explicit SigBinFile(const std::string& path);
+        
+        SigBinFile(const SigBinFile&) = delete;
+        SigBinFile& operator=(const SigBinFile&) = delete;
+        
+        const SigBinHeader& getHeader() const;
+        uint64_t getHeaderSize() const;
+        uint64_t getRecordsCount() const;
+        
+        //
+        // the raw digest of the record, getHeader().digestSize bytes
+        //
+        const uint8_t* getDigest(uint64_t index) const;
+        
+        //
+        // the record with a hex hash, the same as in the text format
+        //
+        void getRecord(uint64_t index, Record& record) const;
+        
+        //
+        // the offset and the size of the record and its raw digest, nothing is converted to hex
+        //
+        const uint8_t* getChunk(uint64_t index, uint64_t& offset, uint32_t& size) const;
+
+    private:
+        const uint8_t* getRecordData(uint64_t index) const;
+
+    private:
+        utils::MappedFile m_file;
+        SigBinHeader m_header;
+        uint64_t m_headerSize = 0;
+        uint64_t m_recordsCount = 0;
+    };
+
+    //
+    // rewrites a text or binary signature in the other format,
+    // the records are written with fixed chunks if they are in a chunk grid
+    //
+    void convertSignature(const std::string& inPath, const std::string& outPath, bool binary);
+}
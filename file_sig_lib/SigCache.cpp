@@ -0,0 +1,330 @@
+//
+//  SigCache.cpp
+//  file_signature
+//
+//  Created by artem k on 16.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#include "SigCache.hpp"
+#include "FileLock.hpp"
+#include "Exceptions.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <tuple>
+#include <stdio.h>
+
+namespace file_sig
+{
+    namespace
+    {
+        //
+        // version 1 has been rewritten by every save, it has no removed entries
+        //
+        const char kMagic[] = "file_sig cache 2";
+        const char kMagicV1[] = "file_sig cache 1";
+        const uint32_t kVersion = 2;
+        
+        //
+        // a small journal is not compacted
+        //
+        const uint64_t kMinCompactedLines = 1024;
+    }
+
+    bool SigCache::Key::operator<(const Key& other) const
+    {
+        return std::tie(device, inode, chunkSize, hasher, binary)
+            < std::tie(other.device, other.inode, other.chunkSize, other.hasher, other.binary);
+    }
+
+    SigCache::SigCache(const std::string& path)
+        : m_path(path)
+    {
+        load();
+    }
+
+    void SigCache::load()
+    {
+        utils::FileIdentity file;
+        
+        //
+        // the identity is taken before the file is opened: if it is compacted meanwhile,
+        // the next load sees another identity and reads the whole file again
+        //
+        try
+        {
+            file = utils::FileIdentity::get(m_path);
+        }
+        catch (const std::exception&)
+        {
+            return;
+        }
+        
+        if (file.device != m_file.device || file.inode != m_file.inode || file.size < m_loadedSize)
+        {
+            m_entries.clear();
+            m_version = 0;
+            m_loadedSize = 0;
+            m_lines = 0;
+        }
+        
+        m_file = file;
+        
+        std::ifstream in(m_path, std::ios::binary);
+        
+        if (!in.is_open())
+        {
+            return;
+        }
+        
+        in.seekg(m_loadedSize);
+        std::string line;
+        
+        while (std::getline(in, line))
+        {
+            if (in.eof())
+            {
+                //
+                // the line end has not been written yet
+                //
+                break;
+            }
+            
+            m_loadedSize = static_cast<uint64_t>(in.tellg());
+            
+            if (!line.empty() && line.back() == '\r')
+            {
+                line.pop_back();
+            }
+            
+            if (0 == m_version)
+            {
+                THROW_IF(line != kMagic && line != kMagicV1, m_path << " is not a signature cache");
+                m_version = line == kMagic ? kVersion : 1;
+                continue;
+            }
+            
+            ++m_lines;
+            
+            //
+            // <device> <inode> <chunk size> <hash> <text|bin> <size> <mtime> <ctime> <sig size> <sig mtime> <sig path>,
+            // the path is the rest of the line, it may have spaces.
+            // "- <device> <inode> <chunk size> <hash> <text|bin>" removes the entry
+            //
+            const bool removed = line.compare(0, 2, "- ") == 0;
+            std::istringstream fields(removed ? line.substr(2) : line);
+            std::string format;
+            Key key;
+            Entry entry;
+            
+            fields >> key.device >> key.inode >> key.chunkSize >> key.hasher >> format;
+            
+            THROW_IF(!fields || (format != "text" && format != "bin"),
+                     "The cache " << m_path << " is corrupted at line " << m_lines + 1);
+            
+            key.binary = format == "bin";
+            
+            if (removed)
+            {
+                m_entries.erase(key);
+                continue;
+            }
+            
+            fields >> entry.size >> entry.mtimeNs >> entry.ctimeNs >> entry.sigSize >> entry.sigMtimeNs;
+            THROW_IF(!fields || fields.get() != ' ', "The cache " << m_path << " is corrupted at line " << m_lines + 1);
+            
+            std::getline(fields, entry.sigPath);
+            THROW_IF(entry.sigPath.empty(), "The cache " << m_path << " is corrupted at line " << m_lines + 1);
+            
+            m_entries[key] = entry;
+        }
+    }
+
+    SigCache::Key SigCache::makeKey(const utils::FileIdentity& file, uint32_t chunkSize, const std::string& hasher, bool binary)
+    {
+        Key key;
+        key.device = file.device;
+        key.inode = file.inode;
+        key.chunkSize = chunkSize;
+        key.hasher = hasher;
+        key.binary = binary;
+        return key;
+    }
+
+    SigCache::Lookup SigCache::find(const Key& key, const utils::FileIdentity& file, std::string& sigPath) const
+    {
+        const auto it = m_entries.find(key);
+        
+        if (it == m_entries.end())
+        {
+            return Lookup::notCached;
+        }
+        
+        const Entry& entry = it->second;
+        
+        if (entry.size != file.size || entry.mtimeNs != file.mtimeNs || entry.ctimeNs != file.ctimeNs)
+        {
+            return Lookup::fileChanged;
+        }
+        
+        try
+        {
+            const auto sig = utils::FileIdentity::get(entry.sigPath);
+            
+            if (sig.size != entry.sigSize || sig.mtimeNs != entry.sigMtimeNs)
+            {
+                return Lookup::signatureChanged;
+            }
+        }
+        catch (const std::exception&)
+        {
+            return Lookup::signatureChanged;
+        }
+        
+        sigPath = entry.sigPath;
+        return Lookup::hit;
+    }
+
+    void SigCache::add(const Key& key, const utils::FileIdentity& file, const std::string& sigPath)
+    {
+        const auto sig = utils::FileIdentity::get(sigPath);
+        
+        Entry entry;
+        entry.size = file.size;
+        entry.mtimeNs = file.mtimeNs;
+        entry.ctimeNs = file.ctimeNs;
+        entry.sigSize = sig.size;
+        entry.sigMtimeNs = sig.mtimeNs;
+        
+        //
+        // a relative path would be resolved against the working directory of a later run
+        //
+        entry.sigPath = utils::FileIdentity::getAbsolutePath(sigPath);
+        
+        m_entries[key] = entry;
+        m_added[key] = entry;
+        m_removed.erase(key);
+    }
+
+    void SigCache::remove(const Key& key)
+    {
+        m_entries.erase(key);
+        m_added.erase(key);
+        m_removed.insert(key);
+    }
+
+    void SigCache::save()
+    {
+        if (m_added.empty() && m_removed.empty())
+        {
+            return;
+        }
+        
+        //
+        // nobody appends or compacts while the lock is held,
+        // so the entries of other runs are merged and this run's changes are applied over them
+        //
+        utils::FileLock lock(m_path + ".lock");
+        load();
+        
+        std::string lines;
+        
+        for (const auto& key : m_removed)
+        {
+            m_entries.erase(key);
+            lines += "- " + formatKey(key) + "\r\n";
+        }
+        
+        for (const auto& it : m_added)
+        {
+            m_entries[it.first] = it.second;
+            lines += formatEntry(it.first, it.second);
+        }
+        
+        const uint64_t changes = m_added.size() + m_removed.size();
+        m_added.clear();
+        m_removed.clear();
+        
+        if (m_version != kVersion || m_lines + changes > 2 * m_entries.size() + kMinCompactedLines)
+        {
+            compact();
+        }
+        else
+        {
+            std::ofstream out(m_path, std::ios::binary | std::ios::app);
+            THROW_IF(!out.is_open(), "Cannot open " << m_path);
+            
+            out << lines;
+            out.close();
+            THROW_IF(!out, "Cannot write " << m_path);
+        }
+        
+        //
+        // the own lines are skipped by the next save
+        //
+        load();
+    }
+
+    void SigCache::compact() const
+    {
+        const std::string tmpPath = m_path + ".tmp";
+        
+        {
+            std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+            THROW_IF(!out.is_open(), "Cannot open " << tmpPath);
+            
+            out << kMagic << "\r\n";
+            
+            for (const auto& it : m_entries)
+            {
+                out << formatEntry(it.first, it.second);
+            }
+            
+            out.close();
+            THROW_IF(!out, "Cannot write " << tmpPath);
+        }
+
+#if defined(_WIN32)
+        //
+        // rename does not replace an existing file on Windows
+        //
+        ::remove(m_path.c_str());
+#endif
+        THROW_IF(::rename(tmpPath.c_str(), m_path.c_str()) != 0, "Cannot rename " << tmpPath);
+    }
+
+    std::string SigCache::formatKey(const Key& key)
+    {
+        std::ostringstream out;
+        out << key.device << ' ' << key.inode << ' ' << key.chunkSize << ' ' << key.hasher << ' '
+            << (key.binary ? "bin" : "text");
+        return out.str();
+    }
+
+    std::string SigCache::formatEntry(const Key& key, const Entry& entry)
+    {
+        std::ostringstream out;
+        out << formatKey(key) << ' '
+            << entry.size << ' ' << entry.mtimeNs << ' ' << entry.ctimeNs << ' '
+            << entry.sigSize << ' ' << entry.sigMtimeNs << ' ' << entry.sigPath << "\r\n";
+        return out.str();
+    }
+
+    const char* SigCache::toString(Lookup res)
+    {
+        switch (res)
+        {
+            case Lookup::hit:
+                return "hit";
+            case Lookup::notCached:
+                return "miss, the file is not cached";
+            case Lookup::fileChanged:
+                return "miss, the file has been changed";
+            case Lookup::signatureChanged:
+                return "miss, the cached signature has been changed";
+        }
+        
+        return "unknown";
+    }
+}
@@ -0,0 +1,127 @@
+//
+//  SigCache.hpp
+//  file_signature
+//
+//  Created by artem k on 16.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#pragma once
+
+#include "FileIdentity.hpp"
+
+#include <map>
+#include <set>
+#include <string>
+
+namespace file_sig
+{
+    //
+    // A sidecar database of signatures that have been made:
+    // (device, inode, chunk size, hash, format) -> the file version and its signature.
+    // A file with the same identity as at signing has not been changed,
+    // so its signature is reused without reading the file.
+    // It is a text journal: save appends the changed entries under a lock of <path>.lock,
+    // the later line of a key wins. The entries saved by concurrent runs are merged,
+    // the journal is compacted when most of its lines are superseded
+    //
+    class SigCache
+    {
+    public:
+        struct Key
+        {
+            uint64_t device = 0;
+            uint64_t inode = 0;
+            uint32_t chunkSize = 0;
+            std::string hasher;
+            bool binary = false;
+            
+            bool operator<(const Key& other) const;
+        };
+        
+        enum class Lookup
+        {
+            hit,
+            notCached,
+            fileChanged,        // the file has another size, mtime or ctime
+            signatureChanged    // the signature has been removed or rewritten
+        };
+
+    public:
+        //
+        // loads the cache if the file exists, throws if it is corrupted
+        //
+        explicit SigCache(const std::string& path);
+        
+        SigCache(const SigCache&) = delete;
+        SigCache& operator=(const SigCache&) = delete;
+        
+        static Key makeKey(const utils::FileIdentity& file, uint32_t chunkSize, const std::string& hasher, bool binary);
+        
+        //
+        // sigPath is set to the cached signature if it is a hit
+        //
+        Lookup find(const Key& key, const utils::FileIdentity& file, std::string& sigPath) const;
+        
+        //
+        // replaces the entry of the file, the signature must be complete,
+        // its absolute path is kept
+        //
+        void add(const Key& key, const utils::FileIdentity& file, const std::string& sigPath);
+        
+        void remove(const Key& key);
+        
+        //
+        // writes the entries added and removed since the cache has been loaded,
+        // the entries saved by other runs meanwhile are kept
+        //
+        void save();
+        
+        static const char* toString(Lookup res);
+
+    private:
+        struct Entry
+        {
+            uint64_t size = 0;
+            uint64_t mtimeNs = 0;
+            uint64_t ctimeNs = 0;
+            
+            //
+            // the signature is checked by its own size and times,
+            // it is not parsed
+            //
+            uint64_t sigSize = 0;
+            uint64_t sigMtimeNs = 0;
+            std::string sigPath;
+        };
+
+    private:
+        //
+        // reads the lines after the loaded ones, the whole file if it has been compacted,
+        // a line that is being appended by another run is left for the next load
+        //
+        void load();
+        void compact() const;
+        
+        static std::string formatKey(const Key& key);
+        static std::string formatEntry(const Key& key, const Entry& entry);
+
+    private:
+        const std::string m_path;
+        std::map<Key, Entry> m_entries;
+        
+        //
+        // the changes of this run, they are applied again over the entries of other runs by save
+        //
+        std::map<Key, Entry> m_added;
+        std::set<Key> m_removed;
+        
+        //
+        // the loaded part of the file: 0 version if the file does not exist
+        //
+        utils::FileIdentity m_file;
+        uint32_t m_version = 0;
+        uint64_t m_loadedSize = 0;
+        uint64_t m_lines = 0;
+    };
+}
@@ -0,0 +1,131 @@
+//
+//  SigCheckpoint.cpp
+//  file_signature
+//
+//  Created by artem k on 07.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#include "SigCheckpoint.hpp"
+#include "ScopedHandle.hpp"
+#include "Utils.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#if defined(_MSC_VER)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace file_sig
+{
+    namespace
+    {
+        bool readValue(std::istream& in, const std::string& key, std::string& value)
+        {
+            std::string line;
+            
+            if (!std::getline(in, line))
+            {
+                return false;
+            }
+            
+            if (!line.empty() && line.back() == '\r')
+            {
+                line.pop_back();
+            }
+            
+            const std::string prefix = key + ": ";
+            
+            if (line.compare(0, prefix.size(), prefix) != 0)
+            {
+                return false;
+            }
+            
+            value = line.substr(prefix.size());
+            return true;
+        }
+    }
+
+    bool SigCheckpoint::isSameSignature(const SigCheckpoint& other) const
+    {
+        return fileName == other.fileName
+            && fileSize == other.fileSize
+            && hasher == other.hasher
+            && chunkSize == other.chunkSize;
+    }
+
+    bool SigCheckpoint::load(const std::string& path)
+    {
+        std::ifstream in(path, std::ios::binary);
+        
+        if (!in.is_open())
+        {
+            return false;
+        }
+        
+        std::string fileSizeStr;
+        std::string chunkSizeStr;
+        std::string offsetStr;
+        std::string lengthStr;
+        
+        const bool parsed = readValue(in, "Filename", fileName)
+            && readValue(in, "Filesize", fileSizeStr)
+            && readValue(in, "Hash", hasher)
+            && readValue(in, "Chunksize", chunkSizeStr)
+            && readValue(in, "Offset", offsetStr)
+            && readValue(in, "Length", lengthStr);
+        
+        THROW_IF(!parsed, "The checkpoint " << path << " is corrupted");
+        
+        fileSize = utils::toUnsigned<uint64_t>(fileSizeStr);
+        chunkSize = utils::toUnsigned<uint32_t>(chunkSizeStr);
+        offset = utils::toUnsigned<uint64_t>(offsetStr);
+        length = utils::toUnsigned<uint64_t>(lengthStr);
+        
+        THROW_IF(0 == chunkSize || offset % chunkSize != 0, "The checkpoint " << path << " is corrupted");
+        return true;
+    }
+
+    void SigCheckpoint::save(const std::string& path) const
+    {
+        std::stringstream text;
+        text << "Filename: " << fileName << "\r\n";
+        text << "Filesize: " << fileSize << "\r\n";
+        text << "Hash: " << hasher << "\r\n";
+        text << "Chunksize: " << chunkSize << "\r\n";
+        text << "Offset: " << offset << "\r\n";
+        text << "Length: " << length << "\r\n";
+        
+        const std::string data = text.str();
+        const std::string tmpPath = path + ".tmp";
+        
+        {
+            utils::ScopedHandle<int, decltype(::close), ::close, -1> file;
+            file.reset(::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644));
+            THROW_ERRNO_IF(file.get() < 0, "Cannot open " << tmpPath);
+            
+            const auto res = ::write(file, data.data(), static_cast<unsigned int>(data.size()));
+            THROW_ERRNO_IF(res < 0 || static_cast<size_t>(res) != data.size(), "Cannot write " << tmpPath);
+
+#if defined(_MSC_VER)
+            THROW_ERRNO_IF(_commit(file) != 0, "Cannot flush " << tmpPath);
+#else
+            THROW_ERRNO_IF(fsync(file) != 0, "Cannot flush " << tmpPath);
+#endif
+        }
+
+#if defined(_WIN32)
+        //
+        // rename does not replace an existing file on Windows
+        //
+        ::remove(path.c_str());
+#endif
+        THROW_ERRNO_IF(::rename(tmpPath.c_str(), path.c_str()) != 0, "Cannot rename " << tmpPath);
+    }
+}
@@ -0,0 +1,48 @@
+//
+//  SigCheckpoint.hpp
+//  file_signature
+//
+//  Created by artem k on 07.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#pragma once
+
+#include <string>
+#include <stdint.h>
+
+namespace file_sig
+{
+    //
+    // Progress of a signature file that is durable on the disk
+    // The signature file keeps the records of all the chunks before 'offset'
+    // in its first 'length' bytes, the rest of the file may be garbage
+    // of an interrupted run and it is cut off by a resumed run
+    //
+    struct SigCheckpoint
+    {
+        std::string fileName;
+        uint64_t fileSize = 0;
+        std::string hasher;
+        uint32_t chunkSize = 0;
+        
+        uint64_t offset = 0; // offset of the first chunk that is not in the signature
+        uint64_t length = 0; // size of the signature that holds the records before 'offset'
+        
+        //
+        // true if both checkpoints describe a signature of the same file with the same parameters
+        //
+        bool isSameSignature(const SigCheckpoint& other) const;
+        
+        //
+        // returns false if there is no checkpoint file,
+        // throws if the file is corrupted
+        //
+        bool load(const std::string& path);
+        
+        //
+        // the file is replaced atomically, so a crash keeps either the old or the new checkpoint
+        //
+        void save(const std::string& path) const;
+    };
+}
@@ -0,0 +1,534 @@
+//
+//  SigDelta.cpp
+//  file_signature
+//
+//  Created by artem k on 10.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#include "SigDelta.hpp"
+#include "Hash.hpp"
+#include "Utils.hpp"
+#include "PageMemory.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <string.h>
+#include <stdlib.h>
+
+namespace file_sig
+{
+    namespace
+    {
+        //
+        // more segments than threads balance the tasks
+        // if some segments have more candidates than others
+        //
+        const size_t kSegmentsPerThread = 4;
+        const size_t kReadSize = 8 * 1024 * 1024;
+        
+        //
+        // the filter is indexed by the high 20 bits of CRC,
+        // it takes 128KB and is checked for every byte, so it fits the L2 cache
+        //
+        const uint32_t kFilterShift = 12;
+        const size_t kFilterWords = (1u << (32 - kFilterShift)) / 64;
+        
+        bool parseCrc(const std::string& hash, uint32_t& crc)
+        {
+            if (hash.size() != 8)
+            {
+                return false;
+            }
+            
+            char* end = nullptr;
+            crc = static_cast<uint32_t>(strtoul(hash.c_str(), &end, 16));
+            return end == hash.c_str() + hash.size();
+        }
+    }
+
+    //
+    // Sequential reader of a segment of the new file
+    // A range out of the buffer is read again, most of the requests
+    // continue the previous ones, the tail of the buffer is kept for them
+    // The buffer is not initialized, only m_size bytes of it are valid
+    //
+    class SigDelta::SegmentReader
+    {
+    public:
+        SegmentReader(const std::string& path, uint64_t fileSize, size_t capacity)
+            : m_path(path)
+            , m_fileSize(fileSize)
+            , m_buffer(capacity)
+            , m_capacity(capacity)
+        {
+            m_file.open(path, std::ios::binary);
+            THROW_IF(!m_file.is_open(), "Cannot open " << path);
+        }
+        
+        uint64_t getFileSize() const
+        {
+            return m_fileSize;
+        }
+        
+        const uint8_t* get(uint64_t offset, size_t size)
+        {
+            if (offset >= m_offset && offset + size <= m_offset + m_size)
+            {
+                return m_buffer.data() + (offset - m_offset);
+            }
+            
+            size_t kept = 0;
+            
+            if (offset >= m_offset && offset < m_offset + m_size)
+            {
+                kept = static_cast<size_t>(m_offset + m_size - offset);
+                memmove(m_buffer.data(), m_buffer.data() + (offset - m_offset), kept);
+            }
+            
+            THROW_IF(size > m_capacity || offset + size > m_fileSize,
+                     "Invalid read of " << m_path << " at " << offset);
+            
+            const uint64_t readOffset = offset + kept;
+            const size_t readSize = static_cast<size_t>(std::min<uint64_t>(m_capacity - kept, m_fileSize - readOffset));
+            
+            m_file.clear();
+            m_file.seekg(static_cast<std::streamoff>(readOffset));
+            m_file.read(reinterpret_cast<char*>(m_buffer.data() + kept), static_cast<std::streamsize>(readSize));
+            THROW_IF(static_cast<size_t>(m_file.gcount()) != readSize, "Cannot read " << m_path << " at " << readOffset);
+            
+            m_offset = offset;
+            m_size = kept + readSize;
+            return m_buffer.data();
+        }
+
+    private:
+        const std::string m_path;
+        const uint64_t m_fileSize;
+        std::ifstream m_file;
+        utils::PageMemory m_buffer;
+        const size_t m_capacity;
+        uint64_t m_offset = 0;
+        size_t m_size = 0;
+    };
+
+    SigDelta::SigDelta(const std::string& sigPath, SigPipeline::Hasher hasher)
+        : m_hasher(hasher)
+    {
+        SigFileReader reader(sigPath);
+        m_header = reader.getHeader();
+        m_rolling = m_header.hasher == "crc32";
+        
+        if (m_rolling)
+        {
+            m_crcFilter.resize(kFilterWords, 0);
+        }
+        
+        SigFileReader::Record record;
+        
+        while (reader.next(record))
+        {
+            if (0 == m_chunks)
+            {
+                m_chunkSize = record.size;
+            }
+
+            //
+            // offsets of the old chunks are not kept, they are taken from the chunk grid
+            //
+            THROW_IF(0 == m_chunkSize
+                     || m_tailSize
+                     || record.offset != m_chunks * m_chunkSize
+                     || record.size > m_chunkSize,
+                     sigPath << " does not have chunks of the same size at record " << m_chunks);
+            
+            if (record.size < m_chunkSize)
+            {
+                m_tailSize = record.size;
+            }
+            
+            if (m_rolling)
+            {
+                uint32_t crc = 0;
+                THROW_IF(!parseCrc(record.hash, crc), "Invalid crc32 in " << sigPath << " at record " << m_chunks);
+                m_crcs.push_back(crc);
+                
+                if (!m_tailSize)
+                {
+                    m_crcFilter[(crc >> kFilterShift) / 64] |= 1ull << ((crc >> kFilterShift) % 64);
+                    m_crcChunks.emplace(crc, m_chunks);
+                }
+            }
+            else if (m_tailSize)
+            {
+                m_tailHash = record.hash;
+            }
+            else
+            {
+                //
+                // the first of the same chunks is kept
+                //
+                m_hashChunks.emplace(record.hash, m_chunks);
+            }
+            
+            ++m_chunks;
+        }
+    }
+
+    const SigFileReader::Header& SigDelta::getHeader() const
+    {
+        return m_header;
+    }
+
+    uint32_t SigDelta::getChunkSize() const
+    {
+        return m_chunkSize;
+    }
+
+    std::vector<SigDelta::Instruction> SigDelta::compute(const std::string& filePath, utils::TaskPool& pool) const
+    {
+        const uint64_t fileSize = utils::getFileSize(filePath);
+        const size_t capacity = kReadSize + m_chunkSize + 1;
+        std::vector<Match> matches;
+        
+        if (0 == m_chunks || 0 == fileSize)
+        {
+            return makeInstructions(matches, fileSize);
+        }
+
+        //
+        // segments are aligned to chunks for the grid scan
+        //
+        const uint64_t segmentsCount = std::max<uint64_t>(pool.getThreadsCount() * kSegmentsPerThread, 1);
+        uint64_t segmentSize = (fileSize + segmentsCount - 1) / segmentsCount;
+        segmentSize = (segmentSize + m_chunkSize - 1) / m_chunkSize * m_chunkSize;
+        
+        const size_t count = static_cast<size_t>((fileSize + segmentSize - 1) / segmentSize);
+        std::vector<std::vector<Match>> segments(count);
+        std::vector<std::exception_ptr> errors(count);
+        
+        //
+        // the tables of the rolling CRC are made once and copied to the tasks
+        //
+        std::unique_ptr<utils::RollingCrc32> rolling;
+        
+        if (m_rolling)
+        {
+            rolling.reset(new utils::RollingCrc32(m_chunkSize));
+        }
+        
+        std::vector<utils::TaskPool::Task> tasks;
+        
+        for (size_t i = 0; i < count; ++i)
+        {
+            tasks.push_back([&, i]() noexcept
+            {
+                try
+                {
+                    SegmentReader reader(filePath, fileSize, capacity);
+                    const uint64_t begin = i * segmentSize;
+                    const uint64_t end = std::min(begin + segmentSize, fileSize);
+                    
+                    if (m_rolling)
+                    {
+                        scanRolling(reader, *rolling, begin, end, segments[i]);
+                    }
+                    else
+                    {
+                        scanGrid(reader, begin, end, segments[i]);
+                    }
+                }
+                catch (const std::exception&)
+                {
+                    errors[i] = std::current_exception();
+                }
+            });
+        }
+        
+        pool.push(std::move(tasks)).wait();
+        
+        for (const auto& error : errors)
+        {
+            if (error)
+            {
+                std::rethrow_exception(error);
+            }
+        }
+
+        //
+        // a match may cross the end of its segment,
+        // the matches of the next segment it overlaps are dropped
+        //
+        for (const auto& segment : segments)
+        {
+            for (const auto& match : segment)
+            {
+                if (matches.empty() || match.offset >= matches.back().offset + m_chunkSize)
+                {
+                    matches.push_back(match);
+                }
+            }
+        }
+        
+        SegmentReader reader(filePath, fileSize, capacity);
+        addTail(reader, matches);
+        
+        return makeInstructions(matches, fileSize);
+    }
+
+    void SigDelta::scanRolling(SegmentReader& reader,
+                               utils::RollingCrc32 rolling,
+                               uint64_t begin,
+                               uint64_t end,
+                               std::vector<Match>& matches) const
+    {
+        const uint64_t fileSize = reader.getFileSize();
+        
+        if (fileSize < m_chunkSize)
+        {
+            return;
+        }
+
+        //
+        // windows of the segment may end in the next one
+        //
+        end = std::min(end, fileSize - m_chunkSize + 1);
+        
+        Match previous;
+        bool hasPrevious = false;
+        uint64_t offset = begin;
+        
+        while (offset < end)
+        {
+            uint32_t crc = rolling.reset(reader.get(offset, m_chunkSize));
+            
+            for (;;)
+            {
+                if (isCandidate(crc))
+                {
+                    const uint64_t chunk = confirm(reader, offset, crc, hasPrevious ? &previous : nullptr);
+                    
+                    if (chunk != kNoChunk)
+                    {
+                        previous.offset = offset;
+                        previous.chunk = chunk;
+                        hasPrevious = true;
+                        matches.push_back(previous);
+                        
+                        //
+                        // the rest of the windows overlap the match,
+                        // the CRC is calculated again after it
+                        //
+                        offset += m_chunkSize;
+                        break;
+                    }
+                }
+                
+                if (offset + 1 >= end)
+                {
+                    offset = end;
+                    break;
+                }
+
+                //
+                // the window is moved inside the buffer until the next candidate
+                //
+                const size_t steps = static_cast<size_t>(std::min<uint64_t>(end - offset - 1, kReadSize));
+                const uint8_t* data = reader.get(offset, m_chunkSize + steps);
+                size_t i = 0;
+                
+                do
+                {
+                    crc = rolling.roll(data[i], data[i + m_chunkSize]);
+                    ++i;
+                }
+                while (i < steps && !isCandidate(crc));
+                
+                offset += i;
+            }
+        }
+    }
+
+    void SigDelta::scanGrid(SegmentReader& reader, uint64_t begin, uint64_t end, std::vector<Match>& matches) const
+    {
+        const uint64_t fileSize = reader.getFileSize();
+        
+        for (uint64_t offset = begin; offset < end && offset + m_chunkSize <= fileSize; offset += m_chunkSize)
+        {
+            const auto it = m_hashChunks.find(m_hasher(reader.get(offset, m_chunkSize), m_chunkSize));
+            
+            if (it != m_hashChunks.end())
+            {
+                Match match;
+                match.offset = offset;
+                match.chunk = it->second;
+                matches.push_back(match);
+            }
+        }
+    }
+
+    uint64_t SigDelta::confirm(SegmentReader& reader, uint64_t offset, uint32_t crc, const Match* previous) const
+    {
+        //
+        // the match continues the previous one in the old file
+        //
+        if (previous
+            && previous->offset + m_chunkSize == offset
+            && previous->chunk + 1 < m_chunks
+            && getSize(previous->chunk + 1) == m_chunkSize
+            && m_crcs[previous->chunk + 1] == crc)
+        {
+            return previous->chunk + 1;
+        }
+        
+        const auto range = m_crcChunks.equal_range(crc);
+        const uint64_t fileSize = reader.getFileSize();
+        
+        //
+        // CRCs of the neighbour windows are calculated once for all the candidates,
+        // e.g. a file has many zero chunks
+        //
+        bool hasNext = false;
+        uint32_t nextCrc = 0;
+        uint32_t nextSize = 0;
+        bool hasPrev = false;
+        uint32_t prevCrc = 0;
+        
+        for (auto it = range.first; it != range.second; ++it)
+        {
+            const uint64_t chunk = it->second;
+            
+            if (chunk + 1 < m_chunks && offset + m_chunkSize + getSize(chunk + 1) <= fileSize)
+            {
+                const uint32_t size = getSize(chunk + 1);
+                
+                if (!hasNext || nextSize != size)
+                {
+                    nextCrc = utils::crc32Value(reader.get(offset + m_chunkSize, size), size);
+                    nextSize = size;
+                    hasNext = true;
+                }
+                
+                if (nextCrc == m_crcs[chunk + 1])
+                {
+                    return chunk;
+                }
+            }
+            
+            if (chunk > 0 && offset >= m_chunkSize)
+            {
+                if (!hasPrev)
+                {
+                    prevCrc = utils::crc32Value(reader.get(offset - m_chunkSize, m_chunkSize), m_chunkSize);
+                    hasPrev = true;
+                }
+                
+                if (prevCrc == m_crcs[chunk - 1])
+                {
+                    return chunk;
+                }
+            }
+        }
+        
+        return kNoChunk;
+    }
+
+    void SigDelta::addTail(SegmentReader& reader, std::vector<Match>& matches) const
+    {
+        const uint64_t fileSize = reader.getFileSize();
+        
+        if (!m_tailSize || fileSize < m_tailSize)
+        {
+            return;
+        }
+        
+        const uint64_t offset = fileSize - m_tailSize;
+        
+        if (!matches.empty() && matches.back().offset + m_chunkSize > offset)
+        {
+            return;
+        }
+
+        //
+        // only one offset is checked, so CRC is enough to confirm it
+        //
+        const uint8_t* data = reader.get(offset, m_tailSize);
+        const bool matched = m_rolling
+            ? utils::crc32Value(data, m_tailSize) == m_crcs.back()
+            : m_hasher(data, m_tailSize) == m_tailHash;
+        
+        if (matched)
+        {
+            Match match;
+            match.offset = offset;
+            match.chunk = m_chunks - 1;
+            matches.push_back(match);
+        }
+    }
+
+    std::vector<SigDelta::Instruction> SigDelta::makeInstructions(const std::vector<Match>& matches, uint64_t fileSize) const
+    {
+        std::vector<Instruction> instructions;
+        uint64_t offset = 0;
+        
+        for (const auto& match : matches)
+        {
+            if (match.offset > offset)
+            {
+                Instruction literal;
+                literal.offset = offset;
+                literal.size = match.offset - offset;
+                instructions.push_back(literal);
+            }
+            
+            const uint64_t oldOffset = match.chunk * m_chunkSize;
+            const uint32_t size = getSize(match.chunk);
+            
+            auto* last = instructions.empty() ? nullptr : &instructions.back();
+            
+            if (last
+                && Instruction::Type::copy == last->type
+                && last->offset + last->size == match.offset
+                && last->oldOffset + last->size == oldOffset)
+            {
+                //
+                // contiguous chunks of the old file are copied at once
+                //
+                last->size += size;
+            }
+            else
+            {
+                Instruction copy;
+                copy.type = Instruction::Type::copy;
+                copy.offset = match.offset;
+                copy.size = size;
+                copy.oldOffset = oldOffset;
+                instructions.push_back(copy);
+            }
+            
+            offset = match.offset + size;
+        }
+        
+        if (offset < fileSize)
+        {
+            Instruction literal;
+            literal.offset = offset;
+            literal.size = fileSize - offset;
+            instructions.push_back(literal);
+        }
+        
+        return instructions;
+    }
+
+    bool SigDelta::isCandidate(uint32_t crc) const
+    {
+        const uint32_t bit = crc >> kFilterShift;
+        return 0 != (m_crcFilter[bit / 64] & (1ull << (bit % 64)));
+    }
+
+    uint32_t SigDelta::getSize(uint64_t chunk) const
+    {
+        return chunk + 1 == m_chunks && m_tailSize ? m_tailSize : m_chunkSize;
+    }
+}
@@ -0,0 +1,141 @@
+//
+//  SigDelta.hpp
+//  file_signature
+//
+//  Created by artem k on 10.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#pragma once
+
+#include "SigFileReader.hpp"
+#include "TaskPool.hpp"
+#include "RollingCrc32.hpp"
+
+#include <unordered_map>
+#include <vector>
+
+namespace file_sig
+{
+    //
+    // rsync-style delta of a new version of a file
+    // against the signature of its old version:
+    //   * the chunk hashes of the signature are loaded to a hash table
+    //   * the new file is split to segments that are scanned by pool tasks,
+    //     a rolling CRC32 is moved over a segment byte by byte,
+    //     so the old chunks are found at any offset (e.g. after an insertion)
+    //   * the found chunks become copy instructions,
+    //     the rest of the new file becomes literal ones
+    //
+    // A crc32 signature has no strong hash, a candidate is confirmed
+    // only if the next or the previous chunk of the old file is found next to it.
+    // A sha2 signature has no weak hash, so chunks are looked for only
+    // at the offsets of the chunk grid and are confirmed by sha2 itself
+    //
+    class SigDelta
+    {
+    public:
+        struct Instruction
+        {
+            enum class Type
+            {
+                copy,
+                literal
+            };
+            
+            Type type = Type::literal;
+            
+            //
+            // the range of the new file
+            //
+            uint64_t offset = 0;
+            uint64_t size = 0;
+            
+            //
+            // the offset of the copied data in the old file
+            //
+            uint64_t oldOffset = 0;
+        };
+
+    public:
+        //
+        // hasher is the hash of the signature, it confirms candidates
+        // of a strong signature (sha2)
+        //
+        SigDelta(const std::string& sigPath, SigPipeline::Hasher hasher);
+        
+        SigDelta(const SigDelta&) = delete;
+        SigDelta& operator=(const SigDelta&) = delete;
+        
+        const SigFileReader::Header& getHeader() const;
+        uint32_t getChunkSize() const;
+        
+        //
+        // scans the new file by the pool tasks and returns the instructions
+        // that make it from the old one, they cover the whole new file in order.
+        // Must not be called from a task of the same pool
+        //
+        std::vector<Instruction> compute(const std::string& filePath, utils::TaskPool& pool) const;
+
+    private:
+        struct Match
+        {
+            uint64_t offset = 0;
+            uint64_t chunk = 0;
+        };
+        
+        class SegmentReader;
+        
+        void scanRolling(SegmentReader& reader,
+                         utils::RollingCrc32 rolling,
+                         uint64_t begin,
+                         uint64_t end,
+                         std::vector<Match>& matches) const;
+        
+        void scanGrid(SegmentReader& reader, uint64_t begin, uint64_t end, std::vector<Match>& matches) const;
+        
+        //
+        // returns the old chunk the candidate is confirmed as, or kNoChunk
+        //
+        uint64_t confirm(SegmentReader& reader, uint64_t offset, uint32_t crc, const Match* previous) const;
+        
+        //
+        // the partial last chunk of the old file is looked for
+        // only at the end of the new file
+        //
+        void addTail(SegmentReader& reader, std::vector<Match>& matches) const;
+        
+        std::vector<Instruction> makeInstructions(const std::vector<Match>& matches, uint64_t fileSize) const;
+        bool isCandidate(uint32_t crc) const;
+        uint32_t getSize(uint64_t chunk) const;
+
+    private:
+        static const uint64_t kNoChunk = static_cast<uint64_t>(-1);
+        
+        SigFileReader::Header m_header;
+        SigPipeline::Hasher m_hasher;
+        bool m_rolling = false;
+        uint32_t m_chunkSize = 0;
+        uint64_t m_chunks = 0;
+        
+        //
+        // the size of the last chunk of the old file, 0 if it is not partial
+        //
+        uint32_t m_tailSize = 0;
+        
+        //
+        // crc32 signature: the chunk CRCs by chunk index
+        // and a bit filter that rejects most of the rolling CRCs
+        // before the lookup in the hash table
+        //
+        std::vector<uint32_t> m_crcs;
+        std::vector<uint64_t> m_crcFilter;
+        std::unordered_multimap<uint32_t, uint64_t> m_crcChunks;
+        
+        //
+        // strong signature: the first chunk of every hash
+        //
+        std::unordered_map<std::string, uint64_t> m_hashChunks;
+        std::string m_tailHash;
+    };
+}
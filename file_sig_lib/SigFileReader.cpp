@@ -0,0 +1,245 @@
+//
+//  SigFileReader.cpp
+//  file_signature
+//
+//  Created by artem k on 08.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#include "SigFileReader.hpp"
+#include "Utils.hpp"
+#include "Hash.hpp"
+
+#include <limits>
+#include <sstream>
+#include <stdlib.h>
+
+namespace file_sig
+{
+    namespace
+    {
+        const char kFileName[] = "Filename: ";
+        const char kFileSize[] = "Filesize: ";
+        const char kHash[] = "Hash: ";
+        
+        bool getValue(const std::string& line, const char* key, std::string& value)
+        {
+            const std::string prefix(key);
+            
+            if (line.compare(0, prefix.size(), prefix) != 0)
+            {
+                return false;
+            }
+            
+            value = line.substr(prefix.size());
+            return true;
+        }
+
+        //
+        // parses "0x<hex>" up to the delimiter, the pointer is moved after it
+        //
+        bool parseHex(const char*& str, char delimiter, uint64_t& value)
+        {
+            if (str[0] != '0' || str[1] != 'x')
+            {
+                return false;
+            }
+            
+            char* end = nullptr;
+            value = strtoull(str + 2, &end, 16);
+            
+            if (end == str + 2 || *end != delimiter)
+            {
+                return false;
+            }
+            
+            str = end + 1;
+            return true;
+        }
+    }
+
+    SigFileReader::SigFileReader(const std::string& path)
+        : m_path(path)
+    {
+        m_file.open(path, std::ios::binary);
+        THROW_IF(!m_file.is_open(), "Cannot open " << path);
+        
+        char magic[SigBinHeader::kMagicSize] = {};
+        m_file.read(magic, sizeof(magic));
+        
+        if (SigBinHeader::isBinary(magic, static_cast<size_t>(m_file.gcount())))
+        {
+            m_file.close();
+            m_binary.reset(new SigBinFile(path));
+            
+            const auto& header = m_binary->getHeader();
+            m_header.fileName = header.fileName;
+            m_header.fileSize = header.fileSize;
+            m_header.hasher = header.hasher;
+            m_header.binary = true;
+            m_parsedSize = m_binary->getHeaderSize();
+            return;
+        }
+        
+        m_file.clear();
+        m_file.seekg(0);
+        
+        bool hasName = false;
+        bool hasSize = false;
+        bool hasHash = false;
+        std::string value;
+        
+        while (!(hasName && hasSize && hasHash))
+        {
+            THROW_IF(!readLine(), "The header of " << path << " is invalid");
+            
+            if (getValue(m_line, kFileName, m_header.fileName))
+            {
+                hasName = true;
+            }
+            else if (getValue(m_line, kFileSize, value))
+            {
+                m_header.fileSize = utils::toUnsigned<uint64_t>(value);
+                hasSize = true;
+            }
+            else if (getValue(m_line, kHash, m_header.hasher))
+            {
+                hasHash = true;
+            }
+            else
+            {
+                THROW("The header of " << path << " is invalid at line " << m_lineNumber);
+            }
+        }
+    }
+
+    const SigFileReader::Header& SigFileReader::getHeader() const
+    {
+        return m_header;
+    }
+
+    bool SigFileReader::next(Record& record)
+    {
+        if (m_binary)
+        {
+            if (m_binaryRecord == m_binary->getRecordsCount())
+            {
+                return false;
+            }
+            
+            m_binary->getRecord(m_binaryRecord++, record);
+            m_parsedSize += m_binary->getHeader().getRecordSize();
+            return true;
+        }
+        
+        const char* hash = parseLine(record.offset, record.size);
+        
+        if (!hash)
+        {
+            return false;
+        }
+        
+        record.hash.assign(hash);
+        return true;
+    }
+
+    bool SigFileReader::nextRaw(RawRecord& record)
+    {
+        if (m_binary)
+        {
+            if (m_binaryRecord == m_binary->getRecordsCount())
+            {
+                return false;
+            }
+            
+            record.digest = m_binary->getChunk(m_binaryRecord++, record.offset, record.size);
+            record.digestSize = m_binary->getHeader().digestSize;
+            m_parsedSize += m_binary->getHeader().getRecordSize();
+            return true;
+        }
+        
+        const uint64_t parsedSize = m_parsedSize;
+        const char* hash = parseLine(record.offset, record.size);
+        
+        if (!hash)
+        {
+            return false;
+        }
+        
+        const size_t length = m_line.c_str() + m_line.size() - hash;
+        m_digest.resize(length / 2);
+        
+        if (!utils::fromHex(hash, length, m_digest.data(), m_digest.size()))
+        {
+            m_parsedSize = parsedSize;
+            THROW("Invalid hash in " << m_path << " at line " << m_lineNumber);
+        }
+        
+        record.digest = m_digest.data();
+        record.digestSize = static_cast<uint32_t>(m_digest.size());
+        return true;
+    }
+
+    uint64_t SigFileReader::getParsedSize() const
+    {
+        return m_parsedSize;
+    }
+
+    std::string SigFileReader::formatHeader(const Header& header)
+    {
+        std::stringstream text;
+        text << kFileName << header.fileName << "\r\n";
+        text << kFileSize << header.fileSize << "\r\n";
+        text << kHash << header.hasher << "\r\n";
+        return text.str();
+    }
+
+    bool SigFileReader::readLine()
+    {
+        //
+        // the last line is not terminated if the writer has been interrupted,
+        // it may be truncated, so it is ignored
+        //
+        if (!std::getline(m_file, m_line) || m_file.eof())
+        {
+            return false;
+        }
+        
+        m_parsedSize += m_line.size() + 1;
+        ++m_lineNumber;
+        
+        if (!m_line.empty() && m_line.back() == '\r')
+        {
+            m_line.pop_back();
+        }
+        
+        return true;
+    }
+
+    const char* SigFileReader::parseLine(uint64_t& offset, uint32_t& size)
+    {
+        const uint64_t parsedSize = m_parsedSize;
+        
+        if (!readLine())
+        {
+            return nullptr;
+        }
+        
+        const char* str = m_line.c_str();
+        uint64_t value = 0;
+        
+        const bool parsed = parseHex(str, ':', offset)
+            && parseHex(str, ':', value)
+            && value <= std::numeric_limits<uint32_t>::max()
+            && *str;
+        
+        if (!parsed)
+        {
+            m_parsedSize = parsedSize;
+            THROW("Invalid record in " << m_path << " at line " << m_lineNumber);
+        }
+        
+        size = static_cast<uint32_t>(value);
+        return str;
+    }
+}
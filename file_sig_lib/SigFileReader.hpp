@@ -0,0 +1,107 @@
+//
+//  SigFileReader.hpp
+//  file_signature
+//
+//  Created by artem k on 08.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#pragma once
+
+#include "SigPipeline.hpp"
+#include "SigBinary.hpp"
+
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace file_sig
+{
+    //
+    // Parser of a signature file written by SigWriter:
+    // the header (Filename, Filesize, Hash) and 0x<offset>:0x<size>:<hash> records.
+    // A binary signature (SigBinHeader) is mapped and its records
+    // are returned the same way, with hex hashes
+    //
+    class SigFileReader
+    {
+    public:
+        using Record = SigPipeline::Record;
+        
+        struct Header
+        {
+            std::string fileName;
+            uint64_t fileSize = 0;
+            std::string hasher;
+            bool binary = false;
+        };
+        
+        //
+        // a record with the raw digest, the digest is valid until the next call
+        //
+        struct RawRecord
+        {
+            uint64_t offset = 0;
+            uint32_t size = 0;
+            const uint8_t* digest = nullptr;
+            uint32_t digestSize = 0;
+        };
+
+    public:
+        //
+        // opens the file and parses the header, throws if it is invalid
+        //
+        explicit SigFileReader(const std::string& path);
+        
+        SigFileReader(const SigFileReader&) = delete;
+        SigFileReader& operator=(const SigFileReader&) = delete;
+        
+        const Header& getHeader() const;
+        
+        //
+        // returns false at the end of the file,
+        // throws if the record is malformed.
+        // A record without a line end is not returned, it may be truncated
+        //
+        bool next(Record& record);
+        
+        //
+        // the same as next, but the hash is not converted to a hex string:
+        // the digest of a binary signature points to the mapping
+        // and the hex of a text one is decoded to a buffer of the reader
+        //
+        bool nextRaw(RawRecord& record);
+        
+        //
+        // bytes of the header and the records that have been returned
+        //
+        uint64_t getParsedSize() const;
+
+        //
+        // the header of a text signature
+        //
+        static std::string formatHeader(const Header& header);
+
+    private:
+        bool readLine();
+        
+        //
+        // parses the next line of a text signature,
+        // returns its hex hash or nullptr at the end of the file
+        //
+        const char* parseLine(uint64_t& offset, uint32_t& size);
+
+    private:
+        const std::string m_path;
+        std::ifstream m_file;
+        std::string m_line;
+        std::vector<uint8_t> m_digest;
+        uint64_t m_lineNumber = 0;
+        uint64_t m_parsedSize = 0;
+        Header m_header;
+        
+        std::unique_ptr<SigBinFile> m_binary;
+        uint64_t m_binaryRecord = 0;
+    };
+}
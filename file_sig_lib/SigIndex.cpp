@@ -0,0 +1,481 @@
+//
+//  SigIndex.cpp
+//  file_signature
+//
+//  Created by artem k on 12.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#include "SigIndex.hpp"
+#include "SigFileReader.hpp"
+#include "Endian.hpp"
+#include "FileIdentity.hpp"
+#include "Hash.hpp"
+#include "Exceptions.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <stdio.h>
+#include <string.h>
+
+namespace file_sig
+{
+    namespace
+    {
+        //
+        // the header:
+        //   offset  size
+        //   0       8     magic "FSIGIDX\0"
+        //   8       4     version
+        //   12      4     slot size
+        //   16      8     capacity, slots count (a power of 2)
+        //   24      8     Bloom filter size in bytes
+        //   32      4     digest size
+        //   40      16    hash name, zero padded
+        //   56      8     chunks
+        //   64      8     bytes
+        //   72      8     unique chunks
+        //   80      8     unique bytes
+        //
+        const char kMagic[8] = {'F', 'S', 'I', 'G', 'I', 'D', 'X', '\0'};
+        const uint32_t kVersion = 1;
+        const size_t kHeaderSize = 128;
+        const size_t kHasherSize = 16;
+        const uint64_t kInitialCapacity = 1 << 16;
+        
+        //
+        // a slot: offset, file id (0 in an empty slot), size and the digest
+        //
+        const uint32_t kSlotPrefix = 16;
+        
+        //
+        // 8 bits per slot and 4 bits per hash give about 2% of false positives
+        // when the table is 70% full
+        //
+        const uint64_t kFilterBitsPerSlot = 8;
+        const uint64_t kFilterHashes = 4;
+        
+        uint64_t mix(uint64_t value)
+        {
+            value ^= value >> 30;
+            value *= 0xbf58476d1ce4e5b9ull;
+            value ^= value >> 27;
+            value *= 0x94d049bb133111ebull;
+            value ^= value >> 31;
+            return value;
+        }
+    }
+
+    SigIndex::SigIndex(const std::string& path)
+        : m_path(path)
+    {
+        std::ifstream files(path + ".files", std::ios::binary);
+        std::string line;
+        
+        while (std::getline(files, line))
+        {
+            if (!line.empty() && line.back() == '\r')
+            {
+                line.pop_back();
+            }
+            
+            m_files.push_back(line);
+        }
+        
+        m_stats.files = m_files.size();
+        
+        if (std::ifstream(path, std::ios::binary).is_open())
+        {
+            open();
+        }
+    }
+
+    SigIndex::~SigIndex()
+    {
+    }
+
+    uint64_t SigIndex::add(const std::string& sigPath)
+    {
+        //
+        // files are keyed by the absolute paths of their signatures,
+        // files of the same name in different directories are different files
+        //
+        const std::string name = utils::FileIdentity::getAbsolutePath(sigPath);
+        
+        THROW_IF(std::find(m_files.begin(), m_files.end(), name) != m_files.end(),
+                 name << " is already in the index");
+        
+        SigFileReader reader(sigPath);
+        const auto& header = reader.getHeader();
+        
+        THROW_IF(m_file && header.hasher != m_hasher,
+                 sigPath << " has been made with --hash=" << header.hasher << ", the index keeps " << m_hasher);
+        
+        //
+        // the whole signature is parsed before the table is changed,
+        // so a malformed one leaves no slots of a file that is not listed
+        //
+        uint32_t digestSize = m_digestSize;
+        std::vector<Location> chunks;
+        std::vector<uint8_t> digests;
+        SigFileReader::RawRecord record;
+        
+        while (reader.nextRaw(record))
+        {
+            if (0 == digestSize)
+            {
+                digestSize = record.digestSize;
+            }
+            
+            THROW_IF(record.digestSize != digestSize,
+                     "Invalid hash in " << sigPath << " at offset " << record.offset);
+            
+            digests.insert(digests.end(), record.digest, record.digest + digestSize);
+            
+            Location chunk;
+            chunk.offset = record.offset;
+            chunk.size = record.size;
+            chunks.push_back(chunk);
+        }
+        
+        if (!m_file && !chunks.empty())
+        {
+            create(header.hasher, digestSize);
+        }
+        
+        //
+        // the table is rebuilt once for all the chunks of the file
+        // instead of being doubled again and again
+        //
+        uint64_t capacity = m_capacity;
+        
+        while ((m_stats.uniqueChunks + chunks.size()) * 10 > capacity * 7)
+        {
+            capacity *= 2;
+        }
+        
+        if (capacity != m_capacity)
+        {
+            grow(capacity);
+        }
+        
+        const uint32_t fileId = static_cast<uint32_t>(m_files.size() + 1);
+        uint64_t duplicates = 0;
+        
+        for (size_t i = 0; i < chunks.size(); ++i)
+        {
+            const uint8_t* digest = digests.data() + i * m_digestSize;
+            const uint64_t hash = hashKey(digest);
+            uint8_t* slot = findSlot(digest, hash);
+            
+            if (isUsed(slot))
+            {
+                ++duplicates;
+            }
+            else
+            {
+                utils::store64(slot, chunks[i].offset);
+                utils::store32(slot + 8, fileId);
+                utils::store32(slot + 12, chunks[i].size);
+                memcpy(slot + kSlotPrefix, digest, m_digestSize);
+                addToFilter(hash);
+                
+                ++m_stats.uniqueChunks;
+                m_stats.uniqueBytes += chunks[i].size;
+            }
+            
+            ++m_stats.chunks;
+            m_stats.bytes += chunks[i].size;
+        }
+        
+        {
+            std::ofstream files(m_path + ".files", std::ios::binary | std::ios::app);
+            files << name << "\r\n";
+            THROW_IF(!files, "Cannot write " << m_path << ".files");
+        }
+        
+        m_files.push_back(name);
+        m_stats.files = m_files.size();
+        
+        if (m_file)
+        {
+            saveTotals();
+        }
+        
+        return duplicates;
+    }
+
+    uint64_t SigIndex::lookup(const std::string& sigPath, const OnDuplicate& onDuplicate) const
+    {
+        SigFileReader reader(sigPath);
+        const auto& header = reader.getHeader();
+        
+        THROW_IF(m_file && header.hasher != m_hasher,
+                 sigPath << " has been made with --hash=" << header.hasher << ", the index keeps " << m_hasher);
+        
+        //
+        // the chunks of an indexed file are found at their own places, they are skipped
+        //
+        const auto it = std::find(m_files.begin(), m_files.end(), utils::FileIdentity::getAbsolutePath(sigPath));
+        const uint32_t fileId = it == m_files.end() ? 0 : static_cast<uint32_t>(it - m_files.begin() + 1);
+        
+        uint64_t chunks = 0;
+        SigFileReader::RawRecord raw;
+        
+        while (reader.nextRaw(raw))
+        {
+            ++chunks;
+            
+            if (!m_file || raw.digestSize != m_digestSize)
+            {
+                continue;
+            }
+            
+            const uint64_t hash = hashKey(raw.digest);
+            
+            if (!mayContain(hash))
+            {
+                continue;
+            }
+            
+            const uint8_t* slot = findSlot(raw.digest, hash);
+            
+            if (!isUsed(slot))
+            {
+                continue;
+            }
+            
+            const Location first = getLocation(slot);
+            
+            if (first.file != fileId || first.offset != raw.offset)
+            {
+                //
+                // the hex hash is made only for the reported duplicates
+                //
+                Record record;
+                record.offset = raw.offset;
+                record.size = raw.size;
+                record.hash = utils::toHex(raw.digest, raw.digestSize);
+                onDuplicate(record, first);
+            }
+        }
+        
+        return chunks;
+    }
+
+    SigIndex::Stats SigIndex::getStats() const
+    {
+        return m_stats;
+    }
+
+    const std::string& SigIndex::getFileName(uint32_t file) const
+    {
+        THROW_IF(0 == file || file > m_files.size(), "Unknown file id " << file << " in " << m_path);
+        return m_files[file - 1];
+    }
+
+    void SigIndex::flush()
+    {
+        if (m_file)
+        {
+            saveTotals();
+            m_file->flush();
+        }
+    }
+
+    void SigIndex::create(const std::string& hasher, uint32_t digestSize)
+    {
+        THROW_IF(hasher.size() >= kHasherSize, "The hash name is too long: " << hasher);
+        THROW_IF(0 == digestSize, "Empty hashes cannot be indexed");
+        
+        m_hasher = hasher;
+        m_digestSize = digestSize;
+        m_slotSize = (kSlotPrefix + digestSize + 7) / 8 * 8;
+        createFile(m_path, kInitialCapacity);
+    }
+
+    void SigIndex::open()
+    {
+        m_file.reset(new utils::MappedFile(m_path, utils::MappedFile::Mode::write));
+        const uint8_t* data = m_file->data();
+        
+        THROW_IF(m_file->size() < kHeaderSize || memcmp(data, kMagic, sizeof(kMagic)) != 0,
+                 m_path << " is not a signature index");
+        THROW_IF(utils::load32(data + 8) != kVersion, "Unsupported version of the index " << m_path);
+        
+        m_slotSize = utils::load32(data + 12);
+        m_capacity = utils::load64(data + 16);
+        m_filterBytes = utils::load64(data + 24);
+        m_digestSize = utils::load32(data + 32);
+        
+        auto name = reinterpret_cast<const char*>(data + 40);
+        m_hasher.assign(name, std::find(name, name + kHasherSize, '\0'));
+        
+        m_stats.chunks = utils::load64(data + 56);
+        m_stats.bytes = utils::load64(data + 64);
+        m_stats.uniqueChunks = utils::load64(data + 72);
+        m_stats.uniqueBytes = utils::load64(data + 80);
+        
+        const bool valid = m_capacity
+            && 0 == (m_capacity & (m_capacity - 1))
+            && m_filterBytes == m_capacity * kFilterBitsPerSlot / 8
+            && m_slotSize >= kSlotPrefix + m_digestSize
+            && m_file->size() == kHeaderSize + m_filterBytes + m_capacity * m_slotSize;
+        
+        THROW_IF(!valid, "The index " << m_path << " is corrupted");
+        
+        m_filter = m_file->data() + kHeaderSize;
+        m_slots = m_filter + m_filterBytes;
+    }
+
+    void SigIndex::createFile(const std::string& path, uint64_t capacity)
+    {
+        //
+        // the new file is filled with zeros, so all the slots are empty
+        //
+        ::remove(path.c_str());
+        
+        m_capacity = capacity;
+        m_filterBytes = capacity * kFilterBitsPerSlot / 8;
+        m_file.reset(new utils::MappedFile(path,
+                                           utils::MappedFile::Mode::write,
+                                           kHeaderSize + m_filterBytes + capacity * m_slotSize));
+        
+        uint8_t* data = m_file->data();
+        memcpy(data, kMagic, sizeof(kMagic));
+        utils::store32(data + 8, kVersion);
+        utils::store32(data + 12, m_slotSize);
+        utils::store64(data + 16, m_capacity);
+        utils::store64(data + 24, m_filterBytes);
+        utils::store32(data + 32, m_digestSize);
+        memcpy(data + 40, m_hasher.data(), m_hasher.size());
+        
+        m_filter = data + kHeaderSize;
+        m_slots = m_filter + m_filterBytes;
+        saveTotals();
+    }
+
+    void SigIndex::grow(uint64_t capacity)
+    {
+        std::unique_ptr<utils::MappedFile> old = std::move(m_file);
+        const uint8_t* oldSlots = m_slots;
+        const uint64_t oldCapacity = m_capacity;
+        const std::string tmpPath = m_path + ".tmp";
+        
+        createFile(tmpPath, capacity);
+        
+        for (uint64_t i = 0; i < oldCapacity; ++i)
+        {
+            const uint8_t* slot = oldSlots + i * m_slotSize;
+            
+            if (isUsed(slot))
+            {
+                const uint64_t hash = hashKey(slot + kSlotPrefix);
+                memcpy(findSlot(slot + kSlotPrefix, hash), slot, m_slotSize);
+                addToFilter(hash);
+            }
+        }
+
+        //
+        // the mappings are closed before the file is replaced
+        //
+        m_file->flush();
+        m_file.reset();
+        old.reset();
+
+#if defined(_WIN32)
+        ::remove(m_path.c_str());
+#endif
+        THROW_ERRNO_IF(::rename(tmpPath.c_str(), m_path.c_str()) != 0, "Cannot rename " << tmpPath);
+        open();
+    }
+
+    void SigIndex::saveTotals()
+    {
+        uint8_t* data = m_file->data();
+        utils::store64(data + 56, m_stats.chunks);
+        utils::store64(data + 64, m_stats.bytes);
+        utils::store64(data + 72, m_stats.uniqueChunks);
+        utils::store64(data + 80, m_stats.uniqueBytes);
+    }
+
+    uint64_t SigIndex::hashKey(const uint8_t* digest) const
+    {
+        //
+        // digests are uniform, their first bytes are enough,
+        // they are mixed for short digests (crc32)
+        //
+        uint8_t key[8] = {};
+        memcpy(key, digest, std::min<size_t>(sizeof(key), m_digestSize));
+        return mix(utils::load64(key));
+    }
+
+    bool SigIndex::mayContain(uint64_t hash) const
+    {
+        const uint64_t mask = m_filterBytes * 8 - 1;
+        const uint64_t first = mix(hash);
+        const uint64_t step = (first >> 32) | 1;
+        
+        for (uint64_t i = 0; i < kFilterHashes; ++i)
+        {
+            const uint64_t bit = (first + i * step) & mask;
+            
+            if (0 == (m_filter[bit / 8] & (1 << (bit % 8))))
+            {
+                return false;
+            }
+        }
+        
+        return true;
+    }
+
+    void SigIndex::addToFilter(uint64_t hash)
+    {
+        const uint64_t mask = m_filterBytes * 8 - 1;
+        const uint64_t first = mix(hash);
+        const uint64_t step = (first >> 32) | 1;
+        
+        for (uint64_t i = 0; i < kFilterHashes; ++i)
+        {
+            const uint64_t bit = (first + i * step) & mask;
+            m_filter[bit / 8] |= static_cast<uint8_t>(1 << (bit % 8));
+        }
+    }
+
+    const uint8_t* SigIndex::findSlot(const uint8_t* digest, uint64_t hash) const
+    {
+        const uint64_t mask = m_capacity - 1;
+        uint64_t i = hash & mask;
+        
+        for (;;)
+        {
+            const uint8_t* slot = m_slots + i * m_slotSize;
+            
+            if (!isUsed(slot) || 0 == memcmp(slot + kSlotPrefix, digest, m_digestSize))
+            {
+                return slot;
+            }
+            
+            i = (i + 1) & mask;
+        }
+    }
+
+    uint8_t* SigIndex::findSlot(const uint8_t* digest, uint64_t hash)
+    {
+        return const_cast<uint8_t*>(static_cast<const SigIndex*>(this)->findSlot(digest, hash));
+    }
+
+    bool SigIndex::isUsed(const uint8_t* slot) const
+    {
+        return 0 != utils::load32(slot + 8);
+    }
+
+    SigIndex::Location SigIndex::getLocation(const uint8_t* slot) const
+    {
+        Location location;
+        location.offset = utils::load64(slot);
+        location.file = utils::load32(slot + 8);
+        location.size = utils::load32(slot + 12);
+        return location;
+    }
+}
@@ -0,0 +1,137 @@
+//
+//  SigIndex.hpp
+//  file_signature
+//
+//  Created by artem k on 12.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#pragma once
+
+#include "SigPipeline.hpp"
+#include "MappedFile.hpp"
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace file_sig
+{
+    //
+    // Persistent index of chunk hashes of many signatures
+    // A chunk hash is mapped to the file and the offset it has been seen first at,
+    // so duplicate data are found without reading the files again.
+    //
+    // The index is a mapped file:
+    //   * a header with the totals
+    //   * a Bloom filter that rejects most of the unknown hashes
+    //     without touching the table
+    //   * an open-addressing table of fixed-size slots with linear probing,
+    //     it is rebuilt bigger before it gets 70% full
+    // The indexed files are listed in <index>.files by the absolute paths
+    // of their signatures a line per file, the line number is the file id in the slots
+    //
+    class SigIndex
+    {
+    public:
+        using Record = SigPipeline::Record;
+        
+        struct Location
+        {
+            uint32_t file = 0;
+            uint64_t offset = 0;
+            uint32_t size = 0;
+        };
+        
+        struct Stats
+        {
+            uint64_t files = 0;
+            uint64_t chunks = 0;
+            uint64_t bytes = 0;
+            uint64_t uniqueChunks = 0;
+            uint64_t uniqueBytes = 0;
+        };
+        
+        using OnDuplicate = std::function<void(const Record& record, const Location& first)>;
+
+    public:
+        //
+        // opens the index, it is created by the first added signature
+        //
+        explicit SigIndex(const std::string& path);
+        ~SigIndex();
+        
+        SigIndex(const SigIndex&) = delete;
+        SigIndex& operator=(const SigIndex&) = delete;
+        
+        //
+        // adds the chunks of the signature of a file that is not indexed yet,
+        // returns the count of its chunks that have already been in the index
+        //
+        uint64_t add(const std::string& sigPath);
+        
+        //
+        // calls onDuplicate for every chunk of the signature that is in the index
+        // at another place, the index is not changed.
+        // Returns the count of the chunks of the signature
+        //
+        uint64_t lookup(const std::string& sigPath, const OnDuplicate& onDuplicate) const;
+        
+        Stats getStats() const;
+        
+        //
+        // file ids start from 1
+        //
+        const std::string& getFileName(uint32_t file) const;
+        
+        //
+        // writes the changed pages of the index to the disk
+        //
+        void flush();
+
+    private:
+        void create(const std::string& hasher, uint32_t digestSize);
+        void open();
+        
+        //
+        // maps a new empty index file of the capacity
+        //
+        void createFile(const std::string& path, uint64_t capacity);
+        
+        //
+        // rehashes the slots to a bigger table that replaces the index file,
+        // the capacity is a power of 2
+        //
+        void grow(uint64_t capacity);
+        
+        void saveTotals();
+        uint64_t hashKey(const uint8_t* digest) const;
+        bool mayContain(uint64_t hash) const;
+        void addToFilter(uint64_t hash);
+        
+        //
+        // the slot of the digest or the empty slot it would be inserted to
+        //
+        const uint8_t* findSlot(const uint8_t* digest, uint64_t hash) const;
+        uint8_t* findSlot(const uint8_t* digest, uint64_t hash);
+        
+        bool isUsed(const uint8_t* slot) const;
+        Location getLocation(const uint8_t* slot) const;
+
+    private:
+        const std::string m_path;
+        std::unique_ptr<utils::MappedFile> m_file;
+        std::vector<std::string> m_files;
+        
+        std::string m_hasher;
+        uint32_t m_digestSize = 0;
+        uint32_t m_slotSize = 0;
+        uint64_t m_capacity = 0;
+        uint64_t m_filterBytes = 0;
+        Stats m_stats;
+        
+        uint8_t* m_filter = nullptr;
+        uint8_t* m_slots = nullptr;
+    };
+}
@@ -0,0 +1,80 @@
+//
+//  SigLatency.hpp
+//  file_signature
+//
+//  Created by artem k on 04.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#pragma once
+
+#include "Histogram.hpp"
+
+#include <chrono>
+
+namespace file_sig
+{
+    //
+    // stages that a chunk passes through
+    //
+    enum class SigStage
+    {
+        read,    // waiting for the chunk data in ChunkReader::getNextChunk
+        hash,    // the hasher call
+        reorder, // from pushing the record until it is emitted in order
+        write,   // from queueing the record to the writer until it is formatted
+    };
+
+    const size_t kSigStagesCount = 4;
+
+    inline const char* getStageName(SigStage stage)
+    {
+        switch (stage)
+        {
+            case SigStage::read: return "read";
+            case SigStage::hash: return "hash";
+            case SigStage::reorder: return "reorder";
+            case SigStage::write: return "write";
+        }
+
+        return "unknown";
+    }
+
+    //
+    // Per-stage latency histograms in nanoseconds
+    // The stages record to it only if it has been set,
+    // so a disabled report costs one pointer check per stage
+    //
+    class SigLatency
+    {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        SigLatency()
+            : m_recorder(kSigStagesCount)
+        {
+        }
+
+        void record(SigStage stage, Clock::duration time)
+        {
+            const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(time).count();
+            m_recorder.record(static_cast<size_t>(stage), ns > 0 ? ns : 0);
+        }
+
+        void record(SigStage stage, Clock::time_point start)
+        {
+            record(stage, Clock::now() - start);
+        }
+
+        //
+        // must be called when all the stages have finished
+        //
+        std::vector<utils::Histogram> merge() const
+        {
+            return m_recorder.merge();
+        }
+
+    private:
+        utils::LatencyRecorder m_recorder;
+    };
+}
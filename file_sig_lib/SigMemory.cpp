@@ -0,0 +1,141 @@
+//
+//  SigMemory.cpp
+//  file_signature
+//
+//  Created by artem k on 17.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#include "SigMemory.hpp"
+#include "SigPipeline.hpp"
+#include "Exceptions.hpp"
+
+#include <algorithm>
+
+namespace file_sig
+{
+    namespace
+    {
+        //
+        // percents of the time stalled on memory for the last 10 seconds
+        //
+        const double kHighPressure = 10.0;
+        const double kLowPressure = 1.0;
+        
+        //
+        // the writer formats the records it has taken while the next ones are queued,
+        // so it holds up to twice the queued records
+        //
+        uint64_t getRecords(uint64_t window, uint32_t queuedRecords)
+        {
+            return window + 2 * static_cast<uint64_t>(queuedRecords);
+        }
+        
+        uint64_t getBytes(const SigMemoryPlan& plan, uint32_t chunkSize, uint64_t buffersBytes, uint64_t recordBytes)
+        {
+            const uint32_t chunks = plan.cachedChunks ? plan.cachedChunks : plan.threads;
+            const uint32_t window = SigPipeline::getReorderWindowSize(plan.threads, plan.reorderWindow);
+            
+            return buffersBytes
+                + static_cast<uint64_t>(chunks) * chunkSize
+                + getRecords(window, plan.queuedRecords) * recordBytes;
+        }
+    }
+
+    SigMemoryPlan SigMemoryPlan::make(uint64_t maxMemory,
+                                      uint32_t chunkSize,
+                                      uint64_t readerBytes,
+                                      uint64_t writerBytes,
+                                      uint64_t recordBytes,
+                                      const SigMemoryPlan& wanted)
+    {
+        SigMemoryPlan plan = wanted;
+        plan.threads = std::max(plan.threads, 1u);
+        
+        const uint64_t buffersBytes = readerBytes + writerBytes;
+        
+        if (0 == maxMemory)
+        {
+            plan.bytes = getBytes(plan, chunkSize, buffersBytes, recordBytes);
+            return plan;
+        }
+        
+        const uint64_t window = SigPipeline::getReorderWindowSize(plan.threads, plan.reorderWindow);
+        const uint64_t minimum = buffersBytes + chunkSize + getRecords(window, 1) * recordBytes;
+        
+        THROW_IF(maxMemory < minimum,
+                 "--max-memory=" << maxMemory << " is less than the minimum of " << minimum << " bytes: "
+                 << "the reader buffer of " << readerBytes << ", the writer buffer of " << writerBytes
+                 << ", one chunk of " << chunkSize << " and " << getRecords(window, 1) << " records");
+        
+        const uint64_t recordsBudget = maxMemory / 8;
+        const uint64_t records = recordsBudget / std::max<uint64_t>(recordBytes, 1);
+        const uint64_t queued = records > window ? (records - window) / 2 : 1;
+        
+        plan.queuedRecords = static_cast<uint32_t>(std::max<uint64_t>(std::min<uint64_t>(plan.queuedRecords, queued), 1));
+        
+        uint64_t used = buffersBytes + getRecords(window, plan.queuedRecords) * recordBytes;
+        
+        if (maxMemory < used + chunkSize)
+        {
+            //
+            // the least records leave space for a chunk, it is checked by the minimum
+            //
+            plan.queuedRecords = 1;
+            used = buffersBytes + getRecords(window, plan.queuedRecords) * recordBytes;
+        }
+        
+        const uint64_t chunks = (maxMemory - used) / chunkSize;
+        
+        if (plan.cachedChunks)
+        {
+            //
+            // every hasher holds a chunk, the rest are read ahead
+            //
+            plan.cachedChunks = static_cast<uint32_t>(std::min<uint64_t>(plan.cachedChunks, chunks));
+            plan.threads = std::min(plan.threads, std::max(plan.cachedChunks - 1, 1u));
+        }
+        else
+        {
+            plan.threads = static_cast<uint32_t>(std::min<uint64_t>(plan.threads, chunks));
+        }
+        
+        plan.bytes = getBytes(plan, chunkSize, buffersBytes, recordBytes);
+        return plan;
+    }
+
+    SigMemoryGovernor::SigMemoryGovernor(ChunkReader& reader, uint32_t maxChunks)
+        : m_reader(reader)
+        , m_maxChunks(std::max(maxChunks, 1u))
+        , m_limit(m_maxChunks)
+    {
+    }
+
+    bool SigMemoryGovernor::update(double pressure)
+    {
+        uint32_t limit = m_limit;
+        
+        if (pressure >= kHighPressure)
+        {
+            limit = std::max(m_limit / 2, 1u);
+        }
+        else if (pressure >= 0 && pressure < kLowPressure)
+        {
+            limit = std::min(m_limit * 2, m_maxChunks);
+        }
+        
+        if (limit == m_limit)
+        {
+            return false;
+        }
+        
+        m_limit = limit;
+        m_reader.setCacheLimit(m_limit);
+        return true;
+    }
+
+    uint32_t SigMemoryGovernor::getCacheLimit() const
+    {
+        return m_limit;
+    }
+}
@@ -0,0 +1,73 @@
+//
+//  SigMemory.hpp
+//  file_signature
+//
+//  Created by artem k on 17.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#pragma once
+
+#include "ChunkReader.hpp"
+
+#include <stdint.h>
+
+namespace file_sig
+{
+    //
+    // Memory of a signing run: buffers of the reader and the writer, chunk buffers of the reader,
+    // records of the reorder window and records queued by the writer.
+    // The wanted values are reduced to fit a budget:
+    // records get at most 1/8 of it, the rest is for chunks,
+    // hasher threads are reduced to the chunks that fit
+    //
+    struct SigMemoryPlan
+    {
+        uint32_t threads = 0;
+        uint32_t cachedChunks = 0;  // chunks of a caching reader, 0 for a mapping one
+        uint32_t reorderWindow = 0; // 0 means the default of SigPipeline
+        uint32_t queuedRecords = 0;
+        uint64_t bytes = 0;         // the estimated total
+        
+        //
+        // readerBytes - memory of the reader except chunks, e.g. its file buffer.
+        // writerBytes - the output buffer of the writer.
+        // recordBytes - memory of a record with its hash.
+        // A mapping reader has one chunk per thread mapped.
+        // maxMemory 0 keeps the wanted values, throws if the buffers, one chunk
+        // and the least records do not fit
+        //
+        static SigMemoryPlan make(uint64_t maxMemory,
+                                  uint32_t chunkSize,
+                                  uint64_t readerBytes,
+                                  uint64_t writerBytes,
+                                  uint64_t recordBytes,
+                                  const SigMemoryPlan& wanted);
+    };
+
+    //
+    // Shrinks the cache of a reader by half while the memory pressure is high
+    // and grows it back by twice while it is low, up to the planned chunks
+    //
+    class SigMemoryGovernor
+    {
+    public:
+        SigMemoryGovernor(ChunkReader& reader, uint32_t maxChunks);
+        
+        SigMemoryGovernor(const SigMemoryGovernor&) = delete;
+        SigMemoryGovernor& operator=(const SigMemoryGovernor&) = delete;
+        
+        //
+        // pressure is percents of stalled time (see utils::MemoryPressure),
+        // a negative one is ignored. Returns true if the limit has been changed
+        //
+        bool update(double pressure);
+        
+        uint32_t getCacheLimit() const;
+
+    private:
+        ChunkReader& m_reader;
+        const uint32_t m_maxChunks;
+        uint32_t m_limit;
+    };
+}
@@ -0,0 +1,80 @@
+//
+//  SigModeDelta.cpp
+//  file_signature
+//
+//  Created by artem k on 19.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#include "SigModes.hpp"
+#include "SigDelta.hpp"
+#include "SigFileReader.hpp"
+#include "TaskPool.hpp"
+#include "Exceptions.hpp"
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+
+namespace file_sig
+{
+    int runDelta(SigOptions& options, std::ostream& out)
+    {
+        //
+        // the new file is hashed the same way as the old one
+        //
+        options.hasher = SigFileReader(options.deltaFilePath).getHeader().hasher;
+        const SigDelta delta(options.deltaFilePath, options.createHasher());
+        
+        const uint64_t filesize = options.prepareFile(out);
+        out << "Initialization...\n";
+        
+        size_t readWorker = 0;
+        const auto workerCpus = options.selectWorkerCpus(readWorker, out);
+        utils::TaskPool pool(options.getWorkerThreads(), workerCpus);
+        
+        out << "Delta against: " << options.deltaFilePath << "\n";
+        out << "Chunk size: " << delta.getChunkSize() << "\n";
+        
+        const auto startTime = std::chrono::steady_clock::now();
+        const auto instructions = delta.compute(options.inFilePath, pool);
+        const auto time = std::chrono::steady_clock::now() - startTime;
+        
+        std::ofstream file(options.outFilePath, std::ios::binary | std::ios::trunc);
+        THROW_IF(!file.is_open(), "Cannot open " << options.outFilePath);
+        
+        file << "Filename: " << options.inFilePath << "\r\n";
+        file << "Filesize: " << filesize << "\r\n";
+        file << "Signature: " << options.deltaFilePath << "\r\n";
+        
+        uint64_t copySize = 0;
+        uint64_t literalSize = 0;
+        uint64_t literals = 0;
+        
+        for (const auto& instruction : instructions)
+        {
+            if (SigDelta::Instruction::Type::copy == instruction.type)
+            {
+                file << "copy 0x" << std::hex << instruction.offset << ":0x" << instruction.size;
+                file << ":0x" << instruction.oldOffset << std::dec << "\r\n";
+                copySize += instruction.size;
+            }
+            else
+            {
+                file << "literal 0x" << std::hex << instruction.offset << ":0x" << instruction.size << std::dec << "\r\n";
+                literalSize += instruction.size;
+                ++literals;
+            }
+        }
+        
+        file.close();
+        THROW_IF(!file, "Cannot write " << options.outFilePath);
+        
+        out << "Copied: " << copySize << " bytes in " << instructions.size() - literals << " ranges\n";
+        out << "Literal: " << literalSize << " bytes in " << literals << " ranges\n";
+        out << std::fixed << std::setprecision(2);
+        out << "Delta time: " << std::chrono::duration<double>(time).count() << "s\n";
+        out << "Delta: " << options.outFilePath << "\n";
+        return 0;
+    }
+}
@@ -0,0 +1,134 @@
+//
+//  SigModeIndex.cpp
+//  file_signature
+//
+//  Created by artem k on 19.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#include "SigModes.hpp"
+#include "SigIndex.hpp"
+#include "Exceptions.hpp"
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+
+namespace file_sig
+{
+    int runIndex(const SigOptions& options, std::ostream& out)
+    {
+        SigIndex index(options.indexFilePath);
+        std::vector<std::string> sigPaths = options.indexAdd;
+        
+        if (!options.indexAddList.empty())
+        {
+            std::ifstream list(options.indexAddList, std::ios::binary);
+            THROW_IF(!list.is_open(), "Cannot open " << options.indexAddList);
+            
+            std::string line;
+            
+            while (std::getline(list, line))
+            {
+                if (!line.empty() && line.back() == '\r')
+                {
+                    line.pop_back();
+                }
+                
+                if (!line.empty())
+                {
+                    sigPaths.push_back(line);
+                }
+            }
+        }
+        
+        out << std::fixed << std::setprecision(2);
+        
+        if (!sigPaths.empty())
+        {
+            const uint64_t chunks = index.getStats().chunks;
+            const auto startTime = std::chrono::steady_clock::now();
+            
+            for (const auto& sigPath : sigPaths)
+            {
+                const uint64_t duplicates = index.add(sigPath);
+                
+                if (options.verbose)
+                {
+                    out << "Added: " << sigPath << ", duplicate chunks: " << duplicates << "\n";
+                }
+            }
+            
+            index.flush();
+            
+            const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+            const uint64_t added = index.getStats().chunks - chunks;
+            
+            out << "Added signatures: " << sigPaths.size() << ", chunks: " << added << "\n";
+            out << "Index time: " << seconds << "s";
+            
+            if (seconds > 0)
+            {
+                out << " (" << static_cast<uint64_t>(added / seconds) << " chunks/s)";
+            }
+            
+            out << "\n";
+        }
+        
+        if (!options.indexLookup.empty())
+        {
+            //
+            // contiguous duplicate chunks that continue the same range of a file are merged
+            //
+            SigIndex::Location first;
+            uint64_t rangeOffset = 0;
+            uint64_t rangeSize = 0;
+            uint64_t duplicates = 0;
+            
+            auto printRange = [&]()
+            {
+                if (rangeSize)
+                {
+                    out << "Duplicate range: 0x" << std::hex << rangeOffset << ":0x" << rangeSize;
+                    out << " of " << index.getFileName(first.file) << " at 0x" << first.offset << std::dec << "\n";
+                }
+            };
+            
+            const uint64_t chunks = index.lookup(options.indexLookup,
+                                                 [&](const SigIndex::Record& record, const SigIndex::Location& location)
+            {
+                ++duplicates;
+                
+                const bool contiguous = rangeSize
+                    && first.file == location.file
+                    && rangeOffset + rangeSize == record.offset
+                    && first.offset + rangeSize == location.offset;
+                
+                if (!contiguous)
+                {
+                    printRange();
+                    first = location;
+                    rangeOffset = record.offset;
+                    rangeSize = 0;
+                }
+                
+                rangeSize += record.size;
+            });
+            
+            printRange();
+            out << "Duplicate chunks: " << duplicates << " of " << chunks << "\n";
+        }
+        
+        const auto stats = index.getStats();
+        out << "Indexed files: " << stats.files << "\n";
+        out << "Indexed chunks: " << stats.chunks << ", unique: " << stats.uniqueChunks << "\n";
+        out << "Indexed bytes: " << stats.bytes << ", unique: " << stats.uniqueBytes << "\n";
+        
+        if (stats.uniqueBytes)
+        {
+            out << "Dedup ratio: " << static_cast<double>(stats.bytes) / stats.uniqueBytes << "\n";
+        }
+        
+        return 0;
+    }
+}
@@ -0,0 +1,122 @@
+//
+//  SigModeServer.cpp
+//  file_signature
+//
+//  Created by artem k on 19.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#include "SigModes.hpp"
+#include "SigServer.hpp"
+#include "LocalSocket.hpp"
+#include "Exceptions.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+namespace file_sig
+{
+    int runServer(const SigOptions& options, const std::function<bool()>& isStopped, std::ostream& out)
+    {
+        const uint32_t chunkSize = options.chunkSize ? options.chunkSize : SigOptions::kDefaultChunkSize;
+        SigServer server(options.serveSocketPath, options.getWorkerThreads(), chunkSize);
+        
+        out << "Listening: " << options.serveSocketPath << "\n";
+        out << "Threads: " << options.getWorkerThreads() << "\n";
+        out << "To stop send SIGINT or SIGTERM\n" << std::flush;
+        
+        server.run(isStopped);
+        
+        out << "Stopped, jobs: " << server.getJobsCount() << "\n";
+        return 0;
+    }
+
+    int runClient(const SigOptions& options, std::ostream& out)
+    {
+        const bool signing = options.verifyFilePath.empty();
+        std::stringstream job;
+        
+        if (signing)
+        {
+            job << "Job: sign\r\n";
+            job << "Filename: " << options.inFilePath << "\r\n";
+            job << "Hash: " << options.hasher << "\r\n";
+            job << "Chunksize: " << options.chunkSize << "\r\n";
+        }
+        else
+        {
+            job << "Job: verify\r\n";
+            job << "Signature: " << options.verifyFilePath << "\r\n";
+            
+            if (!options.inFilePath.empty())
+            {
+                job << "Filename: " << options.inFilePath << "\r\n";
+            }
+        }
+        
+        job << "\r\n";
+        
+        const auto startTime = std::chrono::steady_clock::now();
+        auto socket = utils::LocalSocket::connect(options.connectSocketPath);
+        socket.write(job.str());
+        
+        std::ofstream file;
+        
+        if (signing)
+        {
+            file.open(options.outFilePath, std::ios::binary | std::ios::trunc);
+            THROW_IF(!file.is_open(), "Cannot open " << options.outFilePath);
+        }
+        
+        const std::string statusKey = "Status: ";
+        std::string status;
+        std::string line;
+        
+        while (socket.readLine(line))
+        {
+            if (line.compare(0, statusKey.size(), statusKey) == 0)
+            {
+                status = line.substr(statusKey.size());
+                break;
+            }
+            
+            if (signing)
+            {
+                file << line << "\r\n";
+            }
+            else
+            {
+                out << line << "\n";
+            }
+        }
+        
+        if (signing)
+        {
+            file.close();
+            
+            if (status != "OK")
+            {
+                std::remove(options.outFilePath.c_str());
+            }
+            
+            THROW_IF(!file, "Cannot write " << options.outFilePath);
+        }
+        
+        THROW_IF(status.empty(), "The daemon has closed the connection");
+        
+        const auto time = std::chrono::steady_clock::now() - startTime;
+        out << "Status: " << status << "\n";
+        out << std::fixed << std::setprecision(2);
+        out << "Time: " << std::chrono::duration<double>(time).count() << "s\n";
+        
+        if (signing && status == "OK")
+        {
+            out << "Signature: " << options.outFilePath << "\n";
+        }
+        
+        return status == "OK" ? 0 : (status == "FAILED" ? 2 : 1);
+    }
+}
@@ -0,0 +1,634 @@
+//
+//  SigModeSign.cpp
+//  file_signature
+//
+//  Created by artem k on 19.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#include "SigModes.hpp"
+#include "SigWriter.hpp"
+#include "SigCheckpoint.hpp"
+#include "SigFileReader.hpp"
+#include "SigBinary.hpp"
+#include "SigCache.hpp"
+#include "SigLatency.hpp"
+#include "SigTrace.hpp"
+#include "SigPerf.hpp"
+#include "SigProbes.hpp"
+#include "SigReport.hpp"
+#include "FileIdentity.hpp"
+#include "MemoryPressure.hpp"
+#include "TaskPool.hpp"
+#include "Exceptions.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+
+namespace file_sig
+{
+    namespace
+    {
+        //
+        // an event takes 40 bytes, so a thread buffer is limited by 40MB
+        //
+        const size_t kMaxTraceEventsPerThread = 1000 * 1000;
+        
+        //
+        // loads the checkpoint of an interrupted run and checks that it continues
+        // the same signature: the parameters and the header of the signature file must match
+        //
+        SigCheckpoint loadResumeCheckpoint(const std::string& path,
+                                           const SigCheckpoint& expected,
+                                           const std::string& outFilePath,
+                                           const std::string& header)
+        {
+            SigCheckpoint checkpoint;
+            THROW_IF(!checkpoint.load(path), "Nothing to resume, " << path << " is not found");
+            THROW_IF(!checkpoint.isSameSignature(expected), "The checkpoint " << path << " has been made with other parameters");
+            THROW_IF(checkpoint.offset > expected.fileSize, "The checkpoint " << path << " is beyond the end of the file");
+            THROW_IF(checkpoint.length < header.size(), "The checkpoint " << path << " is corrupted");
+            
+            std::ifstream out(outFilePath, std::ios::binary);
+            THROW_IF(!out.is_open(), "Cannot open " << outFilePath);
+            
+            std::string outHeader(header.size(), '\0');
+            out.read(&outHeader[0], outHeader.size());
+            THROW_IF(!out || outHeader != header, "The header of " << outFilePath << " does not match the parameters");
+            
+            out.seekg(0, std::ios::end);
+            THROW_IF(static_cast<uint64_t>(out.tellg()) < checkpoint.length, outFilePath << " is shorter than its checkpoint");
+            
+            return checkpoint;
+        }
+
+        //
+        // keeps the records of the complete chunks from the signature of an append-only file:
+        // the signature is rewritten with the new header and the kept records,
+        // the returned checkpoint continues it after them.
+        // 'verifyChunks' kept chunks spread over the file are hashed again
+        // to check that the old data have not been changed
+        //
+        SigCheckpoint prepareUpdate(const SigCheckpoint& expected,
+                                    const std::string& outFilePath,
+                                    const std::string& header,
+                                    const SigPipeline::Hasher& hasher,
+                                    uint32_t verifyChunks,
+                                    std::ostream& out)
+        {
+            SigCheckpoint checkpoint = expected;
+            std::vector<SigPipeline::Record> samples;
+            uint64_t headerSize = 0;
+            uint64_t keptSize = 0;
+            
+            {
+                SigFileReader old(outFilePath);
+                const auto& oldHeader = old.getHeader();
+                
+                THROW_IF(oldHeader.fileName != expected.fileName, outFilePath << " is a signature of " << oldHeader.fileName);
+                THROW_IF(oldHeader.hasher != expected.hasher, outFilePath << " has been made with --hash=" << oldHeader.hasher);
+                THROW_IF(oldHeader.binary != SigBinHeader::isBinary(header.data(), header.size()),
+                         outFilePath << " has been made with other --format");
+                THROW_IF(oldHeader.fileSize > expected.fileSize, "The file has been truncated, it cannot be updated");
+                
+                headerSize = old.getParsedSize();
+                keptSize = headerSize;
+                
+                const uint64_t oldChunks = oldHeader.fileSize / expected.chunkSize;
+                const uint64_t verifyEvery = verifyChunks ? std::max<uint64_t>(oldChunks / verifyChunks, 1) : 0;
+                SigPipeline::Record record;
+                
+                while (old.next(record))
+                {
+                    THROW_IF(record.offset != checkpoint.offset || record.offset + record.size > oldHeader.fileSize,
+                             outFilePath << " is corrupted at offset " << record.offset);
+                    
+                    if (record.size != expected.chunkSize)
+                    {
+                        //
+                        // only the last chunk may be smaller, it is hashed again with the appended data
+                        //
+                        THROW_IF(record.size > expected.chunkSize || record.offset + record.size != oldHeader.fileSize,
+                                 outFilePath << " has been made with --chunk-size=" << record.size);
+                        break;
+                    }
+                    
+                    if (verifyEvery && 0 == (record.offset / expected.chunkSize) % verifyEvery && samples.size() < verifyChunks)
+                    {
+                        samples.push_back(record);
+                    }
+                    
+                    checkpoint.offset += record.size;
+                    keptSize = old.getParsedSize();
+                }
+            }
+            
+            if (!samples.empty())
+            {
+                std::ifstream file(expected.fileName, std::ios::binary);
+                THROW_IF(!file.is_open(), "Cannot open " << expected.fileName);
+                std::vector<char> chunk(expected.chunkSize);
+                
+                for (const auto& sample : samples)
+                {
+                    file.seekg(sample.offset);
+                    file.read(chunk.data(), chunk.size());
+                    THROW_IF(!file, "Cannot read " << expected.fileName << " at offset " << sample.offset);
+                    THROW_IF(hasher(chunk.data(), chunk.size()) != sample.hash,
+                             "The chunk at offset " << sample.offset << " has been changed, the file is not append-only");
+                }
+                
+                out << "Verified chunks: " << samples.size() << "\n";
+            }
+            
+            //
+            // the header keeps the new file size, so the kept records are copied after it
+            //
+            const std::string tmpPath = outFilePath + ".tmp";
+            
+            {
+                std::ifstream in(outFilePath, std::ios::binary);
+                std::ofstream tmp(tmpPath, std::ios::binary | std::ios::trunc);
+                THROW_IF(!in.is_open(), "Cannot open " << outFilePath);
+                THROW_IF(!tmp.is_open(), "Cannot open " << tmpPath);
+                
+                tmp << header;
+                in.seekg(headerSize);
+                
+                std::vector<char> buffer(1024 * 1024);
+                uint64_t left = keptSize - headerSize;
+                
+                while (left)
+                {
+                    const size_t size = static_cast<size_t>(std::min<uint64_t>(left, buffer.size()));
+                    in.read(buffer.data(), size);
+                    THROW_IF(!in, "Cannot read " << outFilePath);
+                    tmp.write(buffer.data(), size);
+                    left -= size;
+                }
+                
+                tmp.close();
+                THROW_IF(!tmp, "Cannot write " << tmpPath);
+            }
+            
+#if defined(_WIN32)
+            std::remove(outFilePath.c_str());
+#endif
+            THROW_IF(std::rename(tmpPath.c_str(), outFilePath.c_str()) != 0, "Cannot rename " << tmpPath);
+            
+            checkpoint.length = header.size() + keptSize - headerSize;
+            return checkpoint;
+        }
+
+        //
+        // hashes 'checkChunks' chunks spread over the file and compares them with the signature,
+        // returns the number of the chunks that do not match
+        //
+        uint32_t checkCachedSignature(const SigOptions& options, const std::string& sigPath, uint64_t filesize)
+        {
+            SigFileReader sig(sigPath);
+            
+            if (sig.getHeader().fileSize != filesize || sig.getHeader().hasher != options.hasher)
+            {
+                return options.cacheCheckChunks;
+            }
+            
+            const uint64_t totalChunks = filesize / options.chunkSize + (filesize % options.chunkSize ? 1 : 0);
+            const uint64_t checkEvery = std::max<uint64_t>(totalChunks / options.cacheCheckChunks, 1);
+            const auto hasher = options.createHasher();
+            
+            std::ifstream file(options.inFilePath, std::ios::binary);
+            THROW_IF(!file.is_open(), "Cannot open " << options.inFilePath);
+            
+            std::vector<char> chunk(options.chunkSize);
+            SigPipeline::Record record;
+            uint32_t checked = 0;
+            uint32_t bad = 0;
+            
+            while (checked < options.cacheCheckChunks && sig.next(record))
+            {
+                if ((record.offset / options.chunkSize) % checkEvery != 0)
+                {
+                    continue;
+                }
+                
+                ++checked;
+                
+                if (record.size > chunk.size())
+                {
+                    ++bad;
+                    continue;
+                }
+                
+                file.seekg(record.offset);
+                file.read(chunk.data(), record.size);
+                THROW_IF(!file, "Cannot read " << options.inFilePath << " at offset " << record.offset);
+                
+                if (hasher(chunk.data(), record.size) != record.hash)
+                {
+                    ++bad;
+                }
+            }
+            
+            return bad;
+        }
+
+        //
+        // the cache keeps absolute paths, so the files are compared by their identities
+        //
+        bool isSameFile(const std::string& path, const std::string& otherPath)
+        {
+            try
+            {
+                const auto file = utils::FileIdentity::get(path);
+                const auto other = utils::FileIdentity::get(otherPath);
+                return file.device == other.device && file.inode == other.inode;
+            }
+            catch (const std::exception&)
+            {
+                return false;
+            }
+        }
+
+        //
+        // returns true if the signature of the unchanged file is taken from the cache,
+        // it is copied to <out file> if it has been made to another path
+        //
+        bool useCachedSignature(const SigOptions& options,
+                                SigCache& cache,
+                                const SigCache::Key& key,
+                                const utils::FileIdentity& identity,
+                                std::ostream& out)
+        {
+            std::string sigPath;
+            const auto res = cache.find(key, identity, sigPath);
+            
+            if (SigCache::Lookup::hit != res)
+            {
+                out << "Cache: " << SigCache::toString(res) << "\n";
+                return false;
+            }
+            
+            if (options.cacheCheckChunks)
+            {
+                const uint32_t bad = checkCachedSignature(options, sigPath, identity.size);
+                
+                if (bad)
+                {
+                    out << "Cache: miss, " << bad << " of " << options.cacheCheckChunks << " checked chunks do not match\n";
+                    cache.remove(key);
+                    return false;
+                }
+            }
+            
+            if (!isSameFile(sigPath, options.outFilePath))
+            {
+                std::ifstream in(sigPath, std::ios::binary);
+                std::ofstream copy(options.outFilePath, std::ios::binary | std::ios::trunc);
+                THROW_IF(!in.is_open(), "Cannot open " << sigPath);
+                THROW_IF(!copy.is_open(), "Cannot open " << options.outFilePath);
+                
+                copy << in.rdbuf();
+                copy.close();
+                THROW_IF(!copy, "Cannot write " << options.outFilePath);
+            }
+            
+            out << "Cache: hit, ";
+            
+            if (options.cacheCheckChunks)
+            {
+                out << "spot-checked chunks match\n";
+            }
+            else
+            {
+                out << "the signature is trusted\n";
+            }
+            
+            out << "Signature: " << options.outFilePath << "\n";
+            return true;
+        }
+    }
+
+    int runSign(SigOptions& options, const IsCanceled& isCanceled, std::ostream& out)
+    {
+        const uint64_t filesize = options.prepareFile(out);
+        
+        //
+        // the identity is taken before hashing, if the file is changed
+        // while it is hashed the signature is not cached
+        //
+        std::unique_ptr<SigCache> cache;
+        SigCache::Key cacheKey;
+        utils::FileIdentity identity;
+        
+        if (!options.cacheFilePath.empty())
+        {
+            identity = utils::FileIdentity::get(options.inFilePath);
+            cache.reset(new SigCache(options.cacheFilePath));
+            cacheKey = SigCache::makeKey(identity, options.chunkSize, options.hasher, options.format == "bin");
+            
+            if (useCachedSignature(options, *cache, cacheKey, identity, out))
+            {
+                return 0;
+            }
+        }
+        
+        out << "Initialization...\n";
+        
+        auto hasher = options.createHasher();
+        
+        size_t readWorker = 0;
+        const auto workerCpus = options.selectWorkerCpus(readWorker, out);
+        
+        //
+        // latency histograms, trace events and hardware counters are recorded
+        // by the pipeline and the writer, so they must outlive both of them
+        //
+        SigLatency latency;
+        SigTrace trace(options.chunkSize, options.traceEvery, kMaxTraceEventsPerThread);
+        SigPerf perf;
+        
+        SigProbes probes;
+        probes.latency = options.report.empty() ? nullptr : &latency;
+        probes.trace = options.traceFilePath.empty() ? nullptr : &trace;
+        probes.perf = options.perf ? &perf : nullptr;
+        
+        const bool binary = options.format == "bin";
+        SigBinHeader binHeader;
+        std::string header;
+        
+        if (binary)
+        {
+            binHeader.fileName = options.inFilePath;
+            binHeader.fileSize = filesize;
+            binHeader.hasher = options.hasher;
+            binHeader.chunkSize = options.chunkSize;
+            binHeader.digestSize = options.getDigestSize();
+            header = binHeader.serialize();
+        }
+        else
+        {
+            SigFileReader::Header textHeader;
+            textHeader.fileName = options.inFilePath;
+            textHeader.fileSize = filesize;
+            textHeader.hasher = options.hasher;
+            header = SigFileReader::formatHeader(textHeader);
+        }
+        
+        SigCheckpoint checkpoint;
+        checkpoint.fileName = options.inFilePath;
+        checkpoint.fileSize = filesize;
+        checkpoint.hasher = options.hasher;
+        checkpoint.chunkSize = options.chunkSize;
+        
+        if (options.resume)
+        {
+            checkpoint = loadResumeCheckpoint(options.getCheckpointPath(), checkpoint, options.outFilePath, header);
+            out << "Resuming from offset: " << checkpoint.offset << "\n";
+        }
+        else if (options.update)
+        {
+            checkpoint = prepareUpdate(checkpoint, options.outFilePath, header, hasher, options.updateVerifyChunks, out);
+            out << "Updating from offset: " << checkpoint.offset << "\n";
+        }
+        
+        //
+        // the pool is shared by the reader and the pipeline,
+        // it must outlive both of them
+        //
+        utils::TaskPool pool(options.getWorkerThreads(), workerCpus);
+        
+        auto reader = options.createReader(pool, readWorker, checkpoint.offset);
+        
+        //
+        // both a resumed and an updated signature are continued after the checkpoint
+        //
+        const bool append = options.resume || options.update;
+        SigWriter writer(options.outFilePath, options.memory.queuedRecords, append ? &checkpoint : nullptr);
+        writer.setProbes(probes);
+        
+        if (binary)
+        {
+            writer.setBinary(binHeader);
+        }
+        
+        if (options.checkpointInterval)
+        {
+            writer.setCheckpoint(options.getCheckpointPath(), checkpoint, std::chrono::seconds(options.checkpointInterval));
+        }
+        
+        if (!append)
+        {
+            writer.write(header);
+        }
+        
+        //
+        // the writer is created before the pipeline, so it outlives the tasks
+        // that are parked by its gate while the output queue is full
+        //
+        SigPipeline pipeline(*reader,
+                             hasher,
+                             pool,
+                             options.getWorkerThreads(),
+                             options.reorderWindow,
+                             probes,
+                             [&writer](const SigPipeline::Resume& resume)
+                             {
+                                 return writer.waitForSpace(resume);
+                             });
+        
+        bool canceled = false;
+        
+        StatsDump stats(options.statsFilePath, std::chrono::seconds(1));
+        
+        //
+        // the cache of chunks is shrunk while the system (or the cgroup) stalls on memory
+        //
+        utils::MemoryPressure pressure;
+        std::unique_ptr<SigMemoryGovernor> governor;
+        
+        if (options.maxMemory && options.memory.cachedChunks && pressure.isSupported())
+        {
+            governor.reset(new SigMemoryGovernor(*reader, options.memory.cachedChunks));
+        }
+        
+        auto checkPressure = [&]()
+        {
+            const double value = governor ? pressure.get() : -1;
+            
+            if (governor && governor->update(value))
+            {
+                out << "\nMemory pressure: " << value << "%, cached chunks: " << governor->getCacheLimit() << "\n";
+            }
+        };
+        
+        out << "\nTo cancel press any key\n\n";
+        
+        const auto startTime = std::chrono::steady_clock::now();
+        
+        if (options.verbose)
+        {
+            //
+            // it is just a sample
+            // how to use SigPipeline::wait funstion with a record parameter
+            //
+            SigPipeline::Record record;
+            SigPipeline::WaitRes res;
+            std::vector<char> text;
+            
+            uint64_t totalChunks = filesize / options.chunkSize + (filesize % options.chunkSize ? 1 : 0);
+            uint64_t chunkId = checkpoint.offset / options.chunkSize;
+            
+            do
+            {
+                //
+                // wait for one second or until a new record is ready
+                // and check if a key has been pressed
+                //
+                res = pipeline.wait(1000, record);
+                stats.dump(pipeline, false);
+                checkPressure();
+
+                if (isCanceled())
+                {
+                    out << "\nCanceling...";
+                    pipeline.cancel(true);
+                    canceled = true;
+                    out << "\nStopped.\n";
+                    break;
+                }
+                
+                if (SigPipeline::WaitRes::ready == res)
+                {
+                    out << std::dec << ++chunkId << "/" << totalChunks << " => ";
+                    printRecord(out, record, text);
+                    out << "\n";
+                    writer.push(SigPipeline::RecordBatch(&record, 1));
+                }
+            }
+            while (res != SigPipeline::WaitRes::finished);
+        
+            out << "\rFinished: " << std::dec << totalChunks << " hashes\n";
+        }
+        else
+        {
+            //
+            // it is just a sample
+            // how to use SigPipeline::wait funstion without a record parameter
+            // and the records batch callback
+            //
+            std::atomic<uint64_t> count{0};
+            std::atomic<uint64_t> offset{checkpoint.offset};
+            
+            pipeline.setRecordBatchCallback([&](SigPipeline::RecordBatch records)
+            {
+                offset = records.back().offset + records.back().size;
+                count += records.size();
+                
+                //
+                // the callback is called by a pool task, the gate keeps the queue bounded
+                //
+                writer.push(records, false);
+            });
+            
+            while (SigPipeline::WaitRes::timeout == pipeline.wait(1000))
+            {
+                stats.dump(pipeline, false);
+                checkPressure();
+                
+                if (isCanceled())
+                {
+                    out << "\nCanceling...";
+                    pipeline.cancel(true);
+                    canceled = true;
+                    out << "\nStopped.\n";
+                    break;
+                }
+                
+                float percents = 100.0f * static_cast<float>(offset) / static_cast<float>(filesize);
+                out << "\r" << std::fixed << std::setprecision(2) << percents << "%";
+                out << " hashes:" << count;
+                out << " window:" << pipeline.getReorderDepth() << "/" << pipeline.getReorderWindow() << "   " << std::flush;
+            }
+        
+            out << "\rFinished: ";
+            out << 100.0f * static_cast<float>(offset) / static_cast<float>(filesize) << "%";
+            out << " hashes:" << std::dec << count << "\n";
+        }
+        
+        stats.dump(pipeline, true);
+        
+        const auto total = pipeline.stats();
+        out << "Reorder window: peak " << std::dec << total.maxReorderDepth;
+        out << " of " << total.reorderWindow << " chunks\n";
+        
+        //
+        // the times are sums for all the tasks
+        //
+        out << std::fixed << std::setprecision(2);
+        out << "Tasks time: hashing " << total.hashUs / 1e6 << "s";
+        out << ", waiting " << total.waitUs / 1e6 << "s";
+        out << " (reader stall " << total.reader.stallUs / 1e6 << "s)\n";
+        
+        writer.finish();
+        
+        if (canceled && options.checkpointInterval)
+        {
+            out << "The signature may be resumed with --resume\n";
+        }
+        else if (options.checkpointInterval)
+        {
+            //
+            // the signature is complete, there is nothing to resume
+            //
+            std::remove(options.getCheckpointPath().c_str());
+        }
+        
+        if (cache && !canceled)
+        {
+            if (utils::FileIdentity::get(options.inFilePath) == identity)
+            {
+                cache->add(cacheKey, identity, options.outFilePath);
+                out << "Cache: the signature has been added\n";
+            }
+            else
+            {
+                cache->remove(cacheKey);
+                out << "Cache: the file has been changed while it was hashed, the signature is not cached\n";
+            }
+            
+            cache->save();
+        }
+        
+        auto time = std::chrono::steady_clock::now() - startTime;
+        auto seconds = std::chrono::duration_cast<std::chrono::seconds>(time).count();
+        out << "Total time: " << timeToStr(seconds) << "\n";
+        
+        if (!options.report.empty())
+        {
+            printReport(out,
+                        latency,
+                        total.bytesHashed,
+                        std::chrono::duration<double>(time).count(),
+                        options.report == "json");
+        }
+        
+        if (probes.perf)
+        {
+            printPerf(out, perf, options.hasher, options.report == "json");
+        }
+        
+        if (probes.trace)
+        {
+            trace.save(options.traceFilePath);
+            out << "Trace: " << options.traceFilePath;
+            out << " (dropped events: " << trace.getDroppedEvents() << ")\n";
+        }
+        
+        return 0;
+    }
+}
@@ -0,0 +1,114 @@
+//
+//  SigModeVerify.cpp
+//  file_signature
+//
+//  Created by artem k on 19.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#include "SigModes.hpp"
+#include "SigVerifier.hpp"
+#include "TaskPool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <iomanip>
+
+namespace file_sig
+{
+    int runVerify(SigOptions& options, const IsCanceled& isCanceled, std::ostream& out)
+    {
+        SigVerifier verifier(options.verifyFilePath, options.failFast);
+        options.applySignature(verifier);
+        
+        const uint64_t filesize = options.prepareFile(out);
+        out << "Initialization...\n";
+        
+        size_t readWorker = 0;
+        const auto workerCpus = options.selectWorkerCpus(readWorker, out);
+        
+        //
+        // the pool is shared by the reader and the pipeline,
+        // it must outlive both of them
+        //
+        utils::TaskPool pool(options.getWorkerThreads(), workerCpus);
+        auto reader = options.createReader(pool, readWorker, 0);
+        
+        SigPipeline pipeline(*reader,
+                             options.createHasher(),
+                             pool,
+                             options.getWorkerThreads(),
+                             options.reorderWindow);
+        
+        std::atomic<uint64_t> offset{0};
+        
+        pipeline.setRecordBatchCallback([&](SigPipeline::RecordBatch records)
+        {
+            offset = records.back().offset + records.back().size;
+            
+            if (!verifier.check(records))
+            {
+                //
+                // it does not wait for the tasks, so it may be called by a task
+                //
+                pipeline.cancel(false);
+            }
+        });
+        
+        out << "\nTo cancel press any key\n\n";
+        
+        bool canceled = false;
+        auto res = SigPipeline::WaitRes::timeout;
+        
+        while (SigPipeline::WaitRes::timeout == (res = pipeline.wait(1000)))
+        {
+            if (isCanceled())
+            {
+                out << "\nCanceling...";
+                pipeline.cancel(true);
+                canceled = true;
+                out << "\nStopped.\n";
+                break;
+            }
+            
+            float percents = 100.0f * static_cast<float>(offset) / static_cast<float>(std::max<uint64_t>(filesize, 1));
+            out << "\r" << std::fixed << std::setprecision(2) << percents << "%";
+            out << " bad chunks:" << verifier.getBadChunks() << "   " << std::flush;
+        }
+        
+        if (SigPipeline::WaitRes::canceled == res)
+        {
+            //
+            // stopped at a bad chunk, wait for the rest of the tasks
+            //
+            pipeline.cancel(true);
+        }
+        
+        if (!canceled)
+        {
+            verifier.finish(filesize);
+        }
+        
+        out << "\rChecked chunks: " << std::dec << verifier.getCheckedChunks();
+        out << ", bad chunks: " << verifier.getBadChunks() << "\n";
+        
+        if (verifier.getHeader().fileSize != filesize)
+        {
+            out << "File size " << filesize << " does not match the signature " << verifier.getHeader().fileSize << "\n";
+        }
+        
+        for (const auto& range : verifier.getBadRanges())
+        {
+            out << "Bad range: 0x" << std::hex << range.offset << ":0x" << range.size << std::dec << "\n";
+        }
+        
+        if (canceled || verifier.isStopped())
+        {
+            out << (verifier.isOk() ? "Verification is not complete\n" : "FAILED\n");
+            return verifier.isOk() ? 1 : 2;
+        }
+        
+        out << (verifier.isOk() ? "OK\n" : "FAILED\n");
+        return verifier.isOk() ? 0 : 2;
+    }
+}
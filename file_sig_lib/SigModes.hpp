@@ -0,0 +1,63 @@
+//
+//  SigModes.hpp
+//  file_signature
+//
+//  Created by artem k on 19.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#pragma once
+
+#include "SigOptions.hpp"
+
+#include <functional>
+#include <ostream>
+
+namespace file_sig
+{
+    //
+    // it is polled about once per second, true cancels the run
+    //
+    using IsCanceled = std::function<bool()>;
+
+    //
+    // Runners of the modes of file_signature, they print the progress and the results to 'out'
+    // and return the exit code of the tool: 0 - done, 1 - not complete, 2 - the file does not match.
+    // Errors are thrown
+    //
+
+    //
+    // makes the signature of --file, it may be resumed, updated or taken from --cache
+    //
+    int runSign(SigOptions& options, const IsCanceled& isCanceled, std::ostream& out);
+
+    //
+    // hashes the file by the pipeline and compares the chunks with the signature,
+    // returns 0 if the whole file matches the signature
+    //
+    int runVerify(SigOptions& options, const IsCanceled& isCanceled, std::ostream& out);
+
+    //
+    // writes the instructions that make the file from the old version of the signature,
+    // literal ranges are the data that must be transferred
+    //
+    int runDelta(SigOptions& options, std::ostream& out);
+
+    //
+    // adds the signatures to the index, looks up the duplicate ranges of a file
+    // and prints the dedup ratio of all the indexed files
+    //
+    int runIndex(const SigOptions& options, std::ostream& out);
+
+#if !defined(_WIN32)
+    //
+    // serves jobs of the local socket until 'isStopped' returns true
+    //
+    int runServer(const SigOptions& options, const std::function<bool()>& isStopped, std::ostream& out);
+
+    //
+    // sends the job to the daemon, a signature is written as it is streamed back
+    //
+    int runClient(const SigOptions& options, std::ostream& out);
+#endif
+}
@@ -0,0 +1,293 @@
+//
+//  SigOptions.cpp
+//  file_signature
+//
+//  Created by artem k on 19.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#include "SigOptions.hpp"
+#include "SigVerifier.hpp"
+#include "SigTuner.hpp"
+#include "SigWriter.hpp"
+#include "FileStreamChunkReader.hpp"
+#include "FileMappingChunkReader.hpp"
+#include "FileIdentity.hpp"
+#include "Topology.hpp"
+#include "Hash.hpp"
+#include "Utils.hpp"
+#include "Exceptions.hpp"
+
+#include <iomanip>
+#include <thread>
+
+namespace file_sig
+{
+    uint32_t SigOptions::getWorkerThreads() const
+    {
+        if (memory.threads)
+        {
+            return memory.threads;
+        }
+        
+        if (threads)
+        {
+            return threads;
+        }
+        
+        if (reader == "stream")
+        {
+            //
+            // For buffered FileStream reader it is enough
+            // to have the same threads count as we have cores:
+            //  * N-cores tasks that calculate hashes all the time -
+            //    they almost don't have blocking operations
+            //  * file data are read by tasks of the same pool
+            //    or by a hasher if nobody reads the file at the moment
+            //
+            return std::thread::hardware_concurrency();
+        }
+        else if (reader == "map" || reader == "mapall")
+        {
+            //
+            // For the current implementation,
+            // mapping is a part of the same thread that calculate a hash.
+            // Working with a mapped memory has a blocked IO operations:
+            // page fault at the first access to a mapped memory that
+            // has not been read from a file yet.
+            // It makes sense to use more threads than cores.
+            //
+            return 3 * std::thread::hardware_concurrency();
+        }
+        
+        THROW("Unknown reader type: " << reader);
+    }
+
+    SigPipeline::Hasher SigOptions::createHasher() const
+    {
+        if (hasher == "crc32")
+        {
+            return utils::crc32;
+        }
+        else if (hasher == "sha2")
+        {
+            return utils::sha2;
+        }
+        
+        THROW("Unknown hasher type: " << hasher);
+    }
+
+    uint32_t SigOptions::getDigestSize() const
+    {
+        //
+        // hashers return hex digits
+        //
+        const char empty = 0;
+        return static_cast<uint32_t>(createHasher()(&empty, 0).size() / 2);
+    }
+
+    std::string SigOptions::getCheckpointPath() const
+    {
+        return outFilePath + ".checkpoint";
+    }
+
+    void SigOptions::applySignature(const SigVerifier& verifier)
+    {
+        if (inFilePath.empty())
+        {
+            inFilePath = verifier.getHeader().fileName;
+        }
+        
+        hasher = verifier.getHeader().hasher;
+        
+        if (verifier.getChunkSize())
+        {
+            chunkSize = verifier.getChunkSize();
+        }
+    }
+
+    void SigOptions::applyTuning(uint64_t filesize, std::ostream& out)
+    {
+        const std::string path = autoFilePath.empty() ? SigTuner::getDefaultPath() : autoFilePath;
+        const uint32_t cpus = utils::Topology::getAvailableCpus();
+        const uint64_t device = utils::FileIdentity::get(inFilePath).device;
+        
+        SigTuner tuner(path);
+        SigTuning tuning;
+        const bool found = tuner.find(device, hasher, chunkSize, cpus, tuning);
+        
+        if (!found)
+        {
+            out << "Calibration...\n";
+            tuning = SigTuner::calibrate(inFilePath, filesize, chunkSize, createHasher(), cpus);
+            tuner.add(device, hasher, chunkSize, cpus, tuning);
+            
+            try
+            {
+                tuner.save();
+            }
+            catch (const std::exception& ex)
+            {
+                //
+                // the run does not need it, only the later ones
+                //
+                out << "WARNING! The tuning is not saved: " << ex.what() << "\n";
+            }
+        }
+        
+        reader = tuning.reader;
+        
+        if (0 == threads)
+        {
+            threads = tuning.threads;
+        }
+        
+        cachedChunks = tuning.cachedChunks;
+        
+        if (0 == reorderWindow)
+        {
+            reorderWindow = tuning.reorderWindow;
+        }
+        
+        const auto precision = out.precision();
+        out << std::fixed << std::setprecision(0);
+        out << "Auto: " << (found ? "saved" : "calibrated") << " for " << cpus << " CPUs";
+        out << ", read " << tuning.readMBps << " MB/s, hash " << tuning.hashMBps << " MB/s per core\n";
+        out << "Auto: reader " << reader << ", threads " << threads;
+        out << ", cached chunks " << cachedChunks << ", reorder window " << reorderWindow << "\n";
+        out.unsetf(std::ios::floatfield);
+        out.precision(precision);
+    }
+
+    void SigOptions::planMemory(uint64_t filesize, std::ostream& out)
+    {
+        if (reader == "mapall" && maxMemory && filesize >= maxMemory)
+        {
+            out << "The file does not fit --max-memory, --reader=map is used instead of mapall\n";
+            reader = "map";
+        }
+        
+        SigMemoryPlan wanted;
+        wanted.threads = getWorkerThreads();
+        wanted.cachedChunks = reader == "stream" ? (cachedChunks ? cachedChunks : wanted.threads * 2) : 0;
+        wanted.reorderWindow = reorderWindow;
+        wanted.queuedRecords = kMaxQueuedRecords;
+        
+        uint64_t readerBytes = 0;
+        
+        if (reader == "stream")
+        {
+            readerBytes = FileStreamChunkReader::kFileBufferSize;
+        }
+        else if (reader == "mapall")
+        {
+            readerBytes = filesize;
+        }
+        
+        //
+        // a record keeps its hash as hex digits
+        //
+        const uint64_t recordBytes = sizeof(SigPipeline::Record) + 2 * getDigestSize();
+        
+        memory = SigMemoryPlan::make(maxMemory, chunkSize, readerBytes, SigWriter::getBufferSize(), recordBytes, wanted);
+    }
+
+    uint64_t SigOptions::prepareFile(std::ostream& out)
+    {
+        const uint64_t filesize = utils::getFileSize(inFilePath);
+        
+        out << "Filename: " << inFilePath << "\n";
+        out << "Filesize: " << filesize << "\n";
+        out << "Hash: " << hasher << "\n";
+        
+        if (autoTune)
+        {
+            applyTuning(filesize, out);
+        }
+        
+        planMemory(filesize, out);
+        
+        if (maxMemory)
+        {
+            out << "Memory: " << memory.bytes << " of " << maxMemory << " bytes";
+            out << ", threads: " << memory.threads;
+            out << ", cached chunks: " << memory.cachedChunks << "\n";
+        }
+        
+        return filesize;
+    }
+
+    std::vector<uint32_t> SigOptions::selectWorkerCpus(size_t& readWorker, std::ostream& out) const
+    {
+        std::vector<uint32_t> workerCpus;
+        readWorker = utils::TaskPool::kAnyWorker;
+        
+        if (!numa)
+        {
+            return workerCpus;
+        }
+        
+        const auto topology = utils::Topology::detect();
+        const uint32_t storageNode = utils::Topology::getStorageNode(inFilePath);
+        
+        out << "Topology: " << topology.describe() << "\n";
+        out << "Storage node: ";
+        
+        if (utils::Topology::kUnknownNode == storageNode)
+        {
+            out << "unknown\n";
+        }
+        else
+        {
+            out << storageNode << "\n";
+        }
+        
+        if (topology.isPinnable())
+        {
+            //
+            // the first workers are on the storage node,
+            // the file is read by the first one
+            //
+            workerCpus = topology.selectCpus(getWorkerThreads(), storageNode);
+            readWorker = 0;
+            
+            out << "Worker CPUs:";
+            
+            for (auto cpu : workerCpus)
+            {
+                out << " " << cpu;
+            }
+            
+            out << "\n";
+        }
+        
+        return workerCpus;
+    }
+
+    std::unique_ptr<ChunkReader> SigOptions::createReader(utils::TaskPool& pool,
+                                                          size_t readWorker,
+                                                          uint64_t startOffset) const
+    {
+        std::unique_ptr<ChunkReader> obj;
+        
+        if (reader == "stream")
+        {
+            //
+            // each worker thread has one cached value and one current value,
+            // unless --max-memory has reduced them
+            //
+            obj.reset(new FileStreamChunkReader(inFilePath, pool, memory.cachedChunks, chunkSize, readWorker, startOffset));
+        }
+        else if (reader == "map")
+        {
+            obj.reset(new FileMappingChunkReader(inFilePath, chunkSize, false, startOffset));
+        }
+        else if (reader == "mapall")
+        {
+            obj.reset(new FileMappingChunkReader(inFilePath, chunkSize, true, startOffset));
+        }
+        
+        THROW_IF(!obj, "Unknown reader type: " << reader);
+        return obj;
+    }
+}
@@ -0,0 +1,123 @@
+//
+//  SigOptions.hpp
+//  file_signature
+//
+//  Created by artem k on 19.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#pragma once
+
+#include "SigPipeline.hpp"
+#include "SigMemory.hpp"
+#include "ChunkReader.hpp"
+#include "TaskPool.hpp"
+
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace file_sig
+{
+    class SigVerifier;
+
+    //
+    // Parameters of a run of the tool, they are filled by the command line
+    // and completed by the file: the signature that is verified, the tuning and the memory plan
+    //
+    struct SigOptions
+    {
+        std::string inFilePath;
+        std::string outFilePath;
+        std::string hasher = "crc32";
+        std::string reader = "stream";
+        std::string statsFilePath;
+        std::string report;
+        std::string traceFilePath;
+        std::string verifyFilePath;
+        std::string deltaFilePath;
+        std::string convertFilePath;
+        std::string indexFilePath;
+        std::vector<std::string> indexAdd;
+        std::string indexAddList;
+        std::string indexLookup;
+        std::string serveSocketPath;
+        std::string connectSocketPath;
+        std::string cacheFilePath;
+        std::string autoFilePath;
+        std::string format = "text";
+        uint32_t chunkSize = 0;
+        uint32_t reorderWindow = 0;
+        uint32_t traceEvery = 1;
+        uint32_t checkpointInterval = 10;
+        uint32_t updateVerifyChunks = 0;
+        uint32_t cacheCheckChunks = 0;
+        uint64_t maxMemory = 0;
+        bool autoTune = false;
+        
+        //
+        // hasher threads (--threads or --auto) and chunks of the stream reader (--auto),
+        // 0 means the defaults of the reader
+        //
+        uint32_t threads = 0;
+        uint32_t cachedChunks = 0;
+        
+        //
+        // threads, chunks and queued records that fit --max-memory, see planMemory
+        //
+        SigMemoryPlan memory;
+        bool verbose = false;
+        bool numa = false;
+        bool perf = false;
+        bool resume = false;
+        bool update = false;
+        bool failFast = false;
+        
+        static const uint32_t kDefaultChunkSize = 1024 * 1024;
+        static const uint32_t kHugeChunkSize = 100 * 1024 * 1024;
+        
+        //
+        // records that are hashed but not written yet,
+        // hashing waits if the output is slower
+        //
+        static const uint32_t kMaxQueuedRecords = 64 * 1024;
+        
+        uint32_t getWorkerThreads() const;
+        SigPipeline::Hasher createHasher() const;
+        uint32_t getDigestSize() const;
+        std::string getCheckpointPath() const;
+        
+        //
+        // the verified file is hashed the same way as its signature has been made
+        //
+        void applySignature(const SigVerifier& verifier);
+        
+        //
+        // --auto: the reader, threads and chunks of the device are taken from the tuning file
+        // or they are calibrated and saved there, must be called before planMemory
+        //
+        void applyTuning(uint64_t filesize, std::ostream& out);
+        
+        //
+        // reduces threads, cached chunks and queued records to fit --max-memory,
+        // must be called before the pool and the reader are created
+        //
+        void planMemory(uint64_t filesize, std::ostream& out);
+        
+        //
+        // prints the file and applies --auto and --max-memory, returns the file size
+        //
+        uint64_t prepareFile(std::ostream& out);
+        
+        //
+        // --numa: CPUs of the workers starting from the storage node,
+        // the file is read by 'readWorker'. Empty if the workers are not pinned
+        //
+        std::vector<uint32_t> selectWorkerCpus(size_t& readWorker, std::ostream& out) const;
+        
+        std::unique_ptr<ChunkReader> createReader(utils::TaskPool& pool,
+                                                  size_t readWorker,
+                                                  uint64_t startOffset) const;
+    };
+}
@@ -0,0 +1,67 @@
+//
+//  SigPerf.hpp
+//  file_signature
+//
+//  Created by artem k on 06.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#pragma once
+
+#include "SigLatency.hpp"
+#include "PerfCounters.hpp"
+
+namespace file_sig
+{
+    //
+    // Hardware counters of the read and hash stages of hasher threads
+    // The rest of the stages are waits for other threads, their counters say nothing.
+    // If perf events are not available the stages are not counted
+    // and getError tells the reason
+    //
+    class SigPerf
+    {
+    public:
+        using Sample = utils::PerfCounters::Sample;
+        using Totals = utils::PerfCounters::Totals;
+        
+        SigPerf()
+            : m_counters(kSigStagesCount)
+        {
+        }
+        
+        Sample begin()
+        {
+            return m_counters.begin();
+        }
+
+        //
+        // returns the sample that the next stage may begin with
+        //
+        Sample end(SigStage stage, const Sample& sample)
+        {
+            return m_counters.end(static_cast<size_t>(stage), sample);
+        }
+
+        //
+        // must be called when all the stages have finished
+        //
+        std::vector<Totals> merge() const
+        {
+            return m_counters.merge();
+        }
+        
+        bool isAvailable(utils::PerfEvent event) const
+        {
+            return m_counters.isAvailable(event);
+        }
+        
+        std::string getError() const
+        {
+            return m_counters.getError();
+        }
+
+    private:
+        utils::PerfCounters m_counters;
+    };
+}
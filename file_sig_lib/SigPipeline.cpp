@@ -11,24 +11,108 @@
 #include <algorithm>
 #include <thread>
 #include <fstream>
+#include <sstream>
 
 namespace file_sig
 {
-    SigPipeline::SigPipeline(ChunkReader& reader, Hasher hasher, uint32_t threadsCount)
-        : m_hasher(std::move(hasher))
+    namespace
+    {
+        //
+        // default records reorder window per a hasher thread,
+        // a thread that is faster than others can be only a few chunks ahead
+        //
+        const uint32_t kWindowChunksPerThread = 4;
+        
+        uint64_t toNs(std::chrono::steady_clock::duration time)
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(time).count();
+        }
+    }
+
+    std::string SigPipeline::Stats::toJson() const
+    {
+        std::stringstream st;
+        st << "{\"elapsed_us\":" << elapsedUs;
+        st << ",\"bytes_read\":" << reader.bytesRead;
+        st << ",\"bytes_hashed\":" << bytesHashed;
+        st << ",\"chunks_hashed\":" << chunksHashed;
+        st << ",\"hash_us\":" << hashUs;
+        st << ",\"wait_us\":" << waitUs;
+        st << ",\"reader_stall_us\":" << reader.stallUs;
+        st << ",\"ready_chunks\":" << reader.readyChunks;
+        st << ",\"busy_chunks\":" << reader.busyChunks;
+        st << ",\"free_chunks\":" << reader.freeChunks;
+        st << ",\"reorder_depth\":" << reorderDepth;
+        st << ",\"max_reorder_depth\":" << maxReorderDepth;
+        st << ",\"reorder_window\":" << reorderWindow << "}";
+        return st.str();
+    }
+
+    uint32_t SigPipeline::getReorderWindowSize(uint32_t threadsCount, uint32_t reorderWindow)
+    {
+        if (reorderWindow)
+        {
+            return reorderWindow;
+        }
+        
+        return std::max(threadsCount, 1u) * kWindowChunksPerThread;
+    }
+
+    SigPipeline::SigPipeline(ChunkReader& reader,
+                             Hasher hasher,
+                             utils::TaskPool& pool,
+                             uint32_t threadsCount,
+                             uint32_t reorderWindow,
+                             SigProbes probes,
+                             Gate gate)
+        : m_pool(pool)
+        , m_gate(std::move(gate))
         , m_reader(reader)
+        , m_hasher(std::move(hasher))
+        , m_records(reader.getChunkSize(),
+                    getReorderWindowSize(threadsCount, reorderWindow),
+                    reader.getStartOffset())
+        , m_startTime(std::chrono::steady_clock::now())
+        , m_probes(probes)
     {
+        m_records.setProbes(m_probes);
+        m_reader.setTrace(m_probes.trace);
+        
         threadsCount = std::max(threadsCount, 1u);
-        m_pool.reserve(threadsCount);
+        m_activeTasks = threadsCount;
+        m_taskRecords.resize(threadsCount);
         
-        m_activeThreads = threadsCount;
+        //
+        // each task hashes one chunk and pushes itself again,
+        // so tasks of different pipelines are interleaved in the pool
+        //
+        std::vector<utils::TaskPool::Task> tasks;
         
-        for (size_t i = 0; i < threadsCount; ++i)
+        for (uint32_t task = 0; task < threadsCount; ++task)
         {
-            m_pool.push_back(std::async(std::launch::async,
-                                        &SigPipeline::hasherThread,
-                                        this));
+            m_resumeHashers.push_back([this, task]()
+            {
+                resumeTask([this, task]() noexcept
+                {
+                    hasherTask(task);
+                });
+            });
+            
+            m_resumePushers.push_back([this, task]()
+            {
+                resumeTask([this, task]() noexcept
+                {
+                    pushTask(task);
+                });
+            });
+            
+            tasks.push_back([this, task]() noexcept
+            {
+                hasherTask(task);
+            });
         }
+        
+        m_pool.push(std::move(tasks), m_tasks);
     }
 
     SigPipeline::~SigPipeline()
@@ -42,6 +126,11 @@ namespace file_sig
         m_records.setOnRecordCallback(cb);
     }
 
+    void SigPipeline::setRecordBatchCallback(RecordBatchCb cb)
+    {
+        m_records.setOnRecordBatchCallback(cb);
+    }
+
     void SigPipeline::cancel(bool sync)
     {
         m_records.setCleanup();
@@ -63,24 +152,119 @@ namespace file_sig
         return m_records.tryPopRecord(timeoutMs, record);
     }
 
-    void SigPipeline::hasherThread()
+    uint32_t SigPipeline::getReorderWindow() const
+    {
+        return m_records.getWindowSize();
+    }
+
+    uint32_t SigPipeline::getReorderDepth() const
+    {
+        return m_records.getDepth();
+    }
+
+    uint32_t SigPipeline::getMaxReorderDepth() const
+    {
+        return m_records.getMaxDepth();
+    }
+
+    SigPipeline::Stats SigPipeline::stats() const
+    {
+        Stats stats;
+        stats.elapsedUs = toNs(std::chrono::steady_clock::now() - m_startTime) / 1000;
+        stats.bytesHashed = m_bytesHashed.load();
+        stats.chunksHashed = m_chunksHashed.load();
+        stats.hashUs = m_hashNs.load() / 1000;
+        stats.waitUs = m_waitNs.load() / 1000;
+        stats.reorderDepth = m_records.getDepth();
+        stats.maxReorderDepth = m_records.getMaxDepth();
+        stats.reorderWindow = m_records.getWindowSize();
+        stats.reader = m_reader.getStats();
+        return stats;
+    }
+
+    void SigPipeline::hasherTask(uint32_t task)
     {
         try
         {
             ChunkReader::Chunk chunk;
+            SigLatency* latency = m_probes.latency;
+            SigTrace* trace = m_probes.trace;
+            SigPerf* perf = m_probes.perf;
+            const auto time = std::chrono::steady_clock::now();
             
-            while (m_reader.getNextChunk(chunk))
+            //
+            // do not read a new chunk while the output is full
+            // or the task is too far ahead of a chunk that is still hashed by another task,
+            // the task is parked instead of waiting, so the worker runs tasks of other pipelines
+            //
+            const Resume& resume = m_resumeHashers[task];
+            const auto window = m_records.tryWaitForWindow(resume);
+            
+            if (window == Records::ParkResult::parked)
+            {
+                return;
+            }
+            
+            if (window == Records::ParkResult::ready && m_gate && !m_gate(resume))
             {
-                Record record;
+                return;
+            }
+            
+            const auto readTime = latency || trace ? std::chrono::steady_clock::now() : time;
+            const bool inWindow = window == Records::ParkResult::ready;
+            SigPerf::Sample sample = perf && inWindow ? perf->begin() : SigPerf::Sample();
+            const auto read = inWindow ? m_reader.getNextChunk(chunk, resume) : ChunkReader::ReadResult::finished;
+            
+            if (read == ChunkReader::ReadResult::parked)
+            {
+                return;
+            }
+            
+            if (read == ChunkReader::ReadResult::ready)
+            {
+                const auto hashTime = std::chrono::steady_clock::now();
+                m_waitNs.add(toNs(hashTime - time));
+                
+                if (perf)
+                {
+                    sample = perf->end(SigStage::read, sample);
+                }
+                
+                Record& record = m_taskRecords[task];
                 record.size = chunk.size();
                 record.offset = chunk.offset();
                 record.hash = m_hasher(chunk.data(), chunk.size());
-                chunk.free();
                 
-                if (!m_records.pushRecord(std::move(record)))
+                if (perf)
+                {
+                    perf->end(SigStage::hash, sample);
+                }
+                
+                const auto endTime = std::chrono::steady_clock::now();
+                m_hashNs.add(toNs(endTime - hashTime));
+                m_bytesHashed.add(record.size);
+                m_chunksHashed.add(1);
+                
+                if (latency)
                 {
-                    break;
+                    latency->record(SigStage::read, hashTime - readTime);
+                    latency->record(SigStage::hash, endTime - hashTime);
                 }
+                
+                if (trace && trace->isSampled(record.offset))
+                {
+                    trace->slice("read", readTime, hashTime, record.offset);
+                    trace->slice("hash", hashTime, endTime, record.offset);
+                }
+                
+                //
+                // freeing (e.g. unmapping) is a part of the wait time, not hashing
+                //
+                chunk.free();
+                m_waitNs.add(toNs(std::chrono::steady_clock::now() - endTime));
+                
+                pushTask(task);
+                return;
             }
         }
         catch (const std::exception&)
@@ -88,21 +272,97 @@ namespace file_sig
             m_records.setException(std::current_exception());
         }
         
-        if (1 == m_activeThreads--)
+        finishTask();
+    }
+
+    void SigPipeline::pushTask(uint32_t task)
+    {
+        try
         {
+            const auto time = std::chrono::steady_clock::now();
+            
             //
-            // it is the latest thread
+            // a record that is out of the window stays in the task slot until the continuation
+            //
+            const auto res = m_records.tryPushRecord(m_taskRecords[task], m_resumePushers[task]);
+            
+            if (res == Records::ParkResult::parked)
+            {
+                return;
+            }
+            
+            m_waitNs.add(toNs(std::chrono::steady_clock::now() - time));
+                
+            if (res == Records::ParkResult::ready)
+            {
+                //
+                // the continuation is pushed with the same handle,
+                // so the handle is not finished until the last task is done
+                //
+                m_pool.push([this, task]() noexcept
+                {
+                    hasherTask(task);
+                }, m_tasks);
+                    
+                return;
+            }
+        }
+        catch (const std::exception&)
+        {
+            m_records.setException(std::current_exception());
+        }
+        
+        finishTask();
+    }
+
+    void SigPipeline::resumeTask(utils::TaskPool::Task task) noexcept
+    {
+        //
+        // it is called by the thread that unparks the task,
+        // the task itself runs in the pool
+        //
+        try
+        {
+            m_pool.push(std::move(task), m_tasks);
+            return;
+        }
+        catch (const std::exception&)
+        {
+            m_records.setException(std::current_exception());
+        }
+        
+        finishTask();
+    }
+
+    void SigPipeline::finishTask()
+    {
+        if (1 == m_activeTasks--)
+        {
+            //
+            // it is the latest task
             // records will not be added anymore
             //
             m_records.setFreez();
+            
+            std::lock_guard<std::mutex> lock(m_doneMutex);
+            m_doneCv.notify_all();
         }
     }
 
     void SigPipeline::waitAllThreads() const
     {
-        for (const auto& thread : m_pool)
+        //
+        // the records are cleaned before, so a task that is parked by the window is resumed at once,
+        // a task that is parked by the reader or the gate is resumed by their threads and finished
+        //
+        std::unique_lock<std::mutex> lock(m_doneMutex);
+        
+        m_doneCv.wait(lock, [this]()
         {
-            thread.wait();
-        }
+            return 0 == m_activeTasks;
+        });
+        
+        lock.unlock();
+        m_tasks.wait();
     }
 }
@@ -10,10 +10,17 @@
 
 #include "ChunkReader.hpp"
 #include "SigRecords.hpp"
+#include "TaskPool.hpp"
+#include "PaddedAtomic.hpp"
+#include "SigProbes.hpp"
 
 #include <functional>
+#include <chrono>
+#include <string>
 #include <vector>
 #include <future>
+#include <memory>
+#include <condition_variable>
 
 //
 // TODO: the class has to be covered by unit tests
@@ -25,7 +32,7 @@ namespace file_sig
     // It is a class that links everythink for processing file signature
     // * ChunkReader - source reader (file reader)
     // * Hasher - a hash function callback
-    // * runs hash calculation in parallel threads
+    // * runs hash calculation in parallel tasks of a shared task pool
     // * provides an interface to process ready file signature records
     //
     class SigPipeline
@@ -35,10 +42,63 @@ namespace file_sig
         using Record = Records::HashRecord;
         using Hasher = Records::Hasher;
         using RecordCb = Records::OnHashRecord;
+        using RecordBatch = Records::HashRecordBatch;
+        using RecordBatchCb = Records::OnHashRecordBatch;
         using WaitRes = Records::RecordResult;
         
+        //
+        // a hasher task never waits holding a worker of the pool,
+        // it is parked with a continuation that pushes it to the pool again.
+        // A gate returns true if a task may read the next chunk,
+        // otherwise it keeps the continuation, e.g. while the output queue is full
+        //
+        using Resume = Records::Resume;
+        using Gate = std::function<bool(const Resume& resume)>;
+        
+        //
+        // snapshot of the pipeline counters, see stats
+        // time of tasks is a sum for all the tasks,
+        // so hashUs close to elapsedUs * threads means the run is CPU-bound
+        // and a big reader.stallUs means it is IO-bound
+        //
+        struct Stats
+        {
+            uint64_t elapsedUs = 0;    // time since the pipeline has been created
+            uint64_t bytesHashed = 0;
+            uint64_t chunksHashed = 0;
+            uint64_t hashUs = 0;       // time of tasks in the hash function
+            uint64_t waitUs = 0;       // time of tasks taking a chunk and pushing a record, parked tasks are not counted
+            uint32_t reorderDepth = 0;
+            uint32_t maxReorderDepth = 0;
+            uint32_t reorderWindow = 0;
+            ChunkReader::Stats reader;
+            
+            //
+            // one line JSON object
+            //
+            std::string toJson() const;
+        };
+        
     public:
-        SigPipeline(ChunkReader& reader, Hasher hasher, uint32_t threadsCount);
+        //
+        // threadsCount is the max count of chunks that are hashed in parallel,
+        // each of them is hashed by a separate task of the pool,
+        // so several pipelines may share the same pool.
+        // reorderWindow is the max distance in chunks between the next record
+        // that has to be emitted and the furthest hashed record,
+        // a hasher task that is too far ahead is parked instead of reading more.
+        // 0 means a default value that depends on threads count
+        // probes record latency, trace and hardware counters of the read, hash and reorder stages,
+        // they must outlive the pipeline.
+        // The gate is checked before every chunk, it must outlive the pipeline too
+        //
+        SigPipeline(ChunkReader& reader,
+                    Hasher hasher,
+                    utils::TaskPool& pool,
+                    uint32_t threadsCount,
+                    uint32_t reorderWindow,
+                    SigProbes probes = SigProbes(),
+                    Gate gate = Gate());
         ~SigPipeline();
         
         SigPipeline(const SigPipeline&) = delete;
@@ -48,20 +108,67 @@ namespace file_sig
         SigPipeline& operator=(SigPipeline&&) = delete;
         
         void setRecordsCallback(RecordCb cb);
+        void setRecordBatchCallback(RecordBatchCb cb);
         
         void cancel(bool sync);
         WaitRes wait(uint32_t timeoutMs);
         WaitRes wait(uint32_t timeoutMs, Record& record);
         
+        uint32_t getReorderWindow() const;
+        uint32_t getReorderDepth() const;
+        uint32_t getMaxReorderDepth() const;
+        
+        //
+        // counters are lock-free, it may be called at any time from any thread
+        //
+        Stats stats() const;
+        
+        //
+        // the window of a pipeline with these parameters
+        //
+        static uint32_t getReorderWindowSize(uint32_t threadsCount, uint32_t reorderWindow);
+        
     private:
-        void hasherThread();
+        //
+        // 'task' is the index of a hasher task, its record and continuations,
+        // a task and its continuations never run at the same time
+        //
+        void hasherTask(uint32_t task);
+        void pushTask(uint32_t task);
+        void resumeTask(utils::TaskPool::Task task) noexcept;
+        void finishTask();
         void waitAllThreads() const;
         
     private:
-        std::vector<std::future<void>> m_pool;
-        std::atomic<uint32_t> m_activeThreads{};
+        utils::TaskPool& m_pool;
+        utils::TaskPool::Handle m_tasks;
+        
+        //
+        // parked tasks are not in the pool, so the pipeline
+        // waits until all the tasks are finished and then for the pool handle
+        //
+        std::atomic<uint32_t> m_activeTasks{};
+        mutable std::mutex m_doneMutex;
+        mutable std::condition_variable m_doneCv;
+        
+        //
+        // per hasher task: the record of the hashed chunk that is kept while the task is parked,
+        // the continuations that read the next chunk and push the record.
+        // They are allocated once, so hashing a chunk does not allocate a record
+        //
+        std::vector<Record> m_taskRecords;
+        std::vector<Resume> m_resumeHashers;
+        std::vector<Resume> m_resumePushers;
+        Gate m_gate;
         ChunkReader& m_reader;
         Hasher m_hasher;
         Records m_records;
+        
+        const std::chrono::steady_clock::time_point m_startTime;
+        utils::PaddedAtomic<uint64_t> m_bytesHashed;
+        utils::PaddedAtomic<uint64_t> m_chunksHashed;
+        utils::PaddedAtomic<uint64_t> m_hashNs;
+        utils::PaddedAtomic<uint64_t> m_waitNs;
+        const SigProbes m_probes;
     };
 }
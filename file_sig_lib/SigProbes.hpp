@@ -0,0 +1,28 @@
+//
+//  SigProbes.hpp
+//  file_signature
+//
+//  Created by artem k on 05.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#pragma once
+
+#include "SigLatency.hpp"
+#include "SigPerf.hpp"
+#include "SigTrace.hpp"
+
+namespace file_sig
+{
+    //
+    // Optional instrumentation of the pipeline stages
+    // A stage records to a probe only if it is set,
+    // the probes must outlive the objects they are passed to
+    //
+    struct SigProbes
+    {
+        SigLatency* latency = nullptr;
+        SigTrace* trace = nullptr;
+        SigPerf* perf = nullptr;
+    };
+}
@@ -8,8 +8,13 @@
 
 #pragma once
 
-#include <set>
+#include "Span.hpp"
+#include "SigProbes.hpp"
+
 #include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
 #include <functional>
 #include <condition_variable>
 #include <future>
@@ -29,15 +34,29 @@ namespace file_sig
     //      this method has higer priority than tryPopRecord,
     //      however, the callback must not use long operations or wait functions
     //      because it may decrease performance of the SigPipeline
+    //   * setOnRecordBatchCallback - the same as setOnRecordCallback but the callback
+    //      gets all the records that are ready at once
     // The class is also responsible for marshaling an exception
     // if the exception happened while next record is prepared
     //
+    // Records are sorted in a ring of at least 'windowSize' slots:
+    // a chunk with offset X is stored to the slot (X / chunkSize) % slots,
+    // so pushing a record is just a move to the slot and an atomic flag,
+    // there are no allocations and no locks on the push path.
+    // Only one thread at a time (the drainer) pops the contiguous prefix of ready slots.
+    // A record that is 'windowSize' chunks or more ahead of the next
+    // expected record waits until the window moves forward,
+    // so memory is bounded even if one of the hasher threads stalls.
+    // A pool task must not wait for the window holding a worker,
+    // it uses the overloads with a continuation: the task is parked
+    // and the continuation is called by the drainer once the window moves forward.
+    //
     template<typename SigHashType>
     class SigRecords
     {
     public:
         using Hasher = std::function<SigHashType(const void* data, size_t size)>;
-
+        
         struct HashRecord
         {
             uint32_t size = 0;
@@ -49,9 +68,16 @@ namespace file_sig
                 return offset < other.offset;
             }
         };
-
+        
         using OnHashRecord = std::function<void(HashRecord record)>;
         
+        //
+        // records in the batch are sorted and contiguous,
+        // they may be moved out by the callback
+        //
+        using HashRecordBatch = utils::Span<HashRecord>;
+        using OnHashRecordBatch = std::function<void(HashRecordBatch records)>;
+        
         enum class RecordResult
         {
             timeout,  // timeout, a record is not ready
@@ -59,37 +85,209 @@ namespace file_sig
             finished, // records are empty, task is finished
             canceled  // task was canceled
         };
+
+        using Resume = std::function<void()>;
         
+        enum class ParkResult
+        {
+            ready,   // the task may go on
+            parked,  // the continuation will be called, the task must return
+            canceled // the object is cleaned
+        };
+
     public:
+        //
+        // the first record has 'startOffset', it is not zero if a signature is resumed
+        //
+        SigRecords(uint32_t chunkSize, uint32_t windowSize, uint64_t startOffset = 0);
+        
+        SigRecords(const SigRecords&) = delete;
+        SigRecords& operator=(const SigRecords&) = delete;
+        
+        SigRecords(SigRecords&&) = delete;
+        SigRecords& operator=(SigRecords&&) = delete;
+        
         bool pushRecord(HashRecord record);
+        bool waitForWindow();
+        
+        //
+        // they never wait: if the record or the next chunk is out of the window,
+        // 'resume' is kept and the result is parked.
+        // The record is moved only if the result is ready
+        //
+        ParkResult tryPushRecord(HashRecord& record, const Resume& resume);
+        ParkResult tryWaitForWindow(const Resume& resume);
         RecordResult tryPopRecord(uint32_t timeoutMs, HashRecord& record);
         RecordResult waitForResult(uint32_t timeoutMs) const;
         void checkException() const;
         
         void setOnRecordCallback(OnHashRecord cb);
+        void setOnRecordBatchCallback(OnHashRecordBatch cb);
         void setException(std::exception_ptr ex);
         void setCleanup();
         void setFreez();
         
+        //
+        // records the reorder stage latency and trace,
+        // must be called before records are pushed
+        //
+        void setProbes(SigProbes probes);
+        
+        uint32_t getWindowSize() const;
+        uint32_t getDepth() const;
+        uint32_t getMaxDepth() const;
+
     private:
+        struct Slot
+        {
+            std::atomic<bool> ready{false};
+            HashRecord record;
+            SigLatency::Clock::time_point pushTime;
+        };
+
+        //
+        // the drainer flag is taken by a thread that pops records,
+        // it guarantees records are popped and passed to the callback in order
+        //
+        class DrainerLock
+        {
+        public:
+            explicit DrainerLock(std::atomic<bool>& flag)
+                : m_flag(flag)
+            {
+                bool expected = false;
+                m_owns = m_flag.compare_exchange_strong(expected, true);
+            }
+            
+            ~DrainerLock()
+            {
+                if (m_owns)
+                {
+                    m_flag.store(false);
+                }
+            }
+            
+            DrainerLock(const DrainerLock&) = delete;
+            DrainerLock& operator=(const DrainerLock&) = delete;
+            
+            bool owns() const
+            {
+                return m_owns;
+            }
+        
+        private:
+            std::atomic<bool>& m_flag;
+            bool m_owns = false;
+        };
+        
         bool tryPopNextRecord(HashRecord& record);
+        bool isNextRecordReady() const;
+        bool isInWindow(uint64_t index) const;
+        void updateTail(uint64_t index);
+        void storeRecord(uint64_t index, HashRecord& record, SigLatency::Clock::time_point pushTime);
+        void drainRecords();
+        void notifyAll();
         
+        template<typename Predicate>
+        ParkResult park(const Resume& resume, Predicate isReady);
+        void resumeParked();
+
     private:
         mutable std::mutex m_mutex;
         mutable std::condition_variable m_cv;
-        std::set<HashRecord> m_records;
+        std::condition_variable m_windowCv;
         std::exception_ptr m_exception;
-        OnHashRecord m_onHashRecord;
+        
+        std::unique_ptr<Slot[]> m_slots;
+        uint64_t m_slotsMask = 0;
+        const uint32_t m_chunkSize;
+        const uint32_t m_windowSize;
+        
+        //
+        // m_next is an index of the next record that has to be popped,
+        // it is changed only by the drainer
+        //
+        std::atomic<uint64_t> m_next{0};
         uint64_t m_offset = 0;
-        bool m_cleaned = false;
-        bool m_freezed = false;
+        
+        //
+        // m_tail is an index after the furthest pushed record,
+        // m_tail - m_next is the current depth of the window
+        //
+        std::atomic<uint64_t> m_tail{0};
+        std::atomic<uint32_t> m_maxDepth{0};
+        
+        std::atomic<bool> m_draining{false};
+        std::atomic<bool> m_hasCallback{false};
+        OnHashRecordBatch m_onHashRecords;
+        std::vector<HashRecord> m_batch;
+        
+        //
+        // threads that sleep on the condition variables,
+        // the push path takes the mutex only if somebody really waits
+        //
+        std::atomic<uint32_t> m_consumerWaiters{0};
+        std::atomic<uint32_t> m_windowWaiters{0};
+        
+        //
+        // continuations of parked tasks, the counter is changed under the mutex
+        // before the window is checked once again, so a move of the window is not missed
+        //
+        std::vector<Resume> m_parked;
+        std::atomic<uint32_t> m_parkedCount{0};
+        
+        std::atomic<bool> m_cleaned{false};
+        std::atomic<bool> m_freezed{false};
+        SigProbes m_probes;
     };
 
     template<typename SigHashType>
-    bool SigRecords<SigHashType>::pushRecord(HashRecord record)
+    SigRecords<SigHashType>::SigRecords(uint32_t chunkSize, uint32_t windowSize, uint64_t startOffset)
+        : m_chunkSize(chunkSize)
+        , m_windowSize(windowSize)
     {
-        std::lock_guard<std::mutex> lock(m_mutex);
+        if (0 == m_chunkSize)
+        {
+            throw std::invalid_argument("Chunk size must not be zero");
+        }
+        
+        if (0 == m_windowSize)
+        {
+            throw std::invalid_argument("Window size must not be zero");
+        }
+        
+        if (startOffset % m_chunkSize != 0)
+        {
+            throw std::invalid_argument("Start offset must be a multiple of the chunk size");
+        }
+        
+        m_next = startOffset / m_chunkSize;
+        m_tail = startOffset / m_chunkSize;
+        m_offset = startOffset;
+
+        //
+        // slots count is rounded up to a power of 2
+        // to get a slot by a mask instead of a division
+        //
+        uint64_t size = 2;
+        while (size < windowSize)
+        {
+            size <<= 1;
+        }
+        
+        m_slots.reset(new Slot[size]);
+        m_slotsMask = size - 1;
         
+        //
+        // a batch is never bigger than the window
+        // so it is not reallocated by the drainer
+        //
+        m_batch.reserve(m_windowSize);
+    }
+
+    template<typename SigHashType>
+    bool SigRecords<SigHashType>::pushRecord(HashRecord record)
+    {
         if (m_cleaned)
         {
             //
@@ -104,23 +302,112 @@ namespace file_sig
             throw std::logic_error("The object was freezed, new records are not allowed anymore");
         }
         
-        m_records.insert(std::move(record));
+        //
+        // waiting for the window is a part of the reorder stage
+        //
+        const bool timed = m_probes.latency || (m_probes.trace && m_probes.trace->isSampled(record.offset));
+        const auto pushTime = timed ? SigLatency::Clock::now() : SigLatency::Clock::time_point();
+        const uint64_t index = record.offset / m_chunkSize;
+        
+        if (index < m_next)
+        {
+            throw std::logic_error("The record has been already popped");
+        }
         
-        if (m_onHashRecord)
+        if (!isInWindow(index))
         {
-            HashRecord r;
+            //
+            // the record is too far ahead of the next expected record,
+            // wait until the drainer frees its slot
+            //
+            std::unique_lock<std::mutex> lock(m_mutex);
+            ++m_windowWaiters;
+            
+            m_windowCv.wait(lock, [this, index]()
+            {
+                return m_cleaned || isInWindow(index);
+            });
+            
+            --m_windowWaiters;
             
-            while (tryPopNextRecord(r))
+            if (m_cleaned)
             {
-                m_onHashRecord(std::move(r));
+                return false;
             }
         }
-        else
+        
+        storeRecord(index, record, pushTime);
+        return true;
+    }
+
+    template<typename SigHashType>
+    typename SigRecords<SigHashType>::ParkResult SigRecords<SigHashType>::tryPushRecord(HashRecord& record,
+                                                                                        const Resume& resume)
+    {
+        if (m_cleaned)
         {
-            m_cv.notify_one();
+            return ParkResult::canceled;
         }
         
-        return true;
+        if (m_freezed)
+        {
+            throw std::logic_error("The object was freezed, new records are not allowed anymore");
+        }
+        
+        const uint64_t index = record.offset / m_chunkSize;
+        
+        if (index < m_next)
+        {
+            throw std::logic_error("The record has been already popped");
+        }
+        
+        const auto res = park(resume, [this, index]()
+        {
+            return isInWindow(index);
+        });
+        
+        if (res != ParkResult::ready)
+        {
+            return res;
+        }
+        
+        //
+        // a parked record waits in its continuation, not in the reorder stage
+        //
+        const bool timed = m_probes.latency || (m_probes.trace && m_probes.trace->isSampled(record.offset));
+        storeRecord(index, record, timed ? SigLatency::Clock::now() : SigLatency::Clock::time_point());
+        return ParkResult::ready;
+    }
+
+    template<typename SigHashType>
+    void SigRecords<SigHashType>::storeRecord(uint64_t index,
+                                              HashRecord& record,
+                                              SigLatency::Clock::time_point pushTime)
+    {
+        Slot& slot = m_slots[index & m_slotsMask];
+        slot.record = std::move(record);
+        slot.pushTime = pushTime;
+        slot.ready.store(true);
+        updateTail(index);
+        
+        if (index != m_next)
+        {
+            //
+            // the previous record is not ready yet,
+            // the thread that pushes it will pop this one
+            //
+            return;
+        }
+        
+        if (m_hasCallback)
+        {
+            drainRecords();
+        }
+        else if (m_consumerWaiters)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_cv.notify_one();
+        }
     }
 
     template<typename SigHashType>
@@ -142,13 +429,33 @@ namespace file_sig
             {
                 return RecordResult::canceled;
             }
+
+            //
+            // freez flag must be read before popping,
+            // all the records have been pushed if it is set
+            //
+            const bool freezed = m_freezed;
+            
+            //
+            // popping may notify producers that wait for the window,
+            // so it is done without the lock
+            //
+            bool popped = false;
+            lock.unlock();
             
-            if (tryPopNextRecord(record))
+            {
+                DrainerLock drainer(m_draining);
+                popped = drainer.owns() && tryPopNextRecord(record);
+            }
+            
+            lock.lock();
+            
+            if (popped)
             {
                 return RecordResult::ready;
             }
             
-            if (m_freezed)
+            if (freezed)
             {
                 //
                 // there are no records in the container
@@ -156,13 +463,22 @@ namespace file_sig
                 //
                 return RecordResult::finished;
             }
-            
+
             //
             // wait until, not wait_for
             // not to wait much more time in case of
             // a few spurious wakeups
             //
-            auto cv = m_cv.wait_until(lock, timepoint);
+            ++m_consumerWaiters;
+            
+            auto cv = std::cv_status::no_timeout;
+            
+            if (!isNextRecordReady())
+            {
+                cv = m_cv.wait_until(lock, timepoint);
+            }
+            
+            --m_consumerWaiters;
             
             if (cv == std::cv_status::timeout)
             {
@@ -174,24 +490,244 @@ namespace file_sig
     template<typename SigHashType>
     bool SigRecords<SigHashType>::tryPopNextRecord(HashRecord& record)
     {
-        if (m_records.empty())
+        //
+        // must be called by the drainer only
+        //
+        const uint64_t next = m_next;
+        Slot& slot = m_slots[next & m_slotsMask];
+        
+        if (!slot.ready)
         {
             return false;
         }
         
-        auto it = m_records.begin();
+        if (slot.record.offset != m_offset)
+        {
+            throw std::logic_error("Records are not contiguous");
+        }
+        
+        record = std::move(slot.record);
+        m_offset += record.size;
         
-        if (it->offset != m_offset)
+        if (slot.pushTime != SigLatency::Clock::time_point())
         {
-            return false;
+            const auto time = SigLatency::Clock::now();
+            
+            if (m_probes.latency)
+            {
+                m_probes.latency->record(SigStage::reorder, time - slot.pushTime);
+            }
+            
+            if (m_probes.trace && m_probes.trace->isSampled(record.offset))
+            {
+                m_probes.trace->asyncSlice("reorder", slot.pushTime, time, record.offset);
+            }
+        }
+        
+        slot.ready.store(false);
+        m_next.store(next + 1);
+        
+        if (m_windowWaiters)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_windowCv.notify_all();
+        }
+        
+        if (m_parkedCount)
+        {
+            resumeParked();
         }
         
-        record = std::move(*it);
-        m_offset += it->size;
-        m_records.erase(it);
         return true;
     }
 
+    template<typename SigHashType>
+    bool SigRecords<SigHashType>::isNextRecordReady() const
+    {
+        return m_slots[m_next & m_slotsMask].ready;
+    }
+
+    template<typename SigHashType>
+    bool SigRecords<SigHashType>::isInWindow(uint64_t index) const
+    {
+        return index - m_next < m_windowSize;
+    }
+
+    template<typename SigHashType>
+    void SigRecords<SigHashType>::updateTail(uint64_t index)
+    {
+        uint64_t tail = m_tail;
+        
+        while (tail <= index && !m_tail.compare_exchange_weak(tail, index + 1))
+        {
+        }
+        
+        const uint32_t depth = getDepth();
+        uint32_t maxDepth = m_maxDepth;
+        
+        while (maxDepth < depth && !m_maxDepth.compare_exchange_weak(maxDepth, depth))
+        {
+        }
+    }
+
+    template<typename SigHashType>
+    bool SigRecords<SigHashType>::waitForWindow()
+    {
+        //
+        // all the chunks before m_tail have been already taken by hashers,
+        // so a hasher that is going to read one more chunk has to wait
+        // until the next expected record is pushed and the window moves forward
+        //
+        if (!m_cleaned && isInWindow(m_tail))
+        {
+            return true;
+        }
+        
+        std::unique_lock<std::mutex> lock(m_mutex);
+        ++m_windowWaiters;
+        
+        m_windowCv.wait(lock, [this]()
+        {
+            return m_cleaned || isInWindow(m_tail);
+        });
+        
+        --m_windowWaiters;
+        return !m_cleaned;
+    }
+
+    template<typename SigHashType>
+    typename SigRecords<SigHashType>::ParkResult SigRecords<SigHashType>::tryWaitForWindow(const Resume& resume)
+    {
+        return park(resume, [this]()
+        {
+            return isInWindow(m_tail);
+        });
+    }
+
+    template<typename SigHashType>
+    template<typename Predicate>
+    typename SigRecords<SigHashType>::ParkResult SigRecords<SigHashType>::park(const Resume& resume,
+                                                                               Predicate isReady)
+    {
+        if (m_cleaned)
+        {
+            return ParkResult::canceled;
+        }
+        
+        if (isReady())
+        {
+            return ParkResult::ready;
+        }
+        
+        std::lock_guard<std::mutex> lock(m_mutex);
+        
+        //
+        // the continuation is published before the window is checked again,
+        // the drainer moves the window before it checks the counter
+        //
+        m_parked.push_back(resume);
+        m_parkedCount = static_cast<uint32_t>(m_parked.size());
+        
+        if (m_cleaned || isReady())
+        {
+            m_parked.pop_back();
+            m_parkedCount = static_cast<uint32_t>(m_parked.size());
+            return m_cleaned ? ParkResult::canceled : ParkResult::ready;
+        }
+        
+        return ParkResult::parked;
+    }
+
+    template<typename SigHashType>
+    void SigRecords<SigHashType>::resumeParked()
+    {
+        std::vector<Resume> parked;
+        
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            parked.swap(m_parked);
+            m_parkedCount = 0;
+        }
+        
+        //
+        // continuations are called without the lock,
+        // a task that is still out of the window parks itself again
+        //
+        for (auto& resume : parked)
+        {
+            resume();
+        }
+    }
+
+    template<typename SigHashType>
+    uint32_t SigRecords<SigHashType>::getWindowSize() const
+    {
+        return m_windowSize;
+    }
+
+    template<typename SigHashType>
+    uint32_t SigRecords<SigHashType>::getDepth() const
+    {
+        //
+        // m_next may be moved forward after m_tail has been read
+        //
+        const uint64_t tail = m_tail;
+        const uint64_t next = m_next;
+        return tail > next ? static_cast<uint32_t>(tail - next) : 0;
+    }
+
+    template<typename SigHashType>
+    uint32_t SigRecords<SigHashType>::getMaxDepth() const
+    {
+        return m_maxDepth;
+    }
+
+    template<typename SigHashType>
+    void SigRecords<SigHashType>::drainRecords()
+    {
+        do
+        {
+            DrainerLock drainer(m_draining);
+            
+            if (!drainer.owns())
+            {
+                //
+                // another thread pops records now,
+                // it checks the next record once again after releasing the drainer flag
+                //
+                return;
+            }
+            
+            for (;;)
+            {
+                HashRecord record;
+                
+                while (m_batch.size() < m_windowSize && tryPopNextRecord(record))
+                {
+                    m_batch.push_back(std::move(record));
+                }
+                
+                if (m_batch.empty())
+                {
+                    break;
+                }
+                
+                try
+                {
+                    m_onHashRecords(HashRecordBatch(m_batch.data(), m_batch.size()));
+                }
+                catch (...)
+                {
+                    m_batch.clear();
+                    throw;
+                }
+                
+                m_batch.clear();
+            }
+        }
+        while (isNextRecordReady());
+    }
+
     template<typename SigHashType>
     typename SigRecords<SigHashType>::RecordResult SigRecords<SigHashType>::waitForResult(uint32_t timeoutMs) const
     {
@@ -211,7 +747,7 @@ namespace file_sig
                 return RecordResult::canceled;
             }
             
-            if (m_freezed && m_records.empty())
+            if (m_freezed && !isNextRecordReady())
             {
                 //
                 // there are no records in the container
@@ -219,7 +755,7 @@ namespace file_sig
                 //
                 return RecordResult::finished;
             }
-            
+
             //
             // wait until, not wait_for
             // not to wait much more time in case of
@@ -244,22 +780,50 @@ namespace file_sig
             std::rethrow_exception(m_exception);
         }
     }
-    
+
     template<typename SigHashType>
     void SigRecords<SigHashType>::setOnRecordCallback(OnHashRecord cb)
     {
-        std::lock_guard<std::mutex> lock(m_mutex);
-        m_onHashRecord = std::move(cb);
+        if (!cb)
+        {
+            setOnRecordBatchCallback(nullptr);
+            return;
+        }
         
-        if (m_onHashRecord)
+        setOnRecordBatchCallback([cb](HashRecordBatch records)
         {
-            HashRecord record;
-            while (tryPopNextRecord(record))
+            for (auto& record : records)
+            {
+                cb(std::move(record));
+            }
+        });
+    }
+
+    template<typename SigHashType>
+    void SigRecords<SigHashType>::setOnRecordBatchCallback(OnHashRecordBatch cb)
+    {
+        //
+        // the callback is used by the drainer only,
+        // so the drainer flag is enough to replace it
+        //
+        for (;;)
+        {
+            DrainerLock drainer(m_draining);
+            
+            if (drainer.owns())
             {
-                m_onHashRecord(std::move(record));
+                m_onHashRecords = std::move(cb);
+                m_hasCallback = !!m_onHashRecords;
+                break;
             }
+            
+            std::this_thread::yield();
         }
         
+        if (m_hasCallback)
+        {
+            drainRecords();
+        }
     }
 
     template<typename SigHashType>
@@ -283,17 +847,32 @@ namespace file_sig
     template<typename SigHashType>
     void SigRecords<SigHashType>::setCleanup()
     {
-        std::lock_guard<std::mutex> lock(m_mutex);
         m_cleaned = true;
-        m_records.clear();
-        m_cv.notify_all();
+        notifyAll();
     }
 
     template<typename SigHashType>
     void SigRecords<SigHashType>::setFreez()
     {
-        std::lock_guard<std::mutex> lock(m_mutex);
         m_freezed = true;
-        m_cv.notify_all();
+        notifyAll();
+    }
+
+    template<typename SigHashType>
+    void SigRecords<SigHashType>::setProbes(SigProbes probes)
+    {
+        m_probes = probes;
+    }
+
+    template<typename SigHashType>
+    void SigRecords<SigHashType>::notifyAll()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_cv.notify_all();
+            m_windowCv.notify_all();
+        }
+        
+        resumeParked();
     }
 }
@@ -0,0 +1,208 @@
+//
+//  SigReport.cpp
+//  file_signature
+//
+//  Created by artem k on 19.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#include "SigReport.hpp"
+#include "SigWriter.hpp"
+#include "Exceptions.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+namespace file_sig
+{
+    void printRecord(std::ostream& out, const SigPipeline::Record& record, std::vector<char>& buffer)
+    {
+        buffer.resize(std::max(buffer.size(), SigWriter::getMaxRecordSize(record)));
+        const char* end = SigWriter::formatRecord(record, buffer.data());
+        
+        //
+        // without the line end of the signature
+        //
+        out.write(buffer.data(), end - buffer.data() - 2);
+    }
+
+    StatsDump::StatsDump(const std::string& filePath, std::chrono::milliseconds interval)
+        : m_interval(interval)
+    {
+        if (!filePath.empty())
+        {
+            m_file.open(filePath);
+            THROW_IF(!m_file, "Cannot open " << filePath);
+        }
+    }
+
+    void StatsDump::dump(const SigPipeline& pipeline, bool force)
+    {
+        const auto now = std::chrono::steady_clock::now();
+        
+        if (m_file.is_open() && (force || now - m_lastTime >= m_interval))
+        {
+            m_lastTime = now;
+            m_file << pipeline.stats().toJson() << "\n" << std::flush;
+        }
+    }
+
+    void printReport(std::ostream& out,
+                     const SigLatency& latency,
+                     uint64_t bytes,
+                     double seconds,
+                     bool json)
+    {
+        const auto stages = latency.merge();
+        const double throughput = seconds > 0 ? bytes / seconds / (1024 * 1024) : 0;
+        
+        out << std::fixed << std::setprecision(2);
+        
+        if (json)
+        {
+            out << "{\"bytes\":" << bytes;
+            out << ",\"seconds\":" << seconds;
+            out << ",\"throughput_mb_s\":" << throughput;
+            out << ",\"stages\":{";
+            
+            for (size_t i = 0; i < stages.size(); ++i)
+            {
+                const auto& stage = stages[i];
+                out << (i ? "," : "") << "\"" << getStageName(static_cast<SigStage>(i)) << "\":{";
+                out << "\"count\":" << stage.getCount();
+                out << ",\"p50_us\":" << stage.getPercentile(50) / 1000.0;
+                out << ",\"p99_us\":" << stage.getPercentile(99) / 1000.0;
+                out << ",\"max_us\":" << stage.getMax() / 1000.0 << "}";
+            }
+            
+            out << "}}\n";
+            return;
+        }
+        
+        out << "Stage latency, us:\n";
+        out << std::setw(10) << "stage" << std::setw(12) << "count";
+        out << std::setw(14) << "p50" << std::setw(14) << "p99" << std::setw(14) << "max" << "\n";
+        
+        for (size_t i = 0; i < stages.size(); ++i)
+        {
+            const auto& stage = stages[i];
+            out << std::setw(10) << getStageName(static_cast<SigStage>(i));
+            out << std::setw(12) << stage.getCount();
+            out << std::setw(14) << stage.getPercentile(50) / 1000.0;
+            out << std::setw(14) << stage.getPercentile(99) / 1000.0;
+            out << std::setw(14) << stage.getMax() / 1000.0 << "\n";
+        }
+        
+        out << "Throughput: " << throughput << " MB/s\n";
+    }
+
+    void printPerf(std::ostream& out, const SigPerf& perf, const std::string& hasher, bool json)
+    {
+        const std::string error = perf.getError();
+        
+        if (!error.empty() && json)
+        {
+            out << "{\"hasher\":\"" << hasher << "\",\"error\":\"" << error << "\"}\n";
+            return;
+        }
+        
+        if (!error.empty())
+        {
+            out << "Hardware counters are not collected: " << error << "\n";
+            return;
+        }
+        
+        const auto stages = perf.merge();
+        const SigStage counted[] = {SigStage::read, SigStage::hash};
+        
+        out << std::fixed << std::setprecision(2);
+        
+        if (json)
+        {
+            out << "{\"hasher\":\"" << hasher << "\",\"stages\":{";
+            
+            for (size_t i = 0; i < sizeof(counted) / sizeof(counted[0]); ++i)
+            {
+                const auto& stage = stages[static_cast<size_t>(counted[i])];
+                out << (i ? "," : "") << "\"" << getStageName(counted[i]) << "\":{";
+                out << "\"chunks\":" << stage.samples;
+                
+                for (size_t j = 0; j < utils::kPerfEventsCount; ++j)
+                {
+                    const auto event = static_cast<utils::PerfEvent>(j);
+                    out << ",\"" << utils::getPerfEventName(event) << "\":";
+                    
+                    if (perf.isAvailable(event))
+                    {
+                        out << stage.values[j];
+                    }
+                    else
+                    {
+                        out << "null";
+                    }
+                }
+                
+                out << "}";
+            }
+            
+            out << "}}\n";
+            return;
+        }
+        
+        out << "Hardware counters per chunk, " << hasher << ":\n";
+        out << std::setw(10) << "stage" << std::setw(12) << "chunks";
+        
+        for (size_t j = 0; j < utils::kPerfEventsCount; ++j)
+        {
+            out << std::setw(14) << utils::getPerfEventName(static_cast<utils::PerfEvent>(j));
+        }
+        
+        out << std::setw(8) << "IPC" << "\n";
+        
+        for (auto id : counted)
+        {
+            const auto& stage = stages[static_cast<size_t>(id)];
+            const double chunks = static_cast<double>(std::max<uint64_t>(stage.samples, 1));
+            out << std::setw(10) << getStageName(id) << std::setw(12) << stage.samples;
+            
+            for (size_t j = 0; j < utils::kPerfEventsCount; ++j)
+            {
+                if (perf.isAvailable(static_cast<utils::PerfEvent>(j)))
+                {
+                    out << std::setw(14) << stage.values[j] / chunks;
+                }
+                else
+                {
+                    out << std::setw(14) << "n/a";
+                }
+            }
+            
+            const uint64_t cycles = stage.values[static_cast<size_t>(utils::PerfEvent::cycles)];
+            const uint64_t instructions = stage.values[static_cast<size_t>(utils::PerfEvent::instructions)];
+            
+            if (cycles && perf.isAvailable(utils::PerfEvent::instructions))
+            {
+                out << std::setw(8) << static_cast<double>(instructions) / cycles << "\n";
+            }
+            else
+            {
+                out << std::setw(8) << "n/a" << "\n";
+            }
+        }
+    }
+
+    std::string timeToStr(uint64_t seconds)
+    {
+        std::stringstream st;
+
+        if (seconds > 60)
+        {
+            st << (seconds / 60) << " minute(s) ";
+            seconds = seconds % 60;
+        }
+        
+        st << seconds << " second(s)";
+        return st.str();
+    }
+}
@@ -0,0 +1,65 @@
+//
+//  SigReport.hpp
+//  file_signature
+//
+//  Created by artem k on 19.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#pragma once
+
+#include "SigPipeline.hpp"
+#include "SigLatency.hpp"
+#include "SigPerf.hpp"
+
+#include <chrono>
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace file_sig
+{
+    //
+    // prints "0x<offset>:0x<size>:<hash>" by the signature formatter,
+    // the buffer is reused for all the records
+    //
+    void printRecord(std::ostream& out, const SigPipeline::Record& record, std::vector<char>& buffer);
+
+    //
+    // writes pipeline statistics as JSON lines,
+    // not more often than once per interval
+    //
+    class StatsDump
+    {
+    public:
+        StatsDump(const std::string& filePath, std::chrono::milliseconds interval);
+        
+        void dump(const SigPipeline& pipeline, bool force);
+        
+    private:
+        std::ofstream m_file;
+        std::chrono::steady_clock::time_point m_lastTime;
+        const std::chrono::milliseconds m_interval;
+    };
+
+    //
+    // per-stage latency in microseconds and throughput
+    //
+    void printReport(std::ostream& out,
+                     const SigLatency& latency,
+                     uint64_t bytes,
+                     double seconds,
+                     bool json);
+
+    //
+    // hardware counters of the read and hash stages per chunk,
+    // the counters are measured for one hash algorithm per run
+    //
+    void printPerf(std::ostream& out, const SigPerf& perf, const std::string& hasher, bool json);
+
+    //
+    // "<minutes> minute(s) <seconds> second(s)"
+    //
+    std::string timeToStr(uint64_t seconds);
+}
@@ -0,0 +1,364 @@
+//
+//  SigServer.cpp
+//  file_signature
+//
+//  Created by artem k on 14.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#include "SigServer.hpp"
+#include "SigFileReader.hpp"
+#include "SigVerifier.hpp"
+#include "SigWriter.hpp"
+#include "FileStreamChunkReader.hpp"
+#include "Hash.hpp"
+#include "Utils.hpp"
+
+#include <sstream>
+
+namespace file_sig
+{
+    namespace
+    {
+        //
+        // records are sent by blocks of this size
+        //
+        const size_t kSendBufferSize = 64 * 1024;
+        
+        //
+        // a job is several short lines, a client that sends more is dropped
+        // before it takes much memory
+        //
+        const size_t kMaxJobLines = 64;
+        const size_t kMaxJobLineSize = 4 * 1024;
+        
+        //
+        // a client has to send its job in time, it does not hold a connection for nothing
+        //
+        const uint32_t kReceiveTimeoutMs = 10 * 1000;
+        
+        //
+        // every connection has a thread, the further clients are refused
+        // until some of the jobs finish
+        //
+        const size_t kMaxConnections = 64;
+        
+        const uint32_t kAcceptTimeoutMs = 200;
+        
+        //
+        // a job of a client that does not read its answer is canceled,
+        // so its file and chunk buffers are not kept forever
+        //
+        const uint32_t kSendTimeoutMs = 60 * 1000;
+        
+        SigPipeline::Hasher createHasher(const std::string& hasher)
+        {
+            if (hasher == "crc32")
+            {
+                return utils::crc32;
+            }
+            else if (hasher == "sha2")
+            {
+                return utils::sha2;
+            }
+            
+            THROW("Unknown hasher type: " << hasher);
+        }
+        
+        //
+        // answers an error to a client above the connections limit
+        //
+        void refuse(utils::LocalSocket& socket)
+        {
+            try
+            {
+                //
+                // the job is read first, a socket closed with unread data resets the connection
+                // and the client would not get the answer. The answer fits the empty buffer
+                // of the new socket, so the accepting thread is blocked for the read timeout at most
+                //
+                socket.setReadTimeout(kAcceptTimeoutMs);
+                socket.setWriteTimeout(kAcceptTimeoutMs);
+                std::string line;
+                
+                for (size_t i = 0; i < kMaxJobLines && socket.readLine(line, kMaxJobLineSize) && !line.empty(); ++i)
+                {
+                }
+                
+                socket.write("Status: Error The daemon is busy, " + std::to_string(kMaxConnections) + " jobs are served\r\n");
+            }
+            catch (const std::exception&)
+            {
+                //
+                // the client has gone
+                //
+            }
+            
+            socket.shutdown();
+        }
+        
+        std::string getValue(const std::map<std::string, std::string>& job,
+                             const std::string& key,
+                             const std::string& defaultValue = std::string())
+        {
+            const auto it = job.find(key);
+            return it == job.end() ? defaultValue : it->second;
+        }
+    }
+
+    SigServer::SigServer(const std::string& socketPath, uint32_t threads, uint32_t chunkSize)
+        : m_threads(std::max(threads, 1u))
+        , m_jobThreads(std::max(m_threads / 2, 1u))
+        , m_chunkSize(chunkSize)
+        , m_pool(m_threads)
+        , m_buffers(4 * m_threads, m_chunkSize)
+    {
+        //
+        // each hasher task of a job has one cached chunk and one current chunk,
+        // so four jobs fit the slots, the other ones take extra buffers
+        //
+        m_listener = utils::LocalSocket::listen(socketPath);
+    }
+
+    SigServer::~SigServer()
+    {
+        for (auto& connection : m_connections)
+        {
+            connection->socket.shutdown();
+        }
+        
+        joinFinished(true);
+    }
+
+    void SigServer::run(const std::function<bool()>& isStopped)
+    {
+        while (!isStopped())
+        {
+            auto socket = m_listener.accept(kAcceptTimeoutMs);
+            joinFinished(false);
+            
+            if (!socket.isValid())
+            {
+                continue;
+            }
+            
+            if (m_connections.size() >= kMaxConnections)
+            {
+                refuse(socket);
+                continue;
+            }
+
+            //
+            // a connection thread mostly waits for the socket or the pipeline,
+            // the chunks are hashed by the shared pool
+            //
+            m_connections.emplace_back(new Connection());
+            Connection& connection = *m_connections.back();
+            connection.socket = std::move(socket);
+            connection.thread = std::thread([this, &connection]()
+            {
+                serve(connection);
+                connection.finished = true;
+            });
+        }
+    }
+
+    uint64_t SigServer::getJobsCount() const
+    {
+        return m_jobs;
+    }
+
+    void SigServer::serve(Connection& connection)
+    {
+        auto& socket = connection.socket;
+        
+        try
+        {
+            Job job;
+            std::string line;
+            socket.setReadTimeout(kReceiveTimeoutMs);
+            
+            while (socket.readLine(line, kMaxJobLineSize) && !line.empty())
+            {
+                THROW_IF(job.size() >= kMaxJobLines, "The job is too long");
+                
+                const auto pos = line.find(": ");
+                THROW_IF(pos == std::string::npos, "Invalid job line: " << line);
+                job[line.substr(0, pos)] = line.substr(pos + 2);
+            }
+            
+            if (job.empty())
+            {
+                return;
+            }
+            
+            ++m_jobs;
+            socket.setWriteTimeout(kSendTimeoutMs);
+            const std::string type = getValue(job, "Job");
+            
+            if (type == "sign")
+            {
+                sign(socket, job);
+            }
+            else if (type == "verify")
+            {
+                verify(socket, job);
+            }
+            else
+            {
+                THROW("Unknown job: " << type);
+            }
+        }
+        catch (const std::exception& ex)
+        {
+            try
+            {
+                socket.write(std::string("Status: Error ") + ex.what() + "\r\n");
+            }
+            catch (const std::exception&)
+            {
+                //
+                // the client has gone
+                //
+            }
+        }
+        
+        socket.shutdown();
+    }
+
+    void SigServer::sign(utils::LocalSocket& socket, const Job& job)
+    {
+        SigFileReader::Header header;
+        header.fileName = getValue(job, "Filename");
+        header.hasher = getValue(job, "Hash", "crc32");
+        
+        const std::string chunkSize = getValue(job, "Chunksize");
+        const uint32_t size = chunkSize.empty() ? m_chunkSize : utils::toUnsigned<uint32_t>(chunkSize);
+        
+        THROW_IF(header.fileName.empty(), "Filename is not set");
+        THROW_IF(0 == size, "Chunksize must be positive");
+        
+        auto hasher = createHasher(header.hasher);
+        header.fileSize = utils::getFileSize(header.fileName);
+        
+        //
+        // the reader must outlive the pipeline
+        //
+        FileStreamChunkReader reader(header.fileName,
+                                     m_pool,
+                                     2 * m_jobThreads,
+                                     size,
+                                     utils::TaskPool::kAnyWorker,
+                                     0,
+                                     &m_buffers);
+        SigPipeline pipeline(reader, hasher, m_pool, m_jobThreads, 0);
+        
+        std::vector<char> buffer(kSendBufferSize);
+        const std::string text = SigFileReader::formatHeader(header);
+        std::copy(text.begin(), text.end(), buffer.begin());
+        size_t used = text.size();
+        
+        SigPipeline::Record record;
+        auto res = SigPipeline::WaitRes::timeout;
+        
+        //
+        // records are popped by the connection thread, it may wait for a slow client,
+        // then the window of the job is full and its hasher tasks are parked,
+        // so the workers hash the chunks of other jobs
+        //
+        while ((res = pipeline.wait(1000, record)) != SigPipeline::WaitRes::finished)
+        {
+            THROW_IF(SigPipeline::WaitRes::canceled == res, "The job has been canceled");
+            
+            if (SigPipeline::WaitRes::ready != res)
+            {
+                continue;
+            }
+            
+            const size_t maxSize = SigWriter::getMaxRecordSize(record);
+            
+            if (used + maxSize > buffer.size())
+            {
+                socket.write(buffer.data(), used);
+                used = 0;
+                buffer.resize(std::max(buffer.size(), maxSize));
+            }
+            
+            used = SigWriter::formatRecord(record, buffer.data() + used) - buffer.data();
+        }
+        
+        socket.write(buffer.data(), used);
+        socket.write("Status: OK\r\n");
+    }
+
+    void SigServer::verify(utils::LocalSocket& socket, const Job& job)
+    {
+        SigVerifier verifier(getValue(job, "Signature"), false);
+        
+        std::string fileName = getValue(job, "Filename");
+        
+        if (fileName.empty())
+        {
+            fileName = verifier.getHeader().fileName;
+        }
+        
+        const uint32_t size = verifier.getChunkSize() ? verifier.getChunkSize() : m_chunkSize;
+        const uint64_t fileSize = utils::getFileSize(fileName);
+        
+        FileStreamChunkReader reader(fileName,
+                                     m_pool,
+                                     2 * m_jobThreads,
+                                     size,
+                                     utils::TaskPool::kAnyWorker,
+                                     0,
+                                     &m_buffers);
+        SigPipeline pipeline(reader, createHasher(verifier.getHeader().hasher), m_pool, m_jobThreads, 0);
+        
+        SigPipeline::Record record;
+        auto res = SigPipeline::WaitRes::timeout;
+        
+        while ((res = pipeline.wait(1000, record)) != SigPipeline::WaitRes::finished)
+        {
+            THROW_IF(SigPipeline::WaitRes::canceled == res, "The job has been canceled");
+            
+            if (SigPipeline::WaitRes::ready == res)
+            {
+                verifier.check(SigVerifier::RecordBatch(&record, 1));
+            }
+        }
+        
+        verifier.finish(fileSize);
+        
+        std::stringstream text;
+        text << "Checked chunks: " << verifier.getCheckedChunks() << ", bad chunks: " << verifier.getBadChunks() << "\r\n";
+        
+        if (verifier.getHeader().fileSize != fileSize)
+        {
+            text << "File size " << fileSize << " does not match the signature " << verifier.getHeader().fileSize << "\r\n";
+        }
+        
+        for (const auto& range : verifier.getBadRanges())
+        {
+            text << "Bad range: 0x" << std::hex << range.offset << ":0x" << range.size << std::dec << "\r\n";
+        }
+        
+        text << "Status: " << (verifier.isOk() ? "OK" : "FAILED") << "\r\n";
+        socket.write(text.str());
+    }
+
+    void SigServer::joinFinished(bool all)
+    {
+        for (auto it = m_connections.begin(); it != m_connections.end();)
+        {
+            if (all || (*it)->finished)
+            {
+                (*it)->thread.join();
+                it = m_connections.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+}
@@ -0,0 +1,96 @@
+//
+//  SigServer.hpp
+//  file_signature
+//
+//  Created by artem k on 14.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#pragma once
+
+#include "SigPipeline.hpp"
+#include "ChunkBufferPool.hpp"
+#include "LocalSocket.hpp"
+#include "TaskPool.hpp"
+
+#include <atomic>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace file_sig
+{
+    //
+    // A daemon that signs and verifies files for clients of a local socket
+    // The task pool and the chunk buffers are created once and shared by all the jobs,
+    // a job only opens its file. Hasher tasks of a pipeline push themselves
+    // again after every chunk, so the chunks of concurrent jobs are interleaved
+    // in the pool and every job gets a fair share of the cores.
+    // A job runs up to half of the workers, so one job never takes the whole pool.
+    // While a client does not read, the records of its job wait in the reorder window
+    // and the hasher tasks of the job are parked, they do not hold workers.
+    // A client that does not read its answer for a minute is dropped,
+    // as well as a client that does not send its job in 10 seconds
+    // or sends a line longer than 4 KB. Up to 64 connections are served at once,
+    // the further clients are answered by an error
+    //
+    // A connection sends one job as "Key: value" lines and an empty line:
+    //   Job: sign                      Job: verify
+    //   Filename: <path>               Signature: <path>
+    //   Hash: <crc32|sha2>             Filename: <path> (optional)
+    //   Chunksize: <bytes>
+    // A sign job is answered by a text signature (the header and the records,
+    // as they are hashed), a verify job by "Checked chunks" and "Bad range" lines.
+    // The answer ends with "Status: OK", "Status: FAILED" or "Status: Error <message>".
+    // Paths are resolved by the daemon
+    //
+    class SigServer
+    {
+    public:
+        //
+        // threads - workers of the shared pool, a job uses half of them,
+        // chunkSize - a default of the jobs, the buffers of one job are preallocated for it
+        //
+        SigServer(const std::string& socketPath, uint32_t threads, uint32_t chunkSize);
+        ~SigServer();
+        
+        SigServer(const SigServer&) = delete;
+        SigServer& operator=(const SigServer&) = delete;
+        
+        //
+        // serves connections until isStopped returns true, it is polled
+        //
+        void run(const std::function<bool()>& isStopped);
+        
+        uint64_t getJobsCount() const;
+
+    private:
+        using Job = std::map<std::string, std::string>;
+        
+        struct Connection
+        {
+            utils::LocalSocket socket;
+            std::thread thread;
+            std::atomic<bool> finished{false};
+        };
+        
+        void serve(Connection& connection);
+        void sign(utils::LocalSocket& socket, const Job& job);
+        void verify(utils::LocalSocket& socket, const Job& job);
+        void joinFinished(bool all);
+
+    private:
+        const uint32_t m_threads;
+        const uint32_t m_jobThreads;
+        const uint32_t m_chunkSize;
+        utils::TaskPool m_pool;
+        ChunkBufferPool m_buffers;
+        utils::LocalSocket m_listener;
+        std::list<std::unique_ptr<Connection>> m_connections;
+        std::atomic<uint64_t> m_jobs{0};
+    };
+}
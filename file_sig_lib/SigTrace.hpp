@@ -0,0 +1,78 @@
+//
+//  SigTrace.hpp
+//  file_signature
+//
+//  Created by artem k on 05.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#pragma once
+
+#include "Trace.hpp"
+
+#include <algorithm>
+
+namespace file_sig
+{
+    //
+    // Trace of chunk lifecycles: read, map/unmap, hash, reorder and write slices
+    // Only every 'sampleEvery' chunk is traced, so the trace size and
+    // the overhead of a long run are bounded
+    //
+    class SigTrace
+    {
+    public:
+        using Clock = utils::TraceRecorder::Clock;
+        
+        SigTrace(uint32_t chunkSize, uint32_t sampleEvery, size_t maxEventsPerThread)
+            : m_chunkSize(std::max(chunkSize, 1u))
+            , m_sampleEvery(std::max(sampleEvery, 1u))
+            , m_recorder(maxEventsPerThread)
+        {
+        }
+        
+        bool isSampled(uint64_t offset) const
+        {
+            return 0 == (offset / m_chunkSize) % m_sampleEvery;
+        }
+
+        //
+        // a slice of the current thread that started at 'start' and ends now
+        //
+        void slice(const char* name, Clock::time_point start, uint64_t offset)
+        {
+            slice(name, start, Clock::now(), offset);
+        }
+        
+        void slice(const char* name, Clock::time_point start, Clock::time_point end, uint64_t offset)
+        {
+            m_recorder.complete(name, start, end, offset / m_chunkSize);
+        }
+
+        //
+        // a slice that may overlap slices of the thread, e.g. waiting for reordering
+        //
+        void asyncSlice(const char* name, Clock::time_point start, Clock::time_point end, uint64_t offset)
+        {
+            m_recorder.async(name, start, end, offset / m_chunkSize);
+        }
+        
+        uint64_t getDroppedEvents() const
+        {
+            return m_recorder.getDroppedEvents();
+        }
+
+        //
+        // must be called when all the stages have finished
+        //
+        void save(const std::string& fileName) const
+        {
+            m_recorder.save(fileName);
+        }
+
+    private:
+        const uint32_t m_chunkSize;
+        const uint32_t m_sampleEvery;
+        utils::TraceRecorder m_recorder;
+    };
+}
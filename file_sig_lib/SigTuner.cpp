@@ -0,0 +1,292 @@
+//
+//  SigTuner.cpp
+//  file_signature
+//
+//  Created by artem k on 18.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#include "SigTuner.hpp"
+#include "MappedFile.hpp"
+#include "Exceptions.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <tuple>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+
+namespace file_sig
+{
+    namespace
+    {
+        const char kMagic[] = "file_sig tune 1";
+        
+        //
+        // bytes that are read by each reader
+        //
+        const uint64_t kSampleSize = 32 * 1024 * 1024;
+        
+        const double kMinHashSeconds = 0.2;
+        
+        //
+        // the stream reader has chunks for this time of reading ahead of the hashers
+        //
+        const double kReadAheadSeconds = 0.1;
+        
+        //
+        // map is chosen only if it is faster by this factor,
+        // the stream reader needs less threads
+        //
+        const double kMapFactor = 1.1;
+        
+        const double kMB = 1024.0 * 1024.0;
+        
+        double getSeconds(std::chrono::steady_clock::time_point start)
+        {
+            const auto time = std::chrono::steady_clock::now() - start;
+            return std::max(std::chrono::duration<double>(time).count(), 1e-6);
+        }
+        
+        double measureStream(const std::string& path, uint64_t offset, uint64_t size, std::vector<char>& chunk)
+        {
+            std::ifstream file(path, std::ios::binary);
+            THROW_IF(!file.is_open(), "Cannot open " << path);
+            file.seekg(static_cast<std::streamoff>(offset));
+            
+            const auto start = std::chrono::steady_clock::now();
+            
+            for (uint64_t left = size; left;)
+            {
+                const size_t readSize = static_cast<size_t>(std::min<uint64_t>(left, chunk.size()));
+                file.read(chunk.data(), static_cast<std::streamsize>(readSize));
+                THROW_IF(!file, "Cannot read " << path);
+                left -= readSize;
+            }
+            
+            return size / kMB / getSeconds(start);
+        }
+
+        //
+        // the pages are faulted by touching a byte of each of them
+        //
+        double measureMap(const std::string& path, uint64_t offset, uint64_t size)
+        {
+            utils::MappedFile file(path);
+            const uint8_t* data = file.data() + offset;
+            const size_t kPageSize = 4096;
+            
+            const auto start = std::chrono::steady_clock::now();
+            volatile uint8_t sum = 0;
+            
+            for (uint64_t i = 0; i < size; i += kPageSize)
+            {
+                sum = sum + data[i];
+            }
+            
+            return size / kMB / getSeconds(start);
+        }
+    }
+
+    bool SigTuner::Key::operator<(const Key& other) const
+    {
+        return std::tie(device, hasher, chunkSize, cpus) < std::tie(other.device, other.hasher, other.chunkSize, other.cpus);
+    }
+
+    SigTuner::SigTuner(const std::string& path)
+        : m_path(path)
+    {
+        std::ifstream in(path, std::ios::binary);
+        
+        if (!in.is_open())
+        {
+            return;
+        }
+        
+        std::string line;
+        uint64_t lineNumber = 0;
+        
+        while (std::getline(in, line))
+        {
+            ++lineNumber;
+            
+            if (!line.empty() && line.back() == '\r')
+            {
+                line.pop_back();
+            }
+            
+            if (1 == lineNumber)
+            {
+                THROW_IF(line != kMagic, path << " is not a tuning file");
+                continue;
+            }
+
+            //
+            // <device> <hash> <chunk size> <cpus> <reader> <threads> <cached chunks> <reorder window> <read MB/s> <hash MB/s>
+            //
+            std::istringstream fields(line);
+            Key key;
+            SigTuning tuning;
+            
+            fields >> key.device >> key.hasher >> key.chunkSize >> key.cpus
+                >> tuning.reader >> tuning.threads >> tuning.cachedChunks >> tuning.reorderWindow
+                >> tuning.readMBps >> tuning.hashMBps;
+            
+            THROW_IF(!fields || (tuning.reader != "stream" && tuning.reader != "map") || 0 == tuning.threads,
+                     "The tuning file " << path << " is corrupted at line " << lineNumber);
+            
+            m_tunings[key] = tuning;
+        }
+    }
+
+    bool SigTuner::find(uint64_t device, const std::string& hasher, uint32_t chunkSize, uint32_t cpus, SigTuning& tuning) const
+    {
+        Key key;
+        key.device = device;
+        key.hasher = hasher;
+        key.chunkSize = chunkSize;
+        key.cpus = cpus;
+        
+        const auto it = m_tunings.find(key);
+        
+        if (it == m_tunings.end())
+        {
+            return false;
+        }
+        
+        tuning = it->second;
+        return true;
+    }
+
+    void SigTuner::add(uint64_t device, const std::string& hasher, uint32_t chunkSize, uint32_t cpus, const SigTuning& tuning)
+    {
+        Key key;
+        key.device = device;
+        key.hasher = hasher;
+        key.chunkSize = chunkSize;
+        key.cpus = cpus;
+        m_tunings[key] = tuning;
+    }
+
+    void SigTuner::save() const
+    {
+        const std::string tmpPath = m_path + ".tmp";
+        
+        {
+            std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+            THROW_IF(!out.is_open(), "Cannot open " << tmpPath);
+            
+            out << kMagic << "\r\n";
+            
+            for (const auto& it : m_tunings)
+            {
+                const Key& key = it.first;
+                const SigTuning& tuning = it.second;
+                
+                out << key.device << ' ' << key.hasher << ' ' << key.chunkSize << ' ' << key.cpus << ' '
+                    << tuning.reader << ' ' << tuning.threads << ' ' << tuning.cachedChunks << ' ' << tuning.reorderWindow << ' '
+                    << tuning.readMBps << ' ' << tuning.hashMBps << "\r\n";
+            }
+            
+            out.close();
+            THROW_IF(!out, "Cannot write " << tmpPath);
+        }
+
+#if defined(_WIN32)
+        //
+        // rename does not replace an existing file on Windows
+        //
+        ::remove(m_path.c_str());
+#endif
+        THROW_IF(::rename(tmpPath.c_str(), m_path.c_str()) != 0, "Cannot rename " << tmpPath);
+    }
+
+    SigTuning SigTuner::calibrate(const std::string& filePath,
+                                  uint64_t fileSize,
+                                  uint32_t chunkSize,
+                                  const SigPipeline::Hasher& hasher,
+                                  uint32_t cpus)
+    {
+        cpus = std::max(cpus, 1u);
+        std::vector<char> chunk(chunkSize);
+        
+        //
+        // the readers read different parts, so the second one
+        // does not get the pages cached by the first one
+        //
+        const uint64_t sampleSize = std::min(kSampleSize, fileSize / 2);
+        double streamMBps = 0;
+        double mapMBps = 0;
+        
+        if (sampleSize)
+        {
+            streamMBps = measureStream(filePath, 0, sampleSize, chunk);
+            mapMBps = measureMap(filePath, fileSize - sampleSize, sampleSize);
+        }
+
+        //
+        // the chunk keeps the data of the file, the hash of zeros may be faster
+        //
+        uint64_t hashed = 0;
+        const auto start = std::chrono::steady_clock::now();
+        
+        do
+        {
+            hasher(chunk.data(), chunk.size());
+            hashed += chunk.size();
+        }
+        while (getSeconds(start) < kMinHashSeconds);
+        
+        SigTuning tuning;
+        tuning.hashMBps = hashed / kMB / getSeconds(start);
+        tuning.reader = mapMBps > streamMBps * kMapFactor ? "map" : "stream";
+        tuning.readMBps = std::max(streamMBps, mapMBps);
+        
+        if (0 == sampleSize)
+        {
+            //
+            // nothing to measure, a small file is hashed by one thread
+            //
+            tuning.readMBps = tuning.hashMBps;
+        }
+
+        //
+        // the threads that hash as fast as the storage reads
+        //
+        const double needed = std::ceil(tuning.readMBps / tuning.hashMBps);
+        tuning.threads = static_cast<uint32_t>(std::max(std::min(needed, static_cast<double>(cpus)), 1.0));
+        
+        if (tuning.reader == "map" && tuning.readMBps < tuning.hashMBps * cpus)
+        {
+            //
+            // hashers of mapped chunks wait for page faults of the slow storage,
+            // more of them keep more reads in flight
+            //
+            tuning.threads = std::min(tuning.threads * 2, 3 * cpus);
+        }
+        
+        if (tuning.reader == "stream")
+        {
+            const double readAhead = std::ceil(tuning.readMBps * kMB * kReadAheadSeconds / chunkSize);
+            tuning.cachedChunks = tuning.threads + static_cast<uint32_t>(std::max(std::min(readAhead, 4.0 * tuning.threads), 1.0));
+        }
+        
+        tuning.reorderWindow = std::max(SigPipeline::getReorderWindowSize(tuning.threads, 0), tuning.cachedChunks);
+        return tuning;
+    }
+
+    std::string SigTuner::getDefaultPath()
+    {
+#if defined(_WIN32)
+        const char* home = getenv("USERPROFILE");
+#else
+        const char* home = getenv("HOME");
+#endif
+        const std::string name = ".file_signature.tune";
+        return home && *home ? std::string(home) + "/" + name : name;
+    }
+}
@@ -0,0 +1,84 @@
+//
+//  SigTuner.hpp
+//  file_signature
+//
+//  Created by artem k on 18.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#pragma once
+
+#include "SigPipeline.hpp"
+
+#include <map>
+#include <string>
+
+namespace file_sig
+{
+    //
+    // The reader, the hasher threads and the depth of the chunk queue
+    // that are chosen by a calibration
+    //
+    struct SigTuning
+    {
+        std::string reader;         // stream or map
+        uint32_t threads = 0;
+        uint32_t cachedChunks = 0;  // chunks of the stream reader, 0 for map
+        uint32_t reorderWindow = 0;
+        double readMBps = 0;        // of the chosen reader by one thread
+        double hashMBps = 0;        // by one core
+    };
+
+    //
+    // Calibrates a signing run by a sample of the file and keeps the results
+    // per (device, hash, chunk size, CPUs) in a text file,
+    // so later runs for the same storage skip the calibration
+    //
+    class SigTuner
+    {
+    public:
+        //
+        // loads the tunings if the file exists, throws if it is corrupted
+        //
+        explicit SigTuner(const std::string& path);
+        
+        SigTuner(const SigTuner&) = delete;
+        SigTuner& operator=(const SigTuner&) = delete;
+        
+        bool find(uint64_t device, const std::string& hasher, uint32_t chunkSize, uint32_t cpus, SigTuning& tuning) const;
+        void add(uint64_t device, const std::string& hasher, uint32_t chunkSize, uint32_t cpus, const SigTuning& tuning);
+        void save() const;
+        
+        //
+        // reads a few chunks of the file by each reader in different parts of it,
+        // hashes one of them by one thread and picks the configuration
+        // that keeps 'cpus' hasher threads (or as many as the storage needs) busy.
+        // It takes a fraction of a second for a fast storage
+        //
+        static SigTuning calibrate(const std::string& filePath,
+                                   uint64_t fileSize,
+                                   uint32_t chunkSize,
+                                   const SigPipeline::Hasher& hasher,
+                                   uint32_t cpus);
+        
+        //
+        // the default file in the home directory
+        //
+        static std::string getDefaultPath();
+
+    private:
+        struct Key
+        {
+            uint64_t device = 0;
+            std::string hasher;
+            uint32_t chunkSize = 0;
+            uint32_t cpus = 0;
+            
+            bool operator<(const Key& other) const;
+        };
+
+    private:
+        const std::string m_path;
+        std::map<Key, SigTuning> m_tunings;
+    };
+}
@@ -0,0 +1,144 @@
+//
+//  SigVerifier.cpp
+//  file_signature
+//
+//  Created by artem k on 09.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#include "SigVerifier.hpp"
+
+#include <algorithm>
+
+namespace file_sig
+{
+    SigVerifier::SigVerifier(const std::string& sigPath, bool stopOnMismatch)
+        : m_reader(sigPath)
+        , m_stopOnMismatch(stopOnMismatch)
+    {
+        readNext();
+        m_chunkSize = m_hasNext ? m_next.size : 0;
+    }
+
+    const SigFileReader::Header& SigVerifier::getHeader() const
+    {
+        return m_reader.getHeader();
+    }
+
+    uint32_t SigVerifier::getChunkSize() const
+    {
+        return m_chunkSize;
+    }
+
+    bool SigVerifier::check(RecordBatch records)
+    {
+        if (m_stopped)
+        {
+            return false;
+        }
+        
+        for (const auto& record : records)
+        {
+            ++m_checkedChunks;
+            
+            //
+            // signature records that no hashed chunk starts at are bad,
+            // e.g. the signature has been made with other chunk sizes
+            //
+            while (m_hasNext && m_next.offset < record.offset)
+            {
+                addBad(m_next.offset, m_next.size);
+                readNext();
+            }
+            
+            const bool matched = m_hasNext
+                && m_next.offset == record.offset
+                && m_next.size == record.size
+                && m_next.hash == record.hash;
+            
+            if (!matched)
+            {
+                addBad(record.offset, record.size);
+            }
+            
+            if (m_hasNext && m_next.offset == record.offset)
+            {
+                readNext();
+            }
+            
+            if (m_stopOnMismatch && m_badChunks)
+            {
+                m_stopped = true;
+                return false;
+            }
+        }
+        
+        return true;
+    }
+
+    void SigVerifier::finish(uint64_t fileSize)
+    {
+        m_sizeMismatch = m_reader.getHeader().fileSize != fileSize;
+        
+        if (m_stopped)
+        {
+            return;
+        }
+
+        //
+        // the file is shorter than the signature
+        //
+        while (m_hasNext)
+        {
+            addBad(m_next.offset, m_next.size);
+            readNext();
+        }
+    }
+
+    bool SigVerifier::isOk() const
+    {
+        return 0 == m_badChunks && !m_sizeMismatch;
+    }
+
+    bool SigVerifier::isStopped() const
+    {
+        return m_stopped;
+    }
+
+    uint64_t SigVerifier::getCheckedChunks() const
+    {
+        return m_checkedChunks;
+    }
+
+    uint64_t SigVerifier::getBadChunks() const
+    {
+        return m_badChunks;
+    }
+
+    const std::vector<SigVerifier::BadRange>& SigVerifier::getBadRanges() const
+    {
+        return m_badRanges;
+    }
+
+    void SigVerifier::readNext()
+    {
+        m_hasNext = m_reader.next(m_next);
+    }
+
+    void SigVerifier::addBad(uint64_t offset, uint64_t size)
+    {
+        ++m_badChunks;
+        
+        if (!m_badRanges.empty() && m_badRanges.back().offset + m_badRanges.back().size >= offset)
+        {
+            auto& last = m_badRanges.back();
+            last.size = std::max(last.offset + last.size, offset + size) - last.offset;
+            return;
+        }
+        
+        BadRange range;
+        range.offset = offset;
+        range.size = size;
+        m_badRanges.push_back(range);
+    }
+}
@@ -0,0 +1,94 @@
+//
+//  SigVerifier.hpp
+//  file_signature
+//
+//  Created by artem k on 09.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#pragma once
+
+#include "SigFileReader.hpp"
+
+#include <vector>
+
+namespace file_sig
+{
+    //
+    // It compares records of the SigPipeline with a signature file
+    // The records come in order from the batch callback, so the signature
+    // is parsed along with them and is never loaded to memory.
+    // Mismatched chunks are merged to contiguous bad ranges
+    //
+    // e.g.: pipeline.setRecordBatchCallback([&](SigPipeline::RecordBatch records)
+    //       {
+    //           if (!verifier.check(records)) pipeline.cancel(false);
+    //       });
+    //
+    class SigVerifier
+    {
+    public:
+        using Record = SigPipeline::Record;
+        using RecordBatch = SigPipeline::RecordBatch;
+        
+        struct BadRange
+        {
+            uint64_t offset = 0;
+            uint64_t size = 0;
+        };
+
+    public:
+        //
+        // stopOnMismatch - check returns false at the first bad chunk
+        //
+        SigVerifier(const std::string& sigPath, bool stopOnMismatch);
+        
+        SigVerifier(const SigVerifier&) = delete;
+        SigVerifier& operator=(const SigVerifier&) = delete;
+        
+        const SigFileReader::Header& getHeader() const;
+        
+        //
+        // size of the first chunk of the signature, 0 if it has no records
+        //
+        uint32_t getChunkSize() const;
+        
+        //
+        // returns false if the verification has to be stopped
+        //
+        bool check(RecordBatch records);
+        
+        //
+        // the signature records after the end of the hashed file are bad,
+        // must be called when hashing has finished
+        //
+        void finish(uint64_t fileSize);
+        
+        bool isOk() const;
+        bool isStopped() const;
+        uint64_t getCheckedChunks() const;
+        uint64_t getBadChunks() const;
+        const std::vector<BadRange>& getBadRanges() const;
+
+    private:
+        void readNext();
+        void addBad(uint64_t offset, uint64_t size);
+
+    private:
+        SigFileReader m_reader;
+        const bool m_stopOnMismatch;
+        bool m_stopped = false;
+        bool m_sizeMismatch = false;
+        
+        //
+        // the next signature record that has not been compared yet
+        //
+        Record m_next;
+        bool m_hasNext = false;
+        uint32_t m_chunkSize = 0;
+        
+        uint64_t m_checkedChunks = 0;
+        uint64_t m_badChunks = 0;
+        std::vector<BadRange> m_badRanges;
+    };
+}
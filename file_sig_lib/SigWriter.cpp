@@ -0,0 +1,491 @@
+//
+//  SigWriter.cpp
+//  file_signature
+//
+//  Created by artem k on 01.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#include "SigWriter.hpp"
+#include "Exceptions.hpp"
+#include "Hash.hpp"
+
+#include <algorithm>
+#include <stdio.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+namespace file_sig
+{
+    namespace
+    {
+        //
+        // the buffer is written to the file when it is filled up to this size
+        //
+        const size_t kFlushSize = 1024 * 1024;
+        
+        //
+        // "0x<offset>:0x<size>:" without a hash
+        //
+        const size_t kMaxRecordPrefix = 2 + 16 + 3 + 8 + 1;
+    }
+
+    size_t SigWriter::getMaxRecordSize(const Record& record)
+    {
+        return kMaxRecordPrefix + record.hash.size() + 2;
+    }
+
+    char* SigWriter::formatRecord(const Record& record, char* out)
+    {
+        //
+        // it is the same as "0x%llx:0x%x:%s\r\n" without a locale
+        // and the parsing of the format string for every record
+        //
+        *out++ = '0';
+        *out++ = 'x';
+        out = utils::formatHex(record.offset, out);
+        *out++ = ':';
+        *out++ = '0';
+        *out++ = 'x';
+        out = utils::formatHex(record.size, out);
+        *out++ = ':';
+        out = std::copy(record.hash.begin(), record.hash.end(), out);
+        *out++ = '\r';
+        *out++ = '\n';
+        return out;
+    }
+
+    size_t SigWriter::getBufferSize()
+    {
+        return kFlushSize;
+    }
+
+    SigWriter::SigWriter(const std::string& fileName,
+                         uint32_t maxQueuedRecords,
+                         const SigCheckpoint* resume)
+        : m_maxQueuedRecords(std::max<size_t>(maxQueuedRecords, 1))
+    {
+        if (resume)
+        {
+            //
+            // the records after the checkpoint may be partially written,
+            // they are cut off and hashed again
+            //
+            m_file.reset(::open(fileName.c_str(), O_WRONLY));
+            THROW_ERRNO_IF(m_file.get() < 0, "Cannot open " << fileName);
+            
+#if defined(_MSC_VER)
+            THROW_ERRNO_IF(_chsize_s(m_file, resume->length) != 0, "Cannot truncate " << fileName);
+            THROW_ERRNO_IF(_lseeki64(m_file, 0, SEEK_END) < 0, "Cannot seek " << fileName);
+#else
+            THROW_ERRNO_IF(ftruncate(m_file, resume->length) != 0, "Cannot truncate " << fileName);
+            THROW_ERRNO_IF(lseek(m_file, 0, SEEK_END) < 0, "Cannot seek " << fileName);
+#endif
+            m_written = resume->length;
+            m_nextOffset = resume->offset;
+        }
+        else
+        {
+            m_file.reset(::open(fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644));
+            THROW_ERRNO_IF(m_file.get() < 0, "Cannot open " << fileName);
+        }
+        
+        m_buffer.resize(kFlushSize);
+        
+        //
+        // create a thread that writes the records
+        //
+        m_thread = std::async(std::launch::async,
+                              &SigWriter::writerThread,
+                              this);
+    }
+
+    SigWriter::~SigWriter()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopped = true;
+        }
+        
+        m_queueCv.notify_all();
+        m_spaceCv.notify_all();
+        resumeParked();
+        
+        std::lock_guard<std::mutex> threadLock(m_threadMutex);
+        
+        if (m_thread.valid())
+        {
+            m_thread.wait();
+        }
+    }
+
+    void SigWriter::write(std::string text)
+    {
+        Batch batch;
+        batch.text = std::move(text);
+        
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            
+            if (m_exception)
+            {
+                std::rethrow_exception(m_exception);
+            }
+            
+            THROW_IF(m_stopped, "The writer is stopped");
+            m_queue.push_back(std::move(batch));
+        }
+        
+        m_queueCv.notify_one();
+    }
+
+    void SigWriter::push(RecordBatch records, bool wait)
+    {
+        Batch batch;
+        batch.records.reserve(records.size());
+        
+        if (m_probes.latency || m_probes.trace)
+        {
+            batch.pushTime = SigLatency::Clock::now();
+        }
+        
+        for (auto& record : records)
+        {
+            batch.records.push_back(std::move(record));
+        }
+        
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            
+            //
+            // do not let the queue grow if the output is slower than hashing,
+            // the caller waits and the pipeline stops reading new chunks
+            //
+            if (wait)
+            {
+                m_spaceCv.wait(lock, [this]()
+                {
+                    return hasSpace();
+                });
+            }
+            
+            if (m_exception)
+            {
+                std::rethrow_exception(m_exception);
+            }
+            
+            THROW_IF(m_stopped, "The writer is stopped");
+            
+            m_queuedRecords += batch.records.size();
+            m_queue.push_back(std::move(batch));
+        }
+        
+        m_queueCv.notify_one();
+    }
+
+    bool SigWriter::waitForSpace(const Resume& resume)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        
+        if (hasSpace())
+        {
+            return true;
+        }
+        
+        m_parked.push_back(resume);
+        return false;
+    }
+
+    bool SigWriter::hasSpace() const
+    {
+        //
+        // must be called under m_mutex,
+        // push throws if the writer is stopped or has failed
+        //
+        return m_queuedRecords < m_maxQueuedRecords || m_stopped || m_exception;
+    }
+
+    void SigWriter::resumeParked()
+    {
+        std::vector<Resume> parked;
+        
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            parked.swap(m_parked);
+        }
+        
+        for (auto& resume : parked)
+        {
+            resume();
+        }
+    }
+
+    void SigWriter::finish()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopped = true;
+        }
+        
+        m_queueCv.notify_all();
+        m_spaceCv.notify_all();
+        resumeParked();
+        
+        //
+        // the mutex is needed for safety calling of this method
+        // from multiple threads
+        //
+        std::lock_guard<std::mutex> threadLock(m_threadMutex);
+        
+        if (m_thread.valid())
+        {
+            m_thread.get();
+        }
+    }
+
+    void SigWriter::setProbes(SigProbes probes)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_probes = probes;
+    }
+
+    void SigWriter::setCheckpoint(const std::string& path, SigCheckpoint checkpoint, std::chrono::milliseconds interval)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_checkpointPath = path;
+        m_checkpoint = std::move(checkpoint);
+        m_checkpointInterval = interval;
+        m_checkpointTime = std::chrono::steady_clock::now();
+    }
+
+    void SigWriter::setBinary(const SigBinHeader& header)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_binHeader = header;
+        m_binary = true;
+    }
+
+    void SigWriter::writerThread()
+    {
+        try
+        {
+            std::vector<Batch> batches;
+            std::unique_lock<std::mutex> lock(m_mutex, std::defer_lock);
+            
+            for (;;)
+            {
+                lock.lock();
+                
+                m_queueCv.wait(lock, [this]()
+                {
+                    return !m_queue.empty() || m_stopped;
+                });
+                
+                if (m_queue.empty())
+                {
+                    //
+                    // stopped and all the data have been formatted
+                    //
+                    lock.unlock();
+                    flush();
+                    
+                    if (!m_checkpointPath.empty())
+                    {
+                        saveCheckpoint();
+                    }
+                    
+                    return;
+                }
+
+                //
+                // take the whole queue at once,
+                // producers wait for the lock only while the vectors are swapped
+                //
+                batches.swap(m_queue);
+                m_queuedRecords = 0;
+                
+                lock.unlock();
+                m_spaceCv.notify_all();
+                resumeParked();
+                
+                for (const auto& batch : batches)
+                {
+                    const auto time = m_probes.trace ? SigTrace::Clock::now() : SigTrace::Clock::time_point();
+                    
+                    format(batch);
+                    
+                    if (m_probes.trace)
+                    {
+                        traceBatch(batch, time);
+                    }
+                }
+                
+                SigLatency* latency = m_probes.latency;
+                
+                if (latency)
+                {
+                    //
+                    // all the records of a batch are queued and formatted together
+                    //
+                    const auto time = SigLatency::Clock::now();
+                    
+                    for (const auto& batch : batches)
+                    {
+                        if (batch.pushTime == SigLatency::Clock::time_point())
+                        {
+                            continue;
+                        }
+                        
+                        for (size_t i = 0; i < batch.records.size(); ++i)
+                        {
+                            latency->record(SigStage::write, time - batch.pushTime);
+                        }
+                    }
+                }
+                
+                batches.clear();
+                
+                if (isCheckpointTime())
+                {
+                    //
+                    // the records may not fill the buffer for a long time,
+                    // they are written anyway to be saved by the checkpoint
+                    //
+                    flush();
+                }
+            }
+        }
+        catch (const std::exception&)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_exception = std::current_exception();
+            }
+            
+            m_spaceCv.notify_all();
+            resumeParked();
+            throw;
+        }
+    }
+
+    void SigWriter::traceBatch(const Batch& batch, SigTrace::Clock::time_point start)
+    {
+        //
+        // a batch is formatted at once, so the slice is attributed to its first sampled record
+        //
+        for (const auto& record : batch.records)
+        {
+            if (m_probes.trace->isSampled(record.offset))
+            {
+                m_probes.trace->slice("write", start, record.offset);
+                break;
+            }
+        }
+    }
+    
+    void SigWriter::format(const Batch& batch)
+    {
+        if (!batch.text.empty())
+        {
+            reserve(batch.text.size());
+            std::copy(batch.text.begin(), batch.text.end(), m_buffer.begin() + m_bufferUsed);
+            m_bufferUsed += batch.text.size();
+        }
+        
+        for (const auto& record : batch.records)
+        {
+            if (m_binary)
+            {
+                formatBinary(record);
+                continue;
+            }
+            
+            reserve(getMaxRecordSize(record));
+            
+            char * out = formatRecord(record, m_buffer.data() + m_bufferUsed);
+            m_bufferUsed = out - m_buffer.data();
+            m_nextOffset = record.offset + record.size;
+        }
+        
+        if (m_bufferUsed >= kFlushSize)
+        {
+            flush();
+        }
+    }
+
+    void SigWriter::formatBinary(const Record& record)
+    {
+        const uint32_t size = m_binHeader.getRecordSize();
+        reserve(size);
+        
+        m_binHeader.encodeRecord(record, reinterpret_cast<uint8_t*>(m_buffer.data() + m_bufferUsed));
+        m_bufferUsed += size;
+        m_nextOffset = record.offset + record.size;
+    }
+
+    void SigWriter::reserve(size_t size)
+    {
+        if (m_buffer.size() - m_bufferUsed >= size)
+        {
+            return;
+        }
+        
+        flush();
+        
+        if (m_buffer.size() < size)
+        {
+            m_buffer.resize(size);
+        }
+    }
+
+    void SigWriter::flush()
+    {
+        const char * data = m_buffer.data();
+        size_t size = m_bufferUsed;
+        
+        while (size)
+        {
+            const auto res = ::write(m_file, data, static_cast<unsigned int>(std::min<size_t>(size, kFlushSize)));
+            
+            if (res < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            
+            THROW_ERRNO_IF(res <= 0, "Cannot write the signature file");
+            
+            data += res;
+            size -= res;
+            m_written += res;
+        }
+        
+        m_bufferUsed = 0;
+        
+        if (isCheckpointTime())
+        {
+            saveCheckpoint();
+        }
+    }
+
+    bool SigWriter::isCheckpointTime() const
+    {
+        return !m_checkpointPath.empty() && std::chrono::steady_clock::now() - m_checkpointTime >= m_checkpointInterval;
+    }
+
+    void SigWriter::saveCheckpoint()
+    {
+        //
+        // the checkpoint must not point to records that are not on the disk yet
+        //
+#if defined(_MSC_VER)
+        THROW_ERRNO_IF(_commit(m_file) != 0, "Cannot flush the signature file");
+#else
+        THROW_ERRNO_IF(fsync(m_file) != 0, "Cannot flush the signature file");
+#endif
+        
+        m_checkpoint.offset = m_nextOffset;
+        m_checkpoint.length = m_written;
+        m_checkpoint.save(m_checkpointPath);
+        m_checkpointTime = std::chrono::steady_clock::now();
+    }
+}
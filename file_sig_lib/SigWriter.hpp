@@ -0,0 +1,179 @@
+//
+//  SigWriter.hpp
+//  file_signature
+//
+//  Created by artem k on 01.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#pragma once
+
+#include "SigPipeline.hpp"
+#include "SigProbes.hpp"
+#include "SigCheckpoint.hpp"
+#include "SigBinary.hpp"
+#include "ScopedHandle.hpp"
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <future>
+#include <condition_variable>
+
+#if defined(_MSC_VER)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace file_sig
+{
+    //
+    // It is an output stage of the SigPipeline
+    // The class receives batches of ordered records through a queue,
+    // formats them to a big buffer and writes the buffer to the file
+    // in its own thread, so hasher threads never wait for output IO.
+    //
+    // e.g.: pipeline.setRecordBatchCallback([&](SigPipeline::RecordBatch records)
+    //       {
+    //           writer.push(records);
+    //       });
+    //
+    // Pipeline tasks must not wait for the writer holding workers of the pool,
+    // they pass waitForSpace as the gate of the pipeline and push without waiting.
+    //
+    class SigWriter
+    {
+    public:
+        using Record = SigPipeline::Record;
+        using RecordBatch = SigPipeline::RecordBatch;
+        using Resume = SigPipeline::Resume;
+
+    public:
+        //
+        // the file is rewritten if it exists,
+        // push waits if there are more than 'maxQueuedRecords' records in the queue.
+        // If 'resume' is set the file is cut to the checkpoint length
+        // and the records are appended to it
+        //
+        SigWriter(const std::string& fileName,
+                  uint32_t maxQueuedRecords,
+                  const SigCheckpoint* resume = nullptr);
+        ~SigWriter();
+        
+        SigWriter(const SigWriter&) = delete;
+        SigWriter& operator=(const SigWriter&) = delete;
+        
+        SigWriter(SigWriter&&) = delete;
+        SigWriter& operator=(SigWriter&&) = delete;
+        
+        //
+        // writes a text as is, e.g. a file header
+        //
+        void write(std::string text);
+        
+        //
+        // records are moved to the queue,
+        // rethrows an exception if writing has failed.
+        // If 'wait' is false, the queue may exceed the limit by the batch
+        //
+        void push(RecordBatch records, bool wait = true);
+        
+        //
+        // returns true if there is space in the queue (or the writer is stopped),
+        // otherwise 'resume' is called once the writer thread takes the queue
+        //
+        bool waitForSpace(const Resume& resume);
+        
+        //
+        // writes all the queued data and stops the writer thread,
+        // rethrows an exception if writing has failed
+        //
+        void finish();
+        
+        //
+        // records the write stage latency and trace,
+        // must be called before records are pushed
+        //
+        void setProbes(SigProbes probes);
+
+        //
+        // the written records are flushed to the disk and the checkpoint
+        // is saved to 'path' not more often than once per interval and when the writer stops.
+        // The checkpoint keeps the signature parameters, the offset and the length are updated,
+        // must be called before anything is written
+        //
+        void setCheckpoint(const std::string& path, SigCheckpoint checkpoint, std::chrono::milliseconds interval);
+
+        //
+        // records are written as fixed-width binary records of the header
+        // instead of text lines, the header itself is written by write().
+        // Must be called before records are pushed
+        //
+        void setBinary(const SigBinHeader& header);
+        
+        //
+        // formats the text record "0x<offset>:0x<size>:<hash>\r\n" to 'out',
+        // that has getMaxRecordSize bytes, returns the end of the record
+        //
+        static size_t getMaxRecordSize(const Record& record);
+        static char* formatRecord(const Record& record, char* out);
+        
+        //
+        // memory of the buffer the records are formatted to
+        //
+        static size_t getBufferSize();
+
+    private:
+        struct Batch
+        {
+            std::string text;
+            std::vector<Record> records;
+            SigLatency::Clock::time_point pushTime;
+        };
+        
+        void writerThread();
+        void format(const Batch& batch);
+        void formatBinary(const Record& record);
+        void traceBatch(const Batch& batch, SigTrace::Clock::time_point start);
+        void reserve(size_t size);
+        void flush();
+        bool isCheckpointTime() const;
+        void saveCheckpoint();
+        bool hasSpace() const;
+        void resumeParked();
+
+    private:
+        std::mutex m_mutex;
+        std::condition_variable m_queueCv;
+        std::condition_variable m_spaceCv;
+        std::vector<Batch> m_queue;
+        std::vector<Resume> m_parked; // continuations of pipeline tasks that wait for space
+        std::exception_ptr m_exception;
+        size_t m_queuedRecords = 0;
+        const size_t m_maxQueuedRecords;
+        bool m_stopped = false;
+        SigProbes m_probes;
+        
+        utils::ScopedHandle<int, decltype(::close), ::close, -1> m_file;
+        std::vector<char> m_buffer;
+        size_t m_bufferUsed = 0;
+        
+        //
+        // the file length and the offset after the last formatted record
+        //
+        uint64_t m_written = 0;
+        uint64_t m_nextOffset = 0;
+        
+        std::string m_checkpointPath;
+        SigCheckpoint m_checkpoint;
+        std::chrono::milliseconds m_checkpointInterval{0};
+        std::chrono::steady_clock::time_point m_checkpointTime;
+        
+        bool m_binary = false;
+        SigBinHeader m_binHeader;
+        
+        std::mutex m_threadMutex;
+        std::future<void> m_thread;
+    };
+}
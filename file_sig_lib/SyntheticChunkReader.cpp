@@ -0,0 +1,135 @@
+//
+//  SyntheticChunkReader.cpp
+//  file_signature
+//
+//  Created by artem k on 19.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#include "SyntheticChunkReader.hpp"
+#include "Exceptions.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string.h>
+#include <thread>
+
+namespace file_sig
+{
+    namespace
+    {
+        //
+        // the pattern is repeated every 64MB at most,
+        // so a chunk is rarely in the cache when it is hashed again
+        //
+        const uint64_t kMaxPatternSize = 64 * 1024 * 1024;
+        
+        //
+        // splitmix64: a random value of the chunk that does not depend on other chunks
+        //
+        uint64_t mix(uint64_t value)
+        {
+            value += 0x9e3779b97f4a7c15ull;
+            value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ull;
+            value = (value ^ (value >> 27)) * 0x94d049bb133111ebull;
+            return value ^ (value >> 31);
+        }
+    }
+
+    SyntheticChunkReader::SyntheticChunkReader(const SyntheticReaderSettings& settings)
+        : m_settings(settings)
+        , m_nextChunk(0)
+    {
+        THROW_IF(0 == settings.chunkSize, "Chunk size must be positive");
+        
+        if (settings.size > settings.startOffset)
+        {
+            m_chunksCount = (settings.size - settings.startOffset + settings.chunkSize - 1) / settings.chunkSize;
+        }
+        
+        m_patternChunks = std::min(m_chunksCount, std::max<uint64_t>(1, kMaxPatternSize / settings.chunkSize));
+        
+        if (0 == m_patternChunks)
+        {
+            return;
+        }
+
+        //
+        // the pages are touched here, not by the first hashers
+        //
+        m_pattern = utils::PageMemory(static_cast<size_t>(m_patternChunks * settings.chunkSize));
+        
+        if (SyntheticPattern::zeros == settings.pattern)
+        {
+            memset(m_pattern.data(), 0, m_pattern.size());
+            return;
+        }
+        
+        std::mt19937 random(settings.seed);
+        
+        for (size_t i = 0; i + sizeof(uint32_t) <= m_pattern.size(); i += sizeof(uint32_t))
+        {
+            const uint32_t value = random();
+            memcpy(m_pattern.data() + i, &value, sizeof(value));
+        }
+    }
+
+    uint32_t SyntheticChunkReader::getChunkSize() const
+    {
+        return m_settings.chunkSize;
+    }
+
+    uint64_t SyntheticChunkReader::getStartOffset() const
+    {
+        return m_settings.startOffset;
+    }
+
+    uint64_t SyntheticChunkReader::getDelayUs(uint64_t chunk) const
+    {
+        const uint64_t value = mix(chunk ^ (static_cast<uint64_t>(m_settings.seed) << 32));
+        uint64_t delay = m_settings.delayUs;
+        
+        if (m_settings.jitterUs)
+        {
+            delay += (value & 0xffffffff) % (m_settings.jitterUs + 1ull);
+        }
+        
+        if (m_settings.slowEvery && 0 == (value >> 32) % m_settings.slowEvery)
+        {
+            delay += m_settings.slowDelayUs;
+        }
+        
+        return delay;
+    }
+
+    bool SyntheticChunkReader::getChunk(const void *& data, uint32_t& size, uint64_t& offset)
+    {
+        //
+        // the index only grows, so a chunk is never returned twice,
+        // a straggler delays only its own chunk, other hashers go on
+        //
+        const uint64_t chunk = m_nextChunk.fetch_add(1, std::memory_order_relaxed);
+        
+        if (chunk >= m_chunksCount)
+        {
+            return false;
+        }
+        
+        const uint64_t delay = getDelayUs(chunk);
+        
+        if (delay)
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(delay));
+        }
+        
+        offset = m_settings.startOffset + chunk * m_settings.chunkSize;
+        size = static_cast<uint32_t>(std::min<uint64_t>(m_settings.chunkSize, m_settings.size - offset));
+        data = m_pattern.data() + (chunk % m_patternChunks) * m_settings.chunkSize;
+        return true;
+    }
+
+    void SyntheticChunkReader::freeChunk(const void * /*data*/, uint32_t /*size*/, uint64_t /*offset*/)
+    {
+    }
+}
@@ -0,0 +1,88 @@
+//
+//  SyntheticChunkReader.hpp
+//  file_signature
+//
+//  Created by artem k on 19.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#pragma once
+
+#include "ChunkReader.hpp"
+#include "PageMemory.hpp"
+
+#include <atomic>
+
+namespace file_sig
+{
+    enum class SyntheticPattern
+    {
+        zeros,
+        random, // the same random chunks are repeated over the stream
+    };
+
+    //
+    // the stream of a SyntheticChunkReader and the emulated device
+    //
+    struct SyntheticReaderSettings
+    {
+        uint64_t size = 0;
+        uint32_t chunkSize = 0;
+        uint64_t startOffset = 0;
+        SyntheticPattern pattern = SyntheticPattern::random;
+        uint32_t seed = 1;
+        
+        //
+        // every chunk takes delayUs plus a random time up to jitterUs,
+        // on average one chunk of slowEvery (0 - none) is a straggler
+        // that takes slowDelayUs more
+        //
+        uint32_t delayUs = 0;
+        uint32_t jitterUs = 0;
+        uint32_t slowEvery = 0;
+        uint32_t slowDelayUs = 0;
+    };
+
+    //
+    // It is a reader of a stream that is generated in memory, there is no I/O:
+    // chunks point to a few chunks of the pattern that are filled
+    // before reading, so the pipeline is measured at any rate.
+    // A device is emulated by the delay of getChunk in the calling hasher thread.
+    // The delay of a chunk depends only on the seed and its index,
+    // so the same stragglers are reproduced by every run
+    //
+    class SyntheticChunkReader : public ChunkReader
+    {
+    public:
+        explicit SyntheticChunkReader(const SyntheticReaderSettings& settings);
+        
+        SyntheticChunkReader(const SyntheticChunkReader&) = delete;
+        SyntheticChunkReader& operator=(const SyntheticChunkReader&) = delete;
+        
+        SyntheticChunkReader(SyntheticChunkReader&&) = delete;
+        SyntheticChunkReader& operator=(SyntheticChunkReader&&) = delete;
+        
+        uint32_t getChunkSize() const override;
+        uint64_t getStartOffset() const override;
+        
+        //
+        // the delay of the chunk in microseconds
+        //
+        uint64_t getDelayUs(uint64_t chunk) const;
+
+    private:
+        bool getChunk(const void *& data, uint32_t& size, uint64_t& offset) override;
+        void freeChunk(const void * data, uint32_t size, uint64_t offset) override;
+
+    private:
+        const SyntheticReaderSettings m_settings;
+        uint64_t m_chunksCount = 0;
+        uint64_t m_patternChunks = 0;
+        utils::PageMemory m_pattern;
+        
+        //
+        // chunk index of the next chunk, it is taken by hasher threads without locks
+        //
+        std::atomic<uint64_t> m_nextChunk;
+    };
+}
@@ -6,33 +6,24 @@
 //  Copyright © 2019 artem k. All rights reserved.
 //
 
-#include "Hash.hpp"
 #include "Utils.hpp"
 #include "Conio.hpp"
-#include "SigPipeline.hpp"
-#include "SigRecords.hpp"
-#include "ChunkReader.hpp"
-#include "FileStreamChunkReader.hpp"
-#include "FileMappingChunkReader.hpp"
+#include "SigModes.hpp"
+#include "SigOptions.hpp"
+#include "SigBinary.hpp"
 
-#include <iomanip>
+#include <csignal>
 #include <iostream>
+#include <limits>
 #include <string>
 
 namespace
 {
-    struct Arguments
+    //
+    // the options of the command line, the modes are run by file_sig_lib (see SigModes.hpp)
+    //
+    struct Arguments : file_sig::SigOptions
     {
-        std::string inFilePath;
-        std::string outFilePath;
-        std::string hasher = "crc32";
-        std::string reader = "stream";
-        uint32_t chunkSize = 0;
-        bool verbose = false;
-        
-        const uint32_t kDefaultChunkSize = 1024 * 1024;
-        const uint32_t kHugeChunkSize = 100 * 1024 * 1024;
-        
         void help()
         {
             std::cout << "Usage: \n";
@@ -45,8 +36,79 @@ namespace
             std::cout << "                                  If the file exists it will be rewritten\n";
             std::cout << "  --hash=<sha2|crc32>           - optional, default: srs32\n";
             std::cout << "                                  hash type for one chunk\n";
+            std::cout << "  --format=<text|bin>           - optional, default: text\n";
+            std::cout << "                                  bin is a compact format of fixed-width records\n";
+            std::cout << "                                  with raw digests, a record is reached in O(1)\n";
+            std::cout << "  --convert=<signature file>    - optional, rewrites the signature in --format\n";
+            std::cout << "                                  to <out file> (default: <signature file>.<format>)\n";
             std::cout << "  --reader=<map|mapall|stream>  - optional, default: stream\n";
             std::cout << "                                  opening method for <file path>\n";
+            std::cout << "  --threads=<count>             - optional, hasher threads, default: CPUs for stream,\n";
+            std::cout << "                                  3 * CPUs for map and mapall\n";
+            std::cout << "  --reorder-window=<chunks>     - optional, default: 4 chunks per a hasher thread\n";
+            std::cout << "                                  max distance between the next written chunk\n";
+            std::cout << "                                  and the furthest hashed one, bounds memory\n";
+            std::cout << "                                  if a hasher thread stalls\n";
+            std::cout << "  --auto[=<file>]               - optional, the reader, threads and chunks read ahead\n";
+            std::cout << "                                  are chosen by a calibration on the file, it is kept\n";
+            std::cout << "                                  per device in the file (default: ~/.file_signature.tune)\n";
+            std::cout << "                                  and later runs skip it, --reader is ignored\n";
+            std::cout << "  --max-memory=<bytes>[K|M|G]   - optional, bounds the reader and writer buffers,\n";
+            std::cout << "                                  chunk buffers and queued records, at least 2MB,\n";
+            std::cout << "                                  threads are reduced to fit it and the cache\n";
+            std::cout << "                                  of chunks shrinks under memory pressure (PSI)\n";
+            std::cout << "  --numa                        - optional, pins worker threads to physical cores\n";
+            std::cout << "                                  starting from the NUMA node of the storage,\n";
+            std::cout << "                                  the file is read near the storage\n";
+            std::cout << "  --stats=<file>                - optional, pipeline statistics are written\n";
+            std::cout << "                                  to the file as JSON lines every second\n";
+            std::cout << "  --report=<text|json>          - optional, per-stage latency (p50/p99/max)\n";
+            std::cout << "                                  and throughput at the end of the run\n";
+            std::cout << "  --perf                        - optional, hardware counters (cycles, instructions,\n";
+            std::cout << "                                  LLC and dTLB misses) of reading and hashing,\n";
+            std::cout << "                                  they are skipped if perf events are not permitted\n";
+            std::cout << "  --trace=<file>                - optional, chunk lifecycles are written to the file\n";
+            std::cout << "                                  in Chrome trace format (ui.perfetto.dev)\n";
+            std::cout << "  --trace-every=<chunks>        - optional, default: 1\n";
+            std::cout << "                                  only every Nth chunk is traced\n";
+            std::cout << "  --checkpoint-interval=<sec>   - optional, default: 10, 0 disables checkpoints\n";
+            std::cout << "                                  the written signature is flushed to the disk\n";
+            std::cout << "                                  and its progress is saved to <out file>.checkpoint\n";
+            std::cout << "  --resume                      - optional, continues an interrupted signature\n";
+            std::cout << "                                  from its checkpoint, the parameters must be the same\n";
+            std::cout << "  --update                      - optional, for append-only files, the complete chunks\n";
+            std::cout << "                                  of the existing <out file> are kept and only\n";
+            std::cout << "                                  the appended data are hashed\n";
+            std::cout << "  --update-verify=<chunks>      - optional, default: 0\n";
+            std::cout << "                                  count of kept chunks that are hashed again\n";
+            std::cout << "                                  to check that the file has been only appended\n";
+            std::cout << "  --verify=<signature file>     - optional, checks the file against the signature\n";
+            std::cout << "                                  instead of making a new one, --file, --hash\n";
+            std::cout << "                                  and --chunk-size are taken from the signature\n";
+            std::cout << "  --fail-fast                   - optional, --verify stops at the first bad chunk\n";
+            std::cout << "                                  instead of reporting all the bad ranges\n";
+            std::cout << "  --delta=<signature file>      - optional, the signature of an old version of the file,\n";
+            std::cout << "                                  copy and literal instructions that make the file\n";
+            std::cout << "                                  from the old one are written to <out file>\n";
+            std::cout << "                                  (default: <file path>.delta) instead of a signature\n";
+            std::cout << "  --index=<index file>          - optional, a chunk index of many signatures,\n";
+            std::cout << "                                  prints the dedup ratio of the indexed files\n";
+            std::cout << "  --add=<signature file>        - optional, repeatable, adds the signature to --index\n";
+            std::cout << "  --add-list=<file>             - optional, adds the signatures listed a line per file\n";
+            std::cout << "  --lookup=<signature file>     - optional, prints the ranges of the file\n";
+            std::cout << "                                  that are in the files of --index\n";
+#if !defined(_WIN32)
+            std::cout << "  --serve=<socket path>         - optional, runs a daemon that signs and verifies files\n";
+            std::cout << "                                  for clients of the local socket until SIGINT/SIGTERM\n";
+            std::cout << "  --connect=<socket path>       - optional, --file (or --verify) is signed (verified)\n";
+            std::cout << "                                  by the daemon, paths are resolved by the daemon\n";
+#endif
+            std::cout << "  --cache=<cache file>          - optional, a database of made signatures, the file\n";
+            std::cout << "                                  is not read if its inode, size, mtime and ctime\n";
+            std::cout << "                                  are the same as when its signature has been made\n";
+            std::cout << "  --cache-check=<chunks>        - optional, default: 0 - the cache is trusted,\n";
+            std::cout << "                                  otherwise the chunks of a cached signature are\n";
+            std::cout << "                                  hashed again to check it\n";
             std::cout << "  --verbose                     - optional, detailed output\n";
         }
         
@@ -63,7 +125,7 @@ namespace
 
         bool parse(int argc, const char * argv[])
         {
-            if (argc <= 1 || argc > 7)
+            if (argc <= 1)
             {
                 help();
                 return false;
@@ -79,18 +141,91 @@ namespace
                 if (parseArg(cmd, "--file=", inFilePath)
                     || parseArg(cmd, "--out=", outFilePath)
                     || parseArg(cmd, "--hash=", hasher)
-                    || parseArg(cmd, "--reader=", reader))
+                    || parseArg(cmd, "--reader=", reader)
+                    || parseArg(cmd, "--stats=", statsFilePath)
+                    || parseArg(cmd, "--report=", report)
+                    || parseArg(cmd, "--trace=", traceFilePath)
+                    || parseArg(cmd, "--verify=", verifyFilePath)
+                    || parseArg(cmd, "--delta=", deltaFilePath)
+                    || parseArg(cmd, "--convert=", convertFilePath)
+                    || parseArg(cmd, "--format=", format)
+                    || parseArg(cmd, "--index=", indexFilePath)
+                    || parseArg(cmd, "--add-list=", indexAddList)
+                    || parseArg(cmd, "--lookup=", indexLookup)
+                    || parseArg(cmd, "--serve=", serveSocketPath)
+                    || parseArg(cmd, "--connect=", connectSocketPath)
+                    || parseArg(cmd, "--cache=", cacheFilePath))
                 {
                     continue;
                 }
+                else if (parseArg(cmd, "--add=", val))
+                {
+                    indexAdd.push_back(val);
+                }
                 else if (cmd == "--verbose")
                 {
                     verbose = true;
                 }
+                else if (cmd == "--auto")
+                {
+                    autoTune = true;
+                }
+                else if (parseArg(cmd, "--auto=", autoFilePath))
+                {
+                    autoTune = true;
+                }
+                else if (cmd == "--numa")
+                {
+                    numa = true;
+                }
+                else if (cmd == "--perf")
+                {
+                    perf = true;
+                }
+                else if (cmd == "--resume")
+                {
+                    resume = true;
+                }
+                else if (cmd == "--update")
+                {
+                    update = true;
+                }
+                else if (cmd == "--fail-fast")
+                {
+                    failFast = true;
+                }
                 else if (parseArg(cmd, "--chunk-size=", val))
                 {
                     chunkSize = utils::toUnsigned<uint32_t>(val);
                 }
+                else if (parseArg(cmd, "--threads=", val))
+                {
+                    threads = utils::toUnsigned<uint32_t>(val);
+                }
+                else if (parseArg(cmd, "--reorder-window=", val))
+                {
+                    reorderWindow = utils::toUnsigned<uint32_t>(val);
+                }
+                else if (parseArg(cmd, "--checkpoint-interval=", val))
+                {
+                    checkpointInterval = utils::toUnsigned<uint32_t>(val);
+                }
+                else if (parseArg(cmd, "--update-verify=", val))
+                {
+                    updateVerifyChunks = utils::toUnsigned<uint32_t>(val);
+                }
+                else if (parseArg(cmd, "--max-memory=", val))
+                {
+                    maxMemory = parseSize(val);
+                }
+                else if (parseArg(cmd, "--cache-check=", val))
+                {
+                    cacheCheckChunks = utils::toUnsigned<uint32_t>(val);
+                }
+                else if (parseArg(cmd, "--trace-every=", val))
+                {
+                    traceEvery = utils::toUnsigned<uint32_t>(val);
+                }
                 else
                 {
                     std::cerr << "Unknown argument: '" << cmd << "'\n";
@@ -99,16 +234,107 @@ namespace
                 }
             }
             
-            if (inFilePath.empty())
+            if (!deltaFilePath.empty() && (resume || update || !verifyFilePath.empty()))
+            {
+                std::cerr << "--delta cannot be used with --resume, --update or --verify\n";
+                return false;
+            }
+            
+            if (format != "text" && format != "bin")
+            {
+                std::cerr << "Unknown signature format: '" << format << "'\n";
+                return false;
+            }
+            
+#if defined(_WIN32)
+            //
+            // the daemon needs local sockets, it is built only for POSIX systems
+            //
+            if (!serveSocketPath.empty() || !connectSocketPath.empty())
+            {
+                std::cerr << "--serve and --connect are not supported on Windows\n";
+                return false;
+            }
+#endif
+            
+            if (indexFilePath.empty() && (!indexAdd.empty() || !indexAddList.empty() || !indexLookup.empty()))
+            {
+                std::cerr << "--add, --add-list and --lookup need --index\n";
+                return false;
+            }
+            
+            if ((maxMemory || autoTune) && (!indexFilePath.empty() || !serveSocketPath.empty() || !connectSocketPath.empty()))
+            {
+                std::cerr << "--max-memory and --auto cannot be used with --index, --serve or --connect\n";
+                return false;
+            }
+            
+            if (!indexFilePath.empty() || !serveSocketPath.empty())
+            {
+                return true;
+            }
+            
+            if (!connectSocketPath.empty() && (resume || update || !deltaFilePath.empty()))
+            {
+                std::cerr << "--connect cannot be used with --resume, --update or --delta\n";
+                return false;
+            }
+            
+            if (!cacheFilePath.empty()
+                && (resume || update || !verifyFilePath.empty() || !deltaFilePath.empty() || !connectSocketPath.empty()))
+            {
+                std::cerr << "--cache cannot be used with --resume, --update, --verify, --delta or --connect\n";
+                return false;
+            }
+            
+            if (!convertFilePath.empty())
+            {
+                if (outFilePath.empty())
+                {
+                    outFilePath = convertFilePath + "." + format;
+                }
+                
+                return true;
+            }
+            
+            if (inFilePath.empty() && verifyFilePath.empty())
             {
                 //
-                // it is a compulsory parameter
+                // it is a compulsory parameter, unless it is taken from a verified signature
                 //
                 std::cerr << "--file is not set\n";
                 return false;
             }
             
-            if (outFilePath.empty())
+            if (!verifyFilePath.empty() && (resume || update))
+            {
+                std::cerr << "--verify cannot be used with --resume or --update\n";
+                return false;
+            }
+            
+            if (!report.empty() && report != "text" && report != "json")
+            {
+                std::cerr << "Unknown report type: '" << report << "'\n";
+                return false;
+            }
+            
+            if (resume && update)
+            {
+                std::cerr << "--resume and --update cannot be used together\n";
+                return false;
+            }
+            
+            if (0 == traceEvery)
+            {
+                std::cerr << "--trace-every must be positive\n";
+                return false;
+            }
+            
+            if (outFilePath.empty() && !deltaFilePath.empty())
+            {
+                outFilePath = inFilePath + ".delta";
+            }
+            else if (outFilePath.empty() && verifyFilePath.empty())
             {
                 outFilePath = inFilePath + ".signature";
             }
@@ -133,96 +359,37 @@ namespace
             return true;
         }
         
-        uint32_t getWorkerThreads() const
+        //
+        // "<bytes>" with an optional K, M or G suffix
+        //
+        static uint64_t parseSize(std::string val)
         {
-            if (reader == "stream")
-            {
-                //
-                // For buffered FileStream reader it is enough
-                // to have the same threads count as we have cores:
-                //  * N-cores threads that calculate hashes all the time -
-                //    they almost don't have blocking operations
-                //  * one another thread read a file data for those
-                //    N-threads
-                //
-                return std::thread::hardware_concurrency();
-            }
-            else if (reader == "map" || reader == "mapall")
-            {
-                //
-                // For the current implementation,
-                // mapping is a part of the same thread that calculate a hash.
-                // Working with a mapped memory has a blocked IO operations:
-                // page fault at the first access to a mapped memory that
-                // has not been read from a file yet.
-                // It makes sense to use more threads than cores.
-                //
-                return 3 * std::thread::hardware_concurrency();
-            }
+            uint64_t unit = 1;
             
-            THROW("Unknown reader type: " << reader);
-        }
-        
-        file_sig::SigPipeline::Hasher createHasher() const
-        {
-            if (hasher == "crc32")
+            if (!val.empty())
             {
-                return utils::crc32;
-            }
-            else if (hasher == "sha2")
-            {
-                return utils::sha2;
+                switch (val.back())
+                {
+                    case 'K': case 'k': unit = 1024ull; break;
+                    case 'M': case 'm': unit = 1024ull * 1024; break;
+                    case 'G': case 'g': unit = 1024ull * 1024 * 1024; break;
+                }
             }
             
-            THROW("Unknown hasher type: " << hasher);
-        }
-        
-        std::unique_ptr<file_sig::ChunkReader> createReader() const
-        {
-            std::unique_ptr<file_sig::ChunkReader> obj;
-            
-            if (reader == "stream")
-            {
-                //
-                // each worker thread has one cached value and one current value
-                //
-                obj.reset(new file_sig::FileStreamChunkReader(inFilePath, getWorkerThreads() * 2, chunkSize));
-            }
-            else if (reader == "map")
-            {
-                obj.reset(new file_sig::FileMappingChunkReader(inFilePath, chunkSize, false));
-            }
-            else if (reader == "mapall")
+            if (unit != 1)
             {
-                obj.reset(new file_sig::FileMappingChunkReader(inFilePath, chunkSize, true));
+                val.pop_back();
             }
             
-            THROW_IF(!obj, "Unknown reader type: " << reader);
-            return obj;
+            const uint64_t size = utils::toUnsigned<uint64_t>(val);
+            THROW_IF(size > std::numeric_limits<uint64_t>::max() / unit, "The size is too big '" << val << "'");
+            return size * unit;
         }
     };
 
-    std::ostream& operator << (std::ostream& out, const file_sig::SigPipeline::Record& record)
-    {
-        out << "0x" << std::hex << record.offset;
-        out << ":0x" << std::hex << record.size;
-        out << ":" << record.hash;
-        return out;
-    }
-
-    std::string timeToStr(uint64_t seconds)
-    {
-        std::stringstream st;
-
-        if (seconds > 60)
-        {
-            st << (seconds / 60) << " minute(s) ";
-            seconds = seconds % 60;
-        }
-        
-        st << seconds << " second(s)";
-        return st.str();
-    }
+#if !defined(_WIN32)
+    volatile std::sig_atomic_t g_stopServer = 0;
+#endif
 }
 
 int main(int argc, const char * argv[])
@@ -236,109 +403,49 @@ int main(int argc, const char * argv[])
             return 1;
         }
         
-        const size_t filesize = utils::getFileSize(args.inFilePath);
-        
-        std::cout << "Filename: " << args.inFilePath << "\n";
-        std::cout << "Filesize: " << filesize << "\n";
-        std::cout << "Hash: " << args.hasher << "\n";
-        std::cout << "Initialization...\n";
-        
-        auto hasher = args.createHasher();
-        auto reader = args.createReader();
-        file_sig::SigPipeline pipeline(*reader, hasher, args.getWorkerThreads());
-        
-        std::ofstream out;
-        out.exceptions(std::ios::badbit | std::ios::failbit);
-        out.open(args.outFilePath, std::ios::out | std::ios::trunc);
-        
-        out << "Filename: " << args.inFilePath << "\r\n";
-        out << "Filesize: " << std::dec << filesize << "\r\n";
-        out << "Hash: " << args.hasher << "\r\n";
-        
-        std::cout << "\nTo cancel press any key\n\n";
-        
-        const auto startTime = std::chrono::steady_clock::now();
+        if (!args.indexFilePath.empty())
+        {
+            return file_sig::runIndex(args, std::cout);
+        }
         
-        if (args.verbose)
+#if !defined(_WIN32)
+        if (!args.serveSocketPath.empty())
         {
-            //
-            // it is just a sample
-            // how to use SigPipeline::wait funstion with a record parameter
-            //
-            file_sig::SigPipeline::Record record;
-            file_sig::SigPipeline::WaitRes res;
-            
-            uint64_t totalChunks = filesize / args.chunkSize + (filesize % args.chunkSize ? 1 : 0);
-            uint64_t chunkId = 0;
+            std::signal(SIGINT, [](int) { g_stopServer = 1; });
+            std::signal(SIGTERM, [](int) { g_stopServer = 1; });
             
-            do
-            {
-                //
-                // wait for one second or until a new record is ready
-                // and check if a key has been pressed
-                //
-                res = pipeline.wait(1000, record);
-
-                if (_kbhit())
-                {
-                    std::cout << "\nCanceling...";
-                    pipeline.cancel(true);
-                    std::cout << "\nStopped.\n";
-                    break;
-                }
-                
-                if (file_sig::SigPipeline::WaitRes::ready == res)
-                {
-                    out << record << "\r\n";
-                    std::cout << std::dec << ++chunkId << "/" << totalChunks << " => " << record << "\n";
-                }
-            }
-            while (res != file_sig::SigPipeline::WaitRes::finished);
+            return file_sig::runServer(args, []() { return 0 != g_stopServer; }, std::cout);
+        }
         
-            std::cout << "\rFinished: " << std::dec << totalChunks << " hashes\n";
+        if (!args.connectSocketPath.empty())
+        {
+            return file_sig::runClient(args, std::cout);
         }
-        else
+#endif
+        
+        if (!args.convertFilePath.empty())
         {
-            //
-            // it is just a sample
-            // how to use SigPipeline::wait funstion without a record parameter
-            // and the records callback
-            //
-            std::atomic<uint64_t> count{0};
-            std::atomic<uint64_t> offset{0};
-            
-            pipeline.setRecordsCallback([&](file_sig::SigPipeline::Record record)
-            {
-                out << record << "\r\n";
-                offset = record.offset + record.size;
-                count += 1;
-            });
-            
-            while (file_sig::SigPipeline::WaitRes::timeout == pipeline.wait(1000))
-            {
-                if (_kbhit())
-                {
-                    std::cout << "\nCanceling...";
-                    pipeline.cancel(true);
-                    std::cout << "\nStopped.\n";
-                    break;
-                }
-                
-                float percents = 100.0f * static_cast<float>(offset) / static_cast<float>(filesize);
-                std::cout << "\r" << std::fixed << std::setprecision(2) << percents << "%";
-                std::cout << " hashes:" << count << std::flush;
-            }
+            file_sig::convertSignature(args.convertFilePath, args.outFilePath, args.format == "bin");
+            std::cout << "Converted: " << args.outFilePath << "\n";
+            return 0;
+        }
         
-            std::cout << "\rFinished: ";
-            std::cout << 100.0f * static_cast<float>(offset) / static_cast<float>(filesize) << "%";
-            std::cout << " hashes:" << std::dec << count << "\n";
+        if (!args.deltaFilePath.empty())
+        {
+            return file_sig::runDelta(args, std::cout);
         }
         
-        auto time = std::chrono::steady_clock::now() - startTime;
-        auto seconds = std::chrono::duration_cast<std::chrono::seconds>(time).count();
-        std::cout << "Total time: " << timeToStr(seconds) << "\n";
+        //
+        // a run is canceled by any key
+        //
+        const file_sig::IsCanceled isCanceled = []() { return 0 != _kbhit(); };
+        
+        if (!args.verifyFilePath.empty())
+        {
+            return file_sig::runVerify(args, isCanceled, std::cout);
+        }
         
-        return 0;
+        return file_sig::runSign(args, isCanceled, std::cout);
     }
     catch (const std::ios::failure& ex)
     {
@@ -0,0 +1,58 @@
+//
+//  Endian.hpp
+//  file_signature
+//
+//  Created by artem k on 12.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#pragma once
+
+#include <stdint.h>
+
+namespace utils
+{
+    //
+    // little-endian numbers of file formats, they do not depend on the host byte order
+    // and compilers merge the byte loops to single loads and stores
+    //
+    inline void store32(uint8_t* out, uint32_t value)
+    {
+        for (int i = 0; i < 4; ++i)
+        {
+            out[i] = static_cast<uint8_t>(value >> (8 * i));
+        }
+    }
+
+    inline void store64(uint8_t* out, uint64_t value)
+    {
+        for (int i = 0; i < 8; ++i)
+        {
+            out[i] = static_cast<uint8_t>(value >> (8 * i));
+        }
+    }
+
+    inline uint32_t load32(const uint8_t* data)
+    {
+        uint32_t value = 0;
+        
+        for (int i = 3; i >= 0; --i)
+        {
+            value = (value << 8) | data[i];
+        }
+        
+        return value;
+    }
+
+    inline uint64_t load64(const uint8_t* data)
+    {
+        uint64_t value = 0;
+        
+        for (int i = 7; i >= 0; --i)
+        {
+            value = (value << 8) | data[i];
+        }
+        
+        return value;
+    }
+}
@@ -0,0 +1,68 @@
+//
+//  FileIdentity.cpp
+//  file_signature
+//
+//  Created by artem k on 16.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#include "FileIdentity.hpp"
+#include "Exceptions.hpp"
+
+#include <stdlib.h>
+#include <sys/stat.h>
+
+namespace utils
+{
+    namespace
+    {
+        uint64_t toNs(const struct timespec& time)
+        {
+            return static_cast<uint64_t>(time.tv_sec) * 1000000000ull + static_cast<uint64_t>(time.tv_nsec);
+        }
+    }
+
+    FileIdentity FileIdentity::get(const std::string& path)
+    {
+        struct stat st = {};
+        THROW_ERRNO_IF(::stat(path.c_str(), &st) != 0, "Cannot open " << path);
+        
+        FileIdentity identity;
+        identity.device = static_cast<uint64_t>(st.st_dev);
+        identity.inode = static_cast<uint64_t>(st.st_ino);
+        identity.size = static_cast<uint64_t>(st.st_size);
+
+#if defined(__APPLE__)
+        identity.mtimeNs = toNs(st.st_mtimespec);
+        identity.ctimeNs = toNs(st.st_ctimespec);
+#else
+        identity.mtimeNs = toNs(st.st_mtim);
+        identity.ctimeNs = toNs(st.st_ctim);
+#endif
+        return identity;
+    }
+
+    std::string FileIdentity::getAbsolutePath(const std::string& path)
+    {
+        char* absolute = ::realpath(path.c_str(), nullptr);
+        THROW_ERRNO_IF(!absolute, "Cannot resolve the path " << path);
+        
+        const std::string res(absolute);
+        ::free(absolute);
+        return res;
+    }
+
+    bool FileIdentity::operator==(const FileIdentity& other) const
+    {
+        return device == other.device
+            && inode == other.inode
+            && size == other.size
+            && mtimeNs == other.mtimeNs
+            && ctimeNs == other.ctimeNs;
+    }
+
+    bool FileIdentity::operator!=(const FileIdentity& other) const
+    {
+        return !(*this == other);
+    }
+}
@@ -0,0 +1,44 @@
+//
+//  FileIdentity.hpp
+//  file_signature
+//
+//  Created by artem k on 16.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#pragma once
+
+#include <string>
+#include <stdint.h>
+
+namespace utils
+{
+    //
+    // Identity and version of a file by its metadata:
+    // the same device and inode with the same size and times
+    // is the same unchanged file, its data are not read.
+    // ctime is changed by any write or metadata change,
+    // even if mtime has been restored by touch or utime
+    //
+    struct FileIdentity
+    {
+        uint64_t device = 0;
+        uint64_t inode = 0;
+        uint64_t size = 0;
+        uint64_t mtimeNs = 0;
+        uint64_t ctimeNs = 0;
+        
+        //
+        // throws if the file cannot be opened
+        //
+        static FileIdentity get(const std::string& path);
+        
+        //
+        // the absolute path of an existing file, so it is found from any working directory
+        //
+        static std::string getAbsolutePath(const std::string& path);
+        
+        bool operator==(const FileIdentity& other) const;
+        bool operator!=(const FileIdentity& other) const;
+    };
+}
@@ -0,0 +1,77 @@
+#include "FileIdentity.hpp"
+#include "ScopedHandle.hpp"
+#include "Exceptions.hpp"
+
+#include <Windows.h>
+
+namespace utils
+{
+    namespace
+    {
+        //
+        // FILETIME and LARGE_INTEGER times are in 100ns since 1601
+        //
+        uint64_t toNs(LARGE_INTEGER time)
+        {
+            return static_cast<uint64_t>(time.QuadPart) * 100;
+        }
+    }
+
+    FileIdentity FileIdentity::get(const std::string& path)
+    {
+        ScopedHandle<HANDLE, decltype(::CloseHandle), ::CloseHandle, INVALID_HANDLE_VALUE> file;
+        file = CreateFileA(path.c_str()
+            , FILE_READ_ATTRIBUTES
+            , FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE
+            , NULL
+            , OPEN_EXISTING
+            , FILE_ATTRIBUTE_NORMAL
+            , NULL);
+        THROW_WIN_IF(!file, "Cannot open " << path);
+
+        BY_HANDLE_FILE_INFORMATION info = {};
+        THROW_WIN_IF(!GetFileInformationByHandle(file, &info), "Cannot get information of " << path);
+
+        //
+        // ChangeTime is the analogue of ctime, it is not in BY_HANDLE_FILE_INFORMATION
+        //
+        FILE_BASIC_INFO basic = {};
+        THROW_WIN_IF(!GetFileInformationByHandleEx(file, FileBasicInfo, &basic, sizeof(basic)),
+                     "Cannot get information of " << path);
+
+        FileIdentity identity;
+        identity.device = info.dwVolumeSerialNumber;
+        identity.inode = (static_cast<uint64_t>(info.nFileIndexHigh) << 32) | info.nFileIndexLow;
+        identity.size = (static_cast<uint64_t>(info.nFileSizeHigh) << 32) | info.nFileSizeLow;
+        identity.mtimeNs = toNs(basic.LastWriteTime);
+        identity.ctimeNs = toNs(basic.ChangeTime);
+        return identity;
+    }
+
+    std::string FileIdentity::getAbsolutePath(const std::string& path)
+    {
+        const DWORD size = GetFullPathNameA(path.c_str(), 0, NULL, NULL);
+        THROW_WIN_IF(0 == size, "Cannot resolve the path " << path);
+        
+        std::string res(size, '\0');
+        const DWORD length = GetFullPathNameA(path.c_str(), size, &res[0], NULL);
+        THROW_WIN_IF(0 == length || length >= size, "Cannot resolve the path " << path);
+        
+        res.resize(length);
+        return res;
+    }
+
+    bool FileIdentity::operator==(const FileIdentity& other) const
+    {
+        return device == other.device
+            && inode == other.inode
+            && size == other.size
+            && mtimeNs == other.mtimeNs
+            && ctimeNs == other.ctimeNs;
+    }
+
+    bool FileIdentity::operator!=(const FileIdentity& other) const
+    {
+        return !(*this == other);
+    }
+}
@@ -0,0 +1,48 @@
+//
+//  FileLock.cpp
+//  file_signature
+//
+//  Created by artem k on 19.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#include "FileLock.hpp"
+#include "ScopedHandle.hpp"
+#include "Exceptions.hpp"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+
+namespace utils
+{
+    struct FileLock::Impl
+    {
+        ScopedHandle<int, decltype(::close), ::close, -1> file;
+    };
+
+    FileLock::FileLock(const std::string& path)
+        : m_impl(std::make_unique<Impl>())
+    {
+        m_impl->file.reset(::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644));
+        THROW_ERRNO_IF(m_impl->file.get() < 0, "Cannot open " << path);
+        
+        int res = 0;
+        
+        do
+        {
+            res = ::flock(m_impl->file, LOCK_EX);
+        }
+        while (res != 0 && EINTR == errno);
+        
+        THROW_ERRNO_IF(res != 0, "Cannot lock " << path);
+    }
+
+    FileLock::~FileLock()
+    {
+        //
+        // the lock is released by closing the file
+        //
+    }
+}
@@ -0,0 +1,40 @@
+//
+//  FileLock.hpp
+//  file_signature
+//
+//  Created by artem k on 19.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#pragma once
+
+#include <memory>
+#include <string>
+
+namespace utils
+{
+    //
+    // An exclusive lock of a file between processes, it is held until the object is destroyed.
+    // The file is created if it does not exist and it is never removed:
+    // two processes could lock different files of the same path otherwise
+    //
+    // e.g.: FileLock lock(dbPath + ".lock");
+    //       ... re-read and update the database ...
+    //
+    class FileLock
+    {
+    public:
+        //
+        // waits until the lock is taken
+        //
+        explicit FileLock(const std::string& path);
+        ~FileLock();
+        
+        FileLock(const FileLock&) = delete;
+        FileLock& operator=(const FileLock&) = delete;
+
+    private:
+        struct Impl;
+        std::unique_ptr<Impl> m_impl;
+    };
+}
@@ -0,0 +1,37 @@
+#include "FileLock.hpp"
+#include "ScopedHandle.hpp"
+#include "Exceptions.hpp"
+
+#include <Windows.h>
+
+namespace utils
+{
+    struct FileLock::Impl
+    {
+        ScopedHandle<HANDLE, decltype(::CloseHandle), ::CloseHandle, INVALID_HANDLE_VALUE> file;
+    };
+
+    FileLock::FileLock(const std::string& path)
+        : m_impl(std::make_unique<Impl>())
+    {
+        m_impl->file = CreateFileA(path.c_str()
+            , GENERIC_READ | GENERIC_WRITE
+            , FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE
+            , NULL
+            , OPEN_ALWAYS
+            , FILE_ATTRIBUTE_NORMAL
+            , NULL);
+        THROW_WIN_IF(!m_impl->file, "Cannot open " << path);
+        
+        OVERLAPPED overlapped = {};
+        THROW_WIN_IF(!LockFileEx(m_impl->file, LOCKFILE_EXCLUSIVE_LOCK, 0, MAXDWORD, MAXDWORD, &overlapped),
+                     "Cannot lock " << path);
+    }
+
+    FileLock::~FileLock()
+    {
+        //
+        // the lock is released by closing the file
+        //
+    }
+}
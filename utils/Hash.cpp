@@ -15,25 +15,165 @@
 #include "picosha2.h"
 #pragma warning(pop)
 
-#include <sstream>
-#include <iomanip>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define HASH_HEX_SSE2 1
+#endif
 
 namespace utils
 {
+    namespace
+    {
+        const char kHexDigits[] = "0123456789abcdef";
+        
+#if HASH_HEX_SSE2
+        //
+        // nibbles 0..15 to '0'..'9', 'a'..'f'
+        //
+        __m128i nibblesToHex(__m128i nibbles)
+        {
+            const __m128i letters = _mm_and_si128(_mm_cmpgt_epi8(nibbles, _mm_set1_epi8(9)),
+                                                  _mm_set1_epi8('a' - '0' - 10));
+            return _mm_add_epi8(_mm_add_epi8(nibbles, _mm_set1_epi8('0')), letters);
+        }
+#endif
+    }
+
     std::string crc32(const void* data, size_t size)
     {
-        const uint32_t crc = crc32_fast(data, size, 0);
+        const uint32_t crc = crc32Value(data, size);
         
-        std::stringstream st;
-        st << std::setfill ('0') << std::setw(8) << std::hex << crc;
+        //
+        // the digits are in the order of "%08x"
+        //
+        const uint8_t bytes[4] =
+        {
+            static_cast<uint8_t>(crc >> 24),
+            static_cast<uint8_t>(crc >> 16),
+            static_cast<uint8_t>(crc >> 8),
+            static_cast<uint8_t>(crc)
+        };
         
-        return st.str();
+        return toHex(bytes, sizeof(bytes));
+    }
+
+    uint32_t crc32Value(const void* data, size_t size)
+    {
+        return crc32_fast(data, size, 0);
     }
 
     std::string sha2(const void* data, size_t size)
     {
-        auto begin = static_cast<const char*>(data);
+        auto begin = static_cast<const uint8_t*>(data);
         auto end = begin + size;
-        return picosha2::hash256_hex_string(begin, end);
+        
+        uint8_t digest[32];
+        picosha2::hash256(begin, end, digest, digest + sizeof(digest));
+        return toHex(digest, sizeof(digest));
+    }
+
+    std::string toHex(const void* data, size_t size)
+    {
+        std::string hex(2 * size, '\0');
+        toHex(data, size, &hex[0]);
+        return hex;
+    }
+
+    void toHex(const void* data, size_t size, char* out)
+    {
+        auto bytes = static_cast<const uint8_t*>(data);
+        size_t i = 0;
+        
+#if HASH_HEX_SSE2
+        const __m128i mask = _mm_set1_epi8(0x0f);
+        
+        for (; i + 16 <= size; i += 16)
+        {
+            const __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes + i));
+            const __m128i high = _mm_and_si128(_mm_srli_epi16(in, 4), mask);
+            const __m128i low = _mm_and_si128(in, mask);
+            
+            //
+            // the high nibble of a byte is the first digit
+            //
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * i), nibblesToHex(_mm_unpacklo_epi8(high, low)));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * i + 16), nibblesToHex(_mm_unpackhi_epi8(high, low)));
+        }
+#endif
+        
+        for (; i < size; ++i)
+        {
+            out[2 * i] = kHexDigits[bytes[i] >> 4];
+            out[2 * i + 1] = kHexDigits[bytes[i] & 0xf];
+        }
+    }
+
+    char* formatHex(uint64_t value, char* out)
+    {
+        char digits[16];
+        size_t count = 0;
+        
+        do
+        {
+            digits[count++] = kHexDigits[value & 0xf];
+            value >>= 4;
+        }
+        while (value);
+        
+        while (count)
+        {
+            *out++ = digits[--count];
+        }
+        
+        return out;
+    }
+
+    bool fromHex(const std::string& hex, void* data, size_t size)
+    {
+        return fromHex(hex.data(), hex.size(), data, size);
+    }
+
+    bool fromHex(const char* hex, size_t length, void* data, size_t size)
+    {
+        if (length != 2 * size)
+        {
+            return false;
+        }
+        
+        auto bytes = static_cast<uint8_t*>(data);
+        
+        for (size_t i = 0; i < length; ++i)
+        {
+            const char c = hex[i];
+            uint8_t digit = 0;
+            
+            if (c >= '0' && c <= '9')
+            {
+                digit = static_cast<uint8_t>(c - '0');
+            }
+            else if (c >= 'a' && c <= 'f')
+            {
+                digit = static_cast<uint8_t>(c - 'a' + 10);
+            }
+            else if (c >= 'A' && c <= 'F')
+            {
+                digit = static_cast<uint8_t>(c - 'A' + 10);
+            }
+            else
+            {
+                return false;
+            }
+            
+            if (i % 2)
+            {
+                bytes[i / 2] |= digit;
+            }
+            else
+            {
+                bytes[i / 2] = static_cast<uint8_t>(digit << 4);
+            }
+        }
+        
+        return true;
     }
 }
@@ -9,9 +9,33 @@
 #pragma once
 
 #include <string>
+#include <stdint.h>
 
 namespace utils
 {
     std::string crc32(const void* data, size_t size);
+    uint32_t crc32Value(const void* data, size_t size);
     std::string sha2(const void* data, size_t size);
+
+    //
+    // lowercase hex digits of raw bytes, e.g. of a digest
+    //
+    std::string toHex(const void* data, size_t size);
+
+    //
+    // writes 2 * size hex digits to 'out' without a terminating zero,
+    // 16 bytes are encoded at once by SSE2
+    //
+    void toHex(const void* data, size_t size, char* out);
+
+    //
+    // writes the value in hex without leading zeros (as "%llx"), returns the end of the digits
+    //
+    char* formatHex(uint64_t value, char* out);
+
+    //
+    // returns false if 'hex' is not 2 * size hex digits
+    //
+    bool fromHex(const std::string& hex, void* data, size_t size);
+    bool fromHex(const char* hex, size_t length, void* data, size_t size);
 }
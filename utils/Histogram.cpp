@@ -0,0 +1,158 @@
+//
+//  Histogram.cpp
+//  file_signature
+//
+//  Created by artem k on 04.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#include "Histogram.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace utils
+{
+    namespace
+    {
+        const size_t kSubBucketBits = 4;
+        const size_t kSubBuckets = size_t(1) << kSubBucketBits;
+        const size_t kBucketsCount = (64 - kSubBucketBits + 1) * kSubBuckets;
+
+        //
+        // index of the highest set bit, the value must not be zero
+        //
+        size_t getHighestBit(uint64_t value)
+        {
+            size_t bit = 0;
+
+            for (size_t shift = 32; shift; shift >>= 1)
+            {
+                if (value >> shift)
+                {
+                    value >>= shift;
+                    bit += shift;
+                }
+            }
+
+            return bit;
+        }
+    }
+
+    Histogram::Histogram()
+        : m_buckets(kBucketsCount, 0)
+    {
+    }
+
+    void Histogram::record(uint64_t value)
+    {
+        ++m_buckets[getBucket(value)];
+        ++m_count;
+        m_max = std::max(m_max, value);
+    }
+
+    void Histogram::merge(const Histogram& other)
+    {
+        for (size_t i = 0; i < m_buckets.size(); ++i)
+        {
+            m_buckets[i] += other.m_buckets[i];
+        }
+
+        m_count += other.m_count;
+        m_max = std::max(m_max, other.m_max);
+    }
+
+    uint64_t Histogram::getCount() const
+    {
+        return m_count;
+    }
+
+    uint64_t Histogram::getMax() const
+    {
+        return m_max;
+    }
+
+    uint64_t Histogram::getPercentile(double percent) const
+    {
+        if (0 == m_count)
+        {
+            return 0;
+        }
+
+        const double rank = std::ceil(static_cast<double>(m_count) * percent / 100.0);
+        const uint64_t target = std::max<uint64_t>(static_cast<uint64_t>(rank), 1);
+        uint64_t count = 0;
+
+        for (size_t i = 0; i < m_buckets.size(); ++i)
+        {
+            count += m_buckets[i];
+
+            if (count >= target)
+            {
+                return std::min(getBucketMax(i), m_max);
+            }
+        }
+
+        return m_max;
+    }
+
+    size_t Histogram::getBucket(uint64_t value)
+    {
+        if (value < kSubBuckets)
+        {
+            return static_cast<size_t>(value);
+        }
+
+        //
+        // the highest bit selects a range, the next bits select a linear bucket in it
+        //
+        const size_t bit = getHighestBit(value);
+        const size_t sub = static_cast<size_t>(value >> (bit - kSubBucketBits)) & (kSubBuckets - 1);
+        return (bit - kSubBucketBits + 1) * kSubBuckets + sub;
+    }
+
+    uint64_t Histogram::getBucketMax(size_t bucket)
+    {
+        if (bucket < kSubBuckets)
+        {
+            return bucket;
+        }
+
+        const size_t bit = bucket / kSubBuckets + kSubBucketBits - 1;
+        const uint64_t sub = bucket % kSubBuckets;
+        const uint64_t lower = (kSubBuckets + sub) << (bit - kSubBucketBits);
+        return lower + (uint64_t(1) << (bit - kSubBucketBits)) - 1;
+    }
+
+    LatencyRecorder::LatencyRecorder(size_t stagesCount)
+        : m_stagesCount(stagesCount)
+    {
+    }
+
+    void LatencyRecorder::record(size_t stage, uint64_t value)
+    {
+        auto& shard = m_shards.get();
+
+        if (shard.empty())
+        {
+            shard.resize(m_stagesCount);
+        }
+
+        shard[stage].record(value);
+    }
+
+    std::vector<Histogram> LatencyRecorder::merge() const
+    {
+        std::vector<Histogram> stages(m_stagesCount);
+
+        m_shards.forEach([&stages](const std::vector<Histogram>& shard)
+        {
+            for (size_t i = 0; i < shard.size(); ++i)
+            {
+                stages[i].merge(shard[i]);
+            }
+        });
+
+        return stages;
+    }
+}
@@ -0,0 +1,75 @@
+//
+//  Histogram.hpp
+//  file_signature
+//
+//  Created by artem k on 04.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#pragma once
+
+#include "ThreadShards.hpp"
+
+#include <vector>
+#include <stdint.h>
+
+namespace utils
+{
+    //
+    // Log-linear histogram of values (e.g. latency in nanoseconds)
+    // Each power of 2 range is split to 16 linear buckets,
+    // so a value is kept with a relative error less than 1/16
+    // and the whole uint64_t range fits to a thousand buckets
+    //
+    class Histogram
+    {
+    public:
+        Histogram();
+
+        void record(uint64_t value);
+        void merge(const Histogram& other);
+
+        uint64_t getCount() const;
+        uint64_t getMax() const;
+
+        //
+        // the upper bound of the bucket that contains the percentile,
+        // e.g. getPercentile(99.0)
+        //
+        uint64_t getPercentile(double percent) const;
+
+    private:
+        static size_t getBucket(uint64_t value);
+        static uint64_t getBucketMax(size_t bucket);
+
+    private:
+        std::vector<uint64_t> m_buckets;
+        uint64_t m_count = 0;
+        uint64_t m_max = 0;
+    };
+
+    //
+    // Histograms of several stages that are recorded by many threads
+    // Each thread records to its own shard without locks or atomics,
+    // the shards are merged when the recording threads have finished
+    //
+    class LatencyRecorder
+    {
+    public:
+        explicit LatencyRecorder(size_t stagesCount);
+
+        LatencyRecorder(const LatencyRecorder&) = delete;
+        LatencyRecorder& operator=(const LatencyRecorder&) = delete;
+
+        void record(size_t stage, uint64_t value);
+
+        //
+        // must not be called while other threads record values
+        //
+        std::vector<Histogram> merge() const;
+
+    private:
+        const size_t m_stagesCount;
+        ThreadShards<std::vector<Histogram>> m_shards;
+    };
+}
@@ -0,0 +1,271 @@
+//
+//  LocalSocket.cpp
+//  file_signature
+//
+//  Created by artem k on 14.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#include "LocalSocket.hpp"
+#include "ScopedHandle.hpp"
+#include "Exceptions.hpp"
+
+#include <vector>
+#include <string.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#if !defined(MSG_NOSIGNAL)
+#define MSG_NOSIGNAL 0
+#endif
+
+namespace utils
+{
+    namespace
+    {
+        const size_t kReadBufferSize = 64 * 1024;
+        
+        sockaddr_un getAddress(const std::string& path)
+        {
+            sockaddr_un address = {};
+            THROW_IF(path.size() >= sizeof(address.sun_path), "The socket path is too long: " << path);
+            
+            address.sun_family = AF_UNIX;
+            memcpy(address.sun_path, path.c_str(), path.size() + 1);
+            return address;
+        }
+        
+        void setTimeout(int socket, int option, uint32_t timeoutMs)
+        {
+            timeval timeout = {};
+            timeout.tv_sec = timeoutMs / 1000;
+            timeout.tv_usec = (timeoutMs % 1000) * 1000;
+            
+            THROW_ERRNO_IF(::setsockopt(socket, SOL_SOCKET, option, &timeout, sizeof(timeout)) != 0,
+                           "Cannot set the socket timeout");
+        }
+        
+        //
+        // a socket file is stale if nobody accepts its connections,
+        // e.g. the daemon has been killed
+        //
+        bool isStaleSocket(const sockaddr_un& address)
+        {
+            ScopedHandle<int, decltype(::close), ::close, -1> socket(::socket(AF_UNIX, SOCK_STREAM, 0));
+            THROW_ERRNO_IF(socket.get() < 0, "Cannot create a socket");
+            
+            return ::connect(socket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0
+                && ECONNREFUSED == errno;
+        }
+    }
+
+    struct LocalSocket::Impl
+    {
+        ScopedHandle<int, decltype(::close), ::close, -1> socket;
+        
+        //
+        // the socket file of a listening socket is removed with it
+        //
+        std::string path;
+        std::vector<char> buffer;
+        size_t begin = 0;
+        size_t end = 0;
+    };
+
+    LocalSocket::LocalSocket()
+        : m_impl(std::make_unique<LocalSocket::Impl>())
+    {
+    }
+
+    LocalSocket::~LocalSocket()
+    {
+        if (m_impl && !m_impl->path.empty())
+        {
+            ::unlink(m_impl->path.c_str());
+        }
+    }
+
+    LocalSocket::LocalSocket(LocalSocket&& other) = default;
+    LocalSocket& LocalSocket::operator=(LocalSocket&& other) = default;
+
+    LocalSocket LocalSocket::listen(const std::string& path)
+    {
+        const sockaddr_un address = getAddress(path);
+        
+        //
+        // only a stale socket is removed: not a regular file of a wrong path
+        // and not the socket of a running daemon
+        //
+        struct stat info = {};
+        
+        if (0 == ::lstat(path.c_str(), &info))
+        {
+            THROW_IF(!S_ISSOCK(info.st_mode), "The address is in use, " << path << " is not a socket");
+            THROW_IF(!isStaleSocket(address), "The address is in use, " << path << " accepts connections");
+            ::unlink(path.c_str());
+        }
+        
+        LocalSocket obj;
+        obj.m_impl->socket.reset(::socket(AF_UNIX, SOCK_STREAM, 0));
+        THROW_ERRNO_IF(obj.m_impl->socket.get() < 0, "Cannot create a socket");
+        
+        THROW_ERRNO_IF(::bind(obj.m_impl->socket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0,
+                       "Cannot bind the socket to " << path);
+        obj.m_impl->path = path;
+        THROW_ERRNO_IF(::listen(obj.m_impl->socket, SOMAXCONN) != 0, "Cannot listen " << path);
+        return obj;
+    }
+
+    LocalSocket LocalSocket::connect(const std::string& path)
+    {
+        const sockaddr_un address = getAddress(path);
+        
+        LocalSocket obj;
+        obj.m_impl->socket.reset(::socket(AF_UNIX, SOCK_STREAM, 0));
+        THROW_ERRNO_IF(obj.m_impl->socket.get() < 0, "Cannot create a socket");
+        
+        THROW_ERRNO_IF(::connect(obj.m_impl->socket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0,
+                       "Cannot connect to " << path);
+        return obj;
+    }
+
+    LocalSocket LocalSocket::accept(uint32_t timeoutMs)
+    {
+        pollfd fd = {};
+        fd.fd = m_impl->socket;
+        fd.events = POLLIN;
+        
+        const int res = ::poll(&fd, 1, static_cast<int>(timeoutMs));
+        
+        if (res < 0 && EINTR == errno)
+        {
+            return LocalSocket();
+        }
+        
+        THROW_ERRNO_IF(res < 0, "poll failed");
+        
+        LocalSocket obj;
+        
+        if (res > 0)
+        {
+            obj.m_impl->socket.reset(::accept(m_impl->socket, nullptr, nullptr));
+            THROW_ERRNO_IF(obj.m_impl->socket.get() < 0 && errno != EINTR && errno != ECONNABORTED, "accept failed");
+        }
+        
+        return obj;
+    }
+
+    bool LocalSocket::isValid() const
+    {
+        return m_impl->socket.get() >= 0;
+    }
+
+    bool LocalSocket::readLine(std::string& line, size_t maxSize)
+    {
+        auto& impl = *m_impl;
+        line.clear();
+        
+        for (;;)
+        {
+            const char* begin = impl.buffer.data() + impl.begin;
+            const char* end = impl.buffer.data() + impl.end;
+            const char* eol = static_cast<const char*>(memchr(begin, '\n', end - begin));
+            
+            const size_t size = (eol ? eol : end) - begin;
+            
+            //
+            // the line is not buffered without a limit, a peer may send no line ends
+            //
+            THROW_IF(maxSize && line.size() + size > maxSize + 1, "The line is longer than " << maxSize << " bytes");
+            
+            if (eol)
+            {
+                line.append(begin, eol);
+                impl.begin += eol - begin + 1;
+                
+                if (!line.empty() && line.back() == '\r')
+                {
+                    line.pop_back();
+                }
+                
+                return true;
+            }
+            
+            line.append(begin, end);
+            impl.buffer.resize(kReadBufferSize);
+            impl.begin = 0;
+            impl.end = 0;
+            
+            ssize_t res = 0;
+            
+            do
+            {
+                res = ::recv(impl.socket, impl.buffer.data(), impl.buffer.size(), 0);
+            }
+            while (res < 0 && EINTR == errno);
+            
+            THROW_IF(res < 0 && (EAGAIN == errno || EWOULDBLOCK == errno), "The peer has not sent a line in time");
+            THROW_ERRNO_IF(res < 0, "Cannot read the socket");
+            
+            if (0 == res)
+            {
+                //
+                // the last line without a line end is not complete
+                //
+                return false;
+            }
+            
+            impl.end = static_cast<size_t>(res);
+        }
+    }
+
+    void LocalSocket::write(const void* data, size_t size)
+    {
+        const char* ptr = static_cast<const char*>(data);
+        
+        while (size)
+        {
+            //
+            // a closed peer is an error, not a SIGPIPE
+            //
+            const ssize_t res = ::send(m_impl->socket, ptr, size, MSG_NOSIGNAL);
+            
+            if (res < 0 && EINTR == errno)
+            {
+                continue;
+            }
+            
+            THROW_IF(res < 0 && (EAGAIN == errno || EWOULDBLOCK == errno), "The peer has not read the socket in time");
+            THROW_ERRNO_IF(res <= 0, "Cannot write the socket");
+            ptr += res;
+            size -= static_cast<size_t>(res);
+        }
+    }
+
+    void LocalSocket::write(const std::string& text)
+    {
+        write(text.data(), text.size());
+    }
+
+    void LocalSocket::setWriteTimeout(uint32_t timeoutMs)
+    {
+        setTimeout(m_impl->socket, SO_SNDTIMEO, timeoutMs);
+    }
+
+    void LocalSocket::setReadTimeout(uint32_t timeoutMs)
+    {
+        setTimeout(m_impl->socket, SO_RCVTIMEO, timeoutMs);
+    }
+
+    void LocalSocket::shutdown()
+    {
+        if (isValid())
+        {
+            ::shutdown(m_impl->socket, SHUT_RDWR);
+        }
+    }
+}
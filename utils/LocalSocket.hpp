@@ -0,0 +1,86 @@
+//
+//  LocalSocket.hpp
+//  file_signature
+//
+//  Created by artem k on 14.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <stdint.h>
+
+namespace utils
+{
+    //
+    // A stream socket of a local (Unix domain) address
+    // with buffered reading of text lines.
+    // It is implemented for POSIX systems only, so the daemon is not built on Windows
+    //
+    // e.g.: auto socket = LocalSocket::connect("/tmp/sig.sock");
+    //       socket.write("Job: sign\n\n");
+    //       while (socket.readLine(line)) ...
+    //
+    class LocalSocket
+    {
+    public:
+        //
+        // an invalid socket
+        //
+        LocalSocket();
+        ~LocalSocket();
+        
+        LocalSocket(const LocalSocket&) = delete;
+        LocalSocket& operator=(const LocalSocket&) = delete;
+        
+        LocalSocket(LocalSocket&& other);
+        LocalSocket& operator=(LocalSocket&& other);
+        
+        //
+        // a stale socket file of the path is removed,
+        // throws if the path is another file or a socket that accepts connections
+        //
+        static LocalSocket listen(const std::string& path);
+        static LocalSocket connect(const std::string& path);
+        
+        //
+        // returns an invalid socket on timeout
+        //
+        LocalSocket accept(uint32_t timeoutMs);
+        
+        bool isValid() const;
+        
+        //
+        // returns false at the end of the stream,
+        // the line end (\n or \r\n) is removed.
+        // Throws if the line is longer than maxSize, 0 - no limit,
+        // or if the peer does not send it for the read timeout
+        //
+        bool readLine(std::string& line, size_t maxSize = 0);
+        
+        void write(const void* data, size_t size);
+        void write(const std::string& text);
+        
+        //
+        // write throws if the peer does not read for the timeout, 0 - no timeout
+        //
+        void setWriteTimeout(uint32_t timeoutMs);
+        
+        //
+        // readLine throws if the peer does not send data for the timeout, 0 - no timeout
+        //
+        void setReadTimeout(uint32_t timeoutMs);
+        
+        //
+        // wakes up the threads that read or write the socket,
+        // it may be called from any thread
+        //
+        void shutdown();
+
+    private:
+        struct Impl;
+        std::unique_ptr<Impl> m_impl;
+    };
+}
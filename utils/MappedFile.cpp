@@ -0,0 +1,101 @@
+//
+//  MappedFile.cpp
+//  file_signature
+//
+//  Created by artem k on 11.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#include "MappedFile.hpp"
+#include "ScopedHandle.hpp"
+#include "Exceptions.hpp"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace utils
+{
+    struct MappedFile::Impl
+    {
+        ScopedHandle<int, decltype(::close), ::close, -1> file;
+        uint8_t* data = nullptr;
+        uint64_t size = 0;
+    };
+
+    MappedFile::MappedFile(const std::string& path, Mode mode, uint64_t size)
+        : m_impl(std::make_unique<MappedFile::Impl>())
+    {
+        const bool writable = Mode::write == mode;
+        THROW_IF(size && !writable, "A read-only file " << path << " cannot be resized");
+        
+        m_impl->file.reset(writable ? open(path.c_str(), O_RDWR | O_CREAT, 0644) : open(path.c_str(), O_RDONLY));
+        THROW_ERRNO_IF(m_impl->file.get() < 0, "Cannot open " << path);
+        
+        if (size)
+        {
+            THROW_ERRNO_IF(ftruncate(m_impl->file, size) != 0, "Cannot resize " << path);
+        }
+        
+        map(path, writable);
+    }
+
+    MappedFile::MappedFile(int fd)
+        : m_impl(std::make_unique<MappedFile::Impl>())
+    {
+        m_impl->file.reset(dup(fd));
+        THROW_ERRNO_IF(m_impl->file.get() < 0, "Cannot duplicate the file descriptor " << fd);
+        
+        map("the file descriptor " + std::to_string(fd), false);
+    }
+
+    MappedFile::~MappedFile()
+    {
+        if (m_impl->data)
+        {
+            munmap(m_impl->data, m_impl->size);
+        }
+    }
+
+    void MappedFile::map(const std::string& name, bool writable)
+    {
+        struct stat statbuf = {};
+        THROW_ERRNO_IF(fstat(m_impl->file, &statbuf) < 0, "Cannot get size of " << name);
+        THROW_IF(!S_ISREG(statbuf.st_mode), name << " is not a regular file");
+        
+        m_impl->size = statbuf.st_size;
+        
+        if (m_impl->size)
+        {
+            void* data = writable
+                ? mmap(nullptr, m_impl->size, PROT_READ | PROT_WRITE, MAP_SHARED, m_impl->file, 0)
+                : mmap(nullptr, m_impl->size, PROT_READ, MAP_PRIVATE, m_impl->file, 0);
+            THROW_ERRNO_IF(data == MAP_FAILED, "mmap of " << name << " failed");
+            m_impl->data = static_cast<uint8_t*>(data);
+        }
+    }
+
+    const uint8_t* MappedFile::data() const
+    {
+        return m_impl->data;
+    }
+
+    uint64_t MappedFile::size() const
+    {
+        return m_impl->size;
+    }
+
+    uint8_t* MappedFile::data()
+    {
+        return m_impl->data;
+    }
+
+    void MappedFile::flush()
+    {
+        if (m_impl->data)
+        {
+            THROW_ERRNO_IF(msync(m_impl->data, m_impl->size, MS_SYNC) != 0, "msync failed");
+        }
+    }
+}
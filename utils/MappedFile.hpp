@@ -0,0 +1,72 @@
+//
+//  MappedFile.hpp
+//  file_signature
+//
+//  Created by artem k on 11.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <stdint.h>
+
+namespace utils
+{
+    //
+    // Mapping of a whole file
+    // An empty file is not mapped, its data are nullptr
+    //
+    class MappedFile
+    {
+    public:
+        enum class Mode
+        {
+            read,
+            
+            //
+            // the file is created if it does not exist,
+            // the changes of the data are written to the file
+            //
+            write
+        };
+
+    public:
+        //
+        // the file is resized to 'size' before it is mapped if 'size' is not 0,
+        // only a writable file may be resized
+        //
+        explicit MappedFile(const std::string& path, Mode mode = Mode::read, uint64_t size = 0);
+        
+        //
+        // read-only mapping of an opened file, the descriptor is duplicated,
+        // so the caller may close it
+        //
+        explicit MappedFile(int fd);
+        ~MappedFile();
+        
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+        
+        const uint8_t* data() const;
+        uint64_t size() const;
+        
+        //
+        // the data of a writable mapping
+        //
+        uint8_t* data();
+        
+        //
+        // writes the changed pages to the file
+        //
+        void flush();
+
+    private:
+        void map(const std::string& name, bool writable);
+
+    private:
+        struct Impl;
+        std::unique_ptr<Impl> m_impl;
+    };
+}
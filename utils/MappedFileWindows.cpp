@@ -0,0 +1,115 @@
+#include "MappedFile.hpp"
+#include "ScopedHandle.hpp"
+#include "Exceptions.hpp"
+
+#include <Windows.h>
+#include <io.h>
+
+namespace utils
+{
+    struct MappedFile::Impl
+    {
+        ScopedHandle<HANDLE, decltype(::CloseHandle), ::CloseHandle, INVALID_HANDLE_VALUE> file;
+        ScopedHandle<HANDLE, decltype(::CloseHandle), ::CloseHandle, NULL> section;
+        ScopedHandle<LPVOID, decltype(::UnmapViewOfFile), ::UnmapViewOfFile, NULL> view;
+        uint64_t size = 0;
+    };
+
+    MappedFile::MappedFile(const std::string& path, Mode mode, uint64_t size)
+        : m_impl(std::make_unique<MappedFile::Impl>())
+    {
+        const bool writable = Mode::write == mode;
+        THROW_IF(size && !writable, "A read-only file " << path << " cannot be resized");
+
+        m_impl->file = CreateFileA(path.c_str()
+            , writable ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ
+            , FILE_SHARE_READ
+            , NULL
+            , writable ? OPEN_ALWAYS : OPEN_EXISTING
+            , FILE_ATTRIBUTE_NORMAL
+            , NULL);
+        THROW_WIN_IF(!m_impl->file, "Cannot open " << path);
+
+        if (size)
+        {
+            LARGE_INTEGER end = {};
+            end.QuadPart = static_cast<LONGLONG>(size);
+            THROW_WIN_IF(!SetFilePointerEx(m_impl->file, end, NULL, FILE_BEGIN), "SetFilePointerEx error");
+            THROW_WIN_IF(!SetEndOfFile(m_impl->file), "Cannot resize " << path);
+        }
+
+        map(path, writable);
+    }
+
+    MappedFile::MappedFile(int fd)
+        : m_impl(std::make_unique<MappedFile::Impl>())
+    {
+        const HANDLE handle = reinterpret_cast<HANDLE>(_get_osfhandle(fd));
+        THROW_IF(INVALID_HANDLE_VALUE == handle, "Invalid file descriptor " << fd);
+
+        HANDLE copy = NULL;
+        THROW_WIN_IF(!DuplicateHandle(GetCurrentProcess()
+            , handle
+            , GetCurrentProcess()
+            , &copy
+            , 0
+            , FALSE
+            , DUPLICATE_SAME_ACCESS), "Cannot duplicate the file descriptor " << fd);
+        m_impl->file = copy;
+
+        map("the file descriptor " + std::to_string(fd), false);
+    }
+
+    void MappedFile::map(const std::string& name, bool writable)
+    {
+        LARGE_INTEGER fileSize = {};
+        THROW_WIN_IF(!GetFileSizeEx(m_impl->file, &fileSize), "Cannot get size of " << name);
+        m_impl->size = static_cast<uint64_t>(fileSize.QuadPart);
+
+        if (m_impl->size)
+        {
+            m_impl->section = CreateFileMapping(m_impl->file
+                , NULL
+                , writable ? PAGE_READWRITE : PAGE_READONLY
+                , 0
+                , 0
+                , NULL);
+            THROW_WIN_IF(!m_impl->section, "CreateFileMapping error");
+
+            m_impl->view = MapViewOfFile(m_impl->section
+                , writable ? FILE_MAP_WRITE : FILE_MAP_READ
+                , 0
+                , 0
+                , 0);
+            THROW_WIN_IF(!m_impl->view, "MapViewOfFile failed");
+        }
+    }
+
+    MappedFile::~MappedFile()
+    {
+    }
+
+    const uint8_t* MappedFile::data() const
+    {
+        return static_cast<const uint8_t*>(m_impl->view.get());
+    }
+
+    uint64_t MappedFile::size() const
+    {
+        return m_impl->size;
+    }
+
+    uint8_t* MappedFile::data()
+    {
+        return static_cast<uint8_t*>(m_impl->view.get());
+    }
+
+    void MappedFile::flush()
+    {
+        if (m_impl->view.get())
+        {
+            THROW_WIN_IF(!FlushViewOfFile(m_impl->view.get(), 0), "FlushViewOfFile error");
+            THROW_WIN_IF(!FlushFileBuffers(m_impl->file), "FlushFileBuffers error");
+        }
+    }
+}
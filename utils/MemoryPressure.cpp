@@ -0,0 +1,96 @@
+//
+//  MemoryPressure.cpp
+//  file_signature
+//
+//  Created by artem k on 17.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#include "MemoryPressure.hpp"
+
+#include <fstream>
+#include <stdlib.h>
+
+namespace utils
+{
+    namespace
+    {
+        const char kSystemPressure[] = "/proc/pressure/memory";
+        
+        bool canRead(const std::string& path)
+        {
+            std::ifstream file(path);
+            std::string line;
+            return file.is_open() && std::getline(file, line);
+        }
+
+        //
+        // the cgroup v2 line of /proc/self/cgroup is "0::<path>"
+        //
+        std::string getCgroupPressure()
+        {
+            std::ifstream file("/proc/self/cgroup");
+            std::string line;
+            
+            while (std::getline(file, line))
+            {
+                if (line.compare(0, 3, "0::") == 0)
+                {
+                    return "/sys/fs/cgroup" + line.substr(3) + "/memory.pressure";
+                }
+            }
+            
+            return std::string();
+        }
+    }
+
+    MemoryPressure::MemoryPressure()
+    {
+        const std::string cgroup = getCgroupPressure();
+        
+        if (!cgroup.empty() && canRead(cgroup))
+        {
+            m_path = cgroup;
+        }
+        else if (canRead(kSystemPressure))
+        {
+            m_path = kSystemPressure;
+        }
+    }
+
+    bool MemoryPressure::isSupported() const
+    {
+        return !m_path.empty();
+    }
+
+    double MemoryPressure::get() const
+    {
+        if (m_path.empty())
+        {
+            return -1;
+        }
+
+        //
+        // some avg10=0.00 avg60=0.00 avg300=0.00 total=0
+        //
+        std::ifstream file(m_path);
+        std::string line;
+        
+        while (std::getline(file, line))
+        {
+            const char key[] = "some avg10=";
+            
+            if (line.compare(0, sizeof(key) - 1, key) == 0)
+            {
+                return strtod(line.c_str() + sizeof(key) - 1, nullptr);
+            }
+        }
+        
+        return -1;
+    }
+
+    const std::string& MemoryPressure::getPath() const
+    {
+        return m_path;
+    }
+}
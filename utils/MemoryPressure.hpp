@@ -0,0 +1,39 @@
+//
+//  MemoryPressure.hpp
+//  file_signature
+//
+//  Created by artem k on 17.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#pragma once
+
+#include <string>
+
+namespace utils
+{
+    //
+    // Memory pressure stall information (PSI) of Linux:
+    // the share of time that some tasks have been stalled waiting for memory.
+    // The cgroup of the process is used if it has memory.pressure,
+    // otherwise the whole system, other systems are not supported
+    //
+    class MemoryPressure
+    {
+    public:
+        MemoryPressure();
+        
+        bool isSupported() const;
+        
+        //
+        // "some avg10" - percents of the last 10 seconds,
+        // a negative value if it cannot be read
+        //
+        double get() const;
+        
+        const std::string& getPath() const;
+
+    private:
+        std::string m_path;
+    };
+}
@@ -0,0 +1,57 @@
+//
+//  PaddedAtomic.hpp
+//  file_signature
+//
+//  Created by artem k on 03.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+namespace utils
+{
+    const size_t kCacheLineSize = 64;
+
+    //
+    // Lock-free statistics counter that occupies a whole cache line,
+    // so counters updated by different threads do not share a line
+    // Relaxed ordering: a counter is not used to synchronize anything
+    //
+    // It is padded instead of alignas, owners are allocated by new
+    // and C++14 new does not support over-aligned types
+    //
+    template<typename T>
+    class PaddedAtomic
+    {
+    public:
+        PaddedAtomic()
+        {
+            (void)m_padding;
+        }
+
+        PaddedAtomic(const PaddedAtomic&) = delete;
+        PaddedAtomic& operator=(const PaddedAtomic&) = delete;
+
+        void add(T value)
+        {
+            m_value.fetch_add(value, std::memory_order_relaxed);
+        }
+
+        void store(T value)
+        {
+            m_value.store(value, std::memory_order_relaxed);
+        }
+
+        T load() const
+        {
+            return m_value.load(std::memory_order_relaxed);
+        }
+
+    private:
+        std::atomic<T> m_value{};
+        char m_padding[kCacheLineSize - sizeof(std::atomic<T>)];
+    };
+}
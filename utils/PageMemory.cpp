@@ -0,0 +1,137 @@
+//
+//  PageMemory.cpp
+//  file_signature
+//
+//  Created by artem k on 18.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#include "PageMemory.hpp"
+#include "Exceptions.hpp"
+
+#include <utility>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace utils
+{
+    namespace
+    {
+        size_t alignUp(size_t size, size_t alignment)
+        {
+            return (size + alignment - 1) / alignment * alignment;
+        }
+    }
+
+    PageMemory::PageMemory(size_t size)
+    {
+        if (0 == size)
+        {
+            return;
+        }
+        
+        const bool huge = size >= kHugePageSize;
+        const size_t alignment = huge ? kHugePageSize : getPageSize();
+        m_size = alignUp(size, alignment);
+        
+        //
+        // mmap aligns to a small page, so a bigger region is mapped
+        // and its unaligned head and tail are unmapped
+        //
+        const size_t mapped = huge ? m_size + kHugePageSize : m_size;
+        void* region = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        THROW_ERRNO_IF(region == MAP_FAILED, "Cannot allocate " << m_size << " bytes");
+        
+        uint8_t* begin = static_cast<uint8_t*>(region);
+        m_data = reinterpret_cast<uint8_t*>(alignUp(reinterpret_cast<uintptr_t>(begin), alignment));
+        
+        if (m_data != begin)
+        {
+            munmap(begin, m_data - begin);
+        }
+        
+        if (begin + mapped != m_data + m_size)
+        {
+            munmap(m_data + m_size, begin + mapped - (m_data + m_size));
+        }
+
+#if defined(MADV_HUGEPAGE)
+        //
+        // it fails if transparent huge pages are disabled, small pages are used then
+        //
+        m_hugePages = huge && 0 == madvise(m_data, m_size, MADV_HUGEPAGE);
+#endif
+    }
+
+    PageMemory::~PageMemory()
+    {
+        release();
+    }
+
+    PageMemory::PageMemory(PageMemory&& other) noexcept
+        : m_data(other.m_data)
+        , m_size(other.m_size)
+        , m_hugePages(other.m_hugePages)
+    {
+        other.m_data = nullptr;
+        other.m_size = 0;
+        other.m_hugePages = false;
+    }
+
+    PageMemory& PageMemory::operator=(PageMemory&& other) noexcept
+    {
+        if (this != &other)
+        {
+            release();
+            std::swap(m_data, other.m_data);
+            std::swap(m_size, other.m_size);
+            std::swap(m_hugePages, other.m_hugePages);
+        }
+        
+        return *this;
+    }
+
+    uint8_t* PageMemory::data() const
+    {
+        return m_data;
+    }
+
+    size_t PageMemory::size() const
+    {
+        return m_size;
+    }
+
+    bool PageMemory::isHugePages() const
+    {
+        return m_hugePages;
+    }
+
+    size_t PageMemory::getPageSize()
+    {
+        static const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        return pageSize;
+    }
+
+    void PageMemory::discard(void* data, size_t size)
+    {
+        //
+        // MADV_FREE would keep the pages until the system is short of memory,
+        // so the resident size would not drop while the cache is shrunk
+        //
+        if (data && size)
+        {
+            madvise(data, size, MADV_DONTNEED);
+        }
+    }
+
+    void PageMemory::release()
+    {
+        if (m_data)
+        {
+            munmap(m_data, m_size);
+            m_data = nullptr;
+            m_size = 0;
+            m_hugePages = false;
+        }
+    }
+}
@@ -0,0 +1,64 @@
+//
+//  PageMemory.hpp
+//  file_signature
+//
+//  Created by artem k on 18.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace utils
+{
+    //
+    // Anonymous memory allocated by pages, it is not initialized by the process:
+    // a page is faulted at the first access by the thread that touches it.
+    // A region of at least a huge page is aligned to it and
+    // transparent huge pages are advised for it where they are supported
+    //
+    class PageMemory
+    {
+    public:
+        static const size_t kHugePageSize = 2 * 1024 * 1024;
+
+    public:
+        PageMemory() = default;
+        explicit PageMemory(size_t size);
+        ~PageMemory();
+        
+        PageMemory(const PageMemory&) = delete;
+        PageMemory& operator=(const PageMemory&) = delete;
+        
+        PageMemory(PageMemory&& other) noexcept;
+        PageMemory& operator=(PageMemory&& other) noexcept;
+        
+        uint8_t* data() const;
+        size_t size() const;
+        
+        //
+        // true if huge pages have been advised successfully,
+        // the kernel may still use small pages
+        //
+        bool isHugePages() const;
+        
+        static size_t getPageSize();
+
+        //
+        // the pages of the range are given back to the system and their data are lost,
+        // a page is faulted again (zeroed) at the next access.
+        // The range must be page aligned, an error is ignored because it is only an advice
+        //
+        static void discard(void* data, size_t size);
+
+    private:
+        void release();
+
+    private:
+        uint8_t* m_data = nullptr;
+        size_t m_size = 0;
+        bool m_hugePages = false;
+    };
+}
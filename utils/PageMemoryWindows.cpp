@@ -0,0 +1,99 @@
+#include "PageMemory.hpp"
+#include "Exceptions.hpp"
+
+#include <utility>
+#include <Windows.h>
+
+namespace utils
+{
+    //
+    // large pages of Windows need SeLockMemoryPrivilege and are never swapped,
+    // so small pages are used
+    //
+    PageMemory::PageMemory(size_t size)
+    {
+        if (0 == size)
+        {
+            return;
+        }
+
+        m_data = static_cast<uint8_t*>(VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+        THROW_WIN_IF(!m_data, "Cannot allocate " << size << " bytes");
+
+        const size_t pageSize = getPageSize();
+        m_size = (size + pageSize - 1) / pageSize * pageSize;
+    }
+
+    PageMemory::~PageMemory()
+    {
+        release();
+    }
+
+    PageMemory::PageMemory(PageMemory&& other) noexcept
+        : m_data(other.m_data)
+        , m_size(other.m_size)
+        , m_hugePages(other.m_hugePages)
+    {
+        other.m_data = nullptr;
+        other.m_size = 0;
+        other.m_hugePages = false;
+    }
+
+    PageMemory& PageMemory::operator=(PageMemory&& other) noexcept
+    {
+        if (this != &other)
+        {
+            release();
+            std::swap(m_data, other.m_data);
+            std::swap(m_size, other.m_size);
+            std::swap(m_hugePages, other.m_hugePages);
+        }
+
+        return *this;
+    }
+
+    uint8_t* PageMemory::data() const
+    {
+        return m_data;
+    }
+
+    size_t PageMemory::size() const
+    {
+        return m_size;
+    }
+
+    bool PageMemory::isHugePages() const
+    {
+        return m_hugePages;
+    }
+
+    size_t PageMemory::getPageSize()
+    {
+        SYSTEM_INFO info = {};
+        GetSystemInfo(&info);
+        return info.dwPageSize;
+    }
+
+    void PageMemory::discard(void* data, size_t size)
+    {
+        //
+        // the pages are not written to the page file and are dropped from the working set
+        //
+        if (data && size)
+        {
+            VirtualAlloc(data, size, MEM_RESET, PAGE_READWRITE);
+            VirtualUnlock(data, size);
+        }
+    }
+
+    void PageMemory::release()
+    {
+        if (m_data)
+        {
+            VirtualFree(m_data, 0, MEM_RELEASE);
+            m_data = nullptr;
+            m_size = 0;
+            m_hugePages = false;
+        }
+    }
+}
@@ -0,0 +1,289 @@
+//
+//  PerfCounters.cpp
+//  file_signature
+//
+//  Created by artem k on 06.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#include "PerfCounters.hpp"
+
+#include <cerrno>
+#include <cstring>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace utils
+{
+    namespace
+    {
+#if defined(__linux__)
+        void setEventConfig(PerfEvent event, perf_event_attr& attr)
+        {
+            const uint64_t readMiss = (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            
+            switch (event)
+            {
+                case PerfEvent::cycles:
+                    attr.type = PERF_TYPE_HARDWARE;
+                    attr.config = PERF_COUNT_HW_CPU_CYCLES;
+                    break;
+                case PerfEvent::instructions:
+                    attr.type = PERF_TYPE_HARDWARE;
+                    attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+                    break;
+                case PerfEvent::llcMisses:
+                    attr.type = PERF_TYPE_HW_CACHE;
+                    attr.config = PERF_COUNT_HW_CACHE_LL | readMiss;
+                    break;
+                case PerfEvent::dtlbMisses:
+                    attr.type = PERF_TYPE_HW_CACHE;
+                    attr.config = PERF_COUNT_HW_CACHE_DTLB | readMiss;
+                    break;
+            }
+        }
+
+        //
+        // counts the event for the calling thread on any CPU
+        //
+        int openEvent(PerfEvent event, int groupFd, bool excludeKernel)
+        {
+            perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            setEventConfig(event, attr);
+            attr.read_format = PERF_FORMAT_GROUP;
+            attr.exclude_kernel = excludeKernel ? 1 : 0;
+            attr.exclude_hv = 1;
+            
+            return static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, groupFd, 0));
+        }
+#endif
+    }
+
+    const char* getPerfEventName(PerfEvent event)
+    {
+        switch (event)
+        {
+            case PerfEvent::cycles: return "cycles";
+            case PerfEvent::instructions: return "instructions";
+            case PerfEvent::llcMisses: return "llc-misses";
+            case PerfEvent::dtlbMisses: return "dtlb-misses";
+        }
+        
+        return "unknown";
+    }
+
+    struct PerfCounters::Shard
+    {
+        bool opened = false;
+        int leader = -1;
+        int fds[kPerfEventsCount] = {-1, -1, -1, -1};
+        
+        //
+        // position of the event in the group read, -1 if it is not counted
+        //
+        int positions[kPerfEventsCount] = {-1, -1, -1, -1};
+        size_t groupSize = 0;
+        std::vector<Totals> stages;
+        
+        ~Shard()
+        {
+#if defined(__linux__)
+            for (int fd : fds)
+            {
+                if (fd >= 0)
+                {
+                    close(fd);
+                }
+            }
+#endif
+        }
+    };
+
+    PerfCounters::PerfCounters(size_t stagesCount)
+        : m_stagesCount(stagesCount)
+    {
+    }
+
+    PerfCounters::~PerfCounters()
+    {
+    }
+
+    PerfCounters::Sample PerfCounters::begin()
+    {
+        Sample sample;
+        Shard& shard = m_shards.get();
+        
+        if (!shard.opened)
+        {
+            open(shard);
+        }
+        
+        sample.valid = read(shard, sample);
+        return sample;
+    }
+
+    PerfCounters::Sample PerfCounters::end(size_t stage, const Sample& sample)
+    {
+        Sample now;
+        
+        if (!sample.valid)
+        {
+            return now;
+        }
+        
+        Shard& shard = m_shards.get();
+        now.valid = read(shard, now);
+        
+        if (!now.valid)
+        {
+            return now;
+        }
+        
+        Totals& totals = shard.stages[stage];
+        ++totals.samples;
+        
+        for (size_t i = 0; i < kPerfEventsCount; ++i)
+        {
+            totals.values[i] += now.values[i] - sample.values[i];
+        }
+        
+        return now;
+    }
+
+    std::vector<PerfCounters::Totals> PerfCounters::merge() const
+    {
+        std::vector<Totals> stages(m_stagesCount);
+        
+        m_shards.forEach([&stages](const Shard& shard)
+        {
+            for (size_t i = 0; i < shard.stages.size(); ++i)
+            {
+                stages[i].samples += shard.stages[i].samples;
+                
+                for (size_t j = 0; j < kPerfEventsCount; ++j)
+                {
+                    stages[i].values[j] += shard.stages[i].values[j];
+                }
+            }
+        });
+        
+        return stages;
+    }
+
+    bool PerfCounters::isAvailable(PerfEvent event) const
+    {
+        return 0 != (m_availableEvents & (1u << static_cast<uint32_t>(event)));
+    }
+
+    std::string PerfCounters::getError() const
+    {
+        const int error = m_error;
+        
+        if (0 == error || m_availableEvents)
+        {
+            return std::string();
+        }
+        
+        if (EACCES == error || EPERM == error)
+        {
+            return "perf events are not permitted, see /proc/sys/kernel/perf_event_paranoid";
+        }
+        
+        if (ENOSYS == error || ENOENT == error || EOPNOTSUPP == error)
+        {
+            //
+            // e.g. a virtual machine without a virtual PMU
+            //
+            return "hardware perf events are not supported";
+        }
+        
+        return std::string("perf_event_open failed: ") + strerror(error);
+    }
+
+    void PerfCounters::open(Shard& shard)
+    {
+        shard.opened = true;
+        shard.stages.resize(m_stagesCount);
+
+#if defined(__linux__)
+        bool excludeKernel = false;
+        
+        for (size_t i = 0; i < kPerfEventsCount; ++i)
+        {
+            const PerfEvent event = static_cast<PerfEvent>(i);
+            int fd = openEvent(event, shard.leader, excludeKernel);
+            
+            if (fd < 0 && shard.leader < 0 && (EACCES == errno || EPERM == errno))
+            {
+                //
+                // an unprivileged user may count the user space only,
+                // so page faults of mapped files are not counted then
+                //
+                excludeKernel = true;
+                fd = openEvent(event, shard.leader, excludeKernel);
+            }
+            
+            if (fd < 0)
+            {
+                //
+                // e.g. a virtual machine does not expose cache events,
+                // the rest of the events are counted anyway
+                //
+                int expected = 0;
+                m_error.compare_exchange_strong(expected, errno);
+                continue;
+            }
+            
+            if (shard.leader < 0)
+            {
+                shard.leader = fd;
+            }
+            
+            shard.fds[i] = fd;
+            shard.positions[i] = static_cast<int>(shard.groupSize++);
+            m_availableEvents |= 1u << i;
+        }
+#else
+        int expected = 0;
+        m_error.compare_exchange_strong(expected, ENOSYS);
+#endif
+    }
+
+    bool PerfCounters::read(Shard& shard, Sample& sample)
+    {
+#if defined(__linux__)
+        if (0 == shard.groupSize)
+        {
+            return false;
+        }
+
+        //
+        // the leader reads the whole group at once: the number of events and their values
+        //
+        uint64_t data[1 + kPerfEventsCount] = {};
+        const ssize_t size = ::read(shard.leader, data, sizeof(uint64_t) * (1 + shard.groupSize));
+        
+        if (size < static_cast<ssize_t>(sizeof(uint64_t) * (1 + shard.groupSize)))
+        {
+            return false;
+        }
+        
+        for (size_t i = 0; i < kPerfEventsCount; ++i)
+        {
+            sample.values[i] = shard.positions[i] >= 0 ? data[1 + shard.positions[i]] : 0;
+        }
+        
+        return true;
+#else
+        (void)shard;
+        (void)sample;
+        return false;
+#endif
+    }
+}
@@ -0,0 +1,100 @@
+//
+//  PerfCounters.hpp
+//  file_signature
+//
+//  Created by artem k on 06.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#pragma once
+
+#include "ThreadShards.hpp"
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace utils
+{
+    enum class PerfEvent
+    {
+        cycles,
+        instructions,
+        llcMisses,  // last level cache read misses
+        dtlbMisses, // data TLB read misses
+    };
+
+    const size_t kPerfEventsCount = 4;
+
+    const char* getPerfEventName(PerfEvent event);
+
+    //
+    // Hardware performance counters of several stages that run on many threads
+    // Every thread opens its own group of counters (perf_event_open on Linux)
+    // the first time it begins a sample and accumulates the stage deltas in its own shard.
+    // If the counters are not permitted or not supported the samples are no-ops,
+    // so a caller does not check the availability
+    //
+    class PerfCounters
+    {
+    public:
+        struct Sample
+        {
+            bool valid = false;
+            uint64_t values[kPerfEventsCount] = {};
+        };
+        
+        struct Totals
+        {
+            uint64_t samples = 0;
+            uint64_t values[kPerfEventsCount] = {};
+        };
+
+    public:
+        explicit PerfCounters(size_t stagesCount);
+        ~PerfCounters();
+        
+        PerfCounters(const PerfCounters&) = delete;
+        PerfCounters& operator=(const PerfCounters&) = delete;
+        
+        //
+        // reads the counters of the current thread
+        //
+        Sample begin();
+        
+        //
+        // adds the counters since 'sample' to the stage,
+        // must be called by the thread that has begun the sample.
+        // Returns the current counters, so the next stage may begin with them
+        //
+        Sample end(size_t stage, const Sample& sample);
+        
+        //
+        // must not be called while other threads record samples
+        //
+        std::vector<Totals> merge() const;
+        
+        //
+        // true if the event has been counted by at least one thread
+        //
+        bool isAvailable(PerfEvent event) const;
+        
+        //
+        // the reason why counters have not been opened, empty if they have
+        //
+        std::string getError() const;
+
+    private:
+        struct Shard;
+        
+        bool read(Shard& shard, Sample& sample);
+        void open(Shard& shard);
+
+    private:
+        const size_t m_stagesCount;
+        std::atomic<uint32_t> m_availableEvents{0};
+        std::atomic<int> m_error{0};
+        ThreadShards<Shard> m_shards;
+    };
+}
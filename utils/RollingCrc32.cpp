@@ -0,0 +1,93 @@
+//
+//  RollingCrc32.cpp
+//  file_signature
+//
+//  Created by artem k on 10.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#include "RollingCrc32.hpp"
+#include "Hash.hpp"
+#include "Exceptions.hpp"
+
+#include <vector>
+
+namespace utils
+{
+    namespace
+    {
+        //
+        // the reflected polynomial of zlib CRC32
+        //
+        const uint32_t kPolynomial = 0xEDB88320;
+    }
+
+    RollingCrc32::RollingCrc32(size_t windowSize)
+        : m_windowSize(windowSize)
+    {
+        THROW_IF(0 == windowSize, "The rolling window is empty");
+        
+        for (uint32_t i = 0; i < 256; ++i)
+        {
+            uint32_t reg = i;
+            
+            for (int bit = 0; bit < 8; ++bit)
+            {
+                reg = (reg >> 1) ^ (reg & 1 ? kPolynomial : 0);
+            }
+            
+            m_table[i] = reg;
+        }
+
+        //
+        // the register is linear, so the table is made of 8 single bit bytes
+        // that are moved through the whole window
+        //
+        uint32_t bits[8];
+        
+        for (int bit = 0; bit < 8; ++bit)
+        {
+            uint32_t reg = step(0, static_cast<uint8_t>(1 << bit));
+            
+            for (size_t i = 1; i < windowSize; ++i)
+            {
+                reg = step(reg, 0);
+            }
+            
+            bits[bit] = reg;
+        }
+        
+        for (uint32_t i = 0; i < 256; ++i)
+        {
+            m_outTable[i] = 0;
+            
+            for (int bit = 0; bit < 8; ++bit)
+            {
+                if (i & (1u << bit))
+                {
+                    m_outTable[i] ^= bits[bit];
+                }
+            }
+        }
+        
+        const std::vector<uint8_t> zeros(windowSize, 0);
+        m_zeroCrc = crc32Value(zeros.data(), zeros.size());
+    }
+
+    size_t RollingCrc32::getWindowSize() const
+    {
+        return m_windowSize;
+    }
+
+    uint32_t RollingCrc32::reset(const void* data)
+    {
+        const uint32_t crc = crc32Value(data, m_windowSize);
+        m_reg = crc ^ m_zeroCrc;
+        return crc;
+    }
+
+    uint32_t RollingCrc32::get() const
+    {
+        return m_reg ^ m_zeroCrc;
+    }
+}
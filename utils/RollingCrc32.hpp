@@ -0,0 +1,74 @@
+//
+//  RollingCrc32.hpp
+//  file_signature
+//
+//  Created by artem k on 10.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace utils
+{
+    //
+    // CRC32 (the same value as crc32Value) of a window of a fixed size
+    // that is moved over data byte by byte.
+    // CRC is linear, so the byte that leaves the window is removed
+    // by a precomputed table and a move takes O(1) instead of O(window)
+    //
+    class RollingCrc32
+    {
+    public:
+        //
+        // the tables take O(window) to be made, a copy reuses them
+        //
+        explicit RollingCrc32(size_t windowSize);
+        
+        size_t getWindowSize() const;
+        
+        //
+        // starts the window at 'data', windowSize bytes are read
+        //
+        uint32_t reset(const void* data);
+        
+        //
+        // moves the window by one byte: 'out' leaves it and 'in' enters it
+        //
+        uint32_t roll(uint8_t out, uint8_t in);
+        
+        uint32_t get() const;
+
+    private:
+        uint32_t step(uint32_t reg, uint8_t byte) const;
+
+    private:
+        const size_t m_windowSize;
+        
+        //
+        // the register is kept without the initial value and the final xor,
+        // they add CRC of the zero window to it
+        //
+        uint32_t m_reg = 0;
+        uint32_t m_zeroCrc = 0;
+        uint32_t m_table[256];
+        
+        //
+        // the register of a window with a byte at its beginning and zeros after it
+        //
+        uint32_t m_outTable[256];
+    };
+
+    inline uint32_t RollingCrc32::step(uint32_t reg, uint8_t byte) const
+    {
+        return (reg >> 8) ^ m_table[(reg ^ byte) & 0xff];
+    }
+
+    inline uint32_t RollingCrc32::roll(uint8_t out, uint8_t in)
+    {
+        m_reg = step(m_reg ^ m_outTable[out], in);
+        return m_reg ^ m_zeroCrc;
+    }
+}
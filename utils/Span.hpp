@@ -0,0 +1,79 @@
+//
+//  Span.hpp
+//  file_signature
+//
+//  Created by artem k on 01.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#pragma once
+
+#include <assert.h>
+#include <stddef.h>
+
+namespace utils
+{
+    //
+    // non owning view of contiguous objects,
+    // it is a simplified std::span that is not available in C++14
+    //
+    template<typename T>
+    class Span
+    {
+    public:
+        Span() noexcept = default;
+        
+        Span(T* data, size_t size) noexcept
+            : m_data(data)
+            , m_size(size)
+        {
+        }
+        
+        T* data() const noexcept
+        {
+            return m_data;
+        }
+        
+        size_t size() const noexcept
+        {
+            return m_size;
+        }
+        
+        bool empty() const noexcept
+        {
+            return 0 == m_size;
+        }
+        
+        T* begin() const noexcept
+        {
+            return m_data;
+        }
+        
+        T* end() const noexcept
+        {
+            return m_data + m_size;
+        }
+        
+        T& front() const noexcept
+        {
+            assert(m_size);
+            return m_data[0];
+        }
+        
+        T& back() const noexcept
+        {
+            assert(m_size);
+            return m_data[m_size - 1];
+        }
+        
+        T& operator[](size_t i) const noexcept
+        {
+            assert(i < m_size);
+            return m_data[i];
+        }
+
+    private:
+        T* m_data = nullptr;
+        size_t m_size = 0;
+    };
+}
@@ -7,21 +7,87 @@
 //
 
 #include "TaskPool.hpp"
+#include "Topology.hpp"
 #include <assert.h>
 
 namespace utils
 {
+    namespace
+    {
+        //
+        // a worker thread knows its pool and its queue
+        //
+        thread_local const TaskPool* t_pool = nullptr;
+        thread_local size_t t_workerId = 0;
+    }
+
+    TaskPool::Handle::Handle()
+        : m_state(std::make_shared<State>())
+    {
+    }
+
+    bool TaskPool::Handle::done() const
+    {
+        return 0 == m_state->pending;
+    }
+
+    void TaskPool::Handle::wait() const
+    {
+        std::unique_lock<std::mutex> lock(m_state->mtx);
+        
+        m_state->cv.wait(lock, [this]()
+        {
+            return 0 == m_state->pending;
+        });
+    }
+
+    bool TaskPool::Handle::wait(uint32_t timeoutMs) const
+    {
+        std::unique_lock<std::mutex> lock(m_state->mtx);
+        
+        return m_state->cv.wait_for(lock, std::chrono::milliseconds(timeoutMs), [this]()
+        {
+            return 0 == m_state->pending;
+        });
+    }
+
+    void TaskPool::Handle::add(size_t count) const
+    {
+        m_state->pending += count;
+    }
+
+    void TaskPool::Handle::release(const std::shared_ptr<State>& state)
+    {
+        if (1 == state->pending--)
+        {
+            std::lock_guard<std::mutex> lock(state->mtx);
+            state->cv.notify_all();
+        }
+    }
+
     TaskPool::TaskPool(size_t workerThreads)
-        : m_stopped(false)
-        , m_threadsCount(workerThreads)
+        : TaskPool(workerThreads, {})
+    {
+    }
+
+    TaskPool::TaskPool(size_t workerThreads, std::vector<uint32_t> workerCpus)
+        : m_workerCpus(std::move(workerCpus))
+        , m_threadsCount(std::max<size_t>(workerThreads, 1))
     {
+        m_workers.reserve(m_threadsCount);
         m_threads.reserve(m_threadsCount);
         
-        for (size_t i = 0; i < workerThreads; ++i)
+        for (size_t i = 0; i < m_threadsCount; ++i)
+        {
+            m_workers.push_back(std::make_unique<Worker>());
+        }
+        
+        for (size_t i = 0; i < m_threadsCount; ++i)
         {
             m_threads.push_back(std::async(std::launch::async,
                                            &TaskPool::workerThread,
-                                           this));
+                                           this,
+                                           i));
         }
     }
 
@@ -29,45 +95,206 @@ namespace utils
     {
         stopImpl(true, true, false);
     }
-        
-    void TaskPool::push(Task task)
+
+    TaskPool::Handle TaskPool::push(Task task)
     {
+        Handle handle;
+        push(std::move(task), handle);
+        return handle;
+    }
+
+    void TaskPool::push(Task task, const Handle& handle)
+    {
+        std::vector<Task> tasks;
+        tasks.push_back(std::move(task));
+        pushImpl(tasks, handle, kAnyWorker);
+    }
+
+    TaskPool::Handle TaskPool::push(std::vector<Task> tasks)
+    {
+        Handle handle;
+        pushImpl(tasks, handle, kAnyWorker);
+        return handle;
+    }
+
+    void TaskPool::push(std::vector<Task> tasks, const Handle& handle)
+    {
+        pushImpl(tasks, handle, kAnyWorker);
+    }
+
+    void TaskPool::pushTo(size_t workerId, Task task, const Handle& handle)
+    {
+        std::vector<Task> tasks;
+        tasks.push_back(std::move(task));
+        pushImpl(tasks, handle, workerId % m_workers.size());
+    }
+
+    void TaskPool::stop(bool cancelQueue, bool sync)
+    {
+        stopImpl(cancelQueue, sync, true);
+    }
+
+    size_t TaskPool::getThreadsCount() const
+    {
+        return m_threadsCount;
+    }
+
+    void TaskPool::pushImpl(std::vector<Task>& tasks, const Handle& handle, size_t workerId)
+    {
+        if (tasks.empty())
         {
-            std::lock_guard<std::mutex> lock(m_mtx);
+            return;
+        }
+        
+        if (m_stopped)
+        {
+            throw std::runtime_error("Cannot push a new task to the task pool, "
+                                     "the task pool is stopped");
+        }
+
+        //
+        // the counters are increased before the tasks are queued,
+        // so a task is never finished before it has been counted
+        //
+        handle.add(tasks.size());
+        m_queued += tasks.size();
+        
+        if (workerId != kAnyWorker)
+        {
+            Worker& worker = *m_workers[workerId];
+            std::lock_guard<std::mutex> lock(worker.mtx);
+            
+            for (auto it = tasks.rbegin(); it != tasks.rend(); ++it)
+            {
+                worker.queue.push_front({ std::move(*it), handle.m_state });
+            }
+        }
+        else if (t_pool == this)
+        {
+            //
+            // a task pushes new tasks, keep them in the same worker,
+            // idle workers will steal them
+            //
+            Worker& worker = *m_workers[t_workerId];
+            std::lock_guard<std::mutex> lock(worker.mtx);
             
-            if (m_stopped)
+            for (auto& task : tasks)
             {
-                throw std::runtime_error("Cannot push a new task to the task pool, "
-                                         "the task pool is stopped");
+                worker.queue.push_back({ std::move(task), handle.m_state });
             }
+        }
+        else
+        {
+            const size_t first = m_nextWorker.fetch_add(tasks.size());
             
-            m_queue.push_back(std::move(task));
+            for (size_t i = 0; i < tasks.size(); ++i)
+            {
+                Worker& worker = *m_workers[(first + i) % m_workers.size()];
+                std::lock_guard<std::mutex> lock(worker.mtx);
+                worker.queue.push_back({ std::move(tasks[i]), handle.m_state });
+            }
+        }
+        
+        if (m_sleeping)
+        {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            
+            if (tasks.size() > 1 || workerId != kAnyWorker)
+            {
+                m_cv.notify_all();
+            }
+            else
+            {
+                m_cv.notify_one();
+            }
         }
-        m_cv.notify_one();
     }
 
-    void TaskPool::stop(bool cancelQueue, bool sync)
+    bool TaskPool::popTask(size_t workerId, Item& item)
     {
-        stopImpl(cancelQueue, sync, true);
+        Worker& worker = *m_workers[workerId];
+        std::lock_guard<std::mutex> lock(worker.mtx);
+        
+        if (worker.queue.empty())
+        {
+            return false;
+        }
+        
+        item = std::move(worker.queue.front());
+        worker.queue.pop_front();
+        --m_queued;
+        return true;
     }
 
-    size_t TaskPool::getThreadsCount() const
+    bool TaskPool::stealTask(size_t workerId, Item& item)
     {
-        return m_threads.size();
+        for (size_t i = 1; i < m_workers.size(); ++i)
+        {
+            Worker& victim = *m_workers[(workerId + i) % m_workers.size()];
+            std::lock_guard<std::mutex> lock(victim.mtx);
+            
+            if (!victim.queue.empty())
+            {
+                item = std::move(victim.queue.back());
+                victim.queue.pop_back();
+                --m_queued;
+                return true;
+            }
+        }
+        
+        return false;
     }
 
-    void TaskPool::workerThread()
+    void TaskPool::workerThread(size_t workerId)
     {
+        t_pool = this;
+        t_workerId = workerId;
+        
+        if (workerId < m_workerCpus.size())
+        {
+            //
+            // pinning is an optimization only,
+            // the worker runs anywhere if it fails
+            //
+            Topology::pinCurrentThread(m_workerCpus[workerId]);
+        }
+        
         for (;;)
         {
+            Item item;
+            
+            if (popTask(workerId, item) || stealTask(workerId, item))
+            {
+                //
+                // task is noexcept, so the caller side has to guarantee
+                // the task will not throw anything
+                //
+                try
+                {
+                    item.task();
+                }
+                catch (...)
+                {
+                    assert(!"A task must never throw an exception");
+                    std::terminate();
+                }
+                
+                item.task = nullptr;
+                Handle::release(item.state);
+                continue;
+            }
+            
             std::unique_lock<std::mutex> lock(m_mtx);
+            ++m_sleeping;
             
             m_cv.wait(lock, [this]()
             {
-                return m_stopped || !m_queue.empty();
+                return m_stopped || m_queued;
             });
             
-            if (m_stopped && m_queue.empty())
+            --m_sleeping;
+            
+            if (m_stopped && !m_queued)
             {
                 //
                 // stop was called,
@@ -75,56 +302,51 @@ namespace utils
                 //
                 return;
             }
-            
-            //
-            // queue has a new task,
-            // let's execute it
-            //
-            assert(!m_queue.empty());
-            Task task = std::move(m_queue.front());
-            m_queue.pop_front();
-            
-            //
-            // execute task without lock
-            // task is noexcept, so the caller side has to guarantee
-            // the task will not throw anything
-            //
-            lock.unlock();
-            
-            try
-            {
-                task();
-            }
-            catch (...)
-            {
-                assert(!"A task must never throw an exception");
-                std::terminate();
-            }
-            
-            lock.lock();
         }
     }
 
     void TaskPool::stopImpl(bool cancelQueue, bool sync, bool checkThreads)
     {
+        m_stopped = true;
+        
+        if (cancelQueue)
         {
-            std::lock_guard<std::mutex> lock(m_mtx);
-            m_stopped = true;
-            
-            if (cancelQueue)
+            //
+            // canceled tasks are finished for their handles
+            //
+            for (auto& worker : m_workers)
             {
-                m_queue.clear();
+                std::deque<Item> queue;
+                
+                {
+                    std::lock_guard<std::mutex> lock(worker->mtx);
+                    queue.swap(worker->queue);
+                    m_queued -= queue.size();
+                }
+                
+                for (auto& item : queue)
+                {
+                    Handle::release(item.state);
+                }
             }
         }
         
-        m_cv.notify_all();
-
+        {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            m_cv.notify_all();
+        }
+        
         if (sync)
         {
             //
             // wait until threads are finished
             //
-            auto threads = std::move(m_threads);
+            std::vector<std::future<void>> threads;
+            
+            {
+                std::lock_guard<std::mutex> lock(m_threadsMtx);
+                threads = std::move(m_threads);
+            }
             
             if (checkThreads)
             {
@@ -135,7 +357,7 @@ namespace utils
                 //
                 for (auto& thread : threads)
                 {
-                     thread.get();
+                    thread.get();
                 }
             }
         }
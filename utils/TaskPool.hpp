@@ -11,11 +11,23 @@
 #include <functional>
 #include <condition_variable>
 #include <future>
+#include <atomic>
+#include <memory>
 #include <vector>
 #include <deque>
 
 namespace utils
 {
+    //
+    // Work-stealing thread pool
+    // Each worker thread has its own queue of tasks:
+    //   * a task pushed from a worker thread goes to the queue of this worker
+    //   * a task pushed from another thread goes to the queues in round robin order
+    //   * a worker takes tasks from the front of its queue
+    //     and steals tasks from the back of other queues if its queue is empty
+    // The pool is shared: any number of clients (e.g. several SigPipeline objects)
+    // push their tasks and wait for them by completion handles.
+    //
     class TaskPool
     {
     public:
@@ -25,8 +37,48 @@ namespace utils
         //
         using Task = std::function<void() noexcept>;
         
+        //
+        // Completion handle
+        // The handle is finished when all the tasks pushed with it are finished,
+        // a task may push a new task with the same handle (e.g. a continuation)
+        // The wait functions must not be called from a task of the same pool
+        //
+        class Handle
+        {
+        public:
+            Handle();
+            
+            bool done() const;
+            void wait() const;
+            bool wait(uint32_t timeoutMs) const;
+        
+        private:
+            struct State
+            {
+                std::mutex mtx;
+                std::condition_variable cv;
+                std::atomic<size_t> pending{0};
+            };
+            
+            void add(size_t count) const;
+            static void release(const std::shared_ptr<State>& state);
+            
+            friend class TaskPool;
+        
+        private:
+            std::shared_ptr<State> m_state;
+        };
+
     public:
+        static const size_t kAnyWorker = static_cast<size_t>(-1);
+        
         explicit TaskPool(size_t workerThreads);
+        
+        //
+        // the worker thread N is pinned to the logical CPU workerCpus[N],
+        // see Topology::selectCpus
+        //
+        TaskPool(size_t workerThreads, std::vector<uint32_t> workerCpus);
         ~TaskPool();
         
         TaskPool(const TaskPool&) = delete;
@@ -35,21 +87,62 @@ namespace utils
         TaskPool(TaskPool&&) = delete;
         TaskPool& operator=(TaskPool&&) = delete;
         
-        void push(Task task);
+        Handle push(Task task);
+        void push(Task task, const Handle& handle);
+        
+        //
+        // bulk submission, tasks are spread over all the worker queues
+        //
+        Handle push(std::vector<Task> tasks);
+        void push(std::vector<Task> tasks, const Handle& handle);
+        
+        //
+        // the task goes to the front of the worker's queue,
+        // so it is most likely run on the CPU of this worker
+        // (other workers steal it only if it is the last task in the queue)
+        //
+        void pushTo(size_t workerId, Task task, const Handle& handle);
+        
         void stop(bool cancelQueue, bool sync);
         
         size_t getThreadsCount() const;
-        
+
     private:
-        void workerThread();
-        void stopImpl(bool cancelQueue, bool sync, bool checkThreads);
+        struct Item
+        {
+            Task task;
+            std::shared_ptr<Handle::State> state;
+        };
+        
+        struct Worker
+        {
+            std::mutex mtx;
+            std::deque<Item> queue;
+        };
         
+        void pushImpl(std::vector<Task>& tasks, const Handle& handle, size_t workerId);
+        bool popTask(size_t workerId, Item& item);
+        bool stealTask(size_t workerId, Item& item);
+        void workerThread(size_t workerId);
+        void stopImpl(bool cancelQueue, bool sync, bool checkThreads);
+
     private:
         std::vector<std::future<void>> m_threads;
-        std::deque<Task> m_queue;
+        std::vector<std::unique_ptr<Worker>> m_workers;
+        const std::vector<uint32_t> m_workerCpus;
+        
+        //
+        // m_queued is a count of tasks in all the queues,
+        // workers sleep on m_cv only if there are no tasks at all
+        //
+        std::atomic<size_t> m_queued{0};
+        std::atomic<size_t> m_sleeping{0};
+        std::atomic<size_t> m_nextWorker{0};
+        std::atomic<bool> m_stopped{false};
+        
         std::condition_variable m_cv;
         std::mutex m_mtx;
-        bool m_stopped;
+        std::mutex m_threadsMtx;
         const size_t m_threadsCount;
     };
 }
@@ -0,0 +1,127 @@
+//
+//  ThreadShards.hpp
+//  file_signature
+//
+//  Created by artem k on 05.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+#include <stdint.h>
+
+namespace utils
+{
+    namespace detail
+    {
+        //
+        // a thread keeps a few last used shards,
+        // so it finds its shard without the owner's lock
+        //
+        struct ShardCache
+        {
+            uint64_t id = 0;
+            void* shard = nullptr;
+        };
+        
+        const size_t kShardCacheSize = 4;
+        
+        inline ShardCache* getShardCache()
+        {
+            static thread_local ShardCache cache[kShardCacheSize];
+            return cache;
+        }
+        
+        inline size_t& getShardCacheNext()
+        {
+            static thread_local size_t next = 0;
+            return next;
+        }
+        
+        inline uint64_t getNextShardsId()
+        {
+            static std::atomic<uint64_t> id{1};
+            return id++;
+        }
+    }
+
+    //
+    // Per-thread instances of Shard
+    // A thread gets its own shard without locks after the first call,
+    // so it may update the shard without atomics.
+    // The shards are read by forEach when the writing threads have finished
+    //
+    template<typename Shard>
+    class ThreadShards
+    {
+    public:
+        ThreadShards()
+            : m_id(detail::getNextShardsId())
+        {
+        }
+        
+        ThreadShards(const ThreadShards&) = delete;
+        ThreadShards& operator=(const ThreadShards&) = delete;
+        
+        //
+        // the shard of the current thread,
+        // the bool is true if the shard has been just created
+        //
+        Shard& get(bool* created = nullptr)
+        {
+            detail::ShardCache* cache = detail::getShardCache();
+            
+            for (size_t i = 0; i < detail::kShardCacheSize; ++i)
+            {
+                if (cache[i].id == m_id)
+                {
+                    return *static_cast<Shard*>(cache[i].shard);
+                }
+            }
+
+            //
+            // ids are never reused, so a cached shard of a destroyed object
+            // is never found and is just replaced
+            //
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto& shard = m_shards[std::this_thread::get_id()];
+            
+            if (created)
+            {
+                *created = !shard;
+            }
+            
+            if (!shard)
+            {
+                shard.reset(new Shard());
+            }
+            
+            auto& entry = cache[detail::getShardCacheNext()++ % detail::kShardCacheSize];
+            entry.id = m_id;
+            entry.shard = shard.get();
+            
+            return *shard;
+        }
+        
+        template<typename Fn>
+        void forEach(Fn fn) const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            
+            for (const auto& shard : m_shards)
+            {
+                fn(*shard.second);
+            }
+        }
+
+    private:
+        const uint64_t m_id;
+        mutable std::mutex m_mutex;
+        std::unordered_map<std::thread::id, std::unique_ptr<Shard>> m_shards;
+    };
+}
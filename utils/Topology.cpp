@@ -0,0 +1,505 @@
+//
+//  Topology.cpp
+//  file_signature
+//
+//  Created by artem k on 02.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#include "Topology.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <map>
+#include <set>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <stdlib.h>
+#include <dirent.h>
+#endif
+
+namespace utils
+{
+    namespace
+    {
+        const uint32_t kCpusPerGroup = 64;
+
+#if defined(__linux__)
+        bool readFirstLine(const std::string& path, std::string& line)
+        {
+            std::ifstream file(path);
+            return file && std::getline(file, line);
+        }
+        
+        bool readNumber(const std::string& path, long& value)
+        {
+            std::string line;
+            
+            if (!readFirstLine(path, line))
+            {
+                return false;
+            }
+            
+            char* end = nullptr;
+            value = strtol(line.c_str(), &end, 10);
+            return end != line.c_str();
+        }
+
+        //
+        // parses a sysfs CPU list, e.g. "0-3,8,10-11"
+        //
+        std::vector<uint32_t> parseCpuList(const std::string& list)
+        {
+            std::vector<uint32_t> cpus;
+            std::stringstream st(list);
+            std::string range;
+            
+            while (std::getline(st, range, ','))
+            {
+                uint32_t first = 0;
+                uint32_t last = 0;
+                char dash = 0;
+                std::stringstream rst(range);
+                
+                if (!(rst >> first))
+                {
+                    continue;
+                }
+                
+                last = first;
+                
+                if (rst >> dash && dash == '-')
+                {
+                    rst >> last;
+                }
+                
+                for (uint32_t cpu = first; cpu <= last; ++cpu)
+                {
+                    cpus.push_back(cpu);
+                }
+            }
+            
+            return cpus;
+        }
+        
+        std::vector<std::string> listDir(const std::string& path, const std::string& prefix)
+        {
+            std::vector<std::string> names;
+            DIR* dir = opendir(path.c_str());
+            
+            if (!dir)
+            {
+                return names;
+            }
+            
+            while (dirent* entry = readdir(dir))
+            {
+                const std::string name = entry->d_name;
+                
+                if (name.compare(0, prefix.size(), prefix) == 0)
+                {
+                    names.push_back(name);
+                }
+            }
+            
+            closedir(dir);
+            return names;
+        }
+#endif
+    }
+
+    Topology Topology::detect()
+    {
+        Topology topology;
+
+#if defined(_WIN32)
+        DWORD length = 0;
+        ::GetLogicalProcessorInformationEx(RelationAll, nullptr, &length);
+        std::vector<char> buffer(length);
+        
+        auto info = reinterpret_cast<PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX>(buffer.data());
+        
+        if (length && ::GetLogicalProcessorInformationEx(RelationAll, info, &length))
+        {
+            //
+            // a CPU id is 'group * 64 + number in the group'
+            //
+            std::map<uint32_t, Cpu> cpus;
+            uint32_t core = 0;
+            uint32_t package = 0;
+            
+            for (DWORD offset = 0; offset < length; offset += info->Size)
+            {
+                info = reinterpret_cast<PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX>(buffer.data() + offset);
+                
+                const bool isCore = info->Relationship == RelationProcessorCore;
+                const bool isPackage = info->Relationship == RelationProcessorPackage;
+                const bool isNode = info->Relationship == RelationNumaNode;
+                
+                if (!isCore && !isPackage && !isNode)
+                {
+                    continue;
+                }
+                
+                const GROUP_AFFINITY* masks = isNode ? &info->NumaNode.GroupMask : info->Processor.GroupMask;
+                const WORD count = isNode ? 1 : info->Processor.GroupCount;
+                
+                for (WORD i = 0; i < count; ++i)
+                {
+                    for (uint32_t bit = 0; bit < kCpusPerGroup; ++bit)
+                    {
+                        if (0 == (masks[i].Mask & (KAFFINITY(1) << bit)))
+                        {
+                            continue;
+                        }
+                        
+                        Cpu& cpu = cpus[masks[i].Group * kCpusPerGroup + bit];
+                        cpu.id = masks[i].Group * kCpusPerGroup + bit;
+                        
+                        if (isCore)
+                        {
+                            cpu.core = core;
+                        }
+                        else if (isPackage)
+                        {
+                            cpu.package = package;
+                        }
+                        else
+                        {
+                            cpu.node = info->NumaNode.NodeNumber;
+                        }
+                    }
+                }
+                
+                core += isCore ? 1 : 0;
+                package += isPackage ? 1 : 0;
+            }
+            
+            for (auto& cpu : cpus)
+            {
+                topology.m_cpus.push_back(cpu.second);
+            }
+            
+            topology.m_pinnable = true;
+        }
+#elif defined(__linux__)
+        std::string online;
+        
+        if (readFirstLine("/sys/devices/system/cpu/online", online))
+        {
+            std::map<uint32_t, uint32_t> nodes;
+            
+            for (const auto& name : listDir("/sys/devices/system/node", "node"))
+            {
+                const std::string node = name.substr(4);
+                std::string list;
+                
+                if (node.empty()
+                    || node.find_first_not_of("0123456789") != std::string::npos
+                    || !readFirstLine("/sys/devices/system/node/" + name + "/cpulist", list))
+                {
+                    //
+                    // it is not a node directory
+                    //
+                    continue;
+                }
+                
+                for (auto cpu : parseCpuList(list))
+                {
+                    nodes[cpu] = static_cast<uint32_t>(std::stoul(node));
+                }
+            }
+
+            //
+            // core_id is unique only inside a package
+            //
+            std::map<std::pair<long, long>, uint32_t> cores;
+            
+            for (auto id : parseCpuList(online))
+            {
+                const std::string path = "/sys/devices/system/cpu/cpu" + std::to_string(id) + "/topology/";
+                long core = id;
+                long package = 0;
+                
+                readNumber(path + "core_id", core);
+                readNumber(path + "physical_package_id", package);
+                
+                auto res = cores.emplace(std::make_pair(package, core), static_cast<uint32_t>(cores.size()));
+                
+                Cpu cpu;
+                cpu.id = id;
+                cpu.core = res.first->second;
+                cpu.package = static_cast<uint32_t>(std::max<long>(package, 0));
+                cpu.node = nodes.count(id) ? nodes[id] : 0;
+                topology.m_cpus.push_back(cpu);
+            }
+            
+            topology.m_pinnable = true;
+        }
+#endif
+        
+        if (topology.m_cpus.empty())
+        {
+            //
+            // unknown topology, every logical CPU is a core of the only node
+            //
+            const uint32_t count = std::max(std::thread::hardware_concurrency(), 1u);
+            
+            for (uint32_t id = 0; id < count; ++id)
+            {
+                Cpu cpu;
+                cpu.id = id;
+                cpu.core = id;
+                topology.m_cpus.push_back(cpu);
+            }
+            
+            topology.m_pinnable = false;
+        }
+        
+        return topology;
+    }
+
+    uint32_t Topology::getStorageNode(const std::string& filePath)
+    {
+#if defined(__linux__)
+        struct stat st = {};
+        
+        if (0 != ::stat(filePath.c_str(), &st))
+        {
+            return kUnknownNode;
+        }
+
+        //
+        // /sys/dev/block/<major>:<minor> points to the block device,
+        // a partition has no 'device' link, its parent directory is the disk
+        //
+        const std::string link = "/sys/dev/block/" + std::to_string(major(st.st_dev)) + ":" + std::to_string(minor(st.st_dev));
+        char* resolved = ::realpath(link.c_str(), nullptr);
+        
+        if (!resolved)
+        {
+            return kUnknownNode;
+        }
+        
+        std::string path = resolved;
+        free(resolved);
+        
+        for (int level = 0; level < 2 && !path.empty(); ++level)
+        {
+            long node = -1;
+            
+            if (readNumber(path + "/device/numa_node", node) && node >= 0)
+            {
+                return static_cast<uint32_t>(node);
+            }
+            
+            path = path.substr(0, path.rfind('/'));
+        }
+#else
+        //
+        // the OS does not report the node of a storage device
+        //
+        (void)filePath;
+#endif
+        
+        return kUnknownNode;
+    }
+
+    bool Topology::pinCurrentThread(uint32_t cpu)
+    {
+#if defined(_WIN32)
+        GROUP_AFFINITY affinity = {};
+        affinity.Group = static_cast<WORD>(cpu / kCpusPerGroup);
+        affinity.Mask = KAFFINITY(1) << (cpu % kCpusPerGroup);
+        return FALSE != ::SetThreadGroupAffinity(::GetCurrentThread(), &affinity, nullptr);
+#elif defined(__linux__)
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        return 0 == ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set);
+#else
+        //
+        // e.g. macOS has only affinity hints, not pinning
+        //
+        (void)cpu;
+        (void)kCpusPerGroup;
+        return false;
+#endif
+    }
+
+    uint32_t Topology::getAvailableCpus()
+    {
+        uint32_t cpus = std::max(std::thread::hardware_concurrency(), 1u);
+
+#if defined(_WIN32)
+        DWORD_PTR processMask = 0;
+        DWORD_PTR systemMask = 0;
+        
+        //
+        // the mask of the current processor group only, it is a limit only if it is smaller
+        //
+        if (::GetProcessAffinityMask(::GetCurrentProcess(), &processMask, &systemMask) && processMask != systemMask)
+        {
+            uint32_t count = 0;
+            
+            for (; processMask; processMask &= processMask - 1)
+            {
+                ++count;
+            }
+            
+            cpus = std::max(std::min(cpus, count), 1u);
+        }
+#elif defined(__linux__)
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        
+        if (0 == ::sched_getaffinity(0, sizeof(set), &set))
+        {
+            cpus = std::max(static_cast<uint32_t>(CPU_COUNT(&set)), 1u);
+        }
+        
+        //
+        // cgroup v2: "<quota> <period>" or "max <period>" in cpu.max of the cgroup,
+        // cgroup v1: cpu.cfs_quota_us is -1 if there is no quota
+        //
+        long quota = -1;
+        long period = 0;
+        std::string line;
+        std::string cgroup;
+        std::ifstream cgroups("/proc/self/cgroup");
+        
+        while (std::getline(cgroups, line))
+        {
+            if (line.compare(0, 3, "0::") == 0)
+            {
+                cgroup = line.substr(3);
+            }
+        }
+        
+        if (readFirstLine("/sys/fs/cgroup" + cgroup + "/cpu.max", line))
+        {
+            std::istringstream values(line);
+            std::string quotaStr;
+            values >> quotaStr >> period;
+            quota = quotaStr == "max" ? -1 : strtol(quotaStr.c_str(), nullptr, 10);
+        }
+        else if (!readNumber("/sys/fs/cgroup/cpu/cpu.cfs_quota_us", quota)
+                 || !readNumber("/sys/fs/cgroup/cpu/cpu.cfs_period_us", period))
+        {
+            quota = -1;
+        }
+        
+        if (quota > 0 && period > 0)
+        {
+            const uint32_t quotaCpus = static_cast<uint32_t>((quota + period - 1) / period);
+            cpus = std::max(std::min(cpus, quotaCpus), 1u);
+        }
+#endif
+        return cpus;
+    }
+
+    const std::vector<Topology::Cpu>& Topology::getCpus() const
+    {
+        return m_cpus;
+    }
+
+    uint32_t Topology::getNodesCount() const
+    {
+        std::set<uint32_t> nodes;
+        
+        for (const auto& cpu : m_cpus)
+        {
+            nodes.insert(cpu.node);
+        }
+        
+        return static_cast<uint32_t>(nodes.size());
+    }
+
+    uint32_t Topology::getCoresCount() const
+    {
+        std::set<uint32_t> cores;
+        
+        for (const auto& cpu : m_cpus)
+        {
+            cores.insert(cpu.core);
+        }
+        
+        return static_cast<uint32_t>(cores.size());
+    }
+
+    bool Topology::isPinnable() const
+    {
+        return m_pinnable;
+    }
+
+    std::vector<uint32_t> Topology::selectCpus(size_t threadsCount, uint32_t preferredNode) const
+    {
+        std::vector<Cpu> ordered = m_cpus;
+        
+        //
+        // the preferred node goes first, then other nodes in their order
+        //
+        std::stable_sort(ordered.begin(), ordered.end(), [preferredNode](const Cpu& l, const Cpu& r)
+        {
+            const bool lPreferred = l.node == preferredNode;
+            const bool rPreferred = r.node == preferredNode;
+            
+            if (lPreferred != rPreferred)
+            {
+                return lPreferred;
+            }
+            
+            return l.node != r.node ? l.node < r.node : l.id < r.id;
+        });
+        
+        //
+        // the first logical CPU of every core, then SMT siblings
+        //
+        std::vector<uint32_t> primary;
+        std::vector<uint32_t> siblings;
+        std::set<uint32_t> cores;
+        
+        for (const auto& cpu : ordered)
+        {
+            (cores.insert(cpu.core).second ? primary : siblings).push_back(cpu.id);
+        }
+        
+        primary.insert(primary.end(), siblings.begin(), siblings.end());
+        
+        std::vector<uint32_t> cpus;
+        cpus.reserve(threadsCount);
+        
+        for (size_t i = 0; i < threadsCount && !primary.empty(); ++i)
+        {
+            cpus.push_back(primary[i % primary.size()]);
+        }
+        
+        return cpus;
+    }
+
+    std::string Topology::describe() const
+    {
+        std::stringstream st;
+        st << getNodesCount() << " node(s), ";
+        st << getCoresCount() << " physical core(s), ";
+        st << m_cpus.size() << " logical CPU(s)";
+        
+        if (!m_pinnable)
+        {
+            st << ", thread pinning is not supported";
+        }
+        
+        return st.str();
+    }
+}
@@ -0,0 +1,83 @@
+//
+//  Topology.hpp
+//  file_signature
+//
+//  Created by artem k on 02.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <limits>
+
+namespace utils
+{
+    //
+    // CPU and NUMA topology of the machine
+    // It is used to pin worker threads to physical cores
+    // and to keep the file data on the node where they are hashed
+    //
+    class Topology
+    {
+    public:
+        static const uint32_t kUnknownNode = std::numeric_limits<uint32_t>::max();
+        
+        struct Cpu
+        {
+            uint32_t id = 0;      // logical CPU number used for pinning
+            uint32_t core = 0;    // physical core, unique for the machine
+            uint32_t package = 0; // socket
+            uint32_t node = 0;    // NUMA node
+        };
+
+    public:
+        //
+        // detects the topology of the current machine,
+        // if it is not supported there is one node with hardware_concurrency CPUs
+        // that are not pinnable
+        //
+        static Topology detect();
+        
+        //
+        // NUMA node of the storage device that keeps the file,
+        // kUnknownNode if the OS does not report it
+        //
+        static uint32_t getStorageNode(const std::string& filePath);
+        
+        //
+        // pins the current thread to the logical CPU,
+        // returns false if it is not supported or failed
+        //
+        static bool pinCurrentThread(uint32_t cpu);
+        
+        //
+        // CPUs that the process may really use: the CPUs of its affinity mask (cpuset)
+        // limited by the CPU quota of its cgroup, rounded up
+        //
+        static uint32_t getAvailableCpus();
+        
+        const std::vector<Cpu>& getCpus() const;
+        uint32_t getNodesCount() const;
+        uint32_t getCoresCount() const;
+        bool isPinnable() const;
+        
+        //
+        // CPUs for 'threadsCount' worker threads:
+        //   * one logical CPU per physical core, SMT siblings are used
+        //     only if there are more threads than physical cores
+        //   * cores of 'preferredNode' go first, so the first workers
+        //     share the node with the storage
+        //   * CPUs are reused in the same order if there are still more threads
+        //
+        std::vector<uint32_t> selectCpus(size_t threadsCount, uint32_t preferredNode) const;
+        
+        std::string describe() const;
+
+    private:
+        std::vector<Cpu> m_cpus;
+        bool m_pinnable = false;
+    };
+}
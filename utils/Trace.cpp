@@ -0,0 +1,128 @@
+//
+//  Trace.cpp
+//  file_signature
+//
+//  Created by artem k on 05.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#include "Trace.hpp"
+#include "Exceptions.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+
+namespace utils
+{
+    namespace
+    {
+        const size_t kReservedEvents = 64 * 1024;
+        
+        //
+        // the trace format uses microseconds, fractions keep nanoseconds
+        //
+        void writeTime(std::ostream& out, int64_t ns)
+        {
+            out << ns / 1000 << "." << std::setw(3) << std::setfill('0') << ns % 1000;
+        }
+    }
+
+    TraceRecorder::TraceRecorder(size_t maxEventsPerThread)
+        : m_maxEvents(maxEventsPerThread)
+        , m_startTime(Clock::now())
+    {
+    }
+
+    void TraceRecorder::complete(const char* name, Clock::time_point start, Clock::time_point end, uint64_t id)
+    {
+        add(name, Type::complete, start, end, id);
+    }
+
+    void TraceRecorder::async(const char* name, Clock::time_point start, Clock::time_point end, uint64_t id)
+    {
+        add(name, Type::async, start, end, id);
+    }
+
+    uint64_t TraceRecorder::getDroppedEvents() const
+    {
+        return m_dropped;
+    }
+
+    void TraceRecorder::add(const char* name, Type type, Clock::time_point start, Clock::time_point end, uint64_t id)
+    {
+        bool created = false;
+        Shard& shard = m_shards.get(&created);
+        
+        if (created)
+        {
+            shard.tid = ++m_nextTid;
+            
+            //
+            // a reallocation is a stall in the trace,
+            // so the buffer is allocated in advance, but not too much of it
+            //
+            shard.events.reserve(std::min<size_t>(m_maxEvents, kReservedEvents));
+        }
+        
+        if (shard.events.size() >= m_maxEvents)
+        {
+            ++m_dropped;
+            return;
+        }
+        
+        Event event;
+        event.name = name;
+        event.type = type;
+        event.start = std::chrono::duration_cast<std::chrono::nanoseconds>(start - m_startTime).count();
+        event.end = std::chrono::duration_cast<std::chrono::nanoseconds>(end - m_startTime).count();
+        event.id = id;
+        shard.events.push_back(event);
+    }
+
+    void TraceRecorder::save(const std::string& fileName) const
+    {
+        std::ofstream out(fileName, std::ios::binary | std::ios::trunc);
+        THROW_IF(!out, "Cannot open " << fileName);
+        
+        out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+        out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"file_signature\"}}";
+        
+        m_shards.forEach([&out](const Shard& shard)
+        {
+            out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << shard.tid;
+            out << ",\"args\":{\"name\":\"thread " << shard.tid << "\"}}";
+            
+            for (const auto& event : shard.events)
+            {
+                if (Type::complete == event.type)
+                {
+                    out << ",\n{\"name\":\"" << event.name << "\",\"cat\":\"chunk\",\"ph\":\"X\",\"pid\":1";
+                    out << ",\"tid\":" << shard.tid << ",\"ts\":";
+                    writeTime(out, event.start);
+                    out << ",\"dur\":";
+                    writeTime(out, event.end - event.start);
+                    out << ",\"args\":{\"chunk\":" << event.id << "}}";
+                }
+                else
+                {
+                    //
+                    // async slices with the same name and id are paired by the viewer
+                    //
+                    out << ",\n{\"name\":\"" << event.name << "\",\"cat\":\"chunk\",\"ph\":\"b\",\"pid\":1";
+                    out << ",\"tid\":" << shard.tid << ",\"id\":" << event.id << ",\"ts\":";
+                    writeTime(out, event.start);
+                    out << ",\"args\":{\"chunk\":" << event.id << "}}";
+                    
+                    out << ",\n{\"name\":\"" << event.name << "\",\"cat\":\"chunk\",\"ph\":\"e\",\"pid\":1";
+                    out << ",\"tid\":" << shard.tid << ",\"id\":" << event.id << ",\"ts\":";
+                    writeTime(out, event.end);
+                    out << "}";
+                }
+            }
+        });
+        
+        out << "\n]}\n";
+        THROW_IF(!out, "Cannot write " << fileName);
+    }
+}
@@ -0,0 +1,87 @@
+//
+//  Trace.hpp
+//  file_signature
+//
+//  Created by artem k on 05.12.2019.
+//  Copyright © 2019 artem k. All rights reserved.
+//
+
+#pragma once
+
+#include "ThreadShards.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace utils
+{
+    //
+    // Recorder of Chrome trace events (chrome://tracing, ui.perfetto.dev)
+    // Every thread writes events to its own buffer without locks,
+    // a buffer is limited by maxEventsPerThread, further events are dropped.
+    // Event names must be string literals, they are not copied
+    //
+    class TraceRecorder
+    {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+    public:
+        explicit TraceRecorder(size_t maxEventsPerThread);
+        
+        TraceRecorder(const TraceRecorder&) = delete;
+        TraceRecorder& operator=(const TraceRecorder&) = delete;
+        
+        //
+        // a slice on the track of the current thread,
+        // slices of one thread must be nested, not overlapped
+        //
+        void complete(const char* name, Clock::time_point start, Clock::time_point end, uint64_t id);
+        
+        //
+        // a slice on its own track, it may overlap other slices of the thread
+        //
+        void async(const char* name, Clock::time_point start, Clock::time_point end, uint64_t id);
+        
+        uint64_t getDroppedEvents() const;
+        
+        //
+        // must not be called while other threads record events
+        //
+        void save(const std::string& fileName) const;
+
+    private:
+        enum class Type
+        {
+            complete,
+            async
+        };
+        
+        struct Event
+        {
+            const char* name;
+            Type type;
+            int64_t start; // ns since the recorder has been created
+            int64_t end;
+            uint64_t id;
+        };
+        
+        struct Shard
+        {
+            uint32_t tid = 0;
+            std::vector<Event> events;
+        };
+        
+        void add(const char* name, Type type, Clock::time_point start, Clock::time_point end, uint64_t id);
+
+    private:
+        const size_t m_maxEvents;
+        const Clock::time_point m_startTime;
+        std::atomic<uint32_t> m_nextTid{0};
+        std::atomic<uint64_t> m_dropped{0};
+        ThreadShards<Shard> m_shards;
+    };
+}